@@ -56,10 +56,7 @@
 #include <unistd.h>
 #endif
 
-#ifdef HAVE_ZZIP
-#include <zzip/lib.h>
-#include "SDL_rwops_zzip.h"
-#endif
+#include "ZipArchivePool.h"
 
 #if defined(__WIN32__)
 #if defined _MSC_VER
@@ -95,12 +92,6 @@ extern DirectorySpecifier local_data_dir, preferences_dir, saved_games_dir, quic
 extern bool is_applesingle(SDL_RWops *f, bool rsrc_fork, int32 &offset, int32 &length);
 extern bool is_macbinary(SDL_RWops *f, int32 &data_length, int32 &rsrc_length);
 
-#ifdef O_BINARY // Microsoft extension
-constexpr int o_binary = O_BINARY;
-#else
-constexpr int o_binary = 0;
-#endif
-
 static int to_posix_code_or_unknown(sys::error_code ec)
 {
 	const auto cond = ec.default_error_condition();
@@ -115,26 +106,6 @@ static fs::path utf8_to_path(const std::string& utf8) { return utf8; }
 static std::string path_to_utf8(const fs::path& path) { return path.native(); }
 #endif
 
-// utf8_zzip_io(): a zzip I/O handler set with a UTF-8-compatible 'open' handler
-#ifdef HAVE_ZZIP
-#ifdef __WIN32__
-static int win_zzip_open(const char* f, int o, ...) { return _wopen(utf8_to_wide(f).c_str(), o); }
-
-static const zzip_plugin_io_handlers& utf8_zzip_io()
-{
-	static const zzip_plugin_io_handlers io = []
-	{
-		zzip_plugin_io_handlers io = {zzip_get_default_io()->fd};
-		io.fd.open = &win_zzip_open;
-		return io;
-	}();
-	return io;
-}
-#else
-static const zzip_plugin_io_handlers& utf8_zzip_io() { return *zzip_get_default_io(); }
-#endif
-#endif // HAVE_ZZIP
-
 /*
  *  Opened file
  */
@@ -421,7 +392,7 @@ bool FileSpecifier::Open(OpenedFile &OFile, bool Writable)
 #ifdef HAVE_ZZIP
 		if (!Writable)
 		{
-			f = OFile.f = SDL_RWFromZZIP(unix_path_separators(GetPath()).c_str(), &utf8_zzip_io());
+			f = OFile.f = ZipArchivePool::instance()->Open(unix_path_separators(GetPath()));
 			err = f ? 0 : errno;
 		} 
 		else {
@@ -497,18 +468,8 @@ bool FileSpecifier::Exists()
 #ifdef HAVE_ZZIP
 	if (err)
 	{
-		// Check whether zzip can open the file (slow!)
-		const auto n = unix_path_separators(name);
-		ZZIP_FILE* file = zzip_open_ext_io(n.c_str(), O_RDONLY|o_binary, ZZIP_ONLYZIP, nullptr, &utf8_zzip_io());
-		if (file)
-		{
-			zzip_close(file);
-			return true;
-		}
-		else
-		{
-			return false;
-		}
+		// Check whether it's inside a zip
+		return ZipArchivePool::instance()->Exists(unix_path_separators(name));
 	}
 #endif
 	return (err == 0);
@@ -531,6 +492,15 @@ TimeType FileSpecifier::GetDate()
 	return err == 0 ? mtime : 0;
 }
 
+// Get size
+int64_t FileSpecifier::GetSize()
+{
+	sys::error_code ec;
+	const auto size = fs::file_size(utf8_to_path(name), ec);
+	err = to_posix_code_or_unknown(ec);
+	return err == 0 ? static_cast<int64_t>(size) : -1;
+}
+
 static const char * alephone_extensions[] = {
 	".sceA",
 	".sgaA",
@@ -950,17 +920,12 @@ bool FileSpecifier::ReadZIP(vector<string> &vec)
 	vec.clear();
 	
 #ifdef HAVE_ZZIP
-	const auto zip = zzip_dir_open_ext_io(unix_path_separators(name).c_str(), nullptr, nullptr, &utf8_zzip_io());
-	if (!zip)
+	if (!ZipArchivePool::instance()->List(unix_path_separators(name), vec))
 	{
 		err = errno;
 		return false;
 	}
 	
-	for (ZZIP_DIRENT entry; zzip_dir_read(zip, &entry); )
-		vec.emplace_back(entry.d_name);
-	
-	zzip_dir_close(zip);
 	return true;
 #else
 	err = ENOTSUP;
@@ -1723,10 +1688,12 @@ ScopedSearchPath::ScopedSearchPath(const DirectorySpecifier& dir) :
 	d{dir}
 {
 	data_search_path.insert(data_search_path.begin(), dir);
+	ZipArchivePool::instance()->SearchPathChanged();
 }
 
 ScopedSearchPath::~ScopedSearchPath() 
 {
 	assert(data_search_path.size() && data_search_path.front() == d);
 	data_search_path.erase(data_search_path.begin());
+	ZipArchivePool::instance()->SearchPathChanged();
 }
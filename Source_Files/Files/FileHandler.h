@@ -286,6 +286,9 @@ public:
 	
 	// Gets the modification date
 	TimeType GetDate();
+
+	// Gets the size in bytes, or -1 if it can't be had
+	int64_t GetSize();
 	
 	// Returns _typecode_unknown if the type could not be identified;
 	// the types returned are the _typecode_stuff in tags.h
@@ -38,6 +38,7 @@
 #include "game_errors.h"
 #include "sdl_resize.h"
 #include "Logging.h"
+#include "MemoryBudget.h"
 
 WadImageCache* WadImageCache::instance() {
 	static WadImageCache *m_instance = nullptr;
@@ -185,6 +186,7 @@ bool WadImageCache::apply_cache_limit()
 		m_cachesize -= last_item.second.second;
 		m_cacheinfo.erase(last_item.first);
 		m_cache_dirty = true;
+		MemoryBudget::instance()->Evicted(m_budget_id);
 	}
 	return deleted;
 }
@@ -281,8 +283,12 @@ SDL_Surface *WadImageCache::retrieve_image(WadImageDescriptor& desc, int width,
 {
 	std::string name = retrieve_name(desc, width, height, true);
 	if (name.empty())
+	{
+		MemoryBudget::instance()->Miss(m_budget_id);
 		return NULL;
+	}
 	
+	MemoryBudget::instance()->Hit(m_budget_id);
 	return image_from_name(name);
 }
 
@@ -315,6 +321,9 @@ SDL_Surface *WadImageCache::get_image(WadImageDescriptor& desc, int width, int h
 
 void WadImageCache::initialize_cache()
 {
+	// lives on disk, so it's only reported; m_sizelimit keeps it in check
+	m_budget_id = MemoryBudget::instance()->Register("wad image cache", MemoryBudget::kPriorityLow, [this]() { return m_cachesize; }, nullptr, false);
+	
 	FileSpecifier info;
 	info.SetToImageCacheDir();
 	info.AddPart("Cache.ini");
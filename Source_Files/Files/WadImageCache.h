@@ -122,6 +122,7 @@ private:
 	size_t m_sizelimit = 300000000;
 	bool m_autosave = true;
 	bool m_cache_dirty = false;
+	int m_budget_id = NONE;
 };
 
 
@@ -0,0 +1,778 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Keeps recently used zip archives open, with their directories indexed,
+	so opening files inside zipped plugins doesn't read the zip over again
+*/
+
+#include "cseries.h"
+#include "ZipArchivePool.h"
+
+#include "Console.h"
+#include "FileHandler.h"
+#include "Logging.h"
+#include "MemoryBudget.h"
+#include "screen.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+
+#ifdef HAVE_ZZIP
+#include <zzip/lib.h>
+#include "SDL_rwops_zzip.h"
+
+#ifdef O_BINARY // Microsoft extension
+constexpr int o_binary = O_BINARY;
+#else
+constexpr int o_binary = 0;
+#endif
+#endif
+
+// each one holds a file handle, so don't keep too many
+static constexpr size_t kMaximumArchives = 32;
+
+// paths that aren't zips (or zips we can't read) to remember; a plugin
+// looking for files it doesn't have probes a few per file
+static constexpr size_t kMaximumFailures = 1024;
+
+static constexpr uint32 kLocalHeaderSignature = 0x04034b50;
+static constexpr uint32 kCentralHeaderSignature = 0x02014b50;
+static constexpr uint32 kEndOfCentralDirectorySignature = 0x06054b50;
+
+static constexpr int kLocalHeaderSize = 30;
+static constexpr int kCentralHeaderSize = 46;
+static constexpr int kEndOfCentralDirectorySize = 22;
+static constexpr int kMaximumCommentSize = 65535;
+
+static constexpr uint16 kMethodStored = 0;
+static constexpr uint16 kFlagEncrypted = 0x0001;
+
+// utf8_zzip_io(): a zzip I/O handler set with a UTF-8-compatible 'open' handler
+#ifdef HAVE_ZZIP
+#ifdef __WIN32__
+static int win_zzip_open(const char* f, int o, ...) { return _wopen(utf8_to_wide(f).c_str(), o); }
+
+static const zzip_plugin_io_handlers& utf8_zzip_io()
+{
+	static const zzip_plugin_io_handlers io = []
+	{
+		zzip_plugin_io_handlers io = {zzip_get_default_io()->fd};
+		io.fd.open = &win_zzip_open;
+		return io;
+	}();
+	return io;
+}
+#else
+static const zzip_plugin_io_handlers& utf8_zzip_io() { return *zzip_get_default_io(); }
+#endif
+#endif // HAVE_ZZIP
+
+static uint16 read_le16(const uint8* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32 read_le32(const uint8* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32>(p[3]) << 24);
+}
+
+struct ZipArchivePool::Archive {
+	struct Entry {
+		uint16 method;
+		uint32 compressed_size;
+		uint32 size;
+		uint32 local_header_offset;
+		int64_t data_offset; // from the local header, the first time it's opened
+	};
+
+	std::string path;
+	std::unordered_map<std::string, Entry> entries;
+	std::vector<std::string> names; // everything, in directory order
+	size_t bytes = 0;
+
+	// file, dir and the entries' data offsets belong to whoever holds this
+	std::mutex mutex;
+	SDL_RWops* file = nullptr;
+#ifdef HAVE_ZZIP
+	ZZIP_DIR* dir = nullptr; // only opened for compressed entries
+#endif
+
+	~Archive() {
+#ifdef HAVE_ZZIP
+		if (dir) zzip_dir_close(dir);
+#endif
+		if (file) SDL_RWclose(file);
+	}
+
+	bool ReadDirectory();
+	SDL_RWops* OpenEntry(const std::shared_ptr<Archive>& self, const std::string& name);
+};
+
+// false for anything this can't serve itself (Zip64, encryption), which
+// the zip library gets instead
+bool ZipArchivePool::Archive::ReadDirectory()
+{
+	Sint64 length = SDL_RWsize(file);
+	if (length < kEndOfCentralDirectorySize)
+		return false;
+
+	// the end of central directory record is last, unless there's a comment
+	size_t tail = static_cast<size_t>(std::min<Sint64>(length, kEndOfCentralDirectorySize + kMaximumCommentSize));
+	std::vector<uint8> buffer(tail);
+	if (SDL_RWseek(file, length - tail, RW_SEEK_SET) < 0 || SDL_RWread(file, &buffer[0], tail, 1) != 1)
+		return false;
+
+	int end = -1;
+	for (int i = static_cast<int>(tail) - kEndOfCentralDirectorySize; i >= 0; --i)
+	{
+		if (read_le32(&buffer[i]) == kEndOfCentralDirectorySignature)
+		{
+			end = i;
+			break;
+		}
+	}
+	if (end < 0)
+		return false;
+
+	uint16 count = read_le16(&buffer[end + 10]);
+	uint32 directory_size = read_le32(&buffer[end + 12]);
+	uint32 directory_offset = read_le32(&buffer[end + 16]);
+	if (count == 0xffff || directory_offset == 0xffffffff || static_cast<Sint64>(directory_offset) + directory_size > length)
+		return false;
+
+	std::vector<uint8> directory(directory_size);
+	if (directory_size && (SDL_RWseek(file, directory_offset, RW_SEEK_SET) < 0 || SDL_RWread(file, &directory[0], directory_size, 1) != 1))
+		return false;
+
+	size_t p = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (p + kCentralHeaderSize > directory_size || read_le32(&directory[p]) != kCentralHeaderSignature)
+			return false;
+
+		Entry entry;
+		uint16 flags = read_le16(&directory[p + 8]);
+		entry.method = read_le16(&directory[p + 10]);
+		entry.compressed_size = read_le32(&directory[p + 20]);
+		entry.size = read_le32(&directory[p + 24]);
+		uint16 name_length = read_le16(&directory[p + 28]);
+		uint16 extra_length = read_le16(&directory[p + 30]);
+		uint16 comment_length = read_le16(&directory[p + 32]);
+		entry.local_header_offset = read_le32(&directory[p + 42]);
+		entry.data_offset = -1;
+
+		if ((flags & kFlagEncrypted) ||
+			entry.compressed_size == 0xffffffff ||
+			entry.size == 0xffffffff ||
+			entry.local_header_offset == 0xffffffff ||
+			p + kCentralHeaderSize + name_length > directory_size)
+			return false;
+
+		std::string name(reinterpret_cast<const char*>(&directory[p + kCentralHeaderSize]), name_length);
+		p += kCentralHeaderSize + name_length + extra_length + comment_length;
+
+		if (name.size() && name.back() != '/')
+		{
+			entries[name] = entry;
+		}
+		names.push_back(name);
+		bytes += sizeof(Entry) + 2 * name.size() + 32;
+	}
+
+	bytes += sizeof(Archive);
+	return true;
+}
+
+// Stored entries are read straight out of the archive into the caller's
+// buffer; there's nothing to decompress, so nothing gets copied on the way
+
+struct StoredMember {
+	std::shared_ptr<ZipArchivePool::Archive> archive;
+	Sint64 start;
+	Sint64 size;
+	Sint64 position;
+};
+
+static StoredMember* stored_member(SDL_RWops* context)
+{
+	return static_cast<StoredMember*>(context->hidden.unknown.data1);
+}
+
+static Sint64 stored_size(SDL_RWops* context)
+{
+	return stored_member(context)->size;
+}
+
+static Sint64 stored_seek(SDL_RWops* context, Sint64 offset, int whence)
+{
+	StoredMember* member = stored_member(context);
+	Sint64 position = offset;
+	if (whence == RW_SEEK_CUR)
+		position += member->position;
+	else if (whence == RW_SEEK_END)
+		position += member->size;
+
+	if (position < 0)
+	{
+		return SDL_SetError("Seek before the start of a zip entry");
+	}
+
+	member->position = position;
+	return position;
+}
+
+static size_t stored_read(SDL_RWops* context, void* ptr, size_t size, size_t maxnum)
+{
+	StoredMember* member = stored_member(context);
+	if (!size || member->position >= member->size)
+		return 0;
+
+	size_t bytes = static_cast<size_t>(std::min<Sint64>(size * maxnum, member->size - member->position));
+
+	size_t read = 0;
+	{
+		std::lock_guard<std::mutex> lock(member->archive->mutex);
+		if (SDL_RWseek(member->archive->file, member->start + member->position, RW_SEEK_SET) >= 0)
+		{
+			read = SDL_RWread(member->archive->file, ptr, 1, bytes);
+		}
+	}
+
+	member->position += read;
+	return read / size;
+}
+
+static size_t member_write(SDL_RWops*, const void*, size_t, size_t)
+{
+	return 0;
+}
+
+static int stored_close(SDL_RWops* context)
+{
+	if (!context) return 0;
+
+	delete stored_member(context);
+	SDL_FreeRW(context);
+	return 0;
+}
+
+#ifdef HAVE_ZZIP
+
+// Compressed entries go through the zip library, but from the archive's own
+// ZZIP_DIR, which the library can share between open files
+
+struct CompressedMember {
+	std::shared_ptr<ZipArchivePool::Archive> archive;
+	ZZIP_FILE* file;
+	Sint64 size;
+};
+
+static CompressedMember* compressed_member(SDL_RWops* context)
+{
+	return static_cast<CompressedMember*>(context->hidden.unknown.data1);
+}
+
+static Sint64 compressed_size(SDL_RWops* context)
+{
+	return compressed_member(context)->size;
+}
+
+static Sint64 compressed_seek(SDL_RWops* context, Sint64 offset, int whence)
+{
+	CompressedMember* member = compressed_member(context);
+	std::lock_guard<std::mutex> lock(member->archive->mutex);
+	return zzip_seek(member->file, offset, whence);
+}
+
+static size_t compressed_read(SDL_RWops* context, void* ptr, size_t size, size_t maxnum)
+{
+	if (!size) return 0;
+
+	CompressedMember* member = compressed_member(context);
+	std::lock_guard<std::mutex> lock(member->archive->mutex);
+	zzip_ssize_t read = zzip_read(member->file, ptr, size * maxnum);
+	return read > 0 ? read / size : 0;
+}
+
+static int compressed_close(SDL_RWops* context)
+{
+	if (!context) return 0;
+
+	CompressedMember* member = compressed_member(context);
+	{
+		std::lock_guard<std::mutex> lock(member->archive->mutex);
+		zzip_file_close(member->file);
+	}
+	delete member;
+	SDL_FreeRW(context);
+	return 0;
+}
+
+#endif // HAVE_ZZIP
+
+SDL_RWops* ZipArchivePool::Archive::OpenEntry(const std::shared_ptr<Archive>& self, const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	Entry& entry = entries[name];
+
+	if (entry.method == kMethodStored)
+	{
+		if (entry.data_offset < 0)
+		{
+			uint8 header[kLocalHeaderSize];
+			if (SDL_RWseek(file, entry.local_header_offset, RW_SEEK_SET) < 0 ||
+				SDL_RWread(file, header, kLocalHeaderSize, 1) != 1 ||
+				read_le32(header) != kLocalHeaderSignature)
+			{
+				errno = EIO;
+				return nullptr;
+			}
+
+			entry.data_offset = static_cast<int64_t>(entry.local_header_offset) + kLocalHeaderSize + read_le16(&header[26]) + read_le16(&header[28]);
+		}
+
+		SDL_RWops* rwops = SDL_AllocRW();
+		if (!rwops)
+		{
+			errno = ENOMEM;
+			return nullptr;
+		}
+
+		rwops->hidden.unknown.data1 = new StoredMember{self, entry.data_offset, entry.size, 0};
+		rwops->size = stored_size;
+		rwops->seek = stored_seek;
+		rwops->read = stored_read;
+		rwops->write = member_write;
+		rwops->close = stored_close;
+		return rwops;
+	}
+
+#ifdef HAVE_ZZIP
+	if (!dir)
+	{
+		dir = zzip_dir_open_ext_io(path.c_str(), nullptr, nullptr, &utf8_zzip_io());
+		if (!dir)
+			return nullptr;
+	}
+
+	ZZIP_FILE* zzip_file = zzip_file_open(dir, name.c_str(), 0);
+	if (!zzip_file)
+	{
+		errno = EIO;
+		return nullptr;
+	}
+
+	SDL_RWops* rwops = SDL_AllocRW();
+	if (!rwops)
+	{
+		zzip_file_close(zzip_file);
+		errno = ENOMEM;
+		return nullptr;
+	}
+
+	rwops->hidden.unknown.data1 = new CompressedMember{self, zzip_file, entry.size};
+	rwops->size = compressed_size;
+	rwops->seek = compressed_seek;
+	rwops->read = compressed_read;
+	rwops->write = member_write;
+	rwops->close = compressed_close;
+	return rwops;
+#else
+	errno = ENOTSUP;
+	return nullptr;
+#endif
+}
+
+ZipArchivePool* ZipArchivePool::instance()
+{
+	static ZipArchivePool pool;
+	return &pool;
+}
+
+// returns the archive at zip_path, opening and indexing it if need be
+std::shared_ptr<ZipArchivePool::Archive> ZipArchivePool::Get(const std::string& zip_path, bool& unsupported)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto it = archives_.begin(); it != archives_.end(); ++it)
+		{
+			if ((*it)->path == zip_path)
+			{
+				archives_.splice(archives_.begin(), archives_, it);
+				return archives_.front();
+			}
+		}
+
+		if (not_archives_.count(zip_path))
+		{
+			return nullptr;
+		}
+
+		if (unsupported_.count(zip_path))
+		{
+			unsupported = true;
+			return nullptr;
+		}
+	}
+
+	// read the directory without holding everyone else up
+	auto archive = std::make_shared<Archive>();
+	archive->path = zip_path;
+	archive->file = SDL_RWFromFile(zip_path.c_str(), "rb");
+	bool indexed = archive->file && archive->ReadDirectory();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!indexed)
+	{
+		if (archive->file)
+		{
+			RememberFailure(unsupported_, zip_path);
+			unsupported = true;
+		}
+		else
+		{
+			RememberFailure(not_archives_, zip_path);
+		}
+		return nullptr;
+	}
+
+	// somebody else may have opened it in the meantime
+	for (auto& other : archives_)
+	{
+		if (other->path == zip_path)
+		{
+			return other;
+		}
+	}
+
+	archives_.push_front(archive);
+	if (archives_.size() > kMaximumArchives)
+	{
+		archives_.pop_back();
+	}
+
+	return archive;
+}
+
+// finds the zip that holds path, the way the zip library would: trying
+// ".../Foo/Bar.zip" for "baz.png", then ".../Foo.zip" for "Bar/baz.png"
+std::shared_ptr<ZipArchivePool::Archive> ZipArchivePool::Find(const std::string& path, std::string& member, bool& unsupported)
+{
+	static const char* extensions[] = { ".zip", ".ZIP" };
+
+	for (size_t slash = path.rfind('/'); slash != std::string::npos && slash > 0; slash = path.rfind('/', slash - 1))
+	{
+		std::string prefix = path.substr(0, slash);
+		member = path.substr(slash + 1);
+
+		for (auto extension : extensions)
+		{
+			auto archive = Get(prefix + extension, unsupported);
+			if (archive && archive->entries.count(member))
+			{
+				return archive;
+			}
+		}
+	}
+
+	return nullptr;
+}
+
+SDL_RWops* ZipArchivePool::Open(const std::string& path)
+{
+	SDL_RWops* rwops = SDL_RWFromFile(path.c_str(), "rb");
+	if (rwops)
+	{
+		return rwops;
+	}
+
+	std::string member;
+	bool unsupported = false;
+	auto archive = Find(path, member, unsupported);
+	if (archive)
+	{
+		return archive->OpenEntry(archive, member);
+	}
+
+#ifdef HAVE_ZZIP
+	if (unsupported)
+	{
+		return SDL_RWFromZZIP(path.c_str(), &utf8_zzip_io());
+	}
+#endif
+
+	errno = ENOENT;
+	return nullptr;
+}
+
+bool ZipArchivePool::Exists(const std::string& path)
+{
+	std::string member;
+	bool unsupported = false;
+	if (Find(path, member, unsupported))
+	{
+		return true;
+	}
+
+#ifdef HAVE_ZZIP
+	if (unsupported)
+	{
+		ZZIP_FILE* file = zzip_open_ext_io(path.c_str(), O_RDONLY|o_binary, ZZIP_ONLYZIP, nullptr, &utf8_zzip_io());
+		if (file)
+		{
+			zzip_close(file);
+			return true;
+		}
+	}
+#endif
+
+	return false;
+}
+
+bool ZipArchivePool::List(const std::string& path, std::vector<std::string>& names)
+{
+	names.clear();
+
+	bool unsupported = false;
+	auto archive = Get(path, unsupported);
+	if (archive)
+	{
+		names = archive->names;
+		return true;
+	}
+
+#ifdef HAVE_ZZIP
+	if (unsupported)
+	{
+		const auto zip = zzip_dir_open_ext_io(path.c_str(), nullptr, nullptr, &utf8_zzip_io());
+		if (!zip)
+			return false;
+
+		for (ZZIP_DIRENT entry; zzip_dir_read(zip, &entry); )
+			names.emplace_back(entry.d_name);
+
+		zzip_dir_close(zip);
+		return true;
+	}
+#endif
+
+	errno = ENOENT;
+	return false;
+}
+
+void ZipArchivePool::Clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	archives_.clear();
+	not_archives_.clear();
+	unsupported_.clear();
+}
+
+void ZipArchivePool::SearchPathChanged()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	not_archives_.clear();
+	unsupported_.clear();
+}
+
+void ZipArchivePool::RememberFailure(std::unordered_set<std::string>& failures, const std::string& zip_path)
+{
+	if (not_archives_.size() + unsupported_.size() >= kMaximumFailures)
+	{
+		not_archives_.clear();
+		unsupported_.clear();
+	}
+
+	failures.insert(zip_path);
+}
+
+// roughly; a set node holds the string and a hash, besides the characters
+size_t ZipArchivePool::FailureBytes() const
+{
+	size_t bytes = 0;
+	for (auto& path : not_archives_)
+		bytes += sizeof(std::string) + 2*sizeof(void*) + path.capacity();
+	for (auto& path : unsupported_)
+		bytes += sizeof(std::string) + 2*sizeof(void*) + path.capacity();
+	return bytes;
+}
+
+size_t ZipArchivePool::Bytes()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	size_t bytes = FailureBytes();
+	for (auto& archive : archives_)
+	{
+		bytes += archive->bytes;
+	}
+	return bytes;
+}
+
+// forgets the failed lookups, then closes the least recently used archives;
+// open files keep theirs alive
+size_t ZipArchivePool::Trim(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	size_t freed = 0;
+	int evicted = 0;
+	if (not_archives_.size() || unsupported_.size())
+	{
+		freed += FailureBytes();
+		not_archives_.clear();
+		unsupported_.clear();
+		++evicted;
+	}
+	while (freed < bytes && archives_.size())
+	{
+		freed += archives_.back()->bytes;
+		archives_.pop_back();
+		++evicted;
+	}
+
+	MemoryBudget::instance()->Evicted(budget_id_, evicted);
+	return freed;
+}
+
+extern std::vector<DirectorySpecifier> data_search_path;
+
+static std::string unix_path(const std::string& path)
+{
+	std::string result = path;
+	std::replace(result.begin(), result.end(), '\\', '/');
+	return result;
+}
+
+static size_t read_all(SDL_RWops* rwops, std::vector<uint8>& scratch)
+{
+	size_t total = 0;
+	for (size_t read; (read = SDL_RWread(rwops, &scratch[0], 1, scratch.size())) > 0; )
+	{
+		total += read;
+	}
+	SDL_RWclose(rwops);
+	return total;
+}
+
+// ".benchmark zip [file.zip]" opens and reads everything in the zip (or in
+// every zip in the Plugins directories) with and without the pool
+static void benchmark_zip_archives(const std::string& arg)
+{
+#ifdef HAVE_ZZIP
+	std::vector<std::string> zips;
+	if (arg.size())
+	{
+		zips.push_back(unix_path(arg));
+	}
+	else
+	{
+		for (auto& directory : data_search_path)
+		{
+			DirectorySpecifier plugins = directory + "Plugins";
+			for (auto& entry : plugins.ReadDirectory())
+			{
+				if (!entry.is_directory && entry.name.size() > 4 &&
+					(entry.name.compare(entry.name.size() - 4, 4, ".zip") == 0 || entry.name.compare(entry.name.size() - 4, 4, ".ZIP") == 0))
+				{
+					zips.push_back(unix_path((plugins + entry.name).GetPath()));
+				}
+			}
+		}
+	}
+
+	std::vector<std::string> paths;
+	int stored = 0;
+	for (auto& zip : zips)
+	{
+		std::vector<std::string> names;
+		if (!ZipArchivePool::instance()->List(zip, names))
+			continue;
+
+		std::string base = zip.substr(0, zip.size() - 4);
+		for (auto& name : names)
+		{
+			if (name.size() && name.back() != '/')
+			{
+				paths.push_back(base + "/" + name);
+			}
+		}
+	}
+
+	if (paths.empty())
+	{
+		screen_printf("No zipped files to benchmark");
+		return;
+	}
+
+	std::vector<uint8> scratch(64 * KILO);
+
+	// once through first, so both runs start with the zips in the OS cache
+	for (auto& path : paths)
+	{
+		SDL_RWops* rwops = ZipArchivePool::instance()->Open(path);
+		if (rwops)
+		{
+			stored += rwops->close == stored_close;
+			read_all(rwops, scratch);
+		}
+	}
+
+	size_t bytes = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (auto& path : paths)
+	{
+		SDL_RWops* rwops = SDL_RWFromZZIP(path.c_str(), &utf8_zzip_io());
+		if (rwops)
+		{
+			bytes += read_all(rwops, scratch);
+		}
+	}
+	auto unpooled = std::chrono::steady_clock::now();
+
+	ZipArchivePool::instance()->Clear();
+	auto cleared = std::chrono::steady_clock::now();
+	for (auto& path : paths)
+	{
+		SDL_RWops* rwops = ZipArchivePool::instance()->Open(path);
+		if (rwops)
+		{
+			read_all(rwops, scratch);
+		}
+	}
+	auto pooled = std::chrono::steady_clock::now();
+
+	double unpooled_ms = std::chrono::duration<double, std::milli>(unpooled - start).count();
+	double pooled_ms = std::chrono::duration<double, std::milli>(pooled - cleared).count();
+	double megabytes = static_cast<double>(bytes) / MEG;
+
+	screen_printf("%d files (%d stored), %.1f MB: %.1f ms unpooled, %.1f ms pooled", static_cast<int>(paths.size()), stored, megabytes, unpooled_ms, pooled_ms);
+	logNote("zip benchmark: %d files in %d zips (%d stored), %.1f MB; unpooled %.1f ms (%.1f MB/s), pooled %.1f ms (%.1f MB/s)",
+			static_cast<int>(paths.size()), static_cast<int>(zips.size()), stored, megabytes,
+			unpooled_ms, unpooled_ms > 0 ? megabytes * 1000 / unpooled_ms : 0.0,
+			pooled_ms, pooled_ms > 0 ? megabytes * 1000 / pooled_ms : 0.0);
+#else
+	screen_printf("Zip support isn't built in");
+#endif
+}
+
+void ZipArchivePool::Initialize()
+{
+	Console::instance()->register_benchmark("zip", benchmark_zip_archives);
+	budget_id_ = MemoryBudget::instance()->Register("zip archives", MemoryBudget::kPriorityLow, [this]() { return Bytes(); }, [this](size_t bytes) { return Trim(bytes); });
+}
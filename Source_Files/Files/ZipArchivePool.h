@@ -0,0 +1,88 @@
+#ifndef ZIP_ARCHIVE_POOL_H
+#define ZIP_ARCHIVE_POOL_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Keeps recently used zip archives open, with their directories indexed,
+	so opening files inside zipped plugins doesn't read the zip over again
+*/
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <SDL2/SDL_rwops.h>
+
+class ZipArchivePool {
+public:
+	static ZipArchivePool* instance();
+
+	// sets up the benchmark and memory accounting; call from the main thread
+	void Initialize();
+
+	// Opens path for reading. If there's no such file, ".../Foo/bar.png"
+	// is looked for as "bar.png" in ".../Foo.zip", and so on up the path.
+	// Paths use '/' separators. Returns nullptr, with errno set, on failure.
+	// Everything here is safe from any thread.
+	SDL_RWops* Open(const std::string& path);
+
+	// whether path names a file inside a zip, as Open() would find it
+	bool Exists(const std::string& path);
+
+	// the names of everything in the zip at path
+	bool List(const std::string& path, std::vector<std::string>& names);
+
+	// closes every archive and forgets which paths aren't zips
+	void Clear();
+
+	// forgets which paths aren't zips, which the search path decides how
+	// many of get probed; the archives stay open
+	void SearchPathChanged();
+
+	struct Archive;
+
+private:
+	ZipArchivePool() : budget_id_(-1) { }
+
+	std::shared_ptr<Archive> Get(const std::string& zip_path, bool& unsupported);
+	std::shared_ptr<Archive> Find(const std::string& path, std::string& member, bool& unsupported);
+	size_t Bytes();
+	size_t Trim(size_t bytes);
+
+	// the two sets below; call with mutex_ held
+	void RememberFailure(std::unordered_set<std::string>& failures, const std::string& zip_path);
+	size_t FailureBytes() const;
+
+	// most recently used first
+	std::list<std::shared_ptr<Archive> > archives_;
+
+	// paths known not to be zips we can index; the zip library gets the
+	// ones that are zips, but not ones we can read. Every failed Exists()
+	// adds to these, so they're emptied when they get too big
+	std::unordered_set<std::string> not_archives_;
+	std::unordered_set<std::string> unsupported_;
+
+	std::mutex mutex_;
+	int budget_id_;
+};
+
+#endif
@@ -86,6 +86,16 @@ Feb 15, 2002 (Br'fin (Jeremy Parsons)):
 #include <string.h>
 #include <stdlib.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "map.h"
 #include "monsters.h"
 #include "network.h"
@@ -129,6 +139,9 @@ Feb 15, 2002 (Br'fin (Jeremy Parsons)):
 #include "motion_sensor.h"	// ZZZ for reset_motion_sensor()
 
 #include "Music.h"
+#include "Logging.h"
+#include "WorkerPool.h"
+#include "MemoryBudget.h"
 
 // unify the save game code into one structure.
 
@@ -150,13 +163,105 @@ struct revert_game_info
 };
 static struct revert_game_info revert_game_data;
 
+// Wall-clock breakdown of a level load, so the log shows where the time goes
+class LoadPhaseTimer
+{
+public:
+	void Start()
+	{
+		phases_.clear();
+		last_ = std::chrono::steady_clock::now();
+	}
+
+	// charges the time since the previous mark to phase
+	void Mark(const char* phase)
+	{
+		auto now = std::chrono::steady_clock::now();
+		phases_.push_back(std::make_pair(phase, std::chrono::duration<double, std::milli>(now - last_).count()));
+		last_ = now;
+	}
+
+	void Log(const char* what) const
+	{
+		double total = 0;
+		std::string breakdown;
+		for (auto& phase : phases_)
+		{
+			char buffer[64];
+			snprintf(buffer, sizeof(buffer), "%s%s %.1f ms", breakdown.empty() ? "" : ", ", phase.first, phase.second);
+			breakdown += buffer;
+			total += phase.second;
+		}
+
+		logNote("%s took %.1f ms on %d threads (%s)", what, total, WorkerPool::instance()->Concurrency(), breakdown.c_str());
+	}
+
+private:
+	std::vector<std::pair<const char*, double> > phases_;
+	std::chrono::steady_clock::time_point last_;
+};
+
+static LoadPhaseTimer map_load_timer;
+
+/* -------- level prefetching */
+// While a level is being played, a worker thread reads and decodes the levels
+// the player is most likely to go to next, so that goto_level() only has to
+// commit what was prefetched instead of waiting on the disk.
+
+static const size_t kLevelPrefetchBudget = 64*MEG;
+
+// past the most likely level, only the wad and environment are prefetched
+static const size_t kMaximumPrefetchedLevels = 4;
+
+struct prefetched_level {
+	short level_index;
+	struct wad_header header;
+	struct wad_data *wad;
+};
+
+struct level_prefetch {
+	// set up on the main thread
+	FileSpecifier map_file;
+	TimeType map_date;
+	std::vector<short> levels; // most likely first
+	std::vector<std::vector<short> > environment_collections;
+	bool landscapes;
+	std::vector<short> other_collections; // what's loaded, besides the environment
+	struct collection_prefetch *collections;
+	std::shared_ptr<SoundManager::Prefetch> sounds;
+
+	// filled in by the worker
+	std::vector<prefetched_level> wads;
+
+	std::mutex mutex;
+	std::condition_variable finished;
+	bool done;
+	std::atomic<bool> cancelled;
+
+	level_prefetch() : map_date(0), landscapes(false), collections(NULL), done(false), cancelled(false) { }
+	~level_prefetch()
+	{
+		for (auto& level : wads) free_wad(level.wad);
+		if (collections) dispose_collection_prefetch(collections);
+	}
+};
+
+static std::shared_ptr<level_prefetch> running_prefetch;
+
+// what goto_level() took from a finished prefetch, for load_level_from_map()
+static std::shared_ptr<level_prefetch> committed_prefetch;
+
+static void run_level_prefetch(std::shared_ptr<level_prefetch> prefetch);
+static void finish_level_prefetch(short level_index);
+static struct wad_data *take_prefetched_wad(short level_index, struct wad_header *header);
+
 /* -------- static functions */
 static void scan_and_add_scenery(void);
 static void complete_restoring_level(struct wad_data *wad);
 static void load_redundant_map_data(short *redundant_data, size_t count);
 static void allocate_map_structure_for_map(struct wad_data *wad);
 static wad_data *build_export_wad(wad_header *header, int32 *length);
-static struct wad_data *build_save_game_wad(struct wad_header *header, int32 *length);
+static struct wad_data *build_save_game_wad(struct wad_header *header, int32 *length, bool recalculate_counts = true);
 
 static void allocate_map_for_counts(size_t polygon_count, size_t side_count,
 	size_t endpoint_count, size_t line_count);
@@ -322,8 +427,11 @@ bool load_level_from_map(
 			{
 				if(index_to_load>=0 && index_to_load<header.wad_count)
 				{
-                        
-					wad= read_indexed_wad_from_file(MapFile, &header, index_to_load, true);
+					wad= restoring_game ? NULL : take_prefetched_wad(level_index, &header);
+					if (!wad)
+					{
+						wad= read_indexed_wad_from_file(MapFile, &header, index_to_load, true);
+					}
 					if (wad)
 					{
 						/* Process everything... */
@@ -388,25 +496,28 @@ void complete_loading_level(
 		assert(0 <= static_cast<int16>(actual_platform_data_count));
 		dynamic_world->platform_count= static_cast<int16>(actual_platform_data_count);
 	}
+	map_load_timer.Mark("platforms");
 
 	scan_and_add_scenery();
 	ok_to_reset_scenery_solidity = true;
+	map_load_timer.Mark("scenery");
 	
 	/* Gotta do this after recalculate redundant.. */
 	if(version==MARATHON_ONE_DATA_VERSION)
 	{
-		short loop;
-		
-		for(loop= 0; loop<dynamic_world->side_count; ++loop)
-		{
-			guess_side_lightsource_indexes(loop);
-			if (static_world->environment_flags&_environment_vacuum)
+		WorkerPool::instance()->ParallelFor(0, dynamic_world->side_count, [](int first, int last) {
+			for (int loop = first; loop < last; ++loop)
 			{
-				side_data *side= get_side_data(loop);
-				if (side->flags&_side_is_control_panel)
-					side->flags |= _side_is_m1_lighted_switch;
+				guess_side_lightsource_indexes(loop);
+				if (static_world->environment_flags&_environment_vacuum)
+				{
+					side_data *side= get_side_data(loop);
+					if (side->flags&_side_is_control_panel)
+						side->flags |= _side_is_m1_lighted_switch;
+				}
 			}
-		}
+		});
+		map_load_timer.Mark("side lightsources");
 	}
 }
 
@@ -766,6 +877,11 @@ bool goto_level(
 	short number_of_players)
 {
 	bool success= true;
+	LoadPhaseTimer timer;
+
+	timer.Start();
+	finish_level_prefetch(entry->level_number);
+	timer.Mark("prefetch");
 
 	if(!new_game)
 	{
@@ -801,6 +917,8 @@ bool goto_level(
 		load_level_from_map(entry->level_number);
 		if(error_pending()) success= false;
 	}
+	committed_prefetch.reset();
+	timer.Mark("map");
 	
 	if (success)
 	{
@@ -830,6 +948,7 @@ bool goto_level(
 		// we want to be before place_initial_objects, and
 		// before MarkLuaCollections
 		RunLuaScript();
+		timer.Mark("scripts");
 
 		if (film_profile.early_object_initialization)
 		{
@@ -843,6 +962,7 @@ bool goto_level(
 			/* entering_map might fail if netsync fails, but we will have already displayed */
 			/* the error.. */
 			success= entering_map(false);
+			timer.Mark("collections and sounds");
 		}
 
 		if (!film_profile.early_object_initialization && success)
@@ -850,7 +970,13 @@ bool goto_level(
 			place_initial_objects();
 			initialize_control_panels_for_level();
 		}
+		timer.Mark("objects");
 		
+		timer.Log("changing level");
+
+		// the old level's assets are fair game now
+		MemoryBudget::instance()->Enforce();
+		MemoryBudget::instance()->Log();
 	}
 	
 //	if(!success) alert_user(fatalError, strERRORS, badReadMap, -1);
@@ -859,6 +985,204 @@ bool goto_level(
 	return success;
 }
 
+/* -------------------- Level prefetching */
+
+/* Called once a level has been entered; guesses where the player will go next from the */
+/*  level's exits and terminals, and from the level order, and starts reading those levels */
+void start_level_prefetch(
+	void)
+{
+	cancel_level_prefetch();
+
+	// with no thread to spare there is nothing to overlap with, and netgames
+	// get their maps from the gatherer
+	if (!file_is_set || game_is_networked || WorkerPool::instance()->Concurrency() < 2) return;
+
+	std::vector<short> destinations;
+	for (short polygon_index= 0; polygon_index<dynamic_world->polygon_count; ++polygon_index)
+	{
+		struct polygon_data *polygon= get_polygon_data(polygon_index);
+		if (polygon->type==_polygon_is_automatic_exit)
+			destinations.push_back(polygon->permutation);
+	}
+	get_interlevel_teleport_destinations(destinations);
+
+	auto prefetch = std::make_shared<level_prefetch>();
+
+	// the next level in order, unless the level only leads elsewhere
+	short current_level= dynamic_world->current_level_number;
+	short next_level= current_level + 1;
+	if (destinations.empty() || std::find(destinations.begin(), destinations.end(), next_level) != destinations.end())
+	{
+		prefetch->levels.push_back(next_level);
+	}
+	for (auto level_index : destinations)
+	{
+		if (prefetch->levels.size() >= kMaximumPrefetchedLevels) break;
+		if (level_index >= 0 && level_index != current_level &&
+		    std::find(prefetch->levels.begin(), prefetch->levels.end(), level_index) == prefetch->levels.end())
+		{
+			prefetch->levels.push_back(level_index);
+		}
+	}
+	if (prefetch->levels.empty()) return;
+
+	prefetch->map_file= MapFileSpec;
+	prefetch->map_date= MapFileSpec.GetDate();
+	get_environment_collections(prefetch->environment_collections);
+	prefetch->landscapes= LandscapesLoaded;
+
+	// the player's, weapons', items' and most monsters' collections carry over
+	short landscape= LandscapesLoaded ? _collection_landscape1 + static_world->song_index : NONE;
+	for (short collection_index= 0; collection_index<MAXIMUM_COLLECTIONS; ++collection_index)
+	{
+		if (is_collection_present(collection_index) && collection_index != landscape &&
+		    !collection_in_environment(collection_index, static_world->environment_code))
+			prefetch->other_collections.push_back(collection_index);
+	}
+
+	prefetch->collections= begin_collection_prefetch();
+	prefetch->sounds= SoundManager::instance()->BeginPrefetch();
+
+	running_prefetch= prefetch;
+	WorkerPool::instance()->Post([prefetch]() { run_level_prefetch(prefetch); });
+}
+
+void cancel_level_prefetch(
+	void)
+{
+	// the worker keeps its own reference, and cleans up after itself
+	if (running_prefetch) running_prefetch->cancelled= true;
+	running_prefetch.reset();
+}
+
+/* Runs on a worker thread, so it only touches what start_level_prefetch() gave it */
+static void run_level_prefetch(
+	std::shared_ptr<level_prefetch> prefetch)
+{
+	auto start= std::chrono::steady_clock::now();
+	size_t budget= kLevelPrefetchBudget;
+	std::vector<short> collections;
+	std::vector<short> later_collections;
+
+	for (size_t i= 0; i<prefetch->levels.size() && !prefetch->cancelled; ++i)
+	{
+		prefetched_level level;
+		level.level_index= prefetch->levels[i];
+		level.wad= prefetch_indexed_wad(prefetch->map_file, level.level_index, &level.header);
+		if (!level.wad) continue;
+
+		size_t length= calculate_wad_length(&level.header, level.wad);
+		if (length > budget)
+		{
+			free_wad(level.wad);
+			continue;
+		}
+		budget-= length;
+		prefetch->wads.push_back(level);
+
+		size_t map_info_length;
+		uint8 *map_info= (uint8 *) extract_type_from_wad(level.wad, MAP_INFO_TAG, &map_info_length);
+		if (map_info && map_info_length >= SIZEOF_static_data)
+		{
+			static_data info;
+			unpack_static_data(map_info, &info, 1);
+
+			std::vector<short>& wanted= i == 0 ? collections : later_collections;
+			if (info.environment_code >= 0 && info.environment_code < static_cast<short>(prefetch->environment_collections.size()))
+			{
+				auto& environment= prefetch->environment_collections[info.environment_code];
+				wanted.insert(wanted.end(), environment.begin(), environment.end());
+			}
+			if (prefetch->landscapes)
+			{
+				wanted.push_back(_collection_landscape1 + info.song_index);
+			}
+		}
+	}
+
+	// the likeliest level's collections first, then the sounds that carry
+	// over, then whatever the other levels need
+	collections.insert(collections.end(), prefetch->other_collections.begin(), prefetch->other_collections.end());
+	size_t collection_bytes= 0, sound_bytes= 0;
+	if (prefetch->collections && !collections.empty() && !prefetch->cancelled)
+	{
+		collection_bytes+= decode_prefetched_collections(prefetch->collections, &collections[0], collections.size(), budget);
+		budget-= collection_bytes;
+	}
+	if (prefetch->sounds && !prefetch->cancelled)
+	{
+		sound_bytes= SoundManager::DecodePrefetch(*prefetch->sounds, budget);
+		budget-= sound_bytes;
+	}
+	if (prefetch->collections && !later_collections.empty() && !prefetch->cancelled)
+	{
+		collection_bytes+= decode_prefetched_collections(prefetch->collections, &later_collections[0], later_collections.size(), budget);
+	}
+
+	if (!prefetch->cancelled)
+	{
+		logNoteNMT("prefetched %d of %d levels, %.1f MB of collections and %.1f MB of sounds in %.1f ms",
+			static_cast<int>(prefetch->wads.size()), static_cast<int>(prefetch->levels.size()),
+			collection_bytes / double(MEG), sound_bytes / double(MEG),
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	std::lock_guard<std::mutex> lock(prefetch->mutex);
+	prefetch->done= true;
+	prefetch->finished.notify_all();
+}
+
+/* Hands whatever was prefetched for level_index over to the loaders */
+static void finish_level_prefetch(
+	short level_index)
+{
+	std::shared_ptr<level_prefetch> prefetch;
+	prefetch.swap(running_prefetch);
+	committed_prefetch.reset();
+
+	if (!prefetch) return;
+	if (std::find(prefetch->levels.begin(), prefetch->levels.end(), level_index) == prefetch->levels.end())
+	{
+		// a guess that didn't pan out
+		prefetch->cancelled= true;
+		return;
+	}
+
+	// it's usually done by now; if not, it's already partway there
+	{
+		std::unique_lock<std::mutex> lock(prefetch->mutex);
+		prefetch->finished.wait(lock, [&prefetch]() { return prefetch->done; });
+	}
+
+	if (!(prefetch->map_file == MapFileSpec) || prefetch->map_date != MapFileSpec.GetDate()) return;
+
+	commit_collection_prefetch(prefetch->collections);
+	prefetch->collections= NULL;
+	if (prefetch->sounds) SoundManager::instance()->CommitPrefetch(prefetch->sounds);
+	committed_prefetch= prefetch;
+}
+
+static struct wad_data *take_prefetched_wad(
+	short level_index,
+	struct wad_header *header)
+{
+	if (!committed_prefetch) return NULL;
+
+	for (auto it= committed_prefetch->wads.begin(); it != committed_prefetch->wads.end(); ++it)
+	{
+		if (it->level_index == level_index && it->header.checksum == header->checksum && it->header.wad_count == header->wad_count)
+		{
+			struct wad_data *wad= it->wad;
+			committed_prefetch->wads.erase(it);
+			logNote("level %d was prefetched", level_index);
+			return wad;
+		}
+	}
+
+	return NULL;
+}
+
 /* -------------------- Private or map editor functions */
 void allocate_map_for_counts(
 	size_t polygon_count, 
@@ -1199,11 +1523,26 @@ void load_random_sound_images(
 void recalculate_redundant_map(
 	void)
 {
-	short loop;
+	WorkerPool* pool = WorkerPool::instance();
+
+	// each element only writes its own redundant fields; the polygon and line
+	// passes are independent of each other, but endpoints need the line flags
+	pool->Run({
+		[pool]() {
+			pool->ParallelFor(0, dynamic_world->polygon_count, [](int first, int last) {
+				for (int loop = first; loop < last; ++loop) recalculate_redundant_polygon_data(loop);
+			});
+		},
+		[pool]() {
+			pool->ParallelFor(0, dynamic_world->line_count, [](int first, int last) {
+				for (int loop = first; loop < last; ++loop) recalculate_redundant_line_data(loop);
+			});
+		}
+	});
 
-	for(loop=0;loop<dynamic_world->polygon_count;++loop) recalculate_redundant_polygon_data(loop);
-	for(loop=0;loop<dynamic_world->line_count;++loop) recalculate_redundant_line_data(loop);
-	for(loop=0;loop<dynamic_world->endpoint_count;++loop) recalculate_redundant_endpoint_data(loop);
+	pool->ParallelFor(0, dynamic_world->endpoint_count, [](int first, int last) {
+		for (int loop = first; loop < last; ++loop) recalculate_redundant_endpoint_data(loop);
+	});
 }
 
 bool load_game_from_file(FileSpecifier& File, bool run_scripts)
@@ -1324,6 +1663,117 @@ bool revert_game(
 	return successful;
 }
 
+/* Keyframe layout: (tag, length, data) for each chunk of the save game wad,
+	then the paths */
+bool save_game_state(std::vector<uint8>& data)
+{
+	struct wad_header header;
+	int32 wad_length;
+
+	/* Save off the random seed. */
+	dynamic_world->random_seed= get_random_seed();
+
+	obj_clear(header);
+	header.version= CURRENT_WADFILE_VERSION;
+	// the counts steer some loops, so trimming them here would make a
+	// recording play out differently from its replay
+	struct wad_data *wad= build_save_game_wad(&header, &wad_length, false);
+	if (!wad) return false;
+
+	size_t paths_size= packed_paths_size();
+	size_t size= 2*sizeof(uint32) + paths_size;
+	for (short i= 0; i<wad->tag_count; ++i)
+		size+= 2*sizeof(uint32) + wad->tag_data[i].length;
+
+	data.resize(size);
+	uint8 *S= data.data();
+	for (short i= 0; i<wad->tag_count; ++i)
+	{
+		uint32 tag= wad->tag_data[i].tag;
+		uint32 length= wad->tag_data[i].length;
+		ValueToStream(S,tag);
+		ValueToStream(S,length);
+		memcpy(S, wad->tag_data[i].data, length);
+		S+= length;
+	}
+	free_wad(wad);
+
+	uint32 tag= PATHS_STRUCTURE_TAG;
+	uint32 length= static_cast<uint32>(paths_size);
+	ValueToStream(S,tag);
+	ValueToStream(S,length);
+	pack_paths(S);
+
+	return true;
+}
+
+bool restore_game_state(const std::vector<uint8>& data)
+{
+	struct wad_data *wad= create_empty_wad();
+	uint8 *paths_data= NULL;
+	size_t paths_length= 0;
+
+	uint8 *S= const_cast<uint8 *>(data.data());
+	uint8 *End= S + data.size();
+	while (wad && S + 2*sizeof(uint32) <= End)
+	{
+		uint32 tag, length;
+		StreamToValue(S,tag);
+		StreamToValue(S,length);
+		if (length > static_cast<size_t>(End - S)) break;
+
+		if (tag == PATHS_STRUCTURE_TAG)
+		{
+			paths_data= S;
+			paths_length= length;
+		}
+		else
+		{
+			wad= append_data_to_wad(wad, tag, S, length, 0);
+		}
+		S+= length;
+	}
+	if (!wad) return false;
+
+	dynamic_data saved_world;
+	get_dynamic_data_from_wad(wad, &saved_world);
+
+	leaving_map();
+
+	if (saved_world.current_level_number != dynamic_world->current_level_number)
+	{
+		ResetLevelScript();
+		RunLevelScript(saved_world.current_level_number);
+	}
+
+	bool success= process_map_wad(wad, true, EDITOR_MAP_VERSION) && !error_pending();
+	if (success)
+	{
+		success= entering_map(true);
+	}
+
+	if (success)
+	{
+		/* entering_map() told the monsters to find new paths and drew random
+			numbers for the scenery; take both back */
+		size_t data_length;
+		uint8 *monster_data= (uint8 *)extract_type_from_wad(wad, MONSTERS_STRUCTURE_TAG, &data_length);
+		unpack_monster_data(monster_data, monsters, data_length/SIZEOF_monster_data);
+		if (paths_data) unpack_paths(paths_data, paths_length);
+		set_random_seed(dynamic_world->random_seed);
+
+		reset_motion_sensor(local_player_index);
+		update_interface(NONE);
+		ChaseCam_Reset();
+		ResetFieldOfView();
+		reset_messages();
+		ReloadViewContext();
+	}
+	free_wad(wad);
+
+	return success;
+}
+
 bool export_level(FileSpecifier& File)
 {
 	struct wad_header header;
@@ -1574,6 +2024,8 @@ bool process_map_wad(
 
 	assert(version==MARATHON_INFINITY_DATA_VERSION || version==MARATHON_TWO_DATA_VERSION || version==MARATHON_ONE_DATA_VERSION);
 
+	map_load_timer.Start();
+
 	/* zero everything so no slots are used */	
 	initialize_map_for_new_level();
 
@@ -1836,6 +2288,7 @@ bool process_map_wad(
 	RunScriptChunks();
 
 	init_ephemera(dynamic_world->polygon_count);
+	map_load_timer.Mark("unpacking");
 
 	PolygonListCopy = PolygonList; // must be done before polygons heights are modified below
 
@@ -1908,6 +2361,7 @@ bool process_map_wad(
 		unpack_player_terminal_data(data,count);
 		
 		complete_restoring_level(wad);
+		map_load_timer.Mark("restoring");
 	} else {
 		uint8 *map_index_data;
 		size_t map_index_count;
@@ -1943,6 +2397,8 @@ bool process_map_wad(
 
 	PlatformListCopy = PlatformList;
 
+	map_load_timer.Log("processing map");
+
 	/* ... and bail */
 	return true;
 }
@@ -2009,8 +2465,10 @@ static void load_redundant_map_data(
 	else
 	{
 		recalculate_redundant_map();
+		map_load_timer.Mark("redundant data");
 		precalculate_map_indexes();
 	}
+	map_load_timer.Mark("map indexes");
 }
 
 void load_terminal_data(
@@ -2600,7 +3058,8 @@ static wad_data *build_export_wad(wad_header *header, int32 *length)
 /* Build the wad, with all the crap */
 static struct wad_data *build_save_game_wad(
 	struct wad_header *header, 
-	int32 *length)
+	int32 *length,
+	bool recalculate_counts)
 {
 	struct wad_data *wad= NULL;
 	uint8 *array_to_slam;
@@ -2609,7 +3068,7 @@ static struct wad_data *build_save_game_wad(
 	wad= create_empty_wad();
 	if(wad)
 	{
-		recalculate_map_counts();
+		if (recalculate_counts) recalculate_map_counts();
 		for(unsigned loop= 0; loop<NUMBER_OF_SAVE_ARRAYS; ++loop)
 		{
 			/* If there is a conversion function, let it handle it */
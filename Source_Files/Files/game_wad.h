@@ -36,6 +36,7 @@ Aug 12, 2000 (Loren Petrich):
 #include "cstypes.h"
 #include "map.h"
 #include <string>
+#include <vector>
 
 class FileSpecifier;
 
@@ -44,6 +45,11 @@ struct wad_data *build_meta_game_wad(const std::string& metadata, const std::str
 
 bool export_level(FileSpecifier& File);
 
+// Film keyframes: what a saved game holds, plus monster paths, in memory;
+// restoring one puts the world back exactly where it was
+bool save_game_state(std::vector<uint8>& data);
+bool restore_game_state(const std::vector<uint8>& data);
+
 /* -------------- New functions */
 void pause_game(void);
 void resume_game(void);
@@ -235,6 +235,47 @@ struct wad_data *read_indexed_wad_from_file(
 	return read_wad;
 }
 
+/* Unlike read_indexed_wad_from_file(), this never touches the game error, so it is safe */
+/*  to call from a worker thread (with nothing else using File); returns NULL on failure */
+struct wad_data *prefetch_indexed_wad(
+	FileSpecifier& File,
+	short index,
+	struct wad_header *header)
+{
+	struct wad_data *read_wad= NULL;
+	OpenedFile OFile;
+	int32 length;
+
+	if (!File.Open(OFile)) return NULL;
+
+	uint8 buffer[SIZEOF_wad_header];
+	if (!read_from_file(OFile, 0, buffer, SIZEOF_wad_header)) return NULL;
+	unpack_wad_header(buffer, header, 1);
+
+	if (header->version>CURRENT_WADFILE_VERSION || header->data_version > 2 || header->wad_count < 1) return NULL;
+	if (index < 0 || index >= header->wad_count) return NULL;
+
+	if (size_of_indexed_wad(OFile, header, index, &length))
+	{
+		int32 padded_length = length + (SIZEOF_entry_header-SIZEOF_old_entry_header);
+		uint8 *raw_wad= (uint8 *) malloc(padded_length);
+
+		if (raw_wad)
+		{
+			if (read_indexed_wad_from_file_into_buffer(OFile, header, index, raw_wad, &length))
+			{
+				read_wad= convert_wad_from_raw(header, raw_wad, 0, length);
+			}
+			if (!read_wad)
+			{
+				free(raw_wad);
+			}
+		}
+	}
+
+	return read_wad;
+}
+
 void *extract_type_from_wad(
 	struct wad_data *wad,
 	WadDataType type, 
@@ -151,6 +151,9 @@ bool read_wad_header(OpenedFile& OFile, struct wad_header *header);
 struct wad_data *read_indexed_wad_from_file(OpenedFile& OFile, 
 	struct wad_header *header, short index, bool read_only);
 
+/* For reading the next level ahead of time, on a thread of its own; see game_wad.cpp */
+struct wad_data *prefetch_indexed_wad(FileSpecifier& File, short index, struct wad_header *header);
+
 /* Properly deal with the memory.. */
 void free_wad(struct wad_data *wad);
 
@@ -0,0 +1,419 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Remembering the floods activate_nearby_monsters() makes, so the same
+	flood out of the same polygon needn't be worked out again
+*/
+
+#include "activation_flood.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdlib.h>
+#include <vector>
+
+#include "map.h"
+#include "Console.h"
+#include "interface.h"
+#include "Logging.h"
+#include "monsters.h"
+
+// Enough for every polygon monsters are making noise in during a big fight;
+// a recording is a few kilobytes at most
+static const int kMaximumRecordedFloods = 128;
+
+struct flood_step
+{
+	short polygon_index;	// NONE once the flood is over
+	int32 flags;
+
+	// where this step's costs and dependencies end
+	uint32 cost_end;
+	uint32 dependency_end;
+};
+
+// what monster_activation_flood_proc() said about a line the flood tried
+struct flood_cost
+{
+	int32 cost;
+	int32 flags;
+};
+
+struct recorded_flood
+{
+	short polygon_index;
+	int32 maximum_cost;
+	int32 flags;
+	int16 environment_flags;
+
+	std::vector<flood_step> steps;
+	std::vector<flood_cost> costs;
+	std::vector<int16> dependencies;
+
+	uint32 last_used;	// 0 for a slot that's never been used
+	bool in_use;
+};
+
+static recorded_flood recorded_floods[kMaximumRecordedFloods];
+static uint32 flood_uses= 0;
+
+// the flood whose costs recording_cost_proc() is keeping
+static ActivationFlood *recording_flood= NULL;
+
+static struct
+{
+	uint32 floods;
+	uint32 played_back;			// floods that never had to flood at all
+	uint32 nodes_played_back;
+	uint32 nodes_expanded;		// by flood_map() on the way to new steps
+	uint32 nodes_caught_up;		// by flood_map() to get back to where a recording stopped holding
+} activation_flood_counts;
+
+// Calls visit() with everything monster_activation_flood_proc() reads when
+// the flood moves on from polygon_index, besides what never changes (the
+// polygon areas, which polygons are next to which, and the environment
+// flags, which recordings are kept by). Stops early if visit() returns false.
+template <class Visit>
+static bool for_each_dependency(
+	short polygon_index,
+	Visit visit)
+{
+	struct polygon_data *polygon= get_polygon_data(polygon_index);
+
+	if (!visit(polygon->floor_height)) return false;
+	for (short i= 0; i<polygon->vertex_count; ++i)
+	{
+		short adjacent_polygon_index= polygon->adjacent_polygon_indexes[i];
+		if (adjacent_polygon_index==NONE) continue;
+
+		struct polygon_data *adjacent_polygon= get_polygon_data(adjacent_polygon_index);
+		if (!visit(adjacent_polygon->type) ||
+			!visit(adjacent_polygon->floor_height) ||
+			!visit(adjacent_polygon->ceiling_height) ||
+			!visit(LINE_IS_SOLID(get_line_data(polygon->line_indexes[i])) ? 1 : 0))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool dependencies_unchanged(
+	short polygon_index,
+	const int16 *dependency,
+	const int16 *end)
+{
+	return for_each_dependency(polygon_index, [&](int16 value) { return dependency!=end && *dependency++==value; }) &&
+		dependency==end;
+}
+
+ActivationFlood::ActivationFlood(short polygon_index, int32 maximum_cost, int32 flags) :
+	polygon_index(polygon_index), maximum_cost(maximum_cost), flags(flags), mode(_flooding), record(NULL),
+	next_step(0), started(false), flood_serial(floods_started()), next_cost(0), cost_count(0)
+{
+	activation_flood_counts.floods++;
+
+	// the same flood, or else the one least recently used
+	recorded_flood *oldest= NULL;
+	for (auto& candidate : recorded_floods)
+	{
+		if (candidate.in_use) continue;
+		if (candidate.last_used && candidate.polygon_index==polygon_index && candidate.maximum_cost==maximum_cost &&
+			candidate.flags==flags && candidate.environment_flags==static_world->environment_flags)
+		{
+			record= &candidate;
+			break;
+		}
+		if (!oldest || candidate.last_used<oldest->last_used) oldest= &candidate;
+	}
+
+	if (!record && oldest)
+	{
+		record= oldest;
+		record->polygon_index= polygon_index;
+		record->maximum_cost= maximum_cost;
+		record->flags= flags;
+		record->environment_flags= static_world->environment_flags;
+		record->steps.clear();
+		record->costs.clear();
+		record->dependencies.clear();
+	}
+
+	if (record)
+	{
+		record->in_use= true;
+		record->last_used= ++flood_uses;
+		mode= record->steps.empty() ? _recording : _playing_back;
+	}
+}
+
+ActivationFlood::~ActivationFlood()
+{
+	if (mode==_playing_back) activation_flood_counts.played_back++;
+	if (record) record->in_use= false;
+}
+
+short ActivationFlood::Next(
+	int32 *flags)
+{
+	/* someone else started a flood between our steps (a Lua hook, say); flood_map()
+		would carry on from wherever theirs left off, so do just that */
+	if (mode!=_flooding && floods_started()!=flood_serial)
+	{
+		mode= _flooding;
+		started= true;
+	}
+
+	if (mode==_playing_back)
+	{
+		if (next_step<record->steps.size())
+		{
+			const flood_step& step= record->steps[next_step];
+			const int16 *dependencies= record->dependencies.data();
+
+			if (step.polygon_index==NONE || dependencies_unchanged(step.polygon_index,
+				dependencies + (next_step ? record->steps[next_step-1].dependency_end : 0), dependencies + step.dependency_end))
+			{
+				next_step+= 1;
+				if (step.polygon_index!=NONE) activation_flood_counts.nodes_played_back++;
+				*flags= step.flags;
+				return step.polygon_index;
+			}
+		}
+
+		CatchUp();
+	}
+
+	short next_polygon_index;
+	if (!started) *flags= this->flags;
+	if (mode==_recording)
+	{
+		ActivationFlood *outer_flood= recording_flood;
+		recording_flood= this;
+		next_polygon_index= flood_map(started ? NONE : polygon_index, maximum_cost, recording_cost_proc, _flagged_breadth_first, flags);
+		recording_flood= outer_flood;
+
+		if (!started)
+		{
+			started= true;
+			flood_serial= floods_started();
+		}
+		Record(next_polygon_index, *flags);
+	}
+	else
+	{
+		next_polygon_index= flood_map(started ? NONE : polygon_index, maximum_cost, monster_activation_flood_proc, _flagged_breadth_first, flags);
+		started= true;
+	}
+
+	if (next_polygon_index!=NONE) activation_flood_counts.nodes_expanded++;
+	return next_polygon_index;
+}
+
+/* the recording stops holding at next_step: feed flood_map() the costs recorded for the
+	steps before, which takes it to exactly where it would be had it flooded all along,
+	and record the rest of the flood from there */
+void ActivationFlood::CatchUp(
+	void)
+{
+	size_t dependency_count= next_step ? record->steps[next_step-1].dependency_end : 0;
+	cost_count= next_step ? record->steps[next_step-1].cost_end : 0;
+	next_cost= 0;
+	record->steps.resize(next_step);
+	record->costs.resize(cost_count);
+	record->dependencies.resize(dependency_count);
+	mode= _recording;
+
+	if (next_step)
+	{
+		ActivationFlood *outer_flood= recording_flood;
+		int32 flood_flags= flags;
+
+		recording_flood= this;
+		for (size_t step= 0; step<next_step; ++step)
+		{
+			short caught_up_polygon_index= flood_map(step ? NONE : polygon_index, maximum_cost, recording_cost_proc, _flagged_breadth_first, &flood_flags);
+			assert(caught_up_polygon_index==record->steps[step].polygon_index);
+			if (caught_up_polygon_index!=NONE) activation_flood_counts.nodes_caught_up++;
+		}
+		recording_flood= outer_flood;
+		assert(next_cost==cost_count);
+
+		started= true;
+		flood_serial= floods_started();
+	}
+}
+
+void ActivationFlood::Record(
+	short expanded_polygon_index,
+	int32 expanded_flags)
+{
+	flood_step step;
+
+	step.polygon_index= expanded_polygon_index;
+	step.flags= expanded_flags;
+	step.cost_end= static_cast<uint32>(record->costs.size());
+	if (expanded_polygon_index!=NONE)
+	{
+		for_each_dependency(expanded_polygon_index, [this](int16 value) { record->dependencies.push_back(value); return true; });
+	}
+	step.dependency_end= static_cast<uint32>(record->dependencies.size());
+
+	record->steps.push_back(step);
+	next_step+= 1;
+}
+
+int32 ActivationFlood::recording_cost_proc(
+	short source_polygon_index,
+	short line_index,
+	short destination_polygon_index,
+	void *data)
+{
+	ActivationFlood *flood= recording_flood;
+	int32 *flags= (int32 *) data;
+	flood_cost cost;
+
+	/* catching up */
+	if (flood->next_cost<flood->cost_count)
+	{
+		cost= flood->record->costs[flood->next_cost++];
+		*flags= cost.flags;
+		return cost.cost;
+	}
+
+	cost.cost= monster_activation_flood_proc(source_polygon_index, line_index, destination_polygon_index, data);
+	cost.flags= *flags;
+	flood->record->costs.push_back(cost);
+	flood->next_cost+= 1;
+	flood->cost_count+= 1;
+
+	return cost.cost;
+}
+
+void invalidate_activation_floods(
+	void)
+{
+	for (auto& record : recorded_floods)
+	{
+		record.steps.clear();
+		record.costs.clear();
+		record.dependencies.clear();
+		record.last_used= 0;
+	}
+
+	obj_clear(activation_flood_counts);
+}
+
+/* ---------- benchmark */
+
+static void benchmark_activation_floods(const std::string& arg)
+{
+	if (get_game_state() != _game_in_progress)
+	{
+		screen_printf("Start a level to benchmark activation floods");
+		return;
+	}
+
+	int passes = arg.empty() ? 10 : std::max(1, atoi(arg.c_str()));
+
+	// the benchmark's own floods don't count
+	auto counts = activation_flood_counts;
+	screen_printf("since the level started: %u floods, %u played back; %u nodes expanded, %u played back, %u caught up",
+		counts.floods, counts.played_back, counts.nodes_expanded, counts.nodes_played_back, counts.nodes_caught_up);
+	logNote("activation floods since the level started: %u floods, %u played back; %u nodes expanded, %u played back, %u caught up",
+		counts.floods, counts.played_back, counts.nodes_expanded, counts.nodes_played_back, counts.nodes_caught_up);
+
+	// out of every polygon with a monster in it, as monsters alerting each
+	// other flood (5 world units, where activation ranges apply)
+	std::vector<short> origins;
+	std::vector<bool> seen(dynamic_world->polygon_count);
+	for (auto& object : ObjectList)
+	{
+		if (!SLOT_IS_USED(&object) || GET_OBJECT_OWNER(&object) != _object_is_monster || seen[object.polygon]) continue;
+		seen[object.polygon] = true;
+		origins.push_back(object.polygon);
+		if (origins.size() == kMaximumRecordedFloods) break;
+	}
+	if (origins.empty())
+	{
+		screen_printf("No monsters here to benchmark activation floods");
+		return;
+	}
+
+	int32 maximum_cost = (static_world->environment_flags & _environment_activation_ranges) ?
+		5*WORLD_ONE*5*WORLD_ONE : INT32_MAX;
+
+	std::vector<short> expected;
+	int32 flood_flags;
+	auto start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < passes; ++pass)
+	{
+		for (auto origin : origins)
+		{
+			flood_flags = _pass_one_zone_border;
+			short polygon_index = flood_map(origin, maximum_cost, monster_activation_flood_proc, _flagged_breadth_first, &flood_flags);
+			while (polygon_index != NONE)
+			{
+				if (!pass) expected.push_back(polygon_index);
+				polygon_index = flood_map(NONE, maximum_cost, monster_activation_flood_proc, _flagged_breadth_first, &flood_flags);
+			}
+		}
+	}
+	double flood_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+	// the first pass records, the rest play back
+	invalidate_activation_floods();
+	int mismatches = 0;
+	double recording_us = 0;
+	start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < passes; ++pass)
+	{
+		size_t next = 0;
+		for (auto origin : origins)
+		{
+			ActivationFlood flood(origin, maximum_cost, _pass_one_zone_border);
+			short polygon_index = flood.Next(&flood_flags);
+			while (polygon_index != NONE)
+			{
+				if (next >= expected.size() || expected[next++] != polygon_index) ++mismatches;
+				polygon_index = flood.Next(&flood_flags);
+			}
+		}
+		if (next != expected.size()) ++mismatches;
+
+		if (!pass) recording_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	}
+	double playback_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() - recording_us;
+
+	double floods = double(origins.size());
+	screen_printf("activation flood: %.1f nodes; flooding %.2f us, recording %.2f us, playing back %.2f us",
+		expected.size() / floods, flood_us / (floods*passes), recording_us / floods,
+		passes > 1 ? playback_us / (floods*(passes - 1)) : 0.0);
+	if (mismatches) screen_printf("%d floods differ from flood_map()!", mismatches);
+	logNote("activation flood benchmark: %d origins, %.1f nodes each; per flood: flooding %.2f us, recording %.2f us, playing back %.2f us; %d mismatches",
+		static_cast<int>(origins.size()), expected.size() / floods, flood_us / (floods*passes), recording_us / floods,
+		passes > 1 ? playback_us / (floods*(passes - 1)) : 0.0, mismatches);
+
+	activation_flood_counts = counts;
+}
+
+void register_activation_flood_benchmark(
+	void)
+{
+	Console::instance()->register_benchmark("activation", benchmark_activation_floods);
+}
@@ -0,0 +1,71 @@
+#ifndef ACTIVATION_FLOOD_H
+#define ACTIVATION_FLOOD_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Remembering the floods activate_nearby_monsters() makes, so the same
+	flood out of the same polygon needn't be worked out again
+*/
+
+#include "flood_map.h"
+
+struct recorded_flood;
+
+// A monster_activation_flood_proc() flood, in _flagged_breadth_first mode.
+// Steps come out exactly as flood_map() would give them, but a flood made
+// before is played back, for as long as none of the polygons and lines it
+// passed through have changed.
+class ActivationFlood
+{
+public:
+	ActivationFlood(short polygon_index, int32 maximum_cost, int32 flags);
+	~ActivationFlood();
+
+	// Like flood_map(): the next polygon, or NONE once there are no more, with
+	// *flags set to the flags the flood reached it with
+	short Next(int32 *flags);
+
+private:
+	void CatchUp();
+	void Record(short expanded_polygon_index, int32 expanded_flags);
+
+	static int32 recording_cost_proc(short source_polygon_index, short line_index,
+		short destination_polygon_index, void *data);
+
+	short polygon_index;
+	int32 maximum_cost;
+	int32 flags;
+
+	enum { _playing_back, _recording, _flooding } mode;
+	recorded_flood *record;
+	size_t next_step;
+	bool started;
+	uint32 flood_serial;
+
+	// costs played back to flood_map() while catching up to a change
+	size_t next_cost;
+	size_t cost_count;
+};
+
+// A new map; nothing recorded for the old one applies
+void invalidate_activation_floods(void);
+
+// ".benchmark activation [passes]"
+void register_activation_flood_benchmark(void);
+
+#endif
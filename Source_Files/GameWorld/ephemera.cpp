@@ -38,6 +38,9 @@ public:
 	}
 
 	int size() { return static_cast<int>(pool_.size()); }
+
+	std::vector<object_data>& storage() { return pool_; }
+	int16_t& first_unused() { return first_unused_; }
 	
 	int16_t get_unused(); // marks as unused before returning
 	void release(int16_t object_index);
@@ -146,6 +149,17 @@ object_data* get_ephemera_data(int16_t ephemera_index)
 	return &ephemera_pool.get(ephemera_index);
 }
 
+std::vector<object_data>& get_ephemera_storage(int16_t*& first_unused)
+{
+	first_unused = &ephemera_pool.first_unused();
+	return ephemera_pool.storage();
+}
+
+std::vector<int16_t>& get_polygon_ephemera_storage()
+{
+	return polygon_ephemera;
+}
+
 int16_t get_polygon_ephemera(int16_t polygon_index)
 {
 	// TODO: settle on bounds checking
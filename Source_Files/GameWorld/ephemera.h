@@ -20,6 +20,7 @@
 */
 
 #include <cstdint>
+#include <vector>
 
 #include "map.h"
 #include "shape_descriptors.h"
@@ -47,4 +48,8 @@ void note_ephemera_polygon_rendered(int16_t polygon_index);
 
 void update_ephemera();
 
+// the raw ephemera storage, for in-memory world snapshots
+std::vector<object_data>& get_ephemera_storage(int16_t*& first_unused);
+std::vector<int16_t>& get_polygon_ephemera_storage();
+
 #endif
@@ -47,6 +47,17 @@ on very small maps, choose_random_flood_node() may not terminate
 #include <stdlib.h>
 #include <limits.h>
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "Console.h"
+#include "interface.h"
+#include "Logging.h"
+#include "WorkerPool.h"
+
 /* ---------- constants */
 
 #define MAXIMUM_FLOOD_NODES 255
@@ -58,7 +69,7 @@ on very small maps, choose_random_flood_node() may not terminate
 #define NODE_IS_UNEXPANDED(n) (!NODE_IS_EXPANDED(n))
 #define MARK_NODE_AS_EXPANDED(n) ((n)->flags|=(uint16)0x8000)
 
-struct node_data /* 16 bytes */
+struct flood_node /* 16 bytes */
 {
 	uint16 flags;
 	
@@ -73,28 +84,37 @@ struct node_data /* 16 bytes */
 
 /* ---------- globals */
 
-static short node_count= 0, last_node_index_expanded= NONE;
-static struct node_data *nodes = NULL;
-static short *visited_polygons = NULL;
+/* the engine behind the free functions */
+static FloodMap default_flood_map;
 
-/* ---------- private prototypes */
+/* ---------- code */
 
-static void add_node(short parent_node_index, short polygon_index, short depth, int32 cost, int32 user_flags);
+FloodMap::FloodMap() :
+	node_count(0), last_node_index_expanded(NONE), nodes(new flood_node[MAXIMUM_FLOOD_NODES]),
+	visited_polygons(NULL), visited_polygon_count(0), flood_count(0)
+{
+}
 
-/* ---------- code */
+FloodMap::~FloodMap()
+{
+	delete []nodes;
+	delete []visited_polygons;
+}
 
-void allocate_flood_map_memory(
+void FloodMap::Allocate(
 	void)
 {
 	// Made reentrant because this must be called every time a map is loaded
-	if (nodes) delete []nodes;
-	nodes= new node_data[MAXIMUM_FLOOD_NODES];
-	if (visited_polygons) delete []visited_polygons;
-	visited_polygons= new short[MAXIMUM_POLYGONS_PER_MAP];
+	delete []visited_polygons;
+	visited_polygon_count= MAXIMUM_POLYGONS_PER_MAP;
+	visited_polygons= new short[visited_polygon_count];
+	objlist_set(visited_polygons, UNVISITED, visited_polygon_count);
+	node_count= 0;
+	last_node_index_expanded= NONE;
 }
 
 /* returns next polygon index or NONE if there are no more polygons left cheaper than maximum_cost */
-short flood_map(
+short FloodMap::Flood(
 	short first_polygon_index,
 	int32 maximum_cost,
 	cost_proc_ptr cost_proc,
@@ -102,19 +122,25 @@ short flood_map(
 	void *caller_data)
 {
 	short lowest_cost_node_index, node_index;
-	struct node_data *node;
+	struct flood_node *node;
 	short polygon_index;
 	int32 lowest_cost;
 
 	/* initialize ourselves if first_polygon_index!=NONE */
 	if (first_polygon_index!=NONE)
 	{
-		/* clear the visited polygon array */
-		objlist_set(visited_polygons, NONE, MAXIMUM_POLYGONS_PER_MAP);
+		/* clear the visited polygon array; only the last flood's polygons are marked, and
+			on a big map that's far fewer than all of them */
+		for (node_index= 0; node_index<node_count; ++node_index)
+		{
+			if (size_t(nodes[node_index].polygon_index)<visited_polygon_count) visited_polygons[nodes[node_index].polygon_index]= UNVISITED;
+		}
+		if (visited_polygon_count<size_t(dynamic_world->polygon_count)) Allocate();
 		
 		node_count= 0;
 		last_node_index_expanded= NONE;
-		add_node(NONE, first_polygon_index, 0, 0, (flood_mode==_flagged_breadth_first) ? *((int32*)caller_data) : 0);
+		flood_count+= 1;
+		AddNode(NONE, first_polygon_index, 0, 0, (flood_mode==_flagged_breadth_first) ? *((int32*)caller_data) : 0);
 	}
 	
 	switch (flood_mode)
@@ -192,7 +218,7 @@ short flood_map(
 				int32 cost= cost_proc ? cost_proc(node->polygon_index, polygon->line_indexes[i], destination_polygon_index, (flood_mode==_flagged_breadth_first) ? &new_user_flags : caller_data) : polygon->area;
 				
 				/* polygons with zero or negative costs are not added to the node list */
-				if (cost>0) add_node(lowest_cost_node_index, destination_polygon_index, node->depth+1, lowest_cost+cost, new_user_flags);
+				if (cost>0) AddNode(lowest_cost_node_index, destination_polygon_index, node->depth+1, lowest_cost+cost, new_user_flags);
 			}
 		}
 		
@@ -211,14 +237,14 @@ short flood_map(
 	when there are no more polygons to return.  this is useful for pathfinding: when
 	flood_map() returns the destination polygon index, calling reverse_flood_map() will return
 	the polygons traversed to reach the destination) */
-short reverse_flood_map(
+short FloodMap::Reverse(
 	void)
 {
 	short polygon_index= NONE;
 	
 	if (last_node_index_expanded!=NONE)
 	{
-		struct node_data *node;
+		struct flood_node *node;
 		
 		assert(last_node_index_expanded>=0&&last_node_index_expanded<node_count);
 		node= nodes+last_node_index_expanded;
@@ -231,8 +257,8 @@ short reverse_flood_map(
 }
 
 /* returns depth (in polygons) at last_node_index_expanded */
-short flood_depth(
-	void)
+short FloodMap::Depth(
+	void) const
 {
 	assert(last_node_index_expanded>=0&&last_node_index_expanded<node_count);
 
@@ -243,7 +269,7 @@ short flood_depth(
 
 /* when looking for a random path, always choose a random node.  if bias is not NULL, then try
 	and choose a destination in that direction */
-void choose_random_flood_node(
+void FloodMap::ChooseRandomNode(
 	world_vector2d *bias)
 {
 	world_point2d origin;
@@ -270,7 +296,7 @@ void choose_random_flood_node(
 			suitable= true;
 			if (bias && (retries-= 1)>=0)
 			{
-				struct node_data *node= nodes+last_node_index_expanded;
+				struct flood_node *node= nodes+last_node_index_expanded;
 				world_point2d destination;
 				
 				find_center_of_polygon(node->polygon_index, &destination);
@@ -281,10 +307,8 @@ void choose_random_flood_node(
 	}
 }
 
-/* ---------- private code */
-
 /* checks to see if the given node is already in the node list */
-static void add_node(
+void FloodMap::AddNode(
 	short parent_node_index,
 	short polygon_index,
 	short depth,
@@ -293,7 +317,7 @@ static void add_node(
 {
 	if (node_count<MAXIMUM_FLOOD_NODES)
 	{
-		struct node_data *node;
+		struct flood_node *node;
 		short node_index;
 		
 		/* see if this polygon already exists in the node list anywhere */
@@ -307,7 +331,7 @@ static void add_node(
 				expanded we’re backtracking and can ignore the node) */
 			assert(node_index>=0&&node_index<node_count);
 			node= nodes+node_index;
-			if (NODE_IS_EXPANDED(node)||node->cost<=cost) node= (struct node_data *) NULL;
+			if (NODE_IS_EXPANDED(node)||node->cost<=cost) node= (struct flood_node *) NULL;
 		}
 		else
 		{
@@ -336,3 +360,134 @@ static void add_node(
 		}
 	}
 }
+
+/* ---------- the default engine */
+
+void allocate_flood_map_memory(
+	void)
+{
+	default_flood_map.Allocate();
+}
+
+short flood_map(
+	short first_polygon_index,
+	int32 maximum_cost,
+	cost_proc_ptr cost_proc,
+	short flood_mode,
+	void *caller_data)
+{
+	return default_flood_map.Flood(first_polygon_index, maximum_cost, cost_proc, flood_mode, caller_data);
+}
+
+short reverse_flood_map(
+	void)
+{
+	return default_flood_map.Reverse();
+}
+
+short flood_depth(
+	void)
+{
+	return default_flood_map.Depth();
+}
+
+/* changes every time a new flood starts, so a caller holding on to a flood can tell whether
+	anyone else has started one since */
+uint32 floods_started(
+	void)
+{
+	return default_flood_map.FloodsStarted();
+}
+
+void choose_random_flood_node(
+	world_vector2d *bias)
+{
+	default_flood_map.ChooseRandomNode(bias);
+}
+
+/* ---------- benchmark */
+
+// everything a flood out of origin finds, folded into one number to compare
+static uint32 flood_out(FloodMap& engine, short origin)
+{
+	uint32 checksum = 0;
+	for (short polygon_index = engine.Flood(origin, INT32_MAX, NULL, _breadth_first, NULL);
+		polygon_index != NONE;
+		polygon_index = engine.Flood(NONE, INT32_MAX, NULL, _breadth_first, NULL))
+	{
+		checksum = checksum*31 + polygon_index;
+	}
+	return checksum*31 + engine.Depth();
+}
+
+static void benchmark_flood_map(const std::string& arg)
+{
+	if (get_game_state() != _game_in_progress)
+	{
+		screen_printf("Start a level to benchmark flood_map()");
+		return;
+	}
+
+	int flood_count = arg.empty() ? 4096 : std::max(1, atoi(arg.c_str()));
+
+	// from polygons spread over the whole map, the same ones every run
+	std::vector<short> origins;
+	uint32 seed = 1;
+	for (int i = 0; origins.size() < size_t(flood_count) && i < flood_count*4; ++i)
+	{
+		seed = seed*1664525 + 1013904223;
+		short polygon_index = static_cast<short>((seed >> 8) % dynamic_world->polygon_count);
+		if (!POLYGON_IS_DETACHED(get_polygon_data(polygon_index))) origins.push_back(polygon_index);
+	}
+	if (origins.empty())
+	{
+		screen_printf("No polygons here to benchmark flood_map()");
+		return;
+	}
+
+	int count = static_cast<int>(origins.size());
+	std::vector<uint32> expected(count);
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; ++i)
+		expected[i] = flood_out(default_flood_map, origins[i]);
+	double serial_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+	// an engine per thread, made before the clock starts
+	WorkerPool* pool = WorkerPool::instance();
+	int threads = pool->Concurrency();
+	std::vector<std::unique_ptr<FloodMap> > engines;
+	for (int thread = 0; thread < threads; ++thread)
+	{
+		engines.emplace_back(new FloodMap);
+		engines.back()->Allocate();
+	}
+
+	std::vector<uint32> found(count);
+	std::vector<std::function<void()> > tasks;
+	for (int thread = 0; thread < threads; ++thread)
+	{
+		tasks.push_back([&, thread]() {
+			for (int i = thread; i < count; i += threads)
+				found[i] = flood_out(*engines[thread], origins[i]);
+		});
+	}
+	start = std::chrono::steady_clock::now();
+	pool->Run(tasks);
+	double parallel_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+	int mismatches = 0;
+	for (int i = 0; i < count; ++i)
+		if (found[i] != expected[i]) ++mismatches;
+
+	screen_printf("%d floods over %d polygons: %.2f us each alone, %.2f us each on %d threads",
+		count, static_cast<int>(dynamic_world->polygon_count), serial_us / count, parallel_us / count, threads);
+	if (mismatches) screen_printf("%d floods differ between engines!", mismatches);
+	logNote("flood_map benchmark: %d floods over %d polygons; %.2f us each alone, %.2f us each on %d threads; %d mismatches",
+		count, static_cast<int>(dynamic_world->polygon_count), serial_us / count, parallel_us / count, threads, mismatches);
+}
+
+void register_flood_map_benchmark(
+	void)
+{
+	Console::instance()->register_benchmark("flood", benchmark_flood_map);
+}
@@ -51,8 +51,55 @@ short new_path(world_point2d *source_point, short source_polygon_index,
 bool move_along_path(short path_index, world_point2d *p);
 void delete_path(short path_index);
 
+// saved games drop paths (monsters recalculate them); film keyframes keep them
+size_t packed_paths_size(void);
+uint8 *pack_paths(uint8 *Stream);
+void unpack_paths(uint8 *Stream, size_t length);
+
+// the raw path storage, for in-memory world snapshots
+void *get_path_array(void);
+int32 calculate_path_array_length(void);
+
+/* ---------- flood map engine */
+
+struct flood_node;
+
+/* one flood at a time per engine, but as many engines as there are threads wanting to flood;
+	each has its own buffers, allocated up front, and floods concurrently with the others as
+	long as nobody changes the map (or whatever the cost procs look at) underneath them */
+class FloodMap
+{
+public:
+	FloodMap();
+	~FloodMap();
+	FloodMap(const FloodMap&) = delete;
+	FloodMap& operator=(const FloodMap&) = delete;
+
+	/* sizes the buffers for the current map, which a new engine hasn't seen yet; floods on a
+		bigger map than the buffers were sized for do this themselves */
+	void Allocate();
+
+	short Flood(short first_polygon_index, int32 maximum_cost, cost_proc_ptr cost_proc, short flood_mode, void *caller_data);
+	short Reverse();
+	short Depth() const;
+	uint32 FloodsStarted() const { return flood_count; }
+
+	/* uses global_random(), so only the game thread's engines may pick random nodes */
+	void ChooseRandomNode(world_vector2d *bias);
+
+private:
+	void AddNode(short parent_node_index, short polygon_index, short depth, int32 cost, int32 user_flags);
+
+	short node_count, last_node_index_expanded;
+	flood_node *nodes;
+	short *visited_polygons;
+	size_t visited_polygon_count;
+	uint32 flood_count;
+};
+
 /* ---------- prototypes/FLOOD_MAP.C */
 
+/* the free functions below all work on one engine the game world shares */
 void allocate_flood_map_memory(void);
 
 /* default cost_proc, NULL, is the area of the destination polygon and is significantly faster
@@ -60,8 +107,12 @@ void allocate_flood_map_memory(void);
 short flood_map(short first_polygon_index, int32 maximum_cost, cost_proc_ptr cost_proc, short flood_mode, void *caller_data);
 short reverse_flood_map(void);
 short flood_depth(void);
+uint32 floods_started(void);
 
 void choose_random_flood_node(world_vector2d *bias);
 
+// ".benchmark flood [floods]"
+void register_flood_map_benchmark(void);
+
 #endif
 
@@ -26,6 +26,7 @@ INTERPOLATED_WORLD.CPP
 #include <cstdint>
 #include <vector>
 
+#include "AnimatedTextures.h"
 #include "dynamic_limits.h"
 #include "ephemera.h"
 #include "map.h"
@@ -898,3 +899,31 @@ bool get_interpolated_weapon_display_information(short* count,
 		return false;
 	}
 }
+
+static render_world_data captured_render_world;
+thread_local render_world_data* render_world = nullptr;
+
+template<typename T>
+static void capture_list(std::vector<T>& copy, const std::vector<T>& list)
+{
+	// assign() keeps the capacity, so this only allocates on a new level
+	copy.assign(list.begin(), list.end());
+}
+
+void capture_render_world()
+{
+	capture_list(captured_render_world.polygon_list, PolygonList);
+	capture_list(captured_render_world.line_list, LineList);
+	capture_list(captured_render_world.side_list, SideList);
+	capture_list(captured_render_world.endpoint_list, EndpointList);
+	capture_list(captured_render_world.media_list, MediaList);
+	capture_list(captured_render_world.platform_list, PlatformList);
+	capture_list(captured_render_world.light_list, LightList);
+
+	AnimTxtr_Capture();
+}
+
+void use_render_world(bool use)
+{
+	render_world = use ? &captured_render_world : nullptr;
+}
@@ -24,6 +24,12 @@ INTERPOLATED_WORLD.H
 */
 
 #include <cstdint>
+#include <vector>
+
+#include "map.h"
+#include "lightsource.h"
+#include "media.h"
+#include "platforms.h"
 
 struct weapon_display_information;
 
@@ -37,4 +43,27 @@ void interpolate_world_view(float heartbeat_fraction);
 void track_contrail_interpolation(int16_t projectile_index, int16_t effect_index);
 bool get_interpolated_weapon_display_information(short* count, weapon_display_information* data);
 
+// A copy of the (interpolated) map as the software rasterizer reads it, so
+// a frame can be drawn on a worker while the main thread runs the next
+// tick; see start_render_view()
+struct render_world_data {
+	std::vector<polygon_data> polygon_list;
+	std::vector<line_data> line_list;
+	std::vector<side_data> side_list;
+	std::vector<endpoint_data> endpoint_list;
+	std::vector<media_data> media_list;
+	std::vector<platform_data> platform_list;
+	std::vector<light_data> light_list;
+};
+
+// Copies the map as it is now into the render world
+void capture_render_world();
+
+// Set on the thread drawing from the render world, where it redirects
+// get_polygon_data() and the other map accessors; NULL everywhere else
+extern thread_local render_world_data* render_world;
+
+// Makes the calling thread read from (or stop reading from) the last capture
+void use_render_world(bool use);
+
 #endif
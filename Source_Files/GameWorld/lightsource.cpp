@@ -48,6 +48,7 @@ Jul 3, 2002 (Loren Petrich):
 #include "map.h"
 #include "lightsource.h"
 #include "Packing.h"
+#include "interpolated_world.h"
 
 //MH: Lua scripting
 #include "lua_script.h"
@@ -147,7 +148,9 @@ static light_definition *get_light_definition(
 light_data *get_light_data(
 	const size_t light_index)
 {
-	struct light_data *light = GetMemberWithBounds(lights,light_index,MAXIMUM_LIGHTS_PER_MAP);
+	struct light_data *light = render_world ?
+		GetMemberWithBounds(render_world->light_list.data(),light_index,render_world->light_list.size()) :
+		GetMemberWithBounds(lights,light_index,MAXIMUM_LIGHTS_PER_MAP);
 	
 	if (!light) return NULL;
 	if (!SLOT_IS_USED(light)) return NULL;
@@ -0,0 +1,535 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Sharing the polygon walks behind line_is_obstructed() and the monsters'
+	line of sight: which polygons could possibly see each other, and what
+	the walks already found out this tick
+*/
+
+#include "line_of_sight.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <stdlib.h>
+#include <vector>
+
+#include "map.h"
+#include "Console.h"
+#include "FilmProfile.h"
+#include "interface.h"
+#include "Logging.h"
+#include "WorkerPool.h"
+
+// Past this many polygons, the two bits kept for every pair of polygons
+// cost more memory than they're worth, and such maps just walk
+static const int kMaximumVisibilityPolygons = 4096;
+
+// Answers remembered until the next reset; a busy tick asks a few hundred
+// questions
+static const int kMemoSize = 4096;
+static const int kMemoProbes = 4;
+
+/* ---------- polygon visibility */
+
+// A line between two polygons, leaving "from": e0 to e1 is clockwise around
+// "from", so points on "to"'s side of the line have a positive cross product,
+// just as find_line_crossed_leaving_polygon() works it out
+struct portal
+{
+	world_point2d e0, e1;
+	short from, to;
+};
+
+static int64_t side_of_edge(const world_point2d& e0, const world_point2d& e1, const world_point2d& p)
+{
+	return int64_t(p.x - e0.x)*(e1.y - e0.y) - int64_t(p.y - e0.y)*(e1.x - e0.x);
+}
+
+// A walk that started inside its polygon has its points along the line
+// only ever move forward, so once it has crossed p it stays on p's far side,
+// and until it crosses q it stays on q's near side. So q can only follow p if
+// part of q is beyond p and part of p is short of q. Points on the lines
+// count, since walks can pass through corners.
+static bool portal_may_follow(const portal& p, const portal& q)
+{
+	return (side_of_edge(p.e0, p.e1, q.e0) >= 0 || side_of_edge(p.e0, p.e1, q.e1) >= 0) &&
+		(side_of_edge(q.e0, q.e1, p.e0) <= 0 || side_of_edge(q.e0, q.e1, p.e1) <= 0);
+}
+
+enum /* visibility states */
+{
+	_visibility_unbuilt,
+	_visibility_built,
+	_visibility_unavailable	// too big, or geometry the argument above doesn't hold for
+};
+
+static short visibility_state = _visibility_unbuilt;
+static int visibility_polygon_count;
+static int visibility_row_words;
+
+// for each polygon, the polygons a walk starting in it could end in, and
+// those plus every polygon sharing an endpoint with one of them (which
+// line_is_obstructed() accepts too)
+static std::vector<uint64_t> reachable_bits;
+static std::vector<uint64_t> touching_bits;
+
+// corners of every polygon, MAXIMUM_VERTICES_PER_POLYGON apiece
+static std::vector<world_point2d> polygon_corners;
+static std::vector<short> polygon_corner_counts;
+static world_point2d bounds_min, bounds_max;
+
+static void set_bit(uint64_t *row, int index)
+{
+	row[index >> 6] |= uint64_t(1) << (index & 63);
+}
+
+static bool test_bit(const uint64_t *row, int index)
+{
+	return (row[index >> 6] >> (index & 63)) & 1;
+}
+
+static bool line_joins(const line_data *line, short endpoint0, short endpoint1)
+{
+	return (line->endpoint_indexes[0] == endpoint0 && line->endpoint_indexes[1] == endpoint1) ||
+		(line->endpoint_indexes[0] == endpoint1 && line->endpoint_indexes[1] == endpoint0);
+}
+
+static bool polygon_has_edge(short polygon_index, short line_index, short endpoint0, short endpoint1)
+{
+	polygon_data *polygon = get_polygon_data(polygon_index);
+	for (short i = 0; i < polygon->vertex_count; ++i)
+	{
+		if (polygon->line_indexes[i] != line_index) continue;
+
+		short next = polygon->endpoint_indexes[i == polygon->vertex_count - 1 ? 0 : i + 1];
+		return (polygon->endpoint_indexes[i] == endpoint1 && next == endpoint0);
+	}
+	return false;
+}
+
+static void build_polygon_visibility(
+	void)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	visibility_state = _visibility_unavailable;
+	reachable_bits.clear();
+	touching_bits.clear();
+
+	int polygon_count = dynamic_world->polygon_count;
+	int endpoint_count = dynamic_world->endpoint_count;
+	if (polygon_count <= 0 || polygon_count > kMaximumVisibilityPolygons) return;
+
+	// the walks multiply coordinate differences in 32 bits; nothing below
+	// holds if those could overflow
+	int32 min_x = INT16_MAX, min_y = INT16_MAX, max_x = INT16_MIN, max_y = INT16_MIN;
+	for (short endpoint_index = 0; endpoint_index < endpoint_count; ++endpoint_index)
+	{
+		world_point2d& vertex = get_endpoint_data(endpoint_index)->vertex;
+		min_x = std::min<int32>(min_x, vertex.x);
+		min_y = std::min<int32>(min_y, vertex.y);
+		max_x = std::max<int32>(max_x, vertex.x);
+		max_y = std::max<int32>(max_y, vertex.y);
+	}
+	if (max_x - min_x > INT16_MAX || max_y - min_y > INT16_MAX) return;
+	bounds_min.x = min_x, bounds_min.y = min_y;
+	bounds_max.x = max_x, bounds_max.y = max_y;
+
+	// every edge has to be a convex polygon's, with the polygon on the far
+	// side (if any) sharing it exactly; that's what lets a walk be treated as
+	// a straight line. Pfhorte-era maps with mismatched lines just walk.
+	polygon_corners.assign(size_t(polygon_count)*MAXIMUM_VERTICES_PER_POLYGON, world_point2d());
+	polygon_corner_counts.assign(polygon_count, 0);
+	std::vector<short> corner_endpoints(size_t(polygon_count)*MAXIMUM_VERTICES_PER_POLYGON, NONE);
+	std::vector<portal> portals;
+	std::vector<int> first_portal(polygon_count + 1);
+	for (short polygon_index = 0; polygon_index < polygon_count; ++polygon_index)
+	{
+		polygon_data *polygon = get_polygon_data(polygon_index);
+		short vertex_count = polygon->vertex_count;
+		if (vertex_count < 3 || vertex_count > MAXIMUM_VERTICES_PER_POLYGON) return;
+
+		world_point2d *corners = &polygon_corners[size_t(polygon_index)*MAXIMUM_VERTICES_PER_POLYGON];
+		for (short i = 0; i < vertex_count; ++i)
+		{
+			short endpoint_index = polygon->endpoint_indexes[i];
+			if (endpoint_index < 0 || endpoint_index >= endpoint_count) return;
+			corners[i] = get_endpoint_data(endpoint_index)->vertex;
+			corner_endpoints[size_t(polygon_index)*MAXIMUM_VERTICES_PER_POLYGON + i] = endpoint_index;
+		}
+		polygon_corner_counts[polygon_index] = vertex_count;
+
+		first_portal[polygon_index] = static_cast<int>(portals.size());
+		for (short i = 0; i < vertex_count; ++i)
+		{
+			short next = i == vertex_count - 1 ? 0 : i + 1;
+			portal edge;
+			edge.e0 = corners[i];
+			edge.e1 = corners[next];
+			edge.from = polygon_index;
+
+			for (short j = 0; j < vertex_count; ++j)
+			{
+				if (side_of_edge(edge.e0, edge.e1, corners[j]) > 0) return;
+			}
+
+			short line_index = polygon->line_indexes[i];
+			if (line_index < 0 || line_index >= dynamic_world->line_count) return;
+			line_data *line = get_line_data(line_index);
+			if (!line_joins(line, polygon->endpoint_indexes[i], polygon->endpoint_indexes[next])) return;
+
+			if (line->clockwise_polygon_owner == polygon_index) edge.to = line->counterclockwise_polygon_owner;
+			else if (line->counterclockwise_polygon_owner == polygon_index) edge.to = line->clockwise_polygon_owner;
+			else return;
+
+			if (edge.to == NONE) continue;
+			if (edge.to < 0 || edge.to >= polygon_count || edge.to == polygon_index) return;
+			if (!polygon_has_edge(edge.to, line_index, polygon->endpoint_indexes[i], polygon->endpoint_indexes[next])) return;
+
+			portals.push_back(edge);
+		}
+	}
+	first_portal[polygon_count] = static_cast<int>(portals.size());
+
+	// which polygons share each endpoint
+	std::vector<int> first_owner(endpoint_count + 1, 0);
+	for (auto endpoint_index : corner_endpoints)
+	{
+		if (endpoint_index != NONE) ++first_owner[endpoint_index + 1];
+	}
+	for (int i = 0; i < endpoint_count; ++i) first_owner[i + 1] += first_owner[i];
+	std::vector<short> owners(first_owner[endpoint_count]);
+	{
+		std::vector<int> next_owner(first_owner.begin(), first_owner.end() - 1);
+		for (size_t corner = 0; corner < corner_endpoints.size(); ++corner)
+		{
+			short endpoint_index = corner_endpoints[corner];
+			if (endpoint_index != NONE) owners[next_owner[endpoint_index]++] = static_cast<short>(corner / MAXIMUM_VERTICES_PER_POLYGON);
+		}
+	}
+
+	int row_words = (polygon_count + 63) / 64;
+	reachable_bits.assign(size_t(polygon_count)*row_words, 0);
+	touching_bits.assign(size_t(polygon_count)*row_words, 0);
+
+	// every row is independent of the others; each one floods out through
+	// the portals leaving its polygon, only ever going on through portals
+	// that may follow the first one
+	WorkerPool::instance()->ParallelFor(0, polygon_count, [&](int first, int last) {
+		std::vector<uint32> portal_visited(portals.size(), 0);
+		std::vector<uint32> endpoint_visited(endpoint_count, 0);
+		std::vector<int> stack;
+		uint32 flood = 0;
+
+		for (int polygon_index = first; polygon_index < last; ++polygon_index)
+		{
+			uint64_t *reachable = &reachable_bits[size_t(polygon_index)*row_words];
+			set_bit(reachable, polygon_index);
+
+			for (int p = first_portal[polygon_index]; p < first_portal[polygon_index + 1]; ++p)
+			{
+				++flood;
+				set_bit(reachable, portals[p].to);
+				stack.push_back(p);
+				while (!stack.empty())
+				{
+					short polygon_entered = portals[stack.back()].to;
+					stack.pop_back();
+					for (int q = first_portal[polygon_entered]; q < first_portal[polygon_entered + 1]; ++q)
+					{
+						if (portal_visited[q] == flood || !portal_may_follow(portals[p], portals[q])) continue;
+						portal_visited[q] = flood;
+						set_bit(reachable, portals[q].to);
+						stack.push_back(q);
+					}
+				}
+			}
+
+			uint64_t *touching = &touching_bits[size_t(polygon_index)*row_words];
+			for (int word = 0; word < row_words; ++word) touching[word] = reachable[word];
+			for (int ended = 0; ended < polygon_count; ++ended)
+			{
+				if (!test_bit(reachable, ended)) continue;
+				for (short i = 0; i < polygon_corner_counts[ended]; ++i)
+				{
+					short endpoint_index = corner_endpoints[size_t(ended)*MAXIMUM_VERTICES_PER_POLYGON + i];
+					if (endpoint_visited[endpoint_index] == uint32(polygon_index + 1)) continue;
+					endpoint_visited[endpoint_index] = polygon_index + 1;
+					for (int owner = first_owner[endpoint_index]; owner < first_owner[endpoint_index + 1]; ++owner)
+						set_bit(touching, owners[owner]);
+				}
+			}
+		}
+	}, 16);
+
+	visibility_polygon_count = polygon_count;
+	visibility_row_words = row_words;
+	visibility_state = _visibility_built;
+
+	logNote("polygon visibility: %d polygons, %d portals, %.1f ms", polygon_count, static_cast<int>(portals.size()),
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+static bool point_in_bounds(const world_point2d *p)
+{
+	return p->x >= bounds_min.x && p->x <= bounds_max.x && p->y >= bounds_min.y && p->y <= bounds_max.y;
+}
+
+static bool point_in_corners(short polygon_index, const world_point2d *p)
+{
+	const world_point2d *corners = &polygon_corners[size_t(polygon_index)*MAXIMUM_VERTICES_PER_POLYGON];
+	short vertex_count = polygon_corner_counts[polygon_index];
+	for (short i = 0; i < vertex_count; ++i)
+	{
+		if (side_of_edge(corners[i], corners[i == vertex_count - 1 ? 0 : i + 1], *p) > 0) return false;
+	}
+	return true;
+}
+
+// false only if no walk of this type could possibly answer true
+static bool polygon_may_see(
+	short type,
+	short polygon_index1,
+	world_point2d *p1,
+	short polygon_index2,
+	world_point2d *p2)
+{
+	// the old line_is_obstructed() stops short in ways of its own
+	if (type == _solid_lines_obstruct && !film_profile.line_is_obstructed_fix) return true;
+
+	if (visibility_state == _visibility_unbuilt) build_polygon_visibility();
+	if (visibility_state != _visibility_built) return true;
+
+	if (polygon_index1 < 0 || polygon_index1 >= visibility_polygon_count ||
+		polygon_index2 < 0 || polygon_index2 >= visibility_polygon_count)
+	{
+		return true;
+	}
+
+	// out of bounds, the 32-bit products can overflow; and the walk only
+	// moves forward along the line if it starts inside its polygon
+	if (!point_in_bounds(p1) || !point_in_bounds(p2) || !point_in_corners(polygon_index1, p1)) return true;
+
+	const std::vector<uint64_t>& bits = type == _solid_lines_obstruct ? touching_bits : reachable_bits;
+	return test_bit(&bits[size_t(polygon_index1)*visibility_row_words], polygon_index2);
+}
+
+void invalidate_polygon_visibility(
+	void)
+{
+	visibility_state = _visibility_unbuilt;
+	std::vector<uint64_t>().swap(reachable_bits);
+	std::vector<uint64_t>().swap(touching_bits);
+	std::vector<world_point2d>().swap(polygon_corners);
+	std::vector<short>().swap(polygon_corner_counts);
+
+	reset_line_of_sight_memo();
+}
+
+/* ---------- the memo */
+
+struct memo_entry
+{
+	uint64_t question[2];
+	uint32 stamp;	// entries from before the last reset don't count
+	bool visible;
+};
+
+static memo_entry memo[kMemoSize];
+static uint32 memo_stamp = 1;
+
+// off while benchmarking the plain walks
+static bool line_of_sight_caching = true;
+
+static struct
+{
+	uint32 questions;
+	uint32 remembered;
+	uint32 ruled_out;
+	uint32 walked;
+} line_of_sight_counts;
+
+void reset_line_of_sight_memo(
+	void)
+{
+	if (++memo_stamp == 0)
+	{
+		for (auto& entry : memo) entry.stamp = 0;
+		memo_stamp = 1;
+	}
+}
+
+bool test_line_of_sight(
+	short type,
+	short polygon_index1,
+	world_point2d *p1,
+	short polygon_index2,
+	world_point2d *p2,
+	line_of_sight_walk walk)
+{
+	if (!line_of_sight_caching) return walk(polygon_index1, p1, polygon_index2, p2);
+
+	++line_of_sight_counts.questions;
+
+	// everything the answer depends on that can change within a tick
+	uint64_t question[2];
+	question[0] = (uint64_t(uint16(polygon_index1)) << 48) | (uint64_t(uint16(polygon_index2)) << 32) |
+		(uint64_t(uint16(p1->x)) << 16) | uint16(p1->y);
+	question[1] = (uint64_t(uint16(p2->x)) << 32) | (uint64_t(uint16(p2->y)) << 16) | uint16(type);
+
+	uint64_t hash = (question[0]*UINT64_C(0x9e3779b97f4a7c15) ^ question[1])*UINT64_C(0xc2b2ae3d27d4eb4f);
+	int slot = static_cast<int>(hash >> 52) & (kMemoSize - 1);
+
+	memo_entry *free_entry = NULL;
+	for (int probe = 0; probe < kMemoProbes; ++probe)
+	{
+		memo_entry *entry = &memo[(slot + probe) & (kMemoSize - 1)];
+		if (entry->stamp != memo_stamp)
+		{
+			if (!free_entry) free_entry = entry;
+		}
+		else if (entry->question[0] == question[0] && entry->question[1] == question[1])
+		{
+			++line_of_sight_counts.remembered;
+			return entry->visible;
+		}
+	}
+
+	bool visible;
+	if (!polygon_may_see(type, polygon_index1, p1, polygon_index2, p2))
+	{
+		++line_of_sight_counts.ruled_out;
+		visible = false;
+	}
+	else
+	{
+		++line_of_sight_counts.walked;
+		visible = walk(polygon_index1, p1, polygon_index2, p2);
+	}
+
+	if (!free_entry) free_entry = &memo[slot];
+	free_entry->question[0] = question[0];
+	free_entry->question[1] = question[1];
+	free_entry->stamp = memo_stamp;
+	free_entry->visible = visible;
+
+	return visible;
+}
+
+/* ---------- benchmark */
+
+// map.cpp's walk, reached through line_is_obstructed() with the memo off so
+// that each question is remembered (and counted) only by the outer call
+static bool line_is_clear(short polygon_index1, world_point2d *p1, short polygon_index2, world_point2d *p2)
+{
+	bool caching = line_of_sight_caching;
+	line_of_sight_caching = false;
+	bool clear = !line_is_obstructed(polygon_index1, p1, polygon_index2, p2);
+	line_of_sight_caching = caching;
+	return clear;
+}
+
+static void benchmark_line_of_sight(const std::string& arg)
+{
+	if (get_game_state() != _game_in_progress)
+	{
+		screen_printf("Start a level to benchmark line of sight");
+		return;
+	}
+
+	int passes = arg.empty() ? 10 : std::max(1, atoi(arg.c_str()));
+
+	// every monster (players included) looking at every other, which is
+	// about what a tick of hunting for targets comes to at worst
+	std::vector<short> polygons;
+	std::vector<world_point2d> locations;
+	for (auto& object : ObjectList)
+	{
+		if (!SLOT_IS_USED(&object) || GET_OBJECT_OWNER(&object) != _object_is_monster) continue;
+		polygons.push_back(object.polygon);
+		locations.push_back(*(world_point2d *)&object.location);
+		if (polygons.size() == 256) break;
+	}
+
+	size_t count = polygons.size();
+	if (count < 2)
+	{
+		screen_printf("Not enough monsters here to benchmark line of sight");
+		return;
+	}
+
+	std::vector<bool> expected(count*count);
+	auto ask_all = [&](bool check) {
+		int mismatches = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			for (size_t j = 0; j < count; ++j)
+			{
+				bool visible = test_line_of_sight(_solid_lines_obstruct, polygons[i], &locations[i], polygons[j], &locations[j], line_is_clear);
+				if (!check) expected[i*count + j] = visible;
+				else if (expected[i*count + j] != visible) ++mismatches;
+			}
+		}
+		return mismatches;
+	};
+
+	// build the visibility bits ahead of timing anything
+	polygon_may_see(_solid_lines_obstruct, polygons[0], &locations[0], polygons[1], &locations[1]);
+
+	line_of_sight_caching = false;
+	auto start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < passes; ++pass) ask_all(pass > 0);
+	double walk_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	line_of_sight_caching = true;
+
+	// a fresh tick every pass, then the same questions asked over and over
+	obj_clear(line_of_sight_counts);
+	int mismatches = 0;
+	start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < passes; ++pass)
+	{
+		reset_line_of_sight_memo();
+		mismatches += ask_all(true);
+	}
+	double fresh_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	auto fresh_counts = line_of_sight_counts;
+
+	start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < passes; ++pass) mismatches += ask_all(true);
+	double again_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	reset_line_of_sight_memo();
+
+	double questions = double(passes)*count*count;
+	screen_printf("line of sight: walk %.3f us, first ask %.3f us, asked again %.3f us",
+		walk_us/questions, fresh_us/questions, again_us/questions);
+	screen_printf("%.1f%% ruled out without walking, %d mismatches",
+		100.0*fresh_counts.ruled_out/std::max<uint32>(1, fresh_counts.questions), mismatches);
+	logNote("line of sight benchmark: %d monsters, %d passes; per question: walk %.3f us, first ask %.3f us (%.1f%% ruled out, %.1f%% remembered), asked again %.3f us; %d mismatches",
+		static_cast<int>(count), passes, walk_us/questions, fresh_us/questions,
+		100.0*fresh_counts.ruled_out/std::max<uint32>(1, fresh_counts.questions),
+		100.0*fresh_counts.remembered/std::max<uint32>(1, fresh_counts.questions),
+		again_us/questions, mismatches);
+	if (mismatches)
+		logWarning("line of sight: %d answers differ from the plain walk", mismatches);
+}
+
+void register_line_of_sight_benchmark(
+	void)
+{
+	Console::instance()->register_benchmark("lineofsight", benchmark_line_of_sight);
+}
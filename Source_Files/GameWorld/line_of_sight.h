@@ -0,0 +1,57 @@
+#ifndef LINE_OF_SIGHT_H
+#define LINE_OF_SIGHT_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Sharing the polygon walks behind line_is_obstructed() and the monsters'
+	line of sight: which polygons could possibly see each other, and what
+	the walks already found out this tick
+*/
+
+#include "world.h"
+
+enum /* line of sight walks */
+{
+	_solid_lines_obstruct,	// line_is_obstructed()
+	_opaque_lines_obstruct,	// monsters looking for targets
+	NUMBER_OF_LINE_OF_SIGHT_WALKS
+};
+
+// Walks from p1 in polygon_index1 toward p2 in polygon_index2 and returns
+// true if nothing is in the way
+typedef bool (*line_of_sight_walk)(short polygon_index1, world_point2d *p1,
+	short polygon_index2, world_point2d *p2);
+
+// Gives the same answer as walk() would, but skips the walk if the same
+// question has been asked since the last reset, or if polygon_index2 can't be
+// seen from anywhere in polygon_index1
+bool test_line_of_sight(short type, short polygon_index1, world_point2d *p1,
+	short polygon_index2, world_point2d *p2, line_of_sight_walk walk);
+
+// Every tick, and whenever lines change solidity or transparency, the
+// answers so far go stale
+void reset_line_of_sight_memo(void);
+
+// A new map; which polygons can see each other is worked out again when
+// it's next needed
+void invalidate_polygon_visibility(void);
+
+// ".benchmark lineofsight [passes]"
+void register_line_of_sight_benchmark(void);
+
+#endif
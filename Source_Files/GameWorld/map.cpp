@@ -118,6 +118,9 @@ find_line_crossed leaving polygon could be sped up considerable by reversing the
 #include "Console.h"
 #include "InfoTree.h"
 #include "flood_map.h"
+#include "activation_flood.h"
+#include "interpolated_world.h"
+#include "line_of_sight.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -276,7 +279,9 @@ polygon_data *get_polygon_data(
 	const short polygon_index)
 {
 	assert(map_polygons);	
-	struct polygon_data *polygon = GetMemberWithBounds(map_polygons,polygon_index,dynamic_world->polygon_count);
+	struct polygon_data *polygon = render_world ?
+		GetMemberWithBounds(render_world->polygon_list.data(),polygon_index,render_world->polygon_list.size()) :
+		GetMemberWithBounds(map_polygons,polygon_index,dynamic_world->polygon_count);
 	
 	vassert(polygon, csprintf(temporary, "polygon index #%d is out of range", polygon_index));
 	
@@ -287,7 +292,9 @@ line_data *get_line_data(
 	const short line_index)
 {
 	assert(map_lines);
-	struct line_data *line = GetMemberWithBounds(map_lines,line_index,dynamic_world->line_count);
+	struct line_data *line = render_world ?
+		GetMemberWithBounds(render_world->line_list.data(),line_index,render_world->line_list.size()) :
+		GetMemberWithBounds(map_lines,line_index,dynamic_world->line_count);
 	
 	vassert(line, csprintf(temporary, "line index #%d is out of range", line_index));
 	
@@ -298,7 +305,9 @@ side_data *get_side_data(
 	const short side_index)
 {
 	assert(map_sides);
-	struct side_data *side = GetMemberWithBounds(map_sides,side_index,dynamic_world->side_count);
+	struct side_data *side = render_world ?
+		GetMemberWithBounds(render_world->side_list.data(),side_index,render_world->side_list.size()) :
+		GetMemberWithBounds(map_sides,side_index,dynamic_world->side_count);
 	
 	vassert(side, csprintf(temporary, "side index #%d is out of range", side_index));
 	
@@ -309,7 +318,9 @@ endpoint_data *get_endpoint_data(
 	const short endpoint_index)
 {
 	assert(map_endpoints);
-	struct endpoint_data *endpoint = GetMemberWithBounds(map_endpoints,endpoint_index,dynamic_world->endpoint_count);
+	struct endpoint_data *endpoint = render_world ?
+		GetMemberWithBounds(render_world->endpoint_list.data(),endpoint_index,render_world->endpoint_list.size()) :
+		GetMemberWithBounds(map_endpoints,endpoint_index,dynamic_world->endpoint_count);
 
 	vassert(endpoint, csprintf(temporary, "endpoint index #%d is out of range", endpoint_index));
 	
@@ -413,6 +424,8 @@ void initialize_map_for_new_level(
 
 	obj_clear(*static_world);
 	Console::instance()->clear_saves();
+	invalidate_polygon_visibility();
+	invalidate_activation_floods();
 	
 	// Clear all these out -- supposed to be none of the contents of these when starting a level.
 	objlist_clear(automap_lines, AutomapLineList.size());
@@ -627,6 +640,23 @@ void mark_environment_collections(
 			mark_collection_for_unloading(_collection_landscape1+static_world->song_index);
 }
 
+/* the collections mark_environment_collections() would load for each environment code, not */
+/*  counting the landscape; for picking collections to prefetch, without marking anything */
+void get_environment_collections(
+	std::vector<std::vector<short> >& collections)
+{
+	collections.resize(NUMBER_OF_ENVIRONMENTS);
+	for (int environment_code= 0; environment_code<NUMBER_OF_ENVIRONMENTS; ++environment_code)
+	{
+		collections[environment_code].clear();
+		for (int i= 0; i<NUMBER_OF_ENV_COLLECTIONS; ++i)
+		{
+			if (Environments[environment_code][i] != NONE)
+				collections[environment_code].push_back(Environments[environment_code][i]);
+		}
+	}
+}
+
 /* make the object list and the map consistent */
 void reconnect_map_object_list(
 	void)
@@ -2202,7 +2232,7 @@ bool point_is_monster_visible(
 	return *distance!=INT32_MAX;
 }
 
-bool line_is_obstructed(
+static bool line_is_clear(
 	short polygon_index1,
 	world_point2d *p1,
 	short polygon_index2,
@@ -2275,7 +2305,16 @@ bool line_is_obstructed(
 	}
 	while (!obstructed&&line_index!=NONE);
 
-	return obstructed;
+	return !obstructed;
+}
+
+bool line_is_obstructed(
+	short polygon_index1,
+	world_point2d *p1,
+	short polygon_index2,
+	world_point2d *p2)
+{
+	return !test_line_of_sight(_solid_lines_obstruct, polygon_index1, p1, polygon_index2, p2, line_is_clear);
 }
 
 #define MAXIMUM_GARBAGE_OBJECTS_PER_MAP 256
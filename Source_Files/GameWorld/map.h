@@ -1101,6 +1101,14 @@ std::pair<bool, int16> update_world(void);
 void reset_intermediate_action_queues();
 void set_prediction_wanted(bool inPrediction);
 
+// whether the tick being run is a predicted one, which will be rolled back
+bool world_is_predicting();
+
+// runs ticks of the world on empty flags, the way predicted ticks are run,
+// then puts it back; microseconds per tick, calculating the world hash after
+// each if asked, or less than zero if a Lua script rules it out
+double time_world_ticks(int ticks, bool hash_each_tick);
+
 /* Called to activate lights, platforms, etc. (original polygon may be NONE) */
 void changed_polygon(short original_polygon_index, short new_polygon_index, short player_index);
 
@@ -1118,6 +1126,7 @@ void initialize_map_for_new_level(void);
 void mark_environment_collections(short environment_code, bool loading);
 void mark_map_collections(bool loading);
 bool collection_in_environment(short collection_code, short environment_code);
+void get_environment_collections(std::vector<std::vector<short> >& collections);
 
 bool valid_point2d(world_point2d *p);
 bool valid_point3d(world_point3d *p);
@@ -1393,6 +1402,8 @@ void set_to_default_map(void);
 /* Otherwise it returns false, meaning that we need have the file sent to us. */
 bool use_map_file(uint32 checksum);
 bool load_level_from_map(short level_index);
+void start_level_prefetch(void);
+void cancel_level_prefetch(void);
 uint32 get_current_map_checksum(void);
 bool select_map_to_use(void);
 
@@ -55,6 +55,7 @@ const bool DoIncorrectCountVWarn = true;
 #include "flood_map.h"
 #include "platforms.h"
 #include "Packing.h"
+#include "WorkerPool.h"
 
 #include <limits.h>
 #include <vector>
@@ -114,7 +115,9 @@ static void find_intersecting_endpoints_and_lines(short polygon_index, world_dis
 static int32 intersecting_flood_proc(short source_polygon_index, short line_index,
 	short destination_polygon_index, void *data);
 
-static void precalculate_polygon_sound_sources(void);
+static void precalculate_polygon_exclusion_zones(void);
+static void find_polygon_sound_sources(short polygon_index, vector<short>& sound_sources);
+static void add_polygon_sound_sources(const vector<vector<short> >& sound_sources);
 
 /* ---------- code */
 
@@ -611,6 +614,30 @@ static int32 calculate_polygon_area(
 
 void precalculate_map_indexes(
 	void)
+{
+	vector<vector<short> > sound_sources(dynamic_world->polygon_count);
+
+	// sound sources don't depend on exclusion zones or neighbors, so the other
+	// cores can find them while this one floods; the map indexes themselves
+	// still have to be added in the original order
+	WorkerPool* pool = WorkerPool::instance();
+	pool->Run({
+		precalculate_polygon_exclusion_zones,
+		[pool, &sound_sources]() {
+			pool->ParallelFor(0, dynamic_world->polygon_count, [&sound_sources](int first, int last) {
+				for (int polygon_index = first; polygon_index < last; ++polygon_index)
+				{
+					find_polygon_sound_sources(polygon_index, sound_sources[polygon_index]);
+				}
+			});
+		}
+	});
+
+	add_polygon_sound_sources(sound_sources);
+}
+
+static void precalculate_polygon_exclusion_zones(
+	void)
 {
 	short polygon_index = 0;
 	struct polygon_data *polygon = map_polygons;
@@ -660,8 +687,6 @@ void precalculate_map_indexes(
 			}
 		}
 	}
-
-	precalculate_polygon_sound_sources();
 }
 
 static void find_intersecting_endpoints_and_lines(
@@ -1133,47 +1158,57 @@ static void add_map_index(
 
 #define ZERO_VOLUME_DISTANCE (10*WORLD_ONE)
 
-static void precalculate_polygon_sound_sources(
-	void)
+static void find_polygon_sound_sources(
+	short polygon_index,
+	vector<short>& sound_sources)
 {
-	short polygon_index;
-	struct polygon_data *polygon;
+	struct polygon_data *polygon= get_polygon_data(polygon_index);
+	short object_index;
+	struct map_object *object;
 	
-	for (polygon_index= 0, polygon= map_polygons; polygon_index<dynamic_world->polygon_count; ++polygon_index, ++polygon)
+	for (object_index= 0, object= saved_objects; object_index<dynamic_world->initial_objects_count; ++object, ++object_index)
 	{
-		short object_index;
-		struct map_object *object;
-		short sound_sources= 0;
-		
-		polygon->sound_source_indexes= dynamic_world->map_index_count;
-		
-		for (object_index= 0, object= saved_objects; object_index<dynamic_world->initial_objects_count; ++object, ++object_index)
+		if (object->type==_saved_sound_source)
 		{
-			if (object->type==_saved_sound_source)
+			short i;
+			bool close= false;
+			
+			for (i= 0; i<polygon->vertex_count; ++i)
 			{
-				short i;
-				bool close= false;
+				struct endpoint_data *endpoint= get_endpoint_data(polygon->endpoint_indexes[i]);
+				struct line_data *line= get_line_data(polygon->line_indexes[i]);
 				
-				for (i= 0; i<polygon->vertex_count; ++i)
+				if (guess_distance2d((world_point2d *)&object->location, &endpoint->vertex)<ZERO_VOLUME_DISTANCE ||
+					point_to_line_segment_distance_squared((world_point2d *)&object->location,
+						&get_endpoint_data(line->endpoint_indexes[0])->vertex,
+						&get_endpoint_data(line->endpoint_indexes[1])->vertex)<ZERO_VOLUME_DISTANCE)
 				{
-					struct endpoint_data *endpoint= get_endpoint_data(polygon->endpoint_indexes[i]);
-					struct line_data *line= get_line_data(polygon->line_indexes[i]);
-					
-					if (guess_distance2d((world_point2d *)&object->location, &endpoint->vertex)<ZERO_VOLUME_DISTANCE ||
-						point_to_line_segment_distance_squared((world_point2d *)&object->location,
-							&get_endpoint_data(line->endpoint_indexes[0])->vertex,
-							&get_endpoint_data(line->endpoint_indexes[1])->vertex)<ZERO_VOLUME_DISTANCE)
-					{
-						close= true;
-						break;
-					}
+					close= true;
+					break;
 				}
-				
-				if (close) add_map_index(object_index, &sound_sources);
 			}
+			
+			if (close) sound_sources.push_back(object_index);
 		}
+	}
+}
+
+static void add_polygon_sound_sources(
+	const vector<vector<short> >& sound_sources)
+{
+	short polygon_index;
+	struct polygon_data *polygon;
+	
+	for (polygon_index= 0, polygon= map_polygons; polygon_index<dynamic_world->polygon_count; ++polygon_index, ++polygon)
+	{
+		short count= 0;
 		
-		add_map_index(NONE, &sound_sources);
+		polygon->sound_source_indexes= dynamic_world->map_index_count;
+		for (short object_index : sound_sources[polygon_index])
+		{
+			add_map_index(object_index, &count);
+		}
+		add_map_index(NONE, &count);
 	}
 }
 
@@ -80,6 +80,8 @@ Feb 8, 2003 (Woody Zenfell):
 #include "interface.h"
 #include "FilmProfile.h"
 #include "flood_map.h"
+#include "activation_flood.h"
+#include "line_of_sight.h"
 #include "effects.h"
 #include "monsters.h"
 #include "projectiles.h"
@@ -93,6 +95,7 @@ Feb 8, 2003 (Woody Zenfell):
 #include "fades.h"
 #include "items.h"
 #include "weapons.h"
+#include "computer_interface.h"
 #include "game_window.h"
 #include "SoundManager.h"
 #include "network_games.h"
@@ -121,11 +124,15 @@ Feb 8, 2003 (Woody Zenfell):
 
 #include "motion_sensor.h"
 
+#include <chrono>
 #include <limits.h>
 #include <thread>
 
 #include "ephemera.h"
 #include "interpolated_world.h"
+#include "world_snapshot.h"
+#include "world_hash.h"
+#include "tick_events.h"
 
 /* ---------- constants */
 
@@ -145,6 +152,7 @@ static uint32	sMostRecentFlagsForPlayer[MAXIMUM_NUMBER_OF_PLAYERS];
 static void game_timed_out(void);
 
 static void load_all_game_sounds(short environment_code);
+static void register_rollback_command();
 
 /* ---------- code */
 
@@ -172,6 +180,12 @@ void initialize_marathon(
 	OGL_Initialize();
 #endif
 	GameQueue = new ModifiableActionQueues(MAXIMUM_NUMBER_OF_PLAYERS, ACTION_QUEUE_BUFFER_DIAMETER, true);
+	register_rollback_command();
+	WorldSnapshot::RegisterBenchmark();
+	register_world_hash_benchmark();
+	register_flood_map_benchmark();
+	register_line_of_sight_benchmark();
+	register_activation_flood_benchmark();
 }
 
 static size_t sPredictedTicks = 0;
@@ -208,6 +222,53 @@ static short sSavedPlayerObjectNextObject[MAXIMUM_NUMBER_OF_PLAYERS];
 static int32 sSavedTickCount;
 static uint16 sSavedRandomSeed;
 
+// Rollback prediction: instead of moving just the players, every subsystem
+// runs on the predicted ticks, and the whole world is put back from a
+// snapshot of the last confirmed tick when the real flags come in.
+static bool sRollbackWanted = true;
+
+// whether the prediction under way saved the whole world
+static bool sRollingBack = false;
+static WorldSnapshot sRollbackSnapshot;
+
+// whether the tick being run is a predicted one
+static bool sPredictingTick = false;
+
+// for .rollback
+static uint32 sRollbackSaves = 0;
+static uint32 sRollbackRestores = 0;
+static uint32 sRollbackPredictedTicks = 0;
+static double sRollbackSaveTime = 0;
+static double sRollbackRestoreTime = 0;
+
+bool world_is_predicting()
+{
+	return sPredictingTick;
+}
+
+static double elapsed_microseconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Call before running a tick, predicted or real
+static void begin_tick(bool predicted)
+{
+	sPredictingTick = predicted;
+
+	// sounds and fades from ticks that will be rolled back are remembered, so
+	// running the tick again only plays what the earlier runs didn't; the
+	// player-only prediction plays everything, as it always has
+	if(!predicted || sRollingBack)
+		world_tick_events().BeginTick(dynamic_world->tick_count, predicted);
+}
+
+static void end_tick()
+{
+	world_tick_events().EndTick();
+	sPredictingTick = false;
+}
+
 
 // ZZZ: If not already in predictive mode, save off partial game-state for later restoration.
 static void
@@ -215,7 +276,17 @@ enter_predictive_mode()
 {
 	if(sPredictedTicks == 0)
 	{
-		for(short i = 0; i < dynamic_world->player_count; i++)
+		// Lua scripts keep state of their own that a snapshot can't see, and
+		// their hooks would run again on every predicted tick
+		sRollingBack = sRollbackWanted && !LuaRunning();
+		if(sRollingBack)
+		{
+			auto start = std::chrono::steady_clock::now();
+			sRollbackSnapshot.Save();
+			sRollbackSaveTime += elapsed_microseconds(start);
+			sRollbackSaves++;
+		}
+		else for(short i = 0; i < dynamic_world->player_count; i++)
 		{
 			sSavedPlayerData[i] = *get_player_data(i);
 			if(sSavedPlayerData[i].monster_index != NONE)
@@ -281,7 +352,37 @@ compare_memory(const char* inChunk1, const char* inChunk2, size_t inSize, size_t
 static void
 exit_predictive_mode()
 {
-	if(sPredictedTicks > 0)
+	if(sPredictedTicks > 0 && sRollingBack)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		// see below for why these are kept
+		int16 saved_interface_flags[MAXIMUM_NUMBER_OF_PLAYERS];
+		int16 saved_interface_decay[MAXIMUM_NUMBER_OF_PLAYERS];
+		for(short i = 0; i < dynamic_world->player_count; i++)
+		{
+			saved_interface_flags[i] = get_player_data(i)->interface_flags;
+			saved_interface_decay[i] = get_player_data(i)->interface_decay;
+		}
+
+		sRollbackSnapshot.Restore();
+
+		for(short i = 0; i < dynamic_world->player_count; i++)
+		{
+			get_player_data(i)->interface_flags = saved_interface_flags[i];
+			get_player_data(i)->interface_decay = saved_interface_decay[i];
+		}
+
+		sRollbackRestoreTime += elapsed_microseconds(start);
+		sRollbackRestores++;
+		sRollbackPredictedTicks += sPredictedTicks;
+		sRollingBack = false;
+		sPredictedTicks = 0;
+
+		if(sSavedTickCount != dynamic_world->tick_count)
+			logWarning("saved tick count %d != dynamic_world->tick_count %d", sSavedTickCount, dynamic_world->tick_count);
+	}
+	else if(sPredictedTicks > 0)
 	{
 		for(short i = 0; i < dynamic_world->player_count; i++)
 		{
@@ -401,6 +502,8 @@ update_world_elements_one_tick(bool& call_postidle)
 	} 
 	else
 	{
+		reset_line_of_sight_memo();
+		
 		decode_hotkeys(*GameQueue);
 		L_Call_Idle();
 		call_postidle = true;
@@ -456,6 +559,52 @@ update_world_elements_one_tick(bool& call_postidle)
         return kUpdateNormalCompletion;
 }
 
+// Runs a predicted tick of everything that follows from the players' flags.
+// Lua is never running here (see enter_predictive_mode()); item respawning,
+// random sounds, ephemera and the purely cosmetic updates wait for the real
+// tick, since item placement keeps a timer of its own outside the world
+static void
+predict_world_elements_one_tick(ActionQueues* inPredictiveQueues)
+{
+	reset_line_of_sight_memo();
+
+	update_lights();
+	update_medias();
+	update_platforms();
+
+	update_control_panels(); // don't put after update_players
+
+	// update_players() dequeues the flags, and only moves players when
+	// predicting, so the weapons are done here
+	uint32 theFlags[MAXIMUM_NUMBER_OF_PLAYERS];
+	for(short i = 0; i < dynamic_world->player_count; i++)
+		theFlags[i] = inPredictiveQueues->peekActionFlags(i, 0);
+
+	update_players(inPredictiveQueues, true);
+
+	for(short i = 0; i < dynamic_world->player_count; i++)
+	{
+		player_data* player = get_player_data(i);
+		uint32 action_flags = theFlags[i];
+		if(action_flags == 0xffffffff || PLAYER_IS_DEAD(player) || PLAYER_IS_TELEPORTING(player) || player_in_terminal_mode(i))
+			action_flags = 0;
+		update_player_weapons(i, action_flags);
+	}
+
+	move_projectiles();
+	move_monsters();
+	update_effects();
+	animate_scenery();
+
+	if (film_profile.animate_items)
+	{
+		animate_items();
+	}
+
+	dynamic_world->tick_count+= 1;
+	dynamic_world->game_information.game_time_remaining-= 1;
+}
+
 // ZZZ: new formulation of update_world(), should be simpler and clearer I hope.
 // Now returns (whether something changed, number of real ticks elapsed) since, with
 // prediction, something can change even if no real ticks have elapsed.
@@ -519,12 +668,19 @@ update_world()
 			sMostRecentFlagsForPlayer[i] = GameQueue->peekActionFlags(i, 0);
 
 		bool call_postidle = true;
+		begin_tick(false);
 		theUpdateResult = update_world_elements_one_tick(call_postidle);
+		end_tick();
 
 		theElapsedTime++;
 		
 		if (call_postidle)
 			L_Call_PostIdle();
+		film_tick_completed(theUpdateResult == kUpdateChangeLevel);
+#if !defined(DISABLE_NETWORKING)
+		if (game_is_networked && theUpdateResult == kUpdateNormalCompletion)
+			NetRecordWorldHash(dynamic_world->tick_count, calculate_world_hash());
+#endif
 		if(theUpdateResult != kUpdateNormalCompletion || Movie::instance()->IsRecording())
 		{
 			canUpdate = false;
@@ -583,7 +739,12 @@ update_world()
 			
 			// update_players() will dequeue the elements we just put in there
 			decode_hotkeys(thePredictiveQueues);
-			update_players(&thePredictiveQueues, true);
+			begin_tick(true);
+			if(sRollingBack)
+				predict_world_elements_one_tick(&thePredictiveQueues);
+			else
+				update_players(&thePredictiveQueues, true);
+			end_tick();
 
 			didPredict = true;
 
@@ -600,12 +761,106 @@ update_world()
 	return std::pair<bool, int16>(didPredict || theElapsedTime != 0, theElapsedTime);
 }
 
+double time_world_ticks(int ticks, bool hash_each_tick)
+{
+	// Lua's state isn't in the snapshot, and its hooks would see the ticks
+	if(LuaRunning())
+		return -1;
+
+	static WorldSnapshot snapshot;
+	snapshot.Save();
+
+	ModifiableActionQueues queues(dynamic_world->player_count, 2, true);
+	bool was_predicting = sPredictingTick;
+	sPredictingTick = true;
+	world_tick_events().SetMuted(true);
+
+	auto start = std::chrono::steady_clock::now();
+	for(int tick = 0; tick < ticks; tick++)
+	{
+		for(short i = 0; i < dynamic_world->player_count; i++)
+		{
+			uint32 flags = 0;
+			queues.enqueueActionFlags(i, &flags, 1);
+		}
+		predict_world_elements_one_tick(&queues);
+		if(hash_each_tick)
+			calculate_world_hash();
+	}
+	double tick_us = elapsed_microseconds(start) / ticks;
+
+	world_tick_events().SetMuted(false);
+	sPredictingTick = was_predicting;
+	snapshot.Restore();
+
+	// the answers are about the world that just went away
+	reset_line_of_sight_memo();
+
+	return tick_us;
+}
+
+// ".rollback" shows what rollback prediction costs, ".rollback on|off" switches
+// between it and moving only the players
+static void register_rollback_command()
+{
+	CommandParser parser;
+	parser.register_command("", [](const std::string&) {
+		screen_printf("rollback prediction is %s; snapshot is %u KB",
+			sRollbackWanted ? "on" : "off",
+			static_cast<unsigned>(sRollbackSnapshot.Size() / 1024));
+		if(world_tick_events().Played())
+		{
+			screen_printf("%u sounds and fades played, %u held back as repeats, %u mispredicted ones stopped",
+				world_tick_events().Played(), world_tick_events().Held(), world_tick_events().Undone());
+		}
+		if(sRollbackSaves && sRollbackRestores)
+		{
+			screen_printf("save %.1f us, restore %.1f us, %.1f ticks predicted per rollback",
+				sRollbackSaveTime / sRollbackSaves,
+				sRollbackRestoreTime / sRollbackRestores,
+				static_cast<double>(sRollbackPredictedTicks) / sRollbackRestores);
+			logNote("rollback: %u saves averaging %.1f us, %u restores averaging %.1f us, %u predicted ticks",
+				sRollbackSaves, sRollbackSaveTime / sRollbackSaves,
+				sRollbackRestores, sRollbackRestoreTime / sRollbackRestores,
+				sRollbackPredictedTicks);
+		}
+	});
+	parser.register_command("on", [](const std::string&) {
+		sRollbackWanted = true;
+		screen_printf("rollback prediction is on");
+	});
+	parser.register_command("off", [](const std::string&) {
+		sRollbackWanted = false;
+		screen_printf("rollback prediction is off");
+	});
+	// a remote player's mispredicted shot, through the sound and fade log
+	parser.register_command("check", [](const std::string&) {
+		std::string failure;
+		if(check_tick_event_log(failure))
+		{
+			screen_printf("rollback sounds and fades check passed");
+			logNote("rollback sounds and fades check passed");
+		}
+		else
+		{
+			screen_printf("rollback sounds and fades check FAILED: %s", failure.c_str());
+			logError("rollback sounds and fades check failed: %s", failure.c_str());
+		}
+	});
+	Console::instance()->register_command("rollback", parser);
+}
+
 /* call this function before leaving the old level, but DO NOT call it when saving the player.
 	it should be called when you're leaving the game (i.e., quitting or reverting, etc.) */
 void leaving_map(
 	void)
 {
+	// the network and whatever comes next want the last confirmed tick
+	exit_predictive_mode();
+
+	finish_render_screen();
 	
+	cancel_level_prefetch();
 	remove_all_projectiles();
 	remove_all_nonpersistent_effects();
 	
@@ -661,6 +916,9 @@ bool entering_map(bool restoring_saved)
 	/* if any active monsters think they have paths, we'll make them reconsider */
 	initialize_monsters_for_new_level();
 
+	world_tick_events().Clear();
+	sRollbackSnapshot.Invalidate();
+
 	/* and since no monsters have paths, we should make sure no paths think they have monsters */
 	reset_paths();
 	
@@ -707,7 +965,8 @@ bool entering_map(bool restoring_saved)
 	stop_fade();
 	set_fade_effect(NONE);
 	
-	if (!success) leaving_map();
+	if (success) start_level_prefetch();
+	else leaving_map();
 
 	first_frame_rendered = false;
 	last_heartbeat_fraction = -1.f;
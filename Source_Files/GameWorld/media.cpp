@@ -49,6 +49,7 @@ Feb 8, 2001 (Loren Petrich):
 #include "lightsource.h"
 #include "SoundManager.h"
 #include "InfoTree.h"
+#include "interpolated_world.h"
 
 #include "Packing.h"
 
@@ -83,7 +84,9 @@ static media_definition *get_media_definition(
 media_data *get_media_data(
 	const size_t media_index)
 {
-	struct media_data *media = GetMemberWithBounds(medias,media_index,MAXIMUM_MEDIAS_PER_MAP);
+	struct media_data *media = render_world ?
+		GetMemberWithBounds(render_world->media_list.data(),media_index,render_world->media_list.size()) :
+		GetMemberWithBounds(medias,media_index,MAXIMUM_MEDIAS_PER_MAP);
 	
 	if (!media) return NULL;
 	if (!(SLOT_IS_USED(media))) return NULL;
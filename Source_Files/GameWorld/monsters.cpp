@@ -100,6 +100,8 @@ Jan 12, 2003 (Loren Petrich)
 #include "interface.h"
 #include "FilmProfile.h"
 #include "flood_map.h"
+#include "activation_flood.h"
+#include "line_of_sight.h"
 #include "effects.h"
 #include "monsters.h"
 #include "projectiles.h"
@@ -250,6 +252,7 @@ static short get_monster_attitude(short monster_index, short target_index);
 void change_monster_target(short monster_index, short target_index);
 static bool switch_target_check(short monster_index, short attacker_index, short delta_vitality);
 static bool clear_line_of_sight(short viewer_index, short target_index, bool full_circle);
+static bool line_is_transparent(short polygon_index1, world_point2d *origin, short polygon_index2, world_point2d *destination);
 
 static void handle_moving_or_stationary_monster(short monster_index);
 static void execute_monster_attack(short monster_index);
@@ -273,9 +276,6 @@ static short position_monster_projectile(short aggressor_index, short target_ind
 static void update_monster_vertical_physics_model(short monster_index);
 static void update_monster_physics_model(short monster_index);
 
-static int32 monster_activation_flood_proc(short source_polygon_index, short line_index,
-	short destination_polygon_index, void *data);
-
 static bool attempt_evasive_manouvers(short monster_index);
 
 static short nearest_goal_polygon_index(short polygon_index);
@@ -826,8 +826,9 @@ void activate_nearby_monsters(
 		int32 flood_flags= flags;
 		
 		/* flood out from the target monster’s polygon, searching through the object lists of all
-			polygons we encounter */
-		polygon_index= flood_map(polygon_index, max_cost, monster_activation_flood_proc, _flagged_breadth_first, &flood_flags);
+			polygons we encounter (the same flood from the same polygon is usually just played back) */
+		ActivationFlood flood(polygon_index, max_cost, flood_flags);
+		polygon_index= flood.Next(&flood_flags);
 		while (polygon_index!=NONE)
 		{
 			short object_index;
@@ -902,7 +903,7 @@ void activate_nearby_monsters(
 				}
 			}
 			
-			polygon_index= flood_map(NONE, max_cost, monster_activation_flood_proc, _flagged_breadth_first, &flood_flags);
+			polygon_index= flood.Next(&flood_flags);
 		}
 
 		// deferred find_closest_appropriate_target() calls
@@ -916,7 +917,7 @@ void activate_nearby_monsters(
 	}
 }
 
-static int32 monster_activation_flood_proc(
+int32 monster_activation_flood_proc(
 	short source_polygon_index,
 	short line_index,
 	short destination_polygon_index,
@@ -2392,37 +2393,50 @@ static bool clear_line_of_sight(
 		/* make sure there are no non-transparent lines between the viewer and the target */
 		if (target_visible)
 		{
-			short polygon_index= viewer_object->polygon;
-			short line_index;
-			
-			do
+			target_visible= test_line_of_sight(_opaque_lines_obstruct, viewer_object->polygon, (world_point2d *)origin,
+				target_object->polygon, (world_point2d *)destination, line_is_transparent);
+		}
+	}
+	
+	return target_visible;
+}
+
+static bool line_is_transparent(
+	short polygon_index1,
+	world_point2d *origin,
+	short polygon_index2,
+	world_point2d *destination)
+{
+	short polygon_index= polygon_index1;
+	short line_index;
+	bool target_visible= true;
+	
+	do
+	{
+		line_index= find_line_crossed_leaving_polygon(polygon_index, origin, destination);
+		if (line_index!=NONE)
+		{
+			if (LINE_IS_TRANSPARENT(get_line_data(line_index)))
 			{
-				line_index= find_line_crossed_leaving_polygon(polygon_index, (world_point2d *)origin, (world_point2d *)destination);
-				if (line_index!=NONE)
-				{
-					if (LINE_IS_TRANSPARENT(get_line_data(line_index)))
-					{
-						/* transparent line, find adjacent polygon */
-						polygon_index= find_adjacent_polygon(polygon_index, line_index);
-						// LP change: make no polygon act like a non-transparent line
-						if (polygon_index == NONE) target_visible= false;
-					}
-					else
-					{
-						/* non-transparent line, target not visible */
-						target_visible= false;
-					}
-				}
-				else
-				{
-					/* we got to the target’s (x,y) location, but we’re in a different polygon;
-						he’s invisible */
-					if (polygon_index!=target_object->polygon) target_visible= false;
-				}
+				/* transparent line, find adjacent polygon */
+				polygon_index= find_adjacent_polygon(polygon_index, line_index);
+				// LP change: make no polygon act like a non-transparent line
+				if (polygon_index == NONE) target_visible= false;
+			}
+			else
+			{
+				/* non-transparent line, target not visible */
+				target_visible= false;
 			}
-			while (target_visible&&line_index!=NONE);
+		}
+		else
+		{
+			/* we got to the target’s (x,y) location, but we’re in a different polygon;
+				he’s invisible */
+			if (polygon_index!=polygon_index2) target_visible= false;
 		}
 	}
+	while (target_visible&&line_index!=NONE);
 	
 	return target_visible;
 }
@@ -304,6 +304,11 @@ void get_monster_dimensions(short monster_index, world_distance *radius, world_d
 
 void activate_nearby_monsters(short target_index, short caller_index, short flags, int32 max_range = -1);
 
+/* what monsters’ floods cost, for activate_nearby_monsters() and find_closest_appropriate_target();
+	activation_flood.cpp has to know everything it looks at */
+int32 monster_activation_flood_proc(short source_polygon_index, short line_index,
+	short destination_polygon_index, void *data);
+
 void damage_monsters_in_radius(short primary_target_index, short aggressor_index, short aggressor_type,
 	world_point3d *epicenter, short epicenter_polygon_index, world_distance radius, struct damage_definition *damage, short projectile_index);
 void damage_monster(short monster_index, short aggressor_index, short aggressor_type, world_point3d *epicenter, struct damage_definition *damage, short projectile_index);
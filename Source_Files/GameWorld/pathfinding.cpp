@@ -44,6 +44,7 @@ Feb 10, 2000 (Loren Petrich):
 #include "map.h"
 #include "flood_map.h"
 #include "dynamic_limits.h"
+#include "Packing.h"
 
 #ifdef DEBUG
 //#define VALIDATE_PATH_SPACE
@@ -385,3 +386,89 @@ world_point2d *path_peek(
 
 // LP addition: the total number of paths
 short GetNumberOfPaths() {return MAXIMUM_PATHS;}
+
+/* Packed as (index, current step, step count, points) for each path in use,
+	then NONE */
+size_t packed_paths_size(
+	void)
+{
+	size_t size= sizeof(int16);
+
+	for (short path_index=0;path_index<MAXIMUM_PATHS;++path_index)
+	{
+		struct path_definition *path= paths+path_index;
+
+		if (path->step_count!=NONE) size+= 3*sizeof(int16) + path->step_count*2*sizeof(int16);
+	}
+
+	return size;
+}
+
+uint8 *pack_paths(
+	uint8 *Stream)
+{
+	uint8* S = Stream;
+
+	for (short path_index=0;path_index<MAXIMUM_PATHS;++path_index)
+	{
+		struct path_definition *path= paths+path_index;
+
+		if (path->step_count==NONE) continue;
+		ValueToStream(S,path_index);
+		ValueToStream(S,path->current_step);
+		ValueToStream(S,path->step_count);
+		for (short i=0;i<path->step_count;++i)
+		{
+			ValueToStream(S,path->points[i].x);
+			ValueToStream(S,path->points[i].y);
+		}
+	}
+	int16 end= NONE;
+	ValueToStream(S,end);
+
+	return S;
+}
+
+void unpack_paths(
+	uint8 *Stream,
+	size_t length)
+{
+	uint8* S = Stream;
+	uint8* End = Stream + length;
+
+	reset_paths();
+	while (S + 3*sizeof(int16) <= End)
+	{
+		int16 path_index, current_step, step_count;
+		StreamToValue(S,path_index);
+		if (path_index==NONE) break;
+		StreamToValue(S,current_step);
+		StreamToValue(S,step_count);
+		if (path_index<0 || path_index>=MAXIMUM_PATHS || step_count<0 || step_count>MAXIMUM_POINTS_PER_PATH ||
+			S + step_count*2*sizeof(int16) > End)
+		{
+			break;
+		}
+
+		struct path_definition *path= paths+path_index;
+		path->current_step= current_step;
+		path->step_count= step_count;
+		for (short i=0;i<step_count;++i)
+		{
+			StreamToValue(S,path->points[i].x);
+			StreamToValue(S,path->points[i].y);
+		}
+	}
+}
+
+void *get_path_array(
+	void)
+{
+	return paths;
+}
+
+int32 calculate_path_array_length(
+	void)
+{
+	return MAXIMUM_PATHS*sizeof(struct path_definition);
+}
@@ -72,6 +72,8 @@ Jun 30, 2002 (tiennou):
 #include "player.h"
 #include "media.h"
 #include "InfoTree.h"
+#include "interpolated_world.h"
+#include "line_of_sight.h"
 
 // LP addition: XML parser for damage
 #include "items.h"
@@ -116,7 +118,9 @@ static platform_definition *get_platform_definition(const short type);
 platform_data *get_platform_data(
 	short platform_index)
 {
-	struct platform_data *platform = GetMemberWithBounds(platforms,platform_index,dynamic_world->platform_count);
+	struct platform_data *platform = render_world ?
+		GetMemberWithBounds(render_world->platform_list.data(),platform_index,render_world->platform_list.size()) :
+		GetMemberWithBounds(platforms,platform_index,dynamic_world->platform_count);
 	
 	vassert(platform, csprintf(temporary, "platform index #%d is out of range", platform_index));
 	
@@ -860,8 +864,12 @@ void adjust_platform_endpoint_and_line_heights(
 			/* only worry about transparency and solidity if there’s a polygon on the other side */
 			if (LINE_IS_VARIABLE_ELEVATION(line))
 			{
+				uint16 old_flags= line->flags;
 				SET_LINE_TRANSPARENCY(line, line->highest_adjacent_floor<line->lowest_adjacent_ceiling);
 				SET_LINE_SOLIDITY(line, line->highest_adjacent_floor>=line->lowest_adjacent_ceiling);
+				
+				/* what monsters could see through this line has changed */
+				if (line->flags!=old_flags) reset_line_of_sight_memo();
 			}
 			
 			/* and only if there is another polygon does this endpoint have a chance of being transparent */
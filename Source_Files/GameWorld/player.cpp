@@ -924,7 +924,8 @@ void damage_player(
 									  team_friendly_fire[aggressor_player->team].kills += 1;
 									}
 								}
-								Console::instance()->report_kill(player_index, aggressor_player_index, projectile_index);
+								if (!world_is_predicting())
+									Console::instance()->report_kill(player_index, aggressor_player_index, projectile_index);
 							}
 							else
 #endif // !defined(DISABLE_NETWORKING)
@@ -0,0 +1,193 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	The sounds and fades predicted ticks have already played, so running the
+	same tick again only plays what's new
+*/
+
+#include "cseries.h"
+#include "tick_events.h"
+
+#include <algorithm>
+
+bool tick_event::operator==(const tick_event& other) const
+{
+	return type == other.type && index == other.index && identifier == other.identifier &&
+		std::equal(values, values + 5, other.values);
+}
+
+TickEventLog::TickEventLog() :
+	tick(0), in_tick(false), recording(false), muted(false), last_claimed(NULL), played(0), held(0), undone(0)
+{
+}
+
+void TickEventLog::BeginTick(int32 tick, bool recorded)
+{
+	this->tick = tick;
+	in_tick = true;
+	recording = recorded;
+	last_claimed = NULL;
+
+	// every run of a tick is checked against everything the earlier runs played
+	auto it = ticks.find(tick);
+	if (it != ticks.end())
+	{
+		for (auto& recorded : it->second)
+			recorded.matched = false;
+	}
+}
+
+void TickEventLog::EndTick()
+{
+	if (in_tick && !recording)
+	{
+		// the real tick: whatever only a misprediction played, stop if we can;
+		// nothing will run this tick, or any before it, again
+		auto it = ticks.find(tick);
+		if (it != ticks.end())
+		{
+			for (auto& recorded : it->second)
+			{
+				if (!recorded.matched && recorded.undo)
+				{
+					recorded.undo();
+					++undone;
+				}
+			}
+		}
+		ticks.erase(ticks.begin(), ticks.upper_bound(tick));
+	}
+
+	in_tick = false;
+	last_claimed = NULL;
+}
+
+void TickEventLog::Clear()
+{
+	ticks.clear();
+	in_tick = false;
+	last_claimed = NULL;
+}
+
+bool TickEventLog::Claim(const tick_event& event)
+{
+	last_claimed = NULL;
+	if (muted) return false;
+	if (!in_tick) return true;
+
+	auto it = ticks.find(tick);
+	if (it != ticks.end())
+	{
+		for (auto& recorded : it->second)
+		{
+			if (!recorded.matched && recorded.event == event)
+			{
+				recorded.matched = true;
+				++held;
+				return false;
+			}
+		}
+	}
+
+	if (recording)
+	{
+		std::vector<recorded_event>& events = ticks[tick];
+		events.push_back(recorded_event());
+		last_claimed = &events.back();
+		last_claimed->event = event;
+		last_claimed->matched = true;
+	}
+
+	++played;
+	return true;
+}
+
+void TickEventLog::SetUndo(std::function<void()> undo)
+{
+	if (last_claimed) last_claimed->undo = undo;
+}
+
+static TickEventLog world_log;
+
+TickEventLog& world_tick_events()
+{
+	return world_log;
+}
+
+bool claim_world_tick_event(const tick_event& event)
+{
+	return world_log.Claim(event);
+}
+
+void set_world_tick_event_undo(std::function<void()> undo)
+{
+	world_log.SetUndo(undo);
+}
+
+/* ---------- check */
+
+static tick_event test_sound(int16 sound_index, int16 identifier)
+{
+	tick_event event;
+	event.type = _sound_tick_event;
+	event.index = sound_index;
+	event.identifier = identifier;
+	std::fill(event.values, event.values + 5, 0);
+	return event;
+}
+
+bool check_tick_event_log(std::string& failure)
+{
+	TickEventLog log;
+
+	// the local player fires (sound 1) and the remote player is predicted to
+	// keep walking (footstep, sound 2)
+	tick_event local_shot = test_sound(1, 0);
+	tick_event remote_footstep = test_sound(2, 1);
+	bool footstep_stopped = false;
+
+	log.BeginTick(100, true);
+	if (!log.Claim(local_shot)) { failure = "predicted tick held back a new sound"; return false; }
+	if (!log.Claim(remote_footstep)) { failure = "predicted tick held back a new sound"; return false; }
+	log.SetUndo([&footstep_stopped]() { footstep_stopped = true; });
+	log.EndTick();
+
+	// the same guess again, after an earlier tick came in
+	log.BeginTick(100, true);
+	if (log.Claim(local_shot) || log.Claim(remote_footstep)) { failure = "repredicted tick repeated a sound"; return false; }
+	log.EndTick();
+
+	// but the remote player had started firing: their shot hits us (sounds
+	// 3 and 4, twice over, as a burst)
+	tick_event remote_shot = test_sound(3, 1);
+	tick_event hit = test_sound(4, 0);
+
+	log.BeginTick(100, false);
+	if (log.Claim(local_shot)) { failure = "real tick repeated a predicted sound"; return false; }
+	if (!log.Claim(remote_shot) || !log.Claim(hit) || !log.Claim(hit)) { failure = "real tick lost a sound prediction missed"; return false; }
+	log.EndTick();
+
+	if (!footstep_stopped) { failure = "mispredicted sound kept playing"; return false; }
+	if (log.Played() != 5 || log.Held() != 3 || log.Undone() != 1) { failure = "counts are off"; return false; }
+
+	// nothing is left over for the next time tick 100 comes around
+	log.BeginTick(100, false);
+	if (!log.Claim(local_shot)) { failure = "finished tick still held back sounds"; return false; }
+	log.EndTick();
+
+	return true;
+}
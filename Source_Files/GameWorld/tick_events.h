@@ -0,0 +1,105 @@
+#ifndef TICK_EVENTS_H
+#define TICK_EVENTS_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	The sounds and fades predicted ticks have already played, so running the
+	same tick again only plays what's new
+*/
+
+#include "cstypes.h"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+enum /* tick event types */
+{
+	_sound_tick_event,
+	_direct_sound_tick_event,
+	_fade_tick_event
+};
+
+// Everything that tells one sound or fade from another; events are only
+// held back when every field matches
+struct tick_event
+{
+	int16 type;
+	int16 index;		// sound or fade type
+	int16 identifier;
+	int32 values[5];	// where and how loud, or NONE
+
+	bool operator==(const tick_event& other) const;
+};
+
+class TickEventLog
+{
+public:
+	TickEventLog();
+
+	// predicted ticks that will be rolled back are recorded; the real tick
+	// with the same number is checked against what they played
+	void BeginTick(int32 tick, bool recorded);
+	void EndTick();
+	void Clear();
+
+	// true if the event should happen, false if it already did when this
+	// tick was predicted
+	bool Claim(const tick_event& event);
+
+	// how to take back the event just claimed if the real tick doesn't
+	// make it after all
+	void SetUndo(std::function<void()> undo);
+
+	// while muted, nothing plays at all (for ticks run only to time them)
+	void SetMuted(bool muted) { this->muted = muted; }
+
+	uint32 Played() const { return played; }
+	uint32 Held() const { return held; }
+	uint32 Undone() const { return undone; }
+
+private:
+	struct recorded_event
+	{
+		tick_event event;
+		bool matched;
+		std::function<void()> undo;
+	};
+
+	std::map<int32, std::vector<recorded_event> > ticks;
+	int32 tick;
+	bool in_tick, recording, muted;
+	recorded_event *last_claimed;
+
+	uint32 played, held, undone;
+};
+
+// the log the world's ticks go through
+TickEventLog& world_tick_events();
+
+// for SoundManager and fades: whether the tick being run (if any) should
+// play this, and how to stop it again
+bool claim_world_tick_event(const tick_event& event);
+void set_world_tick_event_undo(std::function<void()> undo);
+
+// runs a mispredicted remote action through a log of its own; returns
+// false and says why if the log got it wrong
+bool check_tick_event_log(std::string& failure);
+
+#endif
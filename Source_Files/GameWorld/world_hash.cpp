@@ -0,0 +1,156 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	A digest of the world, for noticing when netgames and films go out of sync
+*/
+
+#include "world_hash.h"
+
+#include <chrono>
+#include <stdlib.h>
+
+#include "map.h"
+#include "Console.h"
+#include "interface.h"
+#include "monsters.h"
+#include "platforms.h"
+#include "player.h"
+#include "Logging.h"
+#include "shell.h"
+
+// Only the fields the game logic steers by go in, and only for slots in
+// use; walking them costs far less than a tick does
+class WorldHasher
+{
+public:
+	WorldHasher() : hash(0x9747b28c) { }
+
+	void Add(uint32 value)
+	{
+		value *= 0xcc9e2d51;
+		value = (value << 15) | (value >> 17);
+		value *= 0x1b873593;
+		hash ^= value;
+		hash = (hash << 13) | (hash >> 19);
+		hash = hash*5 + 0xe6546b64;
+	}
+
+	void Add(int16 a, int16 b)
+	{
+		Add((static_cast<uint32>(static_cast<uint16>(a)) << 16) | static_cast<uint16>(b));
+	}
+
+	uint32 Finish()
+	{
+		uint32 value = hash;
+		value ^= value >> 16;
+		value *= 0x85ebca6b;
+		value ^= value >> 13;
+		value *= 0xc2b2ae35;
+		value ^= value >> 16;
+		return value;
+	}
+
+private:
+	uint32 hash;
+};
+
+uint32 calculate_world_hash(
+	void)
+{
+	WorldHasher hasher;
+
+	hasher.Add(dynamic_world->tick_count);
+	hasher.Add(get_random_seed());
+	hasher.Add(dynamic_world->object_count, dynamic_world->monster_count);
+	hasher.Add(dynamic_world->projectile_count, dynamic_world->effect_count);
+
+	// objects are everything that has a place in the world: monsters,
+	// players, projectiles, effects, items and scenery
+	for (auto& object : ObjectList)
+	{
+		if (!SLOT_IS_USED(&object)) continue;
+		hasher.Add(object.location.x, object.location.y);
+		hasher.Add(object.location.z, object.polygon);
+		hasher.Add(object.facing, object.shape);
+	}
+
+	for (auto& monster : MonsterList)
+	{
+		if (!SLOT_IS_USED(&monster)) continue;
+		hasher.Add(monster.type, monster.vitality);
+		hasher.Add(monster.mode, monster.action);
+		hasher.Add(monster.target_index, monster.object_index);
+	}
+
+	for (short player_index = 0; player_index < dynamic_world->player_count; ++player_index)
+	{
+		player_data *player = get_player_data(player_index);
+		hasher.Add(player->suit_energy, player->suit_oxygen);
+		hasher.Add(player->monster_index, player->flags);
+	}
+
+	for (auto& platform : PlatformList)
+	{
+		hasher.Add(platform.floor_height, platform.ceiling_height);
+	}
+
+	return hasher.Finish();
+}
+
+static void benchmark_world_hash(const std::string& arg)
+{
+	if (get_game_state() != _game_in_progress)
+	{
+		screen_printf("Start a level to benchmark the world hash");
+		return;
+	}
+
+	int count = arg.empty() ? 1000 : std::max(1, atoi(arg.c_str()));
+
+	uint32 hash = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; ++i)
+		hash ^= calculate_world_hash();
+	double hash_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / count;
+
+	// what the hash adds to a simulated tick (a few seconds' worth of them,
+	// run from here and then undone), rather than to the frame
+	const int ticks = 4*TICKS_PER_SECOND;
+	time_world_ticks(ticks, false);
+	double tick_us = time_world_ticks(ticks, false);
+	double hashed_tick_us = time_world_ticks(ticks, true);
+	if (tick_us <= 0 || hashed_tick_us <= 0)
+	{
+		screen_printf("world hash: %.2f us; can't time ticks while a Lua script is running", hash_us);
+		logNote("world hash benchmark: %d objects, %d monsters, %.2f us per hash (%08x)",
+			static_cast<int>(ObjectList.size()), static_cast<int>(MonsterList.size()), hash_us, hash);
+		return;
+	}
+
+	screen_printf("world hash: %.2f us; a tick takes %.1f us without it, %.1f us with it (x%.3f)",
+		hash_us, tick_us, hashed_tick_us, hashed_tick_us / tick_us);
+	logNote("world hash benchmark: %d objects, %d monsters, %.2f us per hash (%08x); %d ticks at %.1f us, %.1f us hashed (x%.3f)",
+		static_cast<int>(ObjectList.size()), static_cast<int>(MonsterList.size()), hash_us, hash,
+		ticks, tick_us, hashed_tick_us, hashed_tick_us / tick_us);
+}
+
+void register_world_hash_benchmark(
+	void)
+{
+	Console::instance()->register_benchmark("worldhash", benchmark_world_hash);
+}
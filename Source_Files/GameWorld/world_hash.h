@@ -0,0 +1,38 @@
+#ifndef WORLD_HASH_H
+#define WORLD_HASH_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	A digest of the world, for noticing when netgames and films go out of sync
+*/
+
+#include "cseries.h"
+
+// Changes whenever calculate_world_hash() would give different results for
+// the same world, so old films aren't reported as out of sync
+#define WORLD_HASH_VERSION 1
+
+// Covers the random seed and where everything is, and how hurt it is:
+// enough that a game out of sync differs within a tick or two. Machines
+// playing the same game get the same hash after every tick.
+uint32 calculate_world_hash(void);
+
+// ".benchmark worldhash [count]"
+void register_world_hash_benchmark(void);
+
+#endif
@@ -0,0 +1,251 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	In-memory copies of the dynamic world, for rolling back predicted ticks
+	and anything else that wants to go back to an earlier tick
+*/
+
+#include "world_snapshot.h"
+
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+
+#include "map.h"
+#include "Console.h"
+#include "effects.h"
+#include "ephemera.h"
+#include "flood_map.h"
+#include "game_wad.h"
+#include "interface.h"
+#include "lightsource.h"
+#include "media.h"
+#include "monsters.h"
+#include "platforms.h"
+#include "player.h"
+#include "projectiles.h"
+#include "weapons.h"
+#include "Logging.h"
+#include "shell.h"
+
+void WorldSnapshot::SaveChunk(size_t index, size_t offset, const uint8 *data, size_t size)
+{
+	std::shared_ptr<Chunk>& chunk = chunks[index];
+	if (chunk.use_count() > 1)
+	{
+		// Another snapshot has this chunk too; it only needs a copy of its
+		// own if this part of the world has changed
+		if (memcmp(chunk->bytes + offset, data, size) == 0)
+			return;
+
+		chunk = std::make_shared<Chunk>(*chunk);
+	}
+
+	memcpy(chunk->bytes + offset, data, size);
+}
+
+void WorldSnapshot::Copy(void *data, size_t size)
+{
+	uint8 *bytes = static_cast<uint8 *>(data);
+	while (size)
+	{
+		size_t index = cursor / kChunkSize;
+		size_t offset = cursor % kChunkSize;
+		size_t count = std::min(size, kChunkSize - offset);
+
+		switch (mode)
+		{
+		case _measure:
+			break;
+		case _save:
+			SaveChunk(index, offset, bytes, count);
+			break;
+		case _restore:
+			memcpy(bytes, chunks[index]->bytes + offset, count);
+			break;
+		}
+
+		cursor += count;
+		bytes += count;
+		size -= count;
+	}
+}
+
+template<typename T> void WorldSnapshot::CopyArray(T *data, size_t count)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "world snapshots copy raw memory");
+	if (count) Copy(data, count*sizeof(T));
+}
+
+// The length goes in first, so a list that has grown or shrunk since the
+// save comes back at the size it was
+template<typename T> void WorldSnapshot::CopyVector(std::vector<T>& data)
+{
+	uint32 count = static_cast<uint32>(data.size());
+	Copy(&count, sizeof(count));
+	if (mode == _restore) data.resize(count);
+	CopyArray(data.data(), count);
+}
+
+void WorldSnapshot::Transfer(Mode new_mode)
+{
+	mode = new_mode;
+	cursor = 0;
+
+	// first, since the player count comes from here
+	CopyArray(dynamic_world, 1);
+
+	uint16 random_seed = get_random_seed();
+	Copy(&random_seed, sizeof(random_seed));
+	if (mode == _restore) set_random_seed(random_seed);
+
+	CopyVector(ObjectList);
+	CopyVector(MonsterList);
+	CopyVector(ProjectileList);
+	CopyVector(EffectList);
+
+	// platforms move floors, ceilings and endpoints, and switches change sides
+	CopyVector(EndpointList);
+	CopyVector(LineList);
+	CopyVector(SideList);
+	CopyVector(PolygonList);
+	CopyVector(PlatformList);
+	CopyVector(LightList);
+	CopyVector(MediaList);
+
+	CopyArray(players, dynamic_world->player_count);
+	CopyArray(team_damage_given, NUMBER_OF_TEAM_COLORS);
+	CopyArray(team_damage_taken, NUMBER_OF_TEAM_COLORS);
+	CopyArray(team_monster_damage_taken, NUMBER_OF_TEAM_COLORS);
+	CopyArray(team_monster_damage_given, NUMBER_OF_TEAM_COLORS);
+	CopyArray(team_friendly_fire, NUMBER_OF_TEAM_COLORS);
+
+	Copy(get_weapon_array(), calculate_weapon_array_length());
+	Copy(get_path_array(), calculate_path_array_length());
+	CopyArray(get_placement_info(), 2*MAXIMUM_OBJECT_TYPES);
+
+	int16_t *first_unused_ephemera;
+	CopyVector(get_ephemera_storage(first_unused_ephemera));
+	CopyArray(first_unused_ephemera, 1);
+	CopyVector(get_polygon_ephemera_storage());
+}
+
+void WorldSnapshot::Save()
+{
+	Transfer(_measure);
+	used = cursor;
+
+	// never shrinks, so going back and forth between levels doesn't
+	// reallocate
+	size_t count = (used + kChunkSize - 1) / kChunkSize;
+	if (chunks.size() < count)
+		chunks.resize(count);
+	for (auto& chunk : chunks)
+	{
+		// not make_shared, which would clear it first
+		if (!chunk) chunk.reset(new Chunk);
+	}
+
+	Transfer(_save);
+	valid = true;
+}
+
+void WorldSnapshot::Restore()
+{
+	assert(valid);
+	Transfer(_restore);
+	assert(cursor == used);
+}
+
+size_t WorldSnapshot::SharedBytes() const
+{
+	size_t bytes = 0;
+	for (auto& chunk : chunks)
+	{
+		if (chunk.use_count() > 1) bytes += kChunkSize;
+	}
+
+	return bytes;
+}
+
+static double elapsed_microseconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Saves and restores the world as it is, which leaves it unchanged, and
+// compares that with packing it up the way saved games and film keyframes do
+static void benchmark_world_snapshots(const std::string& arg)
+{
+	if (get_game_state() != _game_in_progress)
+	{
+		screen_printf("Start a level to benchmark world snapshots");
+		return;
+	}
+
+	int count = arg.empty() ? 100 : std::max(1, atoi(arg.c_str()));
+
+	WorldSnapshot snapshot;
+	snapshot.Save();
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; ++i)
+		snapshot.Save();
+	double save_us = elapsed_microseconds(start) / count;
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; ++i)
+		snapshot.Restore();
+	double restore_us = elapsed_microseconds(start) / count;
+
+	// a series of snapshots, each saved over a copy of the one before
+	const int series_length = 8;
+	std::vector<WorldSnapshot> series;
+	series.reserve(series_length);
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < series_length; ++i)
+	{
+		series.push_back(i ? series.back() : snapshot);
+		series.back().Save();
+	}
+	double series_us = elapsed_microseconds(start) / series_length;
+
+	size_t series_own_bytes = 0;
+	for (auto& copy : series)
+		series_own_bytes += copy.Capacity() - copy.SharedBytes();
+
+	std::vector<uint8> packed;
+	int pack_count = std::max(1, count / 10);
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < pack_count; ++i)
+		save_game_state(packed);
+	double pack_us = elapsed_microseconds(start) / pack_count;
+
+	screen_printf("world snapshot: %u KB, save %.1f us, restore %.1f us",
+		static_cast<unsigned>(snapshot.Size() / 1024), save_us, restore_us);
+	screen_printf("copy-on-write save %.1f us (%u KB unshared in %d copies); save game packing %.1f us",
+		series_us, static_cast<unsigned>(series_own_bytes / 1024), series_length, pack_us);
+	logNote("world snapshot benchmark: %d polygons, %u bytes, save %.1f us, restore %.1f us, copy-on-write save %.1f us, save game packing %.1f us (%u bytes)",
+		static_cast<int>(PolygonList.size()), static_cast<unsigned>(snapshot.Size()),
+		save_us, restore_us, series_us, pack_us, static_cast<unsigned>(packed.size()));
+}
+
+void WorldSnapshot::RegisterBenchmark()
+{
+	Console::instance()->register_benchmark("snapshot", benchmark_world_snapshots);
+}
@@ -0,0 +1,93 @@
+#ifndef WORLD_SNAPSHOT_H
+#define WORLD_SNAPSHOT_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	In-memory copies of the dynamic world, for rolling back predicted ticks
+	and anything else that wants to go back to an earlier tick
+*/
+
+#include "cseries.h"
+
+#include <memory>
+#include <vector>
+
+// Everything the game ticks change, copied as raw memory into chunks that
+// are kept between saves, so saving doesn't allocate once there's room for
+// the map. Only valid on the machine and level that saved it; saved games
+// and films still go through game_wad.cpp. Main thread only.
+//
+// Copying a snapshot is cheap: the copies share their chunks until one of
+// them is saved over, and even then only the chunks that changed get
+// copies of their own. A series of snapshots costs about what changed
+// between them.
+class WorldSnapshot
+{
+public:
+	WorldSnapshot() : mode(_measure), cursor(0), used(0), valid(false) { }
+
+	void Save();
+
+	// puts the world back exactly as it was at the last Save()
+	void Restore();
+
+	bool Valid() const { return valid; }
+	void Invalidate() { valid = false; }
+
+	// bytes the last Save() used
+	size_t Size() const { return used; }
+
+	// bytes held, including room left over from bigger maps
+	size_t Capacity() const { return chunks.size()*kChunkSize; }
+
+	// bytes held in common with other snapshots
+	size_t SharedBytes() const;
+
+	// ".benchmark snapshot [count]", on the level that's being played
+	static void RegisterBenchmark();
+
+private:
+	enum Mode {
+		_measure,
+		_save,
+		_restore
+	};
+
+	static const size_t kChunkSize = 64*1024;
+
+	struct Chunk {
+		uint8 bytes[kChunkSize];
+	};
+
+	// Goes over everything that's saved, in the same order every time
+	void Transfer(Mode new_mode);
+
+	void Copy(void *data, size_t size);
+	void SaveChunk(size_t index, size_t offset, const uint8 *data, size_t size);
+
+	template<typename T> void CopyArray(T *data, size_t count);
+	template<typename T> void CopyVector(std::vector<T>& data);
+
+	std::vector<std::shared_ptr<Chunk> > chunks;
+	Mode mode;
+	size_t cursor;
+	size_t used;
+	bool valid;
+};
+
+#endif
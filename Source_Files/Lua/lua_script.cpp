@@ -195,6 +195,7 @@ void ResetLuaMute() {}
 
 bool UseLuaCameras() { return false; }
 bool LuaPlayerCanWieldWeapons(short) { return true; }
+bool LuaRunning() { return false; }
 
 int GetLuaGameEndCondition() {
 	return _game_normal_end_condition;
@@ -1214,7 +1215,7 @@ L_Do_Call(const char* inLuaFunctionName, int inNumArgs = 0, int inNumResults = 0
 }
 */
 
-static bool LuaRunning()
+bool LuaRunning()
 {
 	for (state_map::iterator it = states.begin(); it != states.end(); ++it)
 	{
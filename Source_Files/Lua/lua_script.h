@@ -90,6 +90,9 @@ void ResetLuaMute();
 
 bool UseLuaCameras();
 
+// whether any script is loaded and running
+bool LuaRunning();
+
 void unpack_lua_states(uint8* data, size_t length);
 size_t save_lua_states();
 void pack_lua_states(uint8* data, size_t length);
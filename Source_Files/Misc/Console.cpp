@@ -50,6 +50,7 @@ Console::Console() : m_active(false), m_carnage_messages_exist(false), m_use_lua
 	m_command_iter = m_prev_commands.end();
 	m_carnage_messages.resize(NUMBER_OF_PROJECTILE_TYPES);
 	register_save_commands();
+	register_command("benchmark", [this](const std::string& arg) { m_benchmarks.parse_and_execute(arg); });
 }
 
 Console *Console::instance() {
@@ -456,6 +457,11 @@ void Console::clear_saves()
 	last_level.clear();
 }
 
+void Console::register_benchmark(std::string name, std::function<void(const std::string&)> f)
+{
+	m_benchmarks.register_command(name, f);
+}
+
 void reset_mml_console()
 {
 	Console *console = Console::instance();
@@ -88,6 +88,9 @@ public:
 	// clear last saved level name
 	void clear_saves();
 
+	// ".benchmark <name> [args]" runs the benchmark registered as name
+	void register_benchmark(std::string name, std::function<void(const std::string&)> f);
+
 private:
 	Console();
 
@@ -110,6 +113,8 @@ private:
 
 	bool m_use_lua_console;
 
+	CommandParser m_benchmarks;
+
 	void register_save_commands();
 };
 
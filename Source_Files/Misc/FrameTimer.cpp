@@ -0,0 +1,261 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Where each frame's time goes, for the frame time overlay and for traces
+	that Chrome's trace viewer (chrome://tracing, or Perfetto) can open
+*/
+
+#include "cseries.h"
+#include "FrameTimer.h"
+
+#include "Console.h"
+#include "FileHandler.h"
+#include "Logging.h"
+#include "screen.h"
+
+#include <algorithm>
+
+extern DirectorySpecifier log_dir;
+
+// a few seconds' worth at most frame rates; the overlay graphs all of them
+static const size_t kFrameHistory = 240;
+
+// about a minute of a busy frame; past this, the trace stops growing
+static const size_t kMaximumTraceEvents = 1 << 20;
+
+static const char* stage_names[FrameTimer::kNumberOfStages] = {
+	"world update",
+	"visibility",
+	"sorting",
+	"objects",
+	"rasterizing",
+	"HUD",
+	"Lua HUD",
+	"present"
+};
+
+FrameTimer* FrameTimer::instance()
+{
+	static FrameTimer timer;
+	return &timer;
+}
+
+const char* FrameTimer::StageName(Stage stage)
+{
+	return stage_names[stage];
+}
+
+FrameTimer::FrameTimer() : overlay_(false), tracing_(false), next_frame_(0), frame_(), have_last_frame_(false)
+{
+	// ".frametimes" shows the overlay, ".frametimes trace" starts a trace
+	// and stops it again
+	CommandParser parser;
+	parser.register_command("", [this](const std::string&) {
+		overlay_ = !overlay_;
+		if (!overlay_ && !tracing_)
+		{
+			frames_.clear();
+			next_frame_ = 0;
+			have_last_frame_ = false;
+		}
+	});
+	parser.register_command("trace", [this](const std::string&) {
+		if (!tracing_)
+		{
+			StartTrace();
+			screen_printf("Tracing frames; \".frametimes trace\" again to stop");
+			return;
+		}
+
+		std::string file = StopTrace();
+		if (file.empty())
+			screen_printf("Couldn't write the frame trace");
+		else
+			screen_printf("Wrote frame trace to %s", file.c_str());
+	});
+	Console::instance()->register_command("frametimes", parser);
+}
+
+void FrameTimer::Record(Stage stage, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	frame_.stages[stage] += std::chrono::duration<float, std::milli>(end - start).count();
+
+	if (tracing_ && trace_.size() < kMaximumTraceEvents)
+	{
+		TraceEvent event;
+		event.stage = stage;
+		event.thread = ThreadIndex(std::this_thread::get_id());
+		event.start = TraceTime(start);
+		event.duration = TraceTime(end) - event.start;
+		trace_.push_back(event);
+	}
+}
+
+void FrameTimer::FrameShown()
+{
+	if (!Enabled()) return;
+
+	auto now = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (have_last_frame_)
+	{
+		frame_.total = std::chrono::duration<float, std::milli>(now - last_frame_shown_).count();
+		if (frames_.size() < kFrameHistory)
+		{
+			frames_.push_back(frame_);
+		}
+		else
+		{
+			frames_[next_frame_] = frame_;
+			next_frame_ = (next_frame_ + 1) % kFrameHistory;
+		}
+
+		if (tracing_ && trace_.size() < kMaximumTraceEvents)
+		{
+			TraceEvent event;
+			event.stage = kNumberOfStages;
+			event.thread = ThreadIndex(std::this_thread::get_id());
+			event.start = TraceTime(last_frame_shown_);
+			event.duration = TraceTime(now) - event.start;
+			trace_.push_back(event);
+		}
+	}
+
+	frame_ = Frame();
+	last_frame_shown_ = now;
+	have_last_frame_ = true;
+}
+
+float FrameTimer::FrameTime(int index) const
+{
+	return frames_[(next_frame_ + index) % frames_.size()].total;
+}
+
+float FrameTimer::Percentile(float percent) const
+{
+	if (frames_.empty()) return 0;
+
+	std::vector<float> totals;
+	totals.reserve(frames_.size());
+	for (auto& frame : frames_)
+		totals.push_back(frame.total);
+
+	size_t rank = std::min(totals.size() - 1, static_cast<size_t>(percent / 100 * totals.size()));
+	std::nth_element(totals.begin(), totals.begin() + rank, totals.end());
+	return totals[rank];
+}
+
+float FrameTimer::StageAverage(Stage stage) const
+{
+	if (frames_.empty()) return 0;
+
+	float total = 0;
+	for (auto& frame : frames_)
+		total += frame.stages[stage];
+	return total / frames_.size();
+}
+
+int FrameTimer::ThreadIndex(std::thread::id id)
+{
+	auto it = std::find(trace_threads_.begin(), trace_threads_.end(), id);
+	if (it != trace_threads_.end())
+		return static_cast<int>(it - trace_threads_.begin());
+
+	trace_threads_.push_back(id);
+	return static_cast<int>(trace_threads_.size()) - 1;
+}
+
+int64_t FrameTimer::TraceTime(std::chrono::steady_clock::time_point t) const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(t - trace_start_).count();
+}
+
+void FrameTimer::StartTrace()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	trace_.clear();
+	trace_threads_.clear();
+
+	// the thread starting the trace is the main thread
+	trace_threads_.push_back(std::this_thread::get_id());
+	trace_start_ = std::chrono::steady_clock::now();
+	tracing_ = true;
+}
+
+std::string FrameTimer::StopTrace()
+{
+	std::vector<TraceEvent> events;
+	int threads;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		tracing_ = false;
+		events.swap(trace_);
+		threads = static_cast<int>(trace_threads_.size());
+	}
+
+	if (events.size() >= kMaximumTraceEvents)
+		logWarning("frame trace filled up after %d events; later frames are missing", static_cast<int>(events.size()));
+
+	// the JSON object format of the Trace Event Format: complete ("X")
+	// events, and metadata ("M") events to name the threads
+	std::vector<std::string> lines;
+	char line[256];
+	for (int thread = 0; thread < threads; ++thread)
+	{
+		sprintf(line, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+			thread, thread ? "worker" : "main", thread);
+		lines.push_back(line);
+	}
+	for (auto& event : events)
+	{
+		bool frame = event.stage == kNumberOfStages;
+		sprintf(line, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld}",
+			frame ? "frame" : stage_names[event.stage], frame ? "frame" : "stage", event.thread,
+			static_cast<long long>(event.start), static_cast<long long>(event.duration));
+		lines.push_back(line);
+	}
+
+	std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	for (size_t i = 0; i < lines.size(); ++i)
+	{
+		json += lines[i];
+		json += i + 1 < lines.size() ? ",\n" : "\n";
+	}
+	json += "]}\n";
+
+	FileSpecifier file;
+	int index = 0;
+	do {
+		char name[64];
+		sprintf(name, "Frame Trace %04d.json", index++);
+		file = log_dir;
+		file += name;
+	} while (file.Exists());
+
+	OpenedFile opened;
+	if (!file.Create(_typecode_unknown) || !file.Open(opened, true) ||
+		!opened.Write(static_cast<int32>(json.size()), &json[0]))
+	{
+		logError("couldn't write frame trace %s", file.GetPath());
+		return std::string();
+	}
+
+	logNote("wrote frame trace %s: %d events", file.GetPath(), static_cast<int>(events.size()));
+	return file.GetPath();
+}
@@ -0,0 +1,123 @@
+#ifndef FRAME_TIMER_H
+#define FRAME_TIMER_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Where each frame's time goes, for the frame time overlay and for traces
+	that Chrome's trace viewer (chrome://tracing, or Perfetto) can open
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class FrameTimer {
+public:
+	static FrameTimer* instance();
+
+	enum Stage {
+		kWorldUpdate,
+		kVisibility,		// build_render_tree()
+		kSorting,			// sort_render_tree()
+		kObjects,			// build_render_object_list()
+		kRasterizing,		// walls, sprites and weapons in hand
+		kHUD,
+		kLuaHUD,
+		kPresent,			// blitting, swapping buffers
+		kNumberOfStages
+	};
+
+	static const char* StageName(Stage stage);
+
+	// Nothing is timed unless the overlay is showing or a trace is running
+	bool Enabled() const { return overlay_ || tracing_; }
+	bool OverlayVisible() const { return overlay_; }
+
+	// Times a stage from construction to destruction. Safe on any thread,
+	// so the pipelined rasterizer's worker can use it too.
+	class Scope {
+	public:
+		Scope(Stage stage) : stage_(stage), timing_(FrameTimer::instance()->Enabled()) {
+			if (timing_) start_ = std::chrono::steady_clock::now();
+		}
+		~Scope() {
+			if (timing_) FrameTimer::instance()->Record(stage_, start_, std::chrono::steady_clock::now());
+		}
+	private:
+		Stage stage_;
+		bool timing_;
+		std::chrono::steady_clock::time_point start_;
+	};
+
+	void Record(Stage stage, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+	// Call once a frame has been shown; the time since the last call is
+	// the frame time
+	void FrameShown();
+
+	// Over the frames in the history, in milliseconds
+	int FrameCount() const { return static_cast<int>(frames_.size()); }
+	float FrameTime(int index) const;	// oldest first
+	float Percentile(float percent) const;
+	float StageAverage(Stage stage) const;
+
+	// Starts or stops a trace; a stopped trace is written to the log
+	// directory and its file name returned, or an empty string on failure
+	void StartTrace();
+	std::string StopTrace();
+	bool Tracing() const { return tracing_; }
+
+private:
+	FrameTimer();
+
+	struct Frame {
+		float total;
+		float stages[kNumberOfStages];
+	};
+
+	struct TraceEvent {
+		int16_t stage;		// kNumberOfStages for a whole frame
+		int16_t thread;
+		int64_t start;		// microseconds since the trace started
+		int64_t duration;
+	};
+
+	int ThreadIndex(std::thread::id id);
+	int64_t TraceTime(std::chrono::steady_clock::time_point t) const;
+
+	std::mutex mutex_;
+	std::atomic<bool> overlay_;
+	std::atomic<bool> tracing_;
+
+	// a ring of the last frames; frame_ is the one being timed
+	std::vector<Frame> frames_;
+	size_t next_frame_;
+	Frame frame_;
+	std::chrono::steady_clock::time_point last_frame_shown_;
+	bool have_last_frame_;
+
+	std::vector<TraceEvent> trace_;
+	std::vector<std::thread::id> trace_threads_;
+	std::chrono::steady_clock::time_point trace_start_;
+};
+
+#endif
@@ -28,14 +28,30 @@
 #include "cseries.h"
 #include "shell.h"
 
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <time.h>	// apparently is in C std library, used here to print time/date log section started.
 #include <stdio.h>
 #include "FileHandler.h"
 #include "InfoTree.h"
 
+#ifdef __WIN32__
+#include <io.h>
+#define raw_write(fd, buf, count) _write(fd, buf, static_cast<unsigned int>(count))
+#define raw_fileno _fileno
+#else
+#include <unistd.h>
+#define raw_write(fd, buf, count) write(fd, buf, count)
+#define raw_fileno fileno
+#endif
+
 #ifndef NO_STD_NAMESPACE
 using std::vector;
 using std::string;
@@ -52,6 +68,267 @@ const char*	logDomain	= "global";
 
 
 static void InitializeLogging();
+static void WriteLogOutput(const string& inText, int inLevel);
+
+
+// Async output: callers format their messages as usual, then hand them to a
+// writer thread instead of doing the file and stderr writes themselves, so
+// logging from timing-sensitive code (network, mostly) costs about a copy.
+// Producers never take a lock; slots carry sequence numbers so any number
+// of threads can claim them, and the writer thread is the only consumer.
+// When the ring is full, messages are dropped and counted, except errors,
+// which wait for room instead.
+class AsyncLogWriter {
+public:
+	AsyncLogWriter();
+
+	// false if the ring was full; the message counts as dropped unless the
+	// caller is going to deal with it
+	bool Push(const string& inText, bool inCountDropped = true);
+
+	// writes out everything queued; safe from any thread except in a signal handler
+	void Drain();
+
+	// best effort at getting queued messages out from a signal handler: no
+	// locks, no allocation, just write()
+	void EmergencyDrain();
+
+	void Start();
+	void Stop();
+
+	uint32 Dropped() const { return mDropped.load(std::memory_order_relaxed); }
+	uint32 Truncated() const { return mTruncated.load(std::memory_order_relaxed); }
+
+private:
+	enum {
+		kSlotCount = 512,		// power of two
+		kSlotTextSize = 2 * kStringBufferSize,
+		kBatchSize = 64,
+		kIdleMilliseconds = 5
+	};
+
+	struct Slot {
+		std::atomic<size_t> sequence;
+		size_t length;
+		char text[kSlotTextSize];
+	};
+
+	void WriterLoop();
+
+	std::unique_ptr<Slot[]> mSlots;
+	std::atomic<size_t> mEnqueuePosition;
+	std::atomic<size_t> mDequeuePosition;	// only the drainer moves this
+	std::atomic<uint32> mDropped;
+	std::atomic<uint32> mTruncated;
+	uint32 mReportedDropped;
+	uint32 mReportedTruncated;
+
+	std::mutex mDrainMutex;		// consumer side only
+	std::thread mThread;
+	std::atomic<bool> mQuit;
+	string mBatch;
+};
+
+static AsyncLogWriter* sAsyncWriter = NULL;
+static std::atomic<bool> sAsyncOutput(false);
+
+AsyncLogWriter::AsyncLogWriter() :
+	mSlots(new Slot[kSlotCount]),
+	mEnqueuePosition(0),
+	mDequeuePosition(0),
+	mDropped(0),
+	mTruncated(0),
+	mReportedDropped(0),
+	mReportedTruncated(0),
+	mQuit(false)
+{
+	for (size_t i = 0; i < kSlotCount; i++)
+		mSlots[i].sequence.store(i, std::memory_order_relaxed);
+	mBatch.reserve(kBatchSize * 128);
+}
+
+bool AsyncLogWriter::Push(const string& inText, bool inCountDropped)
+{
+	size_t pos = mEnqueuePosition.load(std::memory_order_relaxed);
+	Slot* slot;
+	for (;;)
+	{
+		slot = &mSlots[pos & (kSlotCount - 1)];
+		size_t seq = slot->sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+		if (diff == 0)
+		{
+			if (mEnqueuePosition.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+		{
+			if (inCountDropped)
+				mDropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		else
+			pos = mEnqueuePosition.load(std::memory_order_relaxed);
+	}
+
+	size_t length = inText.size();
+	if (length > kSlotTextSize)
+	{
+		// keep the line ending
+		length = kSlotTextSize;
+		memcpy(slot->text, inText.data(), length - 1);
+		slot->text[length - 1] = '\n';
+		mTruncated.fetch_add(1, std::memory_order_relaxed);
+	}
+	else
+		memcpy(slot->text, inText.data(), length);
+	slot->length = length;
+
+	slot->sequence.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+void AsyncLogWriter::Drain()
+{
+	std::lock_guard<std::mutex> lock(mDrainMutex);
+	for (;;)
+	{
+		// Slots are only handed back after their batch is written and
+		// flushed, so a crash mid-batch repeats lines rather than losing them
+		size_t first = mDequeuePosition.load(std::memory_order_relaxed);
+		size_t pos = first;
+		mBatch.clear();
+		while (pos - first < kBatchSize)
+		{
+			Slot& slot = mSlots[pos & (kSlotCount - 1)];
+			if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+				break;
+			mBatch.append(slot.text, slot.length);
+			pos++;
+		}
+
+		uint32 dropped = Dropped();
+		uint32 truncated = Truncated();
+		if (dropped != mReportedDropped || truncated != mReportedTruncated)
+		{
+			char stringBuffer[kStringBufferSize];
+			snprintf(stringBuffer, kStringBufferSize, "(logging fell behind: %u messages dropped, %u truncated so far)\n", dropped, truncated);
+			mBatch += stringBuffer;
+			mReportedDropped = dropped;
+			mReportedTruncated = truncated;
+		}
+
+		if (mBatch.empty())
+			break;
+
+		if (sOutputFile != NULL)
+		{
+			fwrite(mBatch.data(), 1, mBatch.size(), sOutputFile);
+			fflush(sOutputFile);
+		}
+		fwrite(mBatch.data(), 1, mBatch.size(), stderr);
+
+		for (size_t i = first; i != pos; i++)
+			mSlots[i & (kSlotCount - 1)].sequence.store(i + kSlotCount, std::memory_order_release);
+		mDequeuePosition.store(pos, std::memory_order_release);
+	}
+}
+
+void AsyncLogWriter::EmergencyDrain()
+{
+	int file = sOutputFile != NULL ? raw_fileno(sOutputFile) : -1;
+	int err = raw_fileno(stderr);
+	for (size_t pos = mDequeuePosition.load(std::memory_order_acquire); ; pos++)
+	{
+		Slot& slot = mSlots[pos & (kSlotCount - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+			break;
+		if (file >= 0)
+			raw_write(file, slot.text, slot.length);
+		raw_write(err, slot.text, slot.length);
+	}
+}
+
+void AsyncLogWriter::Start()
+{
+	if (mThread.joinable())
+		return;
+	mQuit = false;
+	mThread = std::thread(&AsyncLogWriter::WriterLoop, this);
+}
+
+void AsyncLogWriter::Stop()
+{
+	if (mThread.joinable())
+	{
+		mQuit = true;
+		mThread.join();
+	}
+	Drain();
+}
+
+void AsyncLogWriter::WriterLoop()
+{
+	// polling keeps Push() free of locks and wakeups; nobody needs log
+	// lines faster than this
+	while (!mQuit)
+	{
+		Drain();
+		std::this_thread::sleep_for(std::chrono::milliseconds(kIdleMilliseconds));
+	}
+}
+
+
+// Crashes go through here so whatever is still queued makes it out
+static const int sCrashSignals[] = {
+	SIGSEGV, SIGILL, SIGFPE, SIGABRT,
+#ifdef SIGBUS
+	SIGBUS,
+#endif
+};
+typedef void (*SignalHandler)(int);
+static SignalHandler sPreviousSignalHandlers[sizeof(sCrashSignals) / sizeof(sCrashSignals[0])];
+
+static void
+CrashSignalHandler(int inSignal) {
+	if (sAsyncWriter != NULL)
+		sAsyncWriter->EmergencyDrain();
+
+	for (size_t i = 0; i < sizeof(sCrashSignals) / sizeof(sCrashSignals[0]); i++)
+	{
+		if (sCrashSignals[i] == inSignal)
+		{
+			SignalHandler previous = sPreviousSignalHandlers[i];
+			signal(inSignal, previous == SIG_ERR ? SIG_DFL : previous);
+		}
+	}
+	raise(inSignal);
+}
+
+static void
+ShutdownAsyncLogging() {
+	if (sAsyncWriter == NULL)
+		return;
+
+	// the writer keeps taking messages until nobody can be pushing any more;
+	// whatever was pushed while the flag went down gets the last drain
+	sAsyncWriter->Stop();
+	sAsyncOutput = false;
+	sAsyncWriter->Drain();
+}
+
+static void
+StartAsyncLogging() {
+	if (sAsyncWriter == NULL)
+	{
+		sAsyncWriter = new AsyncLogWriter;
+		atexit(ShutdownAsyncLogging);
+		for (size_t i = 0; i < sizeof(sCrashSignals) / sizeof(sCrashSignals[0]); i++)
+			sPreviousSignalHandlers[i] = signal(sCrashSignals[i], CrashSignalHandler);
+	}
+	sAsyncWriter->Start();
+	sAsyncOutput = true;
+}
 
 
 Logger*
@@ -159,19 +436,17 @@ TopLevelLogger::logMessageV(const char* inDomain, int inLevel, const char* inFil
         if(mMostRecentlyPrintedStackDepth != mMostRecentCommonStackDepth && firstDepthToPrint > 0)
             firstDepthToPrint--;
     */
+        string	theString;
         for(size_t depth = firstDepthToPrint; depth < mContextStack.size(); depth++) {
-            string	theString(depth * 2, ' ');
-    
+            theString.append(depth * 2, ' ');
             theString += "while ";
             theString += mContextStack[depth];
-            
-            fprintf(sOutputFile, "%s\n", theString.c_str());
-			fprintf(stderr, "%s\n", theString.c_str());
+            theString += "\n";
         }
         
         vsnprintf(stringBuffer, kStringBufferSize, inMessage, inArgs);
     
-        string	theString(mContextStack.size() * 2, ' ');
+        theString.append(mContextStack.size() * 2, ' ');
         
         theString += stringBuffer;
         
@@ -182,11 +457,7 @@ TopLevelLogger::logMessageV(const char* inDomain, int inLevel, const char* inFil
         else
             theString += "\n";
         
-        fprintf(sOutputFile, "%s", theString.c_str());
-		fprintf(stderr, "%s", theString.c_str());
-        
-        if(sFlushOutput)
-                fflush(sOutputFile);
+        WriteLogOutput(theString, inLevel);
         
         mMostRecentCommonStackDepth = mContextStack.size();
         mMostRecentlyPrintedStackDepth = mContextStack.size();
@@ -195,12 +466,55 @@ TopLevelLogger::logMessageV(const char* inDomain, int inLevel, const char* inFil
 
 void TopLevelLogger::flush()
 {
+	if (sAsyncWriter)
+	{
+		sAsyncWriter->Drain();
+	}
+	
 	if (sOutputFile)
 	{
 		fflush(sOutputFile);
 	}
 }
 
+static void
+WriteLogOutput(const string& inText, int inLevel) {
+	if (sAsyncOutput)
+	{
+		// errors are worth waiting for room for; if there still isn't any,
+		// they're written here, after everything queued before them
+		bool important = inLevel <= logErrorLevel;
+		if (!sAsyncWriter->Push(inText, !important))
+		{
+			if (!important)
+				return;
+
+			sAsyncWriter->Drain();
+			if (!sAsyncWriter->Push(inText, false))
+			{
+				if (sOutputFile != NULL)
+				{
+					fputs(inText.c_str(), sOutputFile);
+					fflush(sOutputFile);
+				}
+				fputs(inText.c_str(), stderr);
+				return;
+			}
+		}
+		
+		// whoever logs a fatal message is about to go down
+		if (inLevel <= logFatalLevel)
+			sAsyncWriter->Drain();
+		return;
+	}
+	
+	fputs(inText.c_str(), sOutputFile);
+	fputs(inText.c_str(), stderr);
+	
+	if(sFlushOutput)
+		fflush(sOutputFile);
+}
+
 #if defined(__unix__) || defined(__NetBSD__) || defined(__OpenBSD__) || (defined(__APPLE__) && defined(__MACH__))
 #include <unistd.h>
 #include <sys/types.h>
@@ -267,6 +581,22 @@ setFlushLoggingOutput(const char* inDomain, bool inFlushOutput) {
 }
 
 
+void
+setAsyncLoggingOutput(const char* inDomain, bool inAsyncOutput) {
+        if(inAsyncOutput)
+                StartAsyncLogging();
+        else
+                ShutdownAsyncLogging();
+}
+
+
+void
+getAsyncLoggingOverflow(unsigned int& outDropped, unsigned int& outTruncated) {
+        outDropped = sAsyncWriter ? sAsyncWriter->Dropped() : 0;
+        outTruncated = sAsyncWriter ? sAsyncWriter->Truncated() : 0;
+}
+
+
 void reset_mml_logging()
 {
 	// no reset
@@ -289,5 +619,8 @@ void parse_mml_logging(const InfoTree& root)
 		bool flush;
 		if (dtree.read_attr("flush", flush))
 			setFlushLoggingOutput(domain.c_str(), flush);
+		bool async;
+		if (dtree.read_attr("async", async))
+			setAsyncLoggingOutput(domain.c_str(), async);
 	}
 }
@@ -66,6 +66,8 @@ Logger* GetCurrentLogger();
 void setLoggingThreshhold(const char* inDomain, short inThreshhold); // message appears if its level < inThreshhold
 void setShowLoggingLocations(const char* inDomain, bool inShowLocations);	// show file and line?
 void setFlushLoggingOutput(const char* inDomain, bool inFlushOutput);	// flush output file after every log message?
+void setAsyncLoggingOutput(const char* inDomain, bool inAsyncOutput);	// hand writes off to a background thread?
+void getAsyncLoggingOverflow(unsigned int& outDropped, unsigned int& outTruncated);	// messages the async writer couldn't keep up with
 
 
 class InfoTree;
@@ -0,0 +1,183 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	One place to see how much memory the asset caches are holding, and to
+	make them give some back when they hold more than the budget allows
+*/
+
+#include "cseries.h"
+#include "MemoryBudget.h"
+
+#include "Console.h"
+#include "Logging.h"
+#include "screen.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+MemoryBudget* MemoryBudget::instance()
+{
+	static MemoryBudget budget;
+	return &budget;
+}
+
+MemoryBudget::MemoryBudget() : budget_(0), last_tick_(0), enforcing_(false)
+{
+	// ".memory" shows the caches, ".memory budget <MB>" changes the budget
+	CommandParser parser;
+	parser.register_command("", [this](const std::string&) {
+		for (auto& line : Report())
+		{
+			screen_printf("%s", line.c_str());
+		}
+		Log();
+	});
+	parser.register_command("budget", [this](const std::string& arg) {
+		SetBudget(static_cast<size_t>(std::max(0L, std::strtol(arg.c_str(), nullptr, 10))) * MEG);
+		screen_printf("Asset memory budget is %s", budget_ ? (std::to_string(budget_ / MEG) + " MB").c_str() : "unlimited");
+	});
+	Console::instance()->register_command("memory", parser);
+}
+
+int MemoryBudget::Register(const std::string& name, Priority priority, std::function<size_t()> bytes, std::function<size_t(size_t)> trim, bool resident)
+{
+	Cache cache;
+	cache.name = name;
+	cache.priority = priority;
+	cache.resident = resident;
+	cache.bytes = bytes;
+	cache.trim = trim;
+	cache.hits = cache.misses = cache.evictions = cache.trimmed = 0;
+
+	caches_.push_back(cache);
+	return static_cast<int>(caches_.size()) - 1;
+}
+
+void MemoryBudget::SetBudget(size_t bytes)
+{
+	budget_ = bytes;
+	Enforce();
+}
+
+size_t MemoryBudget::ResidentBytes() const
+{
+	size_t total = 0;
+	for (auto& cache : caches_)
+	{
+		if (cache.resident)
+		{
+			total += cache.bytes();
+		}
+	}
+
+	return total;
+}
+
+void MemoryBudget::Enforce()
+{
+	if (!budget_ || enforcing_)
+	{
+		return;
+	}
+
+	size_t total = ResidentBytes();
+	if (total <= budget_)
+	{
+		return;
+	}
+
+	// trimming a cache can touch another one (e.g. textures releasing
+	// shapes), so don't let that come back around to here
+	enforcing_ = true;
+
+	std::vector<Cache*> order;
+	for (auto& cache : caches_)
+	{
+		if (cache.resident && cache.trim)
+		{
+			order.push_back(&cache);
+		}
+	}
+	std::stable_sort(order.begin(), order.end(), [](const Cache* a, const Cache* b) { return a->priority < b->priority; });
+
+	size_t start = total;
+	for (auto cache : order)
+	{
+		if (total <= budget_)
+		{
+			break;
+		}
+
+		size_t freed = cache->trim(total - budget_);
+		cache->trimmed += freed;
+		total -= std::min(freed, total);
+	}
+
+	enforcing_ = false;
+
+	logNote("asset caches were %u KB over the %u KB budget; trimmed %u KB",
+			static_cast<unsigned>((start - budget_) / KILO), static_cast<unsigned>(budget_ / KILO), static_cast<unsigned>((start - total) / KILO));
+	if (total > budget_)
+	{
+		logWarning("asset caches are still %u KB over budget; what's left is in use", static_cast<unsigned>((total - budget_) / KILO));
+	}
+}
+
+void MemoryBudget::Tick()
+{
+	uint32_t now = machine_tick_count();
+	if (now - last_tick_ >= MACHINE_TICKS_PER_SECOND)
+	{
+		last_tick_ = now;
+		Enforce();
+	}
+}
+
+std::vector<std::string> MemoryBudget::Report() const
+{
+	std::vector<std::string> lines;
+	char line[256];
+	for (auto& cache : caches_)
+	{
+		uint64_t lookups = cache.hits + cache.misses;
+		snprintf(line, sizeof(line), "%s: %u KB%s, %u%% hits of %llu, %llu evicted, %u KB trimmed",
+				 cache.name.c_str(), static_cast<unsigned>(cache.bytes() / KILO), cache.resident ? "" : " (on disk)",
+				 static_cast<unsigned>(lookups ? cache.hits * 100 / lookups : 0), static_cast<unsigned long long>(lookups),
+				 static_cast<unsigned long long>(cache.evictions), static_cast<unsigned>(cache.trimmed / KILO));
+		lines.push_back(line);
+	}
+
+	if (budget_)
+	{
+		snprintf(line, sizeof(line), "total: %u KB of %u KB budget", static_cast<unsigned>(ResidentBytes() / KILO), static_cast<unsigned>(budget_ / KILO));
+	}
+	else
+	{
+		snprintf(line, sizeof(line), "total: %u KB, no budget", static_cast<unsigned>(ResidentBytes() / KILO));
+	}
+	lines.push_back(line);
+
+	return lines;
+}
+
+void MemoryBudget::Log() const
+{
+	for (auto& line : Report())
+	{
+		logNote("asset cache %s", line.c_str());
+	}
+}
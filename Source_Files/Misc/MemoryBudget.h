@@ -0,0 +1,92 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	One place to see how much memory the asset caches are holding, and to
+	make them give some back when they hold more than the budget allows
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class MemoryBudget {
+public:
+	static MemoryBudget* instance();
+
+	// when over budget, lower priority caches are trimmed first
+	enum Priority {
+		kPriorityLow,
+		kPriorityNormal,
+		kPriorityHigh
+	};
+
+	// bytes() reports what the cache holds; trim(n) tries to free at least n
+	// bytes and returns how many it did free. Caches that aren't resident
+	// (e.g. on disk) are reported, but don't count against the budget.
+	// Returns an id for the counters below. Main thread only, like the
+	// rest of this class.
+	int Register(const std::string& name, Priority priority, std::function<size_t()> bytes, std::function<size_t(size_t)> trim, bool resident = true);
+
+	void Hit(int id, int count = 1) { if (id >= 0) caches_[id].hits += count; }
+	void Miss(int id, int count = 1) { if (id >= 0) caches_[id].misses += count; }
+	void Evicted(int id, int count = 1) { if (id >= 0) caches_[id].evictions += count; }
+
+	// 0 is unlimited
+	void SetBudget(size_t bytes);
+	size_t Budget() const { return budget_; }
+
+	size_t ResidentBytes() const;
+
+	// trims caches until they fit the budget; only call this where none of
+	// them are in the middle of using what they hold
+	void Enforce();
+
+	// Enforce(), but at most once a second
+	void Tick();
+
+	// one line per cache, plus a total
+	std::vector<std::string> Report() const;
+	void Log() const;
+
+private:
+	MemoryBudget();
+
+	struct Cache {
+		std::string name;
+		Priority priority;
+		bool resident;
+		std::function<size_t()> bytes;
+		std::function<size_t(size_t)> trim;
+
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+		uint64_t trimmed;
+	};
+
+	std::vector<Cache> caches_;
+	size_t budget_;
+	uint32_t last_tick_;
+	bool enforcing_;
+};
+
+#endif
@@ -0,0 +1,220 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Shared pool of worker threads for splitting up CPU-bound work
+*/
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <exception>
+
+// more than this and the chunks get too small to be worth handing out
+static constexpr unsigned int kMaximumWorkers = 15;
+
+// hand out a few chunks per thread, so one slow chunk doesn't hold up the rest
+static constexpr int kChunksPerThread = 4;
+
+struct WorkerPool::Group {
+	size_t pending = 0;
+	std::exception_ptr error;
+};
+
+WorkerPool* WorkerPool::instance()
+{
+	static WorkerPool pool;
+	return &pool;
+}
+
+WorkerPool::WorkerPool() : quit_(false)
+{
+	unsigned int cores = std::thread::hardware_concurrency();
+	unsigned int count = std::min(cores > 1 ? cores - 1 : 0, kMaximumWorkers);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		workers_.emplace_back(&WorkerPool::WorkerLoop, this);
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+	work_available_.notify_all();
+
+	for (auto& worker : workers_)
+	{
+		worker.join();
+	}
+}
+
+void WorkerPool::Run(const std::vector<std::function<void()> >& tasks)
+{
+	if (workers_.empty() || tasks.size() < 2)
+	{
+		for (auto& task : tasks)
+		{
+			task();
+		}
+		return;
+	}
+
+	Group group;
+	group.pending = tasks.size() - 1;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (size_t i = 1; i < tasks.size(); ++i)
+		{
+			queue_.push_back({tasks[i], &group});
+		}
+	}
+	work_available_.notify_all();
+
+	// the caller takes the first task itself, then helps with the rest of
+	// its group until everything has finished
+	std::exception_ptr error;
+	try
+	{
+		tasks[0]();
+	}
+	catch (...)
+	{
+		error = std::current_exception();
+	}
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (group.pending)
+	{
+		if (!RunOne(lock, &group))
+		{
+			work_done_.wait(lock);
+		}
+	}
+
+	if (!error)
+	{
+		error = group.error;
+	}
+	lock.unlock();
+
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
+
+void WorkerPool::ParallelFor(int begin, int end, const std::function<void(int, int)>& fn, int min_chunk)
+{
+	int count = end - begin;
+	if (count <= 0)
+	{
+		return;
+	}
+
+	int chunks = std::min(Concurrency() * kChunksPerThread, count / std::max(min_chunk, 1));
+	if (chunks <= 1)
+	{
+		fn(begin, end);
+		return;
+	}
+
+	std::vector<std::function<void()> > tasks;
+	tasks.reserve(chunks);
+	for (int i = 0; i < chunks; ++i)
+	{
+		int first = begin + static_cast<int>(static_cast<int64_t>(count) * i / chunks);
+		int last = begin + static_cast<int>(static_cast<int64_t>(count) * (i + 1) / chunks);
+		tasks.push_back([&fn, first, last]() { fn(first, last); });
+	}
+
+	Run(tasks);
+}
+
+void WorkerPool::Post(std::function<void()> task)
+{
+	if (workers_.empty())
+	{
+		task();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		queue_.push_back({std::move(task), nullptr});
+	}
+	work_available_.notify_one();
+}
+
+// runs the first queued job belonging to group (or any job, if group is
+// null); the lock is released while the job runs
+bool WorkerPool::RunOne(std::unique_lock<std::mutex>& lock, Group* group)
+{
+	auto it = queue_.begin();
+	if (group)
+	{
+		it = std::find_if(queue_.begin(), queue_.end(), [group](const Job& job) { return job.group == group; });
+	}
+
+	if (it == queue_.end())
+	{
+		return false;
+	}
+
+	Job job = std::move(*it);
+	queue_.erase(it);
+	lock.unlock();
+
+	std::exception_ptr error;
+	try
+	{
+		job.fn();
+	}
+	catch (...)
+	{
+		error = std::current_exception();
+	}
+
+	lock.lock();
+	if (job.group)
+	{
+		if (error && !job.group->error)
+		{
+			job.group->error = error;
+		}
+
+		if (--job.group->pending == 0)
+		{
+			work_done_.notify_all();
+		}
+	}
+
+	return true;
+}
+
+void WorkerPool::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!quit_)
+	{
+		if (!RunOne(lock, nullptr))
+		{
+			work_available_.wait(lock);
+		}
+	}
+}
@@ -0,0 +1,72 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Shared pool of worker threads for splitting up CPU-bound work
+*/
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool {
+public:
+	static WorkerPool* instance();
+
+	// number of threads that share the work, counting the caller
+	int Concurrency() const { return static_cast<int>(workers_.size()) + 1; }
+
+	// runs every task concurrently and returns once all of them are done;
+	// the calling thread works on the tasks too, so nesting is safe
+	void Run(const std::vector<std::function<void()> >& tasks);
+
+	// calls fn(first, last) on consecutive chunks of [begin, end), in
+	// parallel; chunks are never smaller than min_chunk elements
+	void ParallelFor(int begin, int end, const std::function<void(int, int)>& fn, int min_chunk = 1);
+
+	// queues a task for a worker and returns immediately; anything the task
+	// throws is dropped
+	void Post(std::function<void()> task);
+
+	~WorkerPool();
+
+private:
+	WorkerPool();
+
+	struct Group;
+	struct Job {
+		std::function<void()> fn;
+		Group* group;
+	};
+
+	bool RunOne(std::unique_lock<std::mutex>& lock, Group* group);
+	void WorkerLoop();
+
+	std::vector<std::thread> workers_;
+	std::deque<Job> queue_;
+	std::mutex mutex_;
+	std::condition_variable work_available_;
+	std::condition_variable work_done_;
+	bool quit_;
+};
+
+#endif
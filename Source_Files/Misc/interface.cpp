@@ -199,6 +199,8 @@ const short max_handled_recording= RECORDING_VERSION_ALEPH_ONE_1_4;
 #include "motion_sensor.h" // for reset_motion_sensor()
 
 #include "lua_hud_script.h"
+#include "MemoryBudget.h"
+#include "FrameTimer.h"
 
 using alephone::Screen;
 
@@ -1204,9 +1206,21 @@ bool idle_game_state(uint32 time)
 	{
 		// ZZZ change: update_world() whether or not get_keyboard_controller_status() is true
 		// This way we won't fill up queues and stall netgames if one player switches out for a bit.
-		std::pair<bool, int16> theUpdateResult= update_world();
+		std::pair<bool, int16> theUpdateResult;
+		{
+			FrameTimer::Scope timer(FrameTimer::kWorldUpdate);
+			theUpdateResult= replay_is_unthrottled() ? update_unthrottled_replay() : update_world();
+		}
 		short ticks_elapsed= theUpdateResult.second;
 
+		// with pipelined rendering, the last frame was rasterizing while the
+		// world updated; show it now
+		finish_render_screen();
+
+		// between frames nothing is holding on to cached assets; once the
+		// next frame starts, a worker may be drawing from them
+		MemoryBudget::instance()->Tick();
+
 		if (get_keyboard_controller_status())
 		{
 			// ZZZ: I don't know for sure that render_screen works best with the number of _real_
@@ -1215,11 +1229,11 @@ bool idle_game_state(uint32 time)
 			auto heartbeat_fraction = get_heartbeat_fraction();
 			if (theUpdateResult.first || (last_heartbeat_fraction != -1 && last_heartbeat_fraction != heartbeat_fraction)) {
 				last_heartbeat_fraction = heartbeat_fraction;
-				render_screen(ticks_elapsed);
+				start_render_screen(ticks_elapsed);
 				first_frame_rendered = ticks_elapsed > 0;
 			}
 		}
-		
+
 		return theUpdateResult.first;
 	} else {
 		/* Update the fade ins, etc.. */
@@ -2340,6 +2354,13 @@ static void finish_game(
 	}
 	Movie::instance()->StopRecording();
 
+	// batch runs of films (e.g. to pull stats out of them) end with the film
+	if (shell_options.fast_replay && game_state.user == _replay)
+	{
+		L_Call_Cleanup();
+		exit(0);
+	}
+
 	if (shell_options.editor && shell_options.output.size())
 	{
 		L_Call_Cleanup();
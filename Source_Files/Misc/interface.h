@@ -54,6 +54,8 @@ May 16, 2002 (Woody Zenfell):
 
 #include "cseries.h"
 
+#include <utility>
+
 class FileSpecifier;
 class OpenedResourceFile;
 
@@ -326,6 +328,14 @@ int count_replacement_collections();
 void load_replacement_collections();
 void unload_all_collections(void);
 
+// level prefetching (see game_wad.cpp): begin on the main thread, decode on a worker
+// thread, then commit on the main thread for the next load_collections() to use
+struct collection_prefetch;
+struct collection_prefetch *begin_collection_prefetch(void);
+size_t decode_prefetched_collections(struct collection_prefetch *prefetch, const short *collections, int count, size_t budget);
+void commit_collection_prefetch(struct collection_prefetch *prefetch);
+void dispose_collection_prefetch(struct collection_prefetch *prefetch);
+
 void set_shapes_patch_data(uint8 *data, size_t length);
 uint8* get_shapes_patch_data(size_t &length);
 
@@ -374,9 +384,14 @@ void stop_recording(void);
 void stop_replay(void);
 void move_replay(void);
 void check_recording_replaying(void);
+void film_tick_completed(bool changed_level);
+int32 get_replay_tick(void);
+bool seek_replay(int32 tick);
 bool has_recording_file(void);
 void increment_replay_speed(void);
 void decrement_replay_speed(void);
+bool replay_is_unthrottled(void);
+std::pair<bool, int16> update_unthrottled_replay(void);
 void reset_recording_and_playback_queues(void);
 uint32 parse_keymap(void);
 
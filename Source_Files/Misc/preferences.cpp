@@ -3486,6 +3486,7 @@ InfoTree graphics_preferences_tree()
 	root.put_attr("scmode_accel", graphics_preferences->screen_mode.acceleration);
 	root.put_attr("scmode_highres", graphics_preferences->screen_mode.high_resolution);
 	root.put_attr("scmode_draw_every_other_line", graphics_preferences->screen_mode.draw_every_other_line);
+	root.put_attr("scmode_lowres_scale", graphics_preferences->screen_mode.low_resolution_scale);
 	root.put_attr("scmode_fov", graphics_preferences->screen_mode.fov);
 	root.put_attr("scmode_fullscreen", graphics_preferences->screen_mode.fullscreen);
 	root.put_attr("scmode_bitdepth", graphics_preferences->screen_mode.bit_depth);
@@ -3494,6 +3495,7 @@ InfoTree graphics_preferences_tree()
 	root.put_attr("ogl_flags", graphics_preferences->OGL_Configure.Flags);
 	root.put_attr("software_alpha_blending", graphics_preferences->software_alpha_blending);
 	root.put_attr("software_sdl_driver", graphics_preferences->software_sdl_driver);
+	root.put_attr("software_pipelined_rendering", graphics_preferences->software_pipelined_rendering);
 	root.put_attr("fps_target", graphics_preferences->fps_target);
 	root.put_attr("anisotropy_level", graphics_preferences->OGL_Configure.AnisotropyLevel);
 	root.put_attr("multisamples", graphics_preferences->OGL_Configure.Multisamples);
@@ -3894,6 +3896,7 @@ InfoTree environment_preferences_tree()
 	root.put_attr("hide_alephone_extensions", environment_preferences->hide_extensions);
 	root.put_attr("film_profile", static_cast<uint32>(environment_preferences->film_profile));
 	root.put_attr("maximum_quick_saves", environment_preferences->maximum_quick_saves);
+	root.put_attr("asset_memory_budget", environment_preferences->asset_memory_budget);
 #ifdef HAVE_NFD
 	root.put_attr("use_native_file_dialogs", environment_preferences->use_native_file_dialogs);
 #endif
@@ -3971,6 +3974,7 @@ static void default_graphics_preferences(graphics_preferences_data *preferences)
 	preferences->screen_mode.bit_depth = 32;
 	
 	preferences->screen_mode.draw_every_other_line= false;
+	preferences->screen_mode.low_resolution_scale = 2;
 
 	preferences->screen_mode.fov = 0; // use default
 	
@@ -3980,6 +3984,7 @@ static void default_graphics_preferences(graphics_preferences_data *preferences)
 
 	preferences->software_alpha_blending = _sw_alpha_off;
 	preferences->software_sdl_driver = _sw_driver_default;
+	preferences->software_pipelined_rendering = false;
 	preferences->fps_target = 30;
 
 	preferences->movie_export_video_quality = 50;
@@ -4124,6 +4129,7 @@ static void default_environment_preferences(environment_preferences_data *prefer
 	preferences->hide_extensions = true;
 	preferences->film_profile = FILM_PROFILE_DEFAULT;
 	preferences->maximum_quick_saves = 0;
+	preferences->asset_memory_budget = 0;
 #ifdef HAVE_NFD
 	preferences->use_native_file_dialogs = false;
 #endif
@@ -4180,6 +4186,12 @@ static bool validate_graphics_preferences(graphics_preferences_data *preferences
 		changed = true;
 	}
 
+	if (preferences->screen_mode.low_resolution_scale < 2 || preferences->screen_mode.low_resolution_scale > 8)
+	{
+		preferences->screen_mode.low_resolution_scale = 2;
+		changed = true;
+	}
+
 	return changed;
 }
 
@@ -4441,6 +4453,7 @@ void parse_graphics_preferences(InfoTree root, std::string version)
 	root.read_attr("scmode_accel", graphics_preferences->screen_mode.acceleration);
 	root.read_attr("scmode_highres", graphics_preferences->screen_mode.high_resolution);
 	root.read_attr("scmode_draw_every_other_line", graphics_preferences->screen_mode.draw_every_other_line);
+	root.read_attr("scmode_lowres_scale", graphics_preferences->screen_mode.low_resolution_scale);
 	root.read_attr("scmode_fullscreen", graphics_preferences->screen_mode.fullscreen);
 	
 	root.read_attr("scmode_fix_h_not_v", graphics_preferences->screen_mode.fix_h_not_v);
@@ -4450,6 +4463,7 @@ void parse_graphics_preferences(InfoTree root, std::string version)
 	root.read_attr("ogl_flags", graphics_preferences->OGL_Configure.Flags);
 	root.read_attr("software_alpha_blending", graphics_preferences->software_alpha_blending);
 	root.read_attr("software_sdl_driver", graphics_preferences->software_sdl_driver);
+	root.read_attr("software_pipelined_rendering", graphics_preferences->software_pipelined_rendering);
 	root.read_attr("fps_target", graphics_preferences->fps_target);
 	root.read_attr("anisotropy_level", graphics_preferences->OGL_Configure.AnisotropyLevel);
 	root.read_attr("multisamples", graphics_preferences->OGL_Configure.Multisamples);
@@ -4893,6 +4907,7 @@ void parse_environment_preferences(InfoTree root, std::string version)
 		environment_preferences->film_profile = static_cast<FilmProfileType>(profile);
 	
 	root.read_attr("maximum_quick_saves", environment_preferences->maximum_quick_saves);
+	root.read_attr("asset_memory_budget", environment_preferences->asset_memory_budget);
 #ifdef HAVE_NFD
 	root.read_attr("use_native_file_dialogs", environment_preferences->use_native_file_dialogs);
 #endif
@@ -95,6 +95,7 @@ struct graphics_preferences_data
 
 	int16 software_alpha_blending;
 	int16 software_sdl_driver;
+	bool software_pipelined_rendering; // rasterize each frame while the next tick runs
 	int16 fps_target; // should be a multiple of 30; 0 = unlimited
 
 	int16 movie_export_video_quality;
@@ -266,6 +267,9 @@ struct environment_preferences_data
 	// how many auto-named save files to keep around (0 is unlimited)
 	uint32 maximum_quick_saves;
 
+	// MB of memory the asset caches may hold before they're trimmed (0 is unlimited)
+	uint32 asset_memory_budget;
+
 #ifdef HAVE_NFD
 	bool use_native_file_dialogs;
 #endif
@@ -98,6 +98,13 @@ Feb 20, 2002 (Woody Zenfell):
 #include "joystick.h"
 #include "Movie.h"
 #include "InfoTree.h"
+#include "game_wad.h"
+#include "lua_script.h"
+#include "shell_options.h"
+#include "world_hash.h"
+
+#include <algorithm>
+#include <vector>
 
 /* ---------- constants */
 
@@ -108,6 +115,18 @@ Feb 20, 2002 (Woody Zenfell):
 #define DISK_CACHE_SIZE             ((sizeof(int16)+sizeof(uint32))*100)
 #define MAXIMUM_REPLAY_SPEED         5
 #define MINIMUM_REPLAY_SPEED        -5
+#define UNTHROTTLED_REPLAY_SPEED    (MAXIMUM_REPLAY_SPEED+1) // as fast as the world runs
+#define UNTHROTTLED_FRAMES_PER_SECOND 10 // how often an unthrottled replay still draws
+
+// Keyframes go after the flags, past header.length, where nothing older looks
+#define KEYFRAME_TRACK_TAG          FOUR_CHARS_TO_INT('k','f','r','m')
+#define KEYFRAME_TRACK_VERSION       1
+#define KEYFRAME_INTERVAL           (30*TICKS_PER_SECOND)
+#define KEYFRAME_COPY_SIZE          (64*1024)
+
+// and after them, the world hash after every tick
+#define WORLD_HASH_TRACK_TAG        FOUR_CHARS_TO_INT('w','h','s','h')
+#define WORLD_HASH_TRACK_VERSION     1
 
 /* ---------- macros */
 
@@ -131,6 +150,31 @@ static OpenedFile FilmFile;
 
 struct replay_private_data replay;
 
+// Every KEYFRAME_INTERVAL ticks of a recording, the world is saved the way a
+// saved game is; seeking a replay restores the nearest one before the target
+// and simulates only what's left, instead of everything from tick 0.
+// While recording they're kept in a temporary file next to the film, and
+// copied onto the end of it when recording stops.
+struct film_keyframe {
+	int32 tick;		// world ticks since the film started
+	int32 offset;	// of the saved state, in the keyframe or film file
+	int32 length;
+};
+
+static std::vector<film_keyframe> film_keyframes;
+static int32 film_tick;
+
+static FileSpecifier KeyframeFileSpec;
+static OpenedFile KeyframeFile;
+
+// replay: film offset of each round of RECORD_CHUNK_SIZE flags per player
+static std::vector<int32> film_round_offsets;
+
+// The world hash after each tick of the film; a replay that comes up with a
+// different one has gone out of sync
+static std::vector<uint32> film_world_hashes;
+static int32 film_divergent_tick= NONE;
+
 #ifdef DEBUG
 ActionQueue *get_player_recording_queue(
 	short player_index)
@@ -155,6 +199,18 @@ static short get_recording_queue_size(short which_queue);
 static uint8 *unpack_recording_header(uint8 *Stream, recording_header *Objects, size_t Count);
 static uint8 *pack_recording_header(uint8 *Stream, recording_header *Objects, size_t Count);
 
+static void record_film_keyframe(void);
+static void discard_film_keyframes(void);
+static void write_keyframe_track(int32 offset);
+static int32 read_keyframe_track(void);
+static void write_world_hash_track(int32 offset);
+static void read_world_hash_track(int32 offset);
+static bool find_film_round_offsets(void);
+static bool restore_film_keyframe(const film_keyframe& keyframe);
+static int32 queue_replay_flags(int32 wanted);
+static void fast_forward_replay(int32 tick);
+static void seek_command(const std::string& arg);
+
 // #define DEBUG_REPLAY
 
 #ifdef DEBUG_REPLAY
@@ -183,6 +239,8 @@ void initialize_keyboard_controller(
 	input_task= install_timer_task(TICKS_PER_SECOND, input_controller);
 	assert(input_task);
 	
+	Console::instance()->register_command("seek", seek_command);
+	
 	atexit(remove_input_controller);
 	
 	/* Allocate the recording queues */	
@@ -243,11 +301,17 @@ void increment_replay_speed(
 	void)
 {
 	if (replay.replay_speed < MAXIMUM_REPLAY_SPEED) replay.replay_speed++;
+	else if (replay.replay_speed == MAXIMUM_REPLAY_SPEED && !Movie::instance()->IsRecording())
+	{
+		replay.replay_speed= UNTHROTTLED_REPLAY_SPEED;
+		screen_printf("Replaying as fast as possible");
+	}
 }
 
 void decrement_replay_speed(
 	void)
 {
+	if (replay.replay_speed == UNTHROTTLED_REPLAY_SPEED) sync_heartbeat_count();
 	if (replay.replay_speed > MINIMUM_REPLAY_SPEED) replay.replay_speed--;
 }
 
@@ -256,6 +320,11 @@ int get_replay_speed()
 	return replay.replay_speed;
 }
 
+bool replay_is_unthrottled()
+{
+	return replay.game_is_being_replayed && replay.replay_speed == UNTHROTTLED_REPLAY_SPEED;
+}
+
 bool game_is_being_replayed()
 {
 	return replay.game_is_being_replayed;
@@ -290,8 +359,9 @@ bool input_controller(
 			{
 				static short phase= 0; /* When this gets to 0, update the world */
 
-				/* Minimum replay speed is a pause. */
-				if(replay.replay_speed != MINIMUM_REPLAY_SPEED)
+				/* Minimum replay speed is a pause; unthrottled replays pull their
+					own flags, from update_unthrottled_replay() */
+				if(replay.replay_speed != MINIMUM_REPLAY_SPEED && replay.replay_speed != UNTHROTTLED_REPLAY_SPEED)
 				{
 					if (replay.replay_speed > 0 || (--phase<=0))
 					{
@@ -567,6 +637,9 @@ bool setup_for_replay_from_file(
 		FilmFile.Read(SIZEOF_recording_header,Header);
 		unpack_recording_header(Header,&replay.header,1);
 		replay.header.game_information.cheat_flags = _allow_crosshair | _allow_tunnel_vision | _allow_behindview | _allow_overlay_map;
+		
+		film_tick= 0;
+		read_world_hash_track(read_keyframe_track());
 	
 		/* Set to the mapfile this replay came from.. */
 		if(use_map_file(replay.header.map_checksum))
@@ -574,7 +647,7 @@ bool setup_for_replay_from_file(
 			replay.fsread_buffer= new char[DISK_CACHE_SIZE];
 			replay.location_in_cache= NULL;
 			replay.bytes_in_cache= 0;
-			replay.replay_speed= 1;
+			replay.replay_speed= shell_options.fast_replay && !Movie::instance()->IsRecording() ? UNTHROTTLED_REPLAY_SPEED : 1;
 			
 #ifdef DEBUG_REPLAY
 			open_stream_file();
@@ -610,6 +683,9 @@ void start_recording(
 		if (FilmFileSpec.Open(FilmFile,true))
 		{
 			replay.game_is_being_recorded= true;
+			film_tick= 0;
+			discard_film_keyframes();
+			film_world_hashes.clear();
 	
 			// save a header containing information about the game.
 			byte Header[SIZEOF_recording_header];
@@ -649,6 +725,14 @@ void stop_recording(
 		FilmFile.GetLength(total_length);
 		assert(total_length==replay.header.length);
 		
+		write_keyframe_track(total_length);
+		discard_film_keyframes();
+
+		int32 hash_offset;
+		if (FilmFile.GetLength(hash_offset))
+			write_world_hash_track(hash_offset);
+		film_world_hashes.clear();
+		
 		FilmFile.Close();
 	}
 
@@ -678,6 +762,9 @@ void rewind_recording(
 		
 		// Use the packed length here!!!
 		replay.header.length= SIZEOF_recording_header;
+		
+		film_tick= 0;
+		discard_film_keyframes();
 	}
 }
 
@@ -768,6 +855,9 @@ void stop_replay(
 #ifdef DEBUG_REPLAY
 		close_stream_file();
 #endif
+		film_keyframes.clear();
+		film_round_offsets.clear();
+		film_world_hashes.clear();
 	}
 
 	/* Unecessary, because reset_player_queues calls this. */
@@ -862,6 +952,459 @@ static void read_recording_queue_chunks(
 	}
 }
 
+/* ---------- film keyframes */
+
+void film_tick_completed(
+	bool changed_level)
+{
+	if (!replay.game_is_being_recorded && !replay.game_is_being_replayed) return;
+
+	film_tick++;
+
+	if (replay.game_is_being_recorded)
+	{
+		// a rewound recording starts over
+		film_world_hashes.resize(film_tick - 1);
+		film_world_hashes.push_back(calculate_world_hash());
+	}
+	else if (film_divergent_tick == NONE && film_tick <= static_cast<int32>(film_world_hashes.size()) &&
+		calculate_world_hash() != film_world_hashes[film_tick - 1])
+	{
+		film_divergent_tick= film_tick;
+		logWarning("the replay went out of sync with the film at tick %d", film_divergent_tick);
+		screen_printf("Replay out of sync at tick %d", film_divergent_tick);
+	}
+
+	// Lua state can't be saved completely, so a keyframe wouldn't play out
+	// the same way
+	if (replay.game_is_being_recorded && !changed_level && film_tick % KEYFRAME_INTERVAL == 0 && !LuaRunning())
+	{
+		record_film_keyframe();
+	}
+}
+
+int32 get_replay_tick(
+	void)
+{
+	return film_tick;
+}
+
+static void record_film_keyframe(
+	void)
+{
+	if (!KeyframeFile.IsOpen())
+	{
+		KeyframeFileSpec.SetTempName(FilmFileSpec);
+		if (!KeyframeFileSpec.Create(_typecode_film) || !KeyframeFileSpec.Open(KeyframeFile, true))
+		{
+			logWarning("couldn't create a keyframe file for the film; seeking in it won't be possible");
+			return;
+		}
+	}
+
+	std::vector<uint8> state;
+	if (!save_game_state(state)) return;
+
+	film_keyframe keyframe;
+	keyframe.tick= film_tick;
+	keyframe.offset= film_keyframes.empty() ? 0 : film_keyframes.back().offset + film_keyframes.back().length;
+	keyframe.length= static_cast<int32>(state.size());
+	if (KeyframeFile.SetPosition(keyframe.offset) && KeyframeFile.Write(keyframe.length, state.data()))
+	{
+		film_keyframes.push_back(keyframe);
+	}
+}
+
+static void discard_film_keyframes(
+	void)
+{
+	if (KeyframeFile.IsOpen())
+	{
+		KeyframeFile.Close();
+		KeyframeFileSpec.Delete();
+	}
+	film_keyframes.clear();
+}
+
+/* Track layout: tag, version, keyframe count, then (tick, length, state) for each */
+static void write_keyframe_track(
+	int32 offset)
+{
+	if (film_keyframes.empty()) return;
+
+	uint8 Header[sizeof(uint32) + 2*sizeof(int16)];
+	uint8 *S= Header;
+	uint32 tag= KEYFRAME_TRACK_TAG;
+	int16 version= KEYFRAME_TRACK_VERSION;
+	int16 count= static_cast<int16>(std::min<size_t>(film_keyframes.size(), INT16_MAX));
+	ValueToStream(S,tag);
+	ValueToStream(S,version);
+	ValueToStream(S,count);
+
+	bool success= FilmFile.SetPosition(offset) && FilmFile.Write(sizeof(Header), Header);
+
+	std::vector<uint8> buffer(KEYFRAME_COPY_SIZE);
+	for (int16 i= 0; success && i<count; ++i)
+	{
+		film_keyframe& keyframe= film_keyframes[i];
+		uint8 EntryHeader[2*sizeof(int32)];
+		S= EntryHeader;
+		ValueToStream(S,keyframe.tick);
+		ValueToStream(S,keyframe.length);
+		success= FilmFile.Write(sizeof(EntryHeader), EntryHeader) && KeyframeFile.SetPosition(keyframe.offset);
+
+		for (int32 copied= 0; success && copied<keyframe.length; copied+= KEYFRAME_COPY_SIZE)
+		{
+			int32 size= std::min<int32>(KEYFRAME_COPY_SIZE, keyframe.length - copied);
+			success= KeyframeFile.Read(size, buffer.data()) && FilmFile.Write(size, buffer.data());
+		}
+	}
+
+	if (!success)
+	{
+		// the flags are fine; older versions never look past them anyway
+		logWarning("couldn't save the film's keyframes");
+	}
+}
+
+// Returns where the next track would start
+static int32 read_keyframe_track(
+	void)
+{
+	film_keyframes.clear();
+	film_round_offsets.clear();
+
+	int32 offset= replay.header.length;
+	int32 total_length;
+	uint8 Header[sizeof(uint32) + 2*sizeof(int16)];
+	if (FilmFile.GetLength(total_length) && total_length >= offset + int32(sizeof(Header)) &&
+		FilmFile.SetPosition(offset) && FilmFile.Read(sizeof(Header), Header))
+	{
+		uint8 *S= Header;
+		uint32 tag;
+		int16 version, count;
+		StreamToValue(S,tag);
+		StreamToValue(S,version);
+		StreamToValue(S,count);
+
+		if (tag == KEYFRAME_TRACK_TAG && version == KEYFRAME_TRACK_VERSION)
+		{
+			offset+= sizeof(Header);
+			for (int16 i= 0; i<count; ++i)
+			{
+				uint8 EntryHeader[2*sizeof(int32)];
+				if (!FilmFile.SetPosition(offset) || !FilmFile.Read(sizeof(EntryHeader), EntryHeader)) break;
+				
+				film_keyframe keyframe;
+				S= EntryHeader;
+				StreamToValue(S,keyframe.tick);
+				StreamToValue(S,keyframe.length);
+				keyframe.offset= offset + sizeof(EntryHeader);
+				if (keyframe.length < 0 || keyframe.offset + keyframe.length > total_length) break;
+				
+				film_keyframes.push_back(keyframe);
+				offset= keyframe.offset + keyframe.length;
+			}
+		}
+	}
+
+	FilmFile.SetPosition(SIZEOF_recording_header);
+	return offset;
+}
+
+/* Track layout: tag, version, hash version, tick count, then the hash after each tick */
+static void write_world_hash_track(
+	int32 offset)
+{
+	if (film_world_hashes.empty()) return;
+
+	std::vector<uint8> track(sizeof(uint32) + 2*sizeof(int16) + sizeof(int32) + film_world_hashes.size()*sizeof(uint32));
+	uint8 *S= track.data();
+	uint32 tag= WORLD_HASH_TRACK_TAG;
+	int16 version= WORLD_HASH_TRACK_VERSION;
+	int16 hash_version= WORLD_HASH_VERSION;
+	int32 count= static_cast<int32>(film_world_hashes.size());
+	ValueToStream(S,tag);
+	ValueToStream(S,version);
+	ValueToStream(S,hash_version);
+	ValueToStream(S,count);
+	for (auto hash : film_world_hashes)
+		ValueToStream(S,hash);
+
+	if (!FilmFile.SetPosition(offset) || !FilmFile.Write(static_cast<int32>(track.size()), track.data()))
+	{
+		logWarning("couldn't save the film's world hashes");
+	}
+}
+
+static void read_world_hash_track(
+	int32 offset)
+{
+	film_world_hashes.clear();
+	film_divergent_tick= NONE;
+
+	int32 total_length;
+	uint8 Header[sizeof(uint32) + 2*sizeof(int16) + sizeof(int32)];
+	if (FilmFile.GetLength(total_length) && total_length >= offset + int32(sizeof(Header)) &&
+		FilmFile.SetPosition(offset) && FilmFile.Read(sizeof(Header), Header))
+	{
+		uint8 *S= Header;
+		uint32 tag;
+		int16 version, hash_version;
+		int32 count;
+		StreamToValue(S,tag);
+		StreamToValue(S,version);
+		StreamToValue(S,hash_version);
+		StreamToValue(S,count);
+		offset+= sizeof(Header);
+
+		// films from versions that hashed differently just aren't checked
+		if (tag == WORLD_HASH_TRACK_TAG && version == WORLD_HASH_TRACK_VERSION && hash_version == WORLD_HASH_VERSION &&
+			count > 0 && count <= (total_length - offset) / int32(sizeof(uint32)))
+		{
+			std::vector<uint8> hashes(count*sizeof(uint32));
+			if (FilmFile.Read(static_cast<int32>(hashes.size()), hashes.data()))
+			{
+				film_world_hashes.resize(count);
+				S= hashes.data();
+				for (auto& hash : film_world_hashes)
+					StreamToValue(S,hash);
+			}
+		}
+	}
+
+	FilmFile.SetPosition(SIZEOF_recording_header);
+}
+
+// Walks the run-length encoded flags the same way read_recording_queue_chunks()
+// does, without keeping any of them
+static bool find_film_round_offsets(
+	void)
+{
+	if (!film_round_offsets.empty()) return true;
+
+	int32 length= replay.header.length - SIZEOF_recording_header;
+	std::vector<uint8> flags(std::max<int32>(length, 0));
+	int32 position;
+	FilmFile.GetPosition(position);
+	bool success= FilmFile.SetPosition(SIZEOF_recording_header) && FilmFile.Read(length, flags.data());
+	FilmFile.SetPosition(position);
+	if (!success) return false;
+
+	const int DataSize= sizeof(int16) + sizeof(uint32);
+	uint8 *S= flags.data();
+	uint8 *End= S + flags.size();
+	bool hit_end= false;
+	while (!hit_end)
+	{
+		film_round_offsets.push_back(SIZEOF_recording_header + static_cast<int32>(S - flags.data()));
+		for (short player_index= 0; !hit_end && player_index<replay.header.num_players; player_index++)
+		{
+			for (int32 count= 0; count<RECORD_CHUNK_SIZE; )
+			{
+				if (End - S < DataSize)
+				{
+					hit_end= true;
+					break;
+				}
+				
+				int16 num_flags;
+				StreamToValue(S,num_flags);
+				S+= sizeof(uint32);
+				if (num_flags == END_OF_RECORDING_INDICATOR)
+				{
+					hit_end= true;
+					break;
+				}
+				count+= num_flags;
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool restore_film_keyframe(
+	const film_keyframe& keyframe)
+{
+	int32 round= keyframe.tick / RECORD_CHUNK_SIZE;
+	if (!find_film_round_offsets() || round >= static_cast<int32>(film_round_offsets.size())) return false;
+
+	std::vector<uint8> state(keyframe.length);
+	if (!FilmFile.SetPosition(keyframe.offset) || !FilmFile.Read(keyframe.length, state.data())) return false;
+	if (!restore_game_state(state)) return false;
+
+	// this reset the action queues, so start reading flags again from the
+	// round the keyframe is in, and drop the ones before it
+	film_tick= keyframe.tick;
+	film_divergent_tick= NONE;
+	FilmFile.SetPosition(film_round_offsets[round]);
+	replay.location_in_cache= NULL;
+	replay.bytes_in_cache= 0;
+	replay.have_read_last_chunk= false;
+	reset_recording_and_playback_queues();
+	read_recording_queue_chunks();
+	for (short player_index= 0; player_index<dynamic_world->player_count; player_index++)
+	{
+		ActionQueue *queue= get_player_recording_queue(player_index);
+		for (int32 i= round*RECORD_CHUNK_SIZE; i<keyframe.tick && queue->read_index != queue->write_index; i++)
+		{
+			INCREMENT_QUEUE_COUNTER(queue->read_index);
+		}
+	}
+
+	return true;
+}
+
+// Queues up to wanted flags from the film, and returns how many are queued
+static int32 queue_replay_flags(
+	int32 wanted)
+{
+	check_recording_replaying();
+
+	int32 queued= GetRealActionQueues()->countActionFlags(0);
+	if (queued < wanted)
+	{
+		short available= MAXIMUM_QUEUE_SIZE;
+		for (short player_index= 0; player_index<dynamic_world->player_count; player_index++)
+		{
+			available= MIN(available, get_recording_queue_size(player_index));
+		}
+		
+		short count= static_cast<short>(MIN(wanted - queued, static_cast<int32>(available)));
+		if (count > 0 && pull_flags_from_recording(count))
+		{
+			queued+= count;
+		}
+	}
+
+	return queued;
+}
+
+// Runs the world as fast as it goes, without drawing, until the film gets to tick
+static void fast_forward_replay(
+	int32 tick)
+{
+	while (film_tick < tick && get_game_state() == _game_in_progress)
+	{
+		int32 wanted= tick - film_tick;
+		int32 queued= queue_replay_flags(wanted);
+		if (!queued) break; // end of the film
+
+		int32 previous_tick= film_tick;
+		heartbeat_count= dynamic_world->tick_count + MIN(wanted, queued);
+		update_world();
+		if (film_tick == previous_tick) break;
+	}
+
+	sync_heartbeat_count();
+}
+
+// Stands in for update_world() while a replay is unthrottled: runs as many
+// ticks as fit in one displayed frame, so the caller draws only that often
+std::pair<bool, int16> update_unthrottled_replay(
+	void)
+{
+	std::pair<bool, int16> result(false, 0);
+	uint32 deadline= machine_tick_count() + MACHINE_TICKS_PER_SECOND / UNTHROTTLED_FRAMES_PER_SECOND;
+
+	do
+	{
+		int32 queued= queue_replay_flags(MAXIMUM_QUEUE_SIZE);
+		if (!queued)
+		{
+			if (replay.have_read_last_chunk)
+			{
+				set_game_state(_switch_demo);
+			}
+			break;
+		}
+
+		heartbeat_count= dynamic_world->tick_count + queued;
+		std::pair<bool, int16> update= update_world();
+		result.first= result.first || update.first;
+		result.second+= update.second;
+		if (!update.second) break;
+	} while (get_game_state() == _game_in_progress && replay_is_unthrottled() && machine_tick_count() < deadline);
+
+	if (get_game_state() == _game_in_progress)
+	{
+		sync_heartbeat_count();
+	}
+
+	return result;
+}
+
+bool seek_replay(
+	int32 tick)
+{
+	if (!replay.game_is_being_replayed || replay.resource_data || get_game_state() != _game_in_progress) return false;
+
+	tick= MAX(tick, 0);
+
+	// the last keyframe at or before the target, if it's any help
+	const film_keyframe *keyframe= NULL;
+	for (const auto& k : film_keyframes)
+	{
+		if (k.tick <= tick) keyframe= &k;
+	}
+	if (keyframe && tick >= film_tick && keyframe->tick <= film_tick) keyframe= NULL;
+
+	if (tick < film_tick && !keyframe)
+	{
+		return false;
+	}
+	if (keyframe)
+	{
+		// scripts' state isn't in keyframes
+		if (LuaRunning() || !restore_film_keyframe(*keyframe)) return false;
+	}
+
+	fast_forward_replay(tick);
+	return true;
+}
+
+// ".seek 12:30" goes to that point in the film, ".seek +30" and ".seek -30" move
+// that many seconds; ".seek" alone says where the film is
+static void seek_command(
+	const std::string& arg)
+{
+	if (!replay.game_is_being_replayed)
+	{
+		screen_printf("Not replaying a film");
+		return;
+	}
+
+	if (!arg.empty())
+	{
+		int32 tick;
+		int minutes, seconds;
+		if (arg[0] == '+' || arg[0] == '-')
+		{
+			tick= film_tick + atoi(arg.c_str())*TICKS_PER_SECOND;
+		}
+		else if (sscanf(arg.c_str(), "%d:%d", &minutes, &seconds) == 2)
+		{
+			tick= (minutes*60 + seconds)*TICKS_PER_SECOND;
+		}
+		else
+		{
+			tick= atoi(arg.c_str())*TICKS_PER_SECOND;
+		}
+
+		uint32 start= machine_tick_count();
+		if (!seek_replay(tick))
+		{
+			screen_printf("Can't seek there; this film has no keyframe before that point");
+			return;
+		}
+		logNote("film seek to tick %d took %u ms", tick, machine_tick_count() - start);
+	}
+
+	screen_printf("Film at %d:%02d, %d keyframes", film_tick/TICKS_PER_SECOND/60, (film_tick/TICKS_PER_SECOND)%60,
+		static_cast<int>(film_keyframes.size()));
+}
+
 /* This is gross, (Alain wrote it, not me!) but I don't have time to clean it up */
 static bool vblFSRead(
 	OpenedFile& File,
@@ -24,6 +24,8 @@
 
 #include <string.h>
 #include <math.h>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 
 #include "VecOps.h"
@@ -33,6 +35,10 @@
 #ifdef HAVE_OPENGL
 
 #include "Model3D.h"
+#include "Console.h"
+#include "Logging.h"
+#include "WorkerPool.h"
+#include "screen.h"
 
 #ifdef HAVE_OPENGL
 #include "OGL_Headers.h"
@@ -67,6 +73,39 @@ inline void TransformVector(GLfloat *Dest, GLfloat *Src, Model3D_Transform& T)
 	}
 }
 
+// Transforms a run of points (or vectors, without the offset) in place;
+// with the matrix in locals and nothing aliased, compilers can vectorize it
+static void TransformPoints(GLfloat *Data, size_t Count, const Model3D_Transform& T, bool IsPoint)
+{
+	const GLfloat M00 = T.M[0][0], M01 = T.M[0][1], M02 = T.M[0][2];
+	const GLfloat M10 = T.M[1][0], M11 = T.M[1][1], M12 = T.M[1][2];
+	const GLfloat M20 = T.M[2][0], M21 = T.M[2][1], M22 = T.M[2][2];
+	const GLfloat O0 = IsPoint ? T.M[0][3] : 0;
+	const GLfloat O1 = IsPoint ? T.M[1][3] : 0;
+	const GLfloat O2 = IsPoint ? T.M[2][3] : 0;
+	
+	for (size_t k=0; k<Count; k++, Data+=3)
+	{
+		const GLfloat X = Data[0], Y = Data[1], Z = Data[2];
+		Data[0] = M00*X + M01*Y + M02*Z + O0;
+		Data[1] = M10*X + M11*Y + M12*Z + O1;
+		Data[2] = M20*X + M21*Y + M22*Z + O2;
+	}
+}
+
+// Big models are split up among the worker threads
+const int MinPoseChunk = 2048;
+
+static void TransformAll(GLfloat *Data, size_t Count, const Model3D_Transform& T, bool IsPoint)
+{
+	WorkerPool::instance()->ParallelFor(0, int(Count), [Data, &T, IsPoint](int First, int Last) {
+		TransformPoints(Data + 3*First, Last - First, T, IsPoint);
+	}, MinPoseChunk);
+}
+
+// How many poses each model keeps
+const size_t MaxPoses = 8;
+
 // Bone and Frame (positions, angles) -> Transform Matrix
 static void FindFrameTransform(Model3D_Transform& T,
 	Model3D_Frame& Frame, GLfloat MixFrac, Model3D_Frame& AddlFrame);
@@ -98,6 +137,7 @@ void Model3D::Clear()
 	Frames.clear();
 	SeqFrames.clear();
 	SeqFrmPointers.clear();
+	ForgetPoses();
 	FindBoundingBox();
 }
 
@@ -219,6 +259,8 @@ void Model3D::CalculateTangents()
 // Normalize the normals
 void Model3D::AdjustNormals(int NormalType, float SmoothThreshold)
 {
+	ForgetPoses();
+	
 	// Copy in normal sources for processing
 	if (!NormSources.empty())
 	{
@@ -702,6 +744,7 @@ bool Model3D::FindPositions_Neutral(bool UseModelTransform)
 {
 	// Positions already there
 	if (VtxSrcIndices.empty()) return false;
+	CurrentPoseValid = false;
 	
 	// Straight copy of the vertices:
 	
@@ -770,6 +813,11 @@ bool Model3D::FindPositions_Neutral(bool UseModelTransform)
 		objlist_copy(NormBase(),NormSrcBase(),NormSources.size());
 	}
 	
+	CurrentPose.SeqIndex = CurrentPose.FrameIndex = CurrentPose.AddlFrameIndex = NONE;
+	CurrentPose.MixFrac = 0;
+	CurrentPose.UseModelTransform = UseModelTransform;
+	CurrentPoseValid = true;
+	
 	return true;
 }
 
@@ -785,6 +833,7 @@ bool Model3D::FindPositions_Frame(bool UseModelTransform,
 	if (FrameIndex < 0 || NumBones*FrameIndex >= Frames.size()) return false;
 	
 	if (InverseVSIndices.empty()) BuildInverseVSIndices();
+	CurrentPoseValid = false;
 	
 	size_t NumVertices = VtxSrcIndices.size();
 	Positions.resize(3*NumVertices);
@@ -839,87 +888,80 @@ bool Model3D::FindPositions_Frame(bool UseModelTransform,
 	bool NormalsPresent = !NormSources.empty();
 	if (NormalsPresent) Normals.resize(NormSources.size());
 	
-	for (unsigned ivs=0; ivs<VtxSources.size(); ivs++)
-	{
-		Model3D_VertexSource& VS = VtxSources[ivs];
-		GLfloat Position[3];
-		
-		if (VS.Bone0 >= 0)
+	// Each vertex has one source, so the sources can be done in parallel
+	WorkerPool::instance()->ParallelFor(0, int(VtxSources.size()), [this, NormalsPresent](int First, int Last) {
+		for (int ivs=First; ivs<Last; ivs++)
 		{
-			Model3D_Transform& T0 = BoneMatrices[VS.Bone0];
-			TransformPoint(Position,VS.Position,T0);
-
-			if (NormalsPresent)
-			{
-				for (int iv=InvVSIPointers[ivs]; iv<InvVSIPointers[ivs+1]; iv++)
-				{
-					int Indx = 3*InverseVSIndices[iv];
-					TransformVector(NormBase() + Indx, NormSrcBase() + Indx, T0);
-				}
-			}			
-			
-			GLfloat Blend = VS.Blend;
-			if (VS.Bone1 >= 0 && Blend != 0)
+			Model3D_VertexSource& VS = VtxSources[ivs];
+			GLfloat Position[3];
+		
+			if (VS.Bone0 >= 0)
 			{
-				Model3D_Transform& T1 = BoneMatrices[VS.Bone1];
-				GLfloat PosExtra[3];
-				GLfloat PosDiff[3];
-				TransformPoint(PosExtra,VS.Position,T1);
-				VecSub(PosExtra,Position,PosDiff);
-				VecScalarMultTo(PosDiff,Blend);
-				VecAddTo(Position,PosDiff);
-				
+				Model3D_Transform& T0 = BoneMatrices[VS.Bone0];
+				TransformPoint(Position,VS.Position,T0);
+
 				if (NormalsPresent)
 				{
 					for (int iv=InvVSIPointers[ivs]; iv<InvVSIPointers[ivs+1]; iv++)
 					{
 						int Indx = 3*InverseVSIndices[iv];
-						GLfloat NormExtra[3];
-						GLfloat NormDiff[3];
-						GLfloat *OrigNorm = NormSrcBase() + Indx;
-						GLfloat *Norm = NormBase() + Indx;
-						TransformVector(NormExtra,OrigNorm,T1);
-						VecSub(NormExtra,Norm,NormDiff);
-						VecScalarMultTo(NormDiff,Blend);
-						VecAddTo(Norm,NormDiff);
+						TransformVector(NormBase() + Indx, NormSrcBase() + Indx, T0);
 					}
 				}			
+			
+				GLfloat Blend = VS.Blend;
+				if (VS.Bone1 >= 0 && Blend != 0)
+				{
+					Model3D_Transform& T1 = BoneMatrices[VS.Bone1];
+					GLfloat PosExtra[3];
+					GLfloat PosDiff[3];
+					TransformPoint(PosExtra,VS.Position,T1);
+					VecSub(PosExtra,Position,PosDiff);
+					VecScalarMultTo(PosDiff,Blend);
+					VecAddTo(Position,PosDiff);
+				
+					if (NormalsPresent)
+					{
+						for (int iv=InvVSIPointers[ivs]; iv<InvVSIPointers[ivs+1]; iv++)
+						{
+							int Indx = 3*InverseVSIndices[iv];
+							GLfloat NormExtra[3];
+							GLfloat NormDiff[3];
+							GLfloat *OrigNorm = NormSrcBase() + Indx;
+							GLfloat *Norm = NormBase() + Indx;
+							TransformVector(NormExtra,OrigNorm,T1);
+							VecSub(NormExtra,Norm,NormDiff);
+							VecScalarMultTo(NormDiff,Blend);
+							VecAddTo(Norm,NormDiff);
+						}
+					}			
+				}
 			}
-		}
-		else	// The assumed root bone (identity transformation)
-		{
-			VecCopy(VS.Position,Position);
-			if (NormalsPresent)
+			else	// The assumed root bone (identity transformation)
 			{
-				for (int iv=InvVSIPointers[ivs]; iv<InvVSIPointers[ivs+1]; iv++)
+				VecCopy(VS.Position,Position);
+				if (NormalsPresent)
 				{
-					int Indx = 3*InverseVSIndices[iv];
-					VecCopy(NormSrcBase() + Indx, NormBase() + Indx);
+					for (int iv=InvVSIPointers[ivs]; iv<InvVSIPointers[ivs+1]; iv++)
+					{
+						int Indx = 3*InverseVSIndices[iv];
+						VecCopy(NormSrcBase() + Indx, NormBase() + Indx);
+					}
 				}
 			}
-		}
 		
-		// Copy found position into vertex array!
-		for (int iv=InvVSIPointers[ivs]; iv<InvVSIPointers[ivs+1]; iv++)
-			VecCopy(Position,PosBase() + 3*InverseVSIndices[iv]);
-	}
+			// Copy found position into vertex array!
+			for (int iv=InvVSIPointers[ivs]; iv<InvVSIPointers[ivs+1]; iv++)
+				VecCopy(Position,PosBase() + 3*InverseVSIndices[iv]);
+		}
+	
+	}, MinPoseChunk);
 	
 	if (UseModelTransform)
 	{
-		GLfloat *PP = PosBase();
-		for (size_t k=0; k<Positions.size()/3; k++, PP+=3)
-		{
-			GLfloat Position[3];
-			TransformPoint(Position,PP,TransformPos);
-			VecCopy(Position,PP);
-		}
-		GLfloat *NP = NormBase();
-		for (size_t k=0; k<Normals.size()/3; k++, NP+=3)
-		{
-			GLfloat Normal[3];
-			TransformVector(Normal,NP,TransformNorm);
-			VecCopy(Normal,NP);
-		}
+		TransformAll(PosBase(), Positions.size()/3, TransformPos, true);
+		if (!Normals.empty())
+			TransformAll(NormBase(), Normals.size()/3, TransformNorm, false);
 	}
 	
 	return true;
@@ -944,14 +986,24 @@ bool Model3D::FindPositions_Sequence(bool UseModelTransform, GLshort SeqIndex,
 	
 	if (FrameIndex < 0 || FrameIndex >= NumSF) return false;
 	
+	bool Mixing = (MixFrac != 0 && AddlFrameIndex != FrameIndex);
+	if (Mixing && (AddlFrameIndex < 0 || AddlFrameIndex >= NumSF)) return false;
+	
+	PoseKey Key;
+	Key.SeqIndex = SeqIndex;
+	Key.FrameIndex = FrameIndex;
+	Key.AddlFrameIndex = Mixing ? AddlFrameIndex : FrameIndex;
+	Key.MixFrac = Mixing ? MixFrac : 0;
+	Key.UseModelTransform = UseModelTransform;
+	if (CurrentPoseValid && CurrentPose == Key) return true;
+	if (FindCachedPose(Key)) return true;
+	
 	Model3D_Transform TSF;
 	
 	Model3D_SeqFrame& SF = SeqFrames[SeqFrmPointers[SeqIndex] + FrameIndex];
 	
-	if (MixFrac != 0 && AddlFrameIndex != FrameIndex)
+	if (Mixing)
 	{
-		if (AddlFrameIndex < 0 || AddlFrameIndex >= NumSF) return false;
-		
 		Model3D_SeqFrame& ASF = SeqFrames[SeqFrmPointers[SeqIndex] + AddlFrameIndex];
 		FindFrameTransform(TSF,SF,MixFrac,ASF);
 		
@@ -970,14 +1022,7 @@ bool Model3D::FindPositions_Sequence(bool UseModelTransform, GLshort SeqIndex,
 		obj_copy(TTot,TSF);
 	
 	size_t NumVerts = Positions.size()/3;
-	GLfloat *Pos = PosBase();
-	for (size_t iv=0; iv<NumVerts; iv++)
-	{
-		GLfloat NewPos[3];
-		TransformPoint(NewPos,Pos,TTot);
-		VecCopy(NewPos,Pos);
-		Pos += 3;
-	}
+	TransformAll(PosBase(), NumVerts, TTot, true);
 	
 	bool NormalsPresent = !NormSources.empty();
 	if (NormalsPresent)
@@ -987,18 +1032,156 @@ bool Model3D::FindPositions_Sequence(bool UseModelTransform, GLshort SeqIndex,
 			TMatMultiply(TTot,TransformNorm,TSF);
 		else
 			obj_copy(TTot,TSF);
-				
-		GLfloat *Norm = NormBase();
-		for (size_t iv=0; iv<NumVerts; iv++)
+		
+		TransformAll(NormBase(), NumVerts, TTot, false);
+	}
+	
+	CachePose(Key);
+	return true;
+}
+
+bool Model3D::FindPoseKey(PoseKey& Key)
+{
+	if (CurrentPoseValid)
+	{
+		Key = CurrentPose;
+		return true;
+	}
+	if (VtxSrcIndices.empty())
+	{
+		Key.SeqIndex = Key.FrameIndex = Key.AddlFrameIndex = NONE;
+		Key.MixFrac = 0;
+		Key.UseModelTransform = false;
+		return true;
+	}
+	return false;
+}
+
+bool Model3D::FindCachedPose(const PoseKey& Key)
+{
+	for (auto It = Poses.begin(); It != Poses.end(); ++It)
+	{
+		if (It->Key == Key)
 		{
-			GLfloat NewNorm[3];
-			TransformVector(NewNorm,Norm,TTot);
-			VecCopy(NewNorm,Norm);
-			Norm += 3;
+			Positions = It->Positions;
+			Normals = It->Normals;
+			std::rotate(Poses.begin(), It, It + 1);
+			CurrentPose = Key;
+			CurrentPoseValid = true;
+			return true;
 		}
 	}
+	return false;
+}
+
+void Model3D::CachePose(const PoseKey& Key)
+{
+	// reuse the oldest one's storage once there are enough
+	if (Poses.size() < MaxPoses)
+		Poses.emplace_back();
+	std::rotate(Poses.begin(), Poses.end() - 1, Poses.end());
 	
-	return true;
+	Pose& NewPose = Poses.front();
+	NewPose.Key = Key;
+	NewPose.Positions = Positions;
+	NewPose.Normals = Normals;
+	CurrentPose = Key;
+	CurrentPoseValid = true;
+}
+
+
+// ".benchmark models [count]" poses a made-up Dim3-sized model for count
+// monsters a frame, first each in a pose of its own and then sharing a few
+static void benchmark_models(const std::string& arg)
+{
+	const int NumBones = 24;
+	const int NumSources = 4000;
+	const int NumVertices = 6000;
+	const int NumFrames = 32;
+	
+	Model3D Model;
+	Model.Bones.resize(NumBones);
+	for (int ib=0; ib<NumBones; ib++)
+	{
+		Model3D_Bone& Bone = Model.Bones[ib];
+		Bone.Position[0] = 0;
+		Bone.Position[1] = 0;
+		Bone.Position[2] = GLfloat(ib*16);
+		Bone.Flags = (ib % 6 == 0) ? Model3D_Bone::Push : ((ib % 6 == 5) ? Model3D_Bone::Pop : 0);
+	}
+	
+	Model.VtxSources.resize(NumSources);
+	for (int ivs=0; ivs<NumSources; ivs++)
+	{
+		Model3D_VertexSource& VS = Model.VtxSources[ivs];
+		VS.Position[0] = GLfloat(sin(ivs*0.1)*64);
+		VS.Position[1] = GLfloat(cos(ivs*0.1)*64);
+		VS.Position[2] = GLfloat((ivs*NumBones*16)/NumSources);
+		VS.Bone0 = ivs % NumBones;
+		VS.Bone1 = (ivs + 1) % NumBones;
+		VS.Blend = 0.25;
+	}
+	
+	Model.VtxSrcIndices.resize(NumVertices);
+	Model.NormSources.resize(3*NumVertices);
+	for (int iv=0; iv<NumVertices; iv++)
+	{
+		Model.VtxSrcIndices[iv] = iv % NumSources;
+		Model.NormSources[3*iv] = 0;
+		Model.NormSources[3*iv+1] = 0;
+		Model.NormSources[3*iv+2] = 1;
+	}
+	
+	Model.Frames.resize(NumBones*NumFrames);
+	Model.SeqFrames.resize(NumFrames);
+	for (int ifr=0; ifr<NumFrames; ifr++)
+	{
+		for (int ib=0; ib<NumBones; ib++)
+		{
+			Model3D_Frame& Frame = Model.Frames[NumBones*ifr + ib];
+			objlist_clear(Frame.Offset,3);
+			Frame.Angles[0] = (ifr*7 + ib*3) % FULL_CIRCLE;
+			Frame.Angles[1] = (ifr*5 + ib) % FULL_CIRCLE;
+			Frame.Angles[2] = (ifr*11 + ib*2) % FULL_CIRCLE;
+		}
+		Model3D_SeqFrame& SF = Model.SeqFrames[ifr];
+		obj_clear(SF);
+		SF.Frame = ifr;
+	}
+	Model.SeqFrmPointers.push_back(0);
+	Model.SeqFrmPointers.push_back(NumFrames);
+	
+	int Count = std::max(1, atoi(arg.c_str()));
+	if (arg.empty()) Count = 32;
+	const int Rendered = 60;
+	const int SharedPoses = 4;
+	
+	double Millis[2];
+	for (int Shared=0; Shared<2; Shared++)
+	{
+		auto Start = std::chrono::steady_clock::now();
+		for (int ir=0; ir<Rendered; ir++)
+		{
+			for (int im=0; im<Count; im++)
+			{
+				int Pose = Shared ? (im % SharedPoses) : im;
+				GLshort Frame = GLshort((ir + Pose) % NumFrames);
+				GLfloat MixFrac = GLfloat(Pose + 1)/GLfloat(Count + 1);
+				Model.FindPositions_Sequence(true, 0, Frame, MixFrac, GLshort((Frame + 1) % NumFrames));
+			}
+		}
+		Millis[Shared] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count()/Rendered;
+	}
+	
+	screen_printf("%d models of %d vertices: %.2f ms a frame in their own poses, %.2f ms sharing %d (%d threads)",
+		Count, NumVertices, Millis[0], Millis[1], SharedPoses, WorkerPool::instance()->Concurrency());
+	logNote("model benchmark: %d models, %d vertices, %d bones; own poses %.2f ms/frame, %d shared poses %.2f ms/frame, %d threads",
+		Count, NumVertices, NumBones, Millis[0], SharedPoses, Millis[1], WorkerPool::instance()->Concurrency());
+}
+
+void Model3D::RegisterBenchmark()
+{
+	Console::instance()->register_benchmark("models", benchmark_models);
 }
 
 
@@ -39,6 +39,7 @@
 #include "OGL_Headers.h"
 #endif
 
+#include <string>
 #include <vector>
 #include "vec3.h"
 
@@ -257,8 +258,51 @@ struct Model3D
 	bool FindPositions_Sequence(bool UseModelTransform, GLshort SeqIndex,
 		GLshort FrameIndex, GLfloat MixFrac = 0, GLshort AddlFrameIndex = 0);
 	
+	// The sequence position finder keeps the last few poses it found,
+	// so that models showing the same frame (a roomful of the same monster)
+	// get a copy instead of having it found all over again
+	struct PoseKey
+	{
+		GLshort SeqIndex, FrameIndex, AddlFrameIndex;
+		GLfloat MixFrac;
+		bool UseModelTransform;
+		
+		bool operator==(const PoseKey& Other) const
+		{
+			return SeqIndex == Other.SeqIndex && FrameIndex == Other.FrameIndex &&
+				AddlFrameIndex == Other.AddlFrameIndex && MixFrac == Other.MixFrac &&
+				UseModelTransform == Other.UseModelTransform;
+		}
+	};
+	struct Pose
+	{
+		PoseKey Key;
+		vector<GLfloat> Positions, Normals;
+	};
+	
+	// Most recently used first
+	vector<Pose> Poses;
+	
+	// Which pose the positions and normals are in now, if any
+	PoseKey CurrentPose;
+	bool CurrentPoseValid;
+	
+	// For when the vertex sources, normals, bones, or frames change
+	void ForgetPoses() {Poses.clear(); CurrentPoseValid = false;}
+	
+	// Which pose the positions are in, if that's known; static models are
+	// always in the same one
+	bool FindPoseKey(PoseKey& Key);
+	
+	// Sets up ".benchmark models"
+	static void RegisterBenchmark();
+	
 	// Constructor
-	Model3D() {FindBoundingBox(); TransformPos.Identity(); TransformNorm.Identity();}
+	Model3D() {FindBoundingBox(); TransformPos.Identity(); TransformNorm.Identity(); CurrentPoseValid = false;}
+
+private:
+	bool FindCachedPose(const PoseKey& Key);
+	void CachePose(const PoseKey& Key);
 };
 
 #endif
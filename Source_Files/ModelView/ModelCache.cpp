@@ -0,0 +1,306 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Keeps fully processed models (loaded, transformed, with their normals
+	and tangents worked out) on disk, so the model files don't have to be
+	parsed again on later loads
+*/
+
+#include "cseries.h"
+
+#ifdef HAVE_OPENGL
+
+#include <string.h>
+
+#include "ModelCache.h"
+#include "crc.h"
+#include "Logging.h"
+
+// Bump this whenever the layout below, or the processing done to models
+// before they're cached, changes
+static const uint32 kModelCacheVersion = 1;
+
+static const char kModelCacheMagic[4] = {'A', '1', 'M', 'C'};
+
+// tells apart caches written on machines of the other byte order
+static const uint32 kModelCacheByteOrder = 0x01020304;
+
+// The file is this header, the key, the fixed-size members of the model,
+// a table of the arrays, and then the arrays themselves, each aligned so
+// that it could be used in place if the file were mapped into memory
+struct ModelCacheHeader
+{
+	char Magic[4];
+	uint32 Version;
+	uint32 ByteOrder;
+	uint32 KeySize;
+	uint32 NumArrays;
+	uint32 FileSize;
+};
+
+struct ModelCacheArray
+{
+	uint32 ElementSize;	// so a change in a struct's layout is noticed
+	uint32 Count;
+	uint32 Offset;
+	uint32 Reserved;
+};
+
+static const size_t kModelCacheAlignment = 16;
+
+static size_t Align(size_t Offset)
+{
+	return (Offset + kModelCacheAlignment - 1) & ~(kModelCacheAlignment - 1);
+}
+
+// Calls F on each of the arrays that get cached, always in the same order
+template<typename F> static void ForEachArray(Model3D& Model, F&& Func)
+{
+	Func(Model.Positions);
+	Func(Model.TxtrCoords);
+	Func(Model.Normals);
+	Func(Model.Tangents);
+	Func(Model.Colors);
+	Func(Model.VtxSrcIndices);
+	Func(Model.VtxSources);
+	Func(Model.NormSources);
+	Func(Model.InverseVSIndices);
+	Func(Model.InvVSIPointers);
+	Func(Model.Bones);
+	Func(Model.VertIndices);
+	Func(Model.Frames);
+	Func(Model.SeqFrames);
+	Func(Model.SeqFrmPointers);
+}
+
+static const uint32 kModelCacheArrays = 15;
+
+
+void ModelCacheKey::Add(std::vector<uint8>& To, const void *Data, size_t Size)
+{
+	const uint8 *Bytes = static_cast<const uint8 *>(Data);
+	To.insert(To.end(), Bytes, Bytes + Size);
+}
+
+void ModelCacheKey::AddFile(FileSpecifier& File)
+{
+	std::string Path = File.GetPath();
+	uint32 PathSize = static_cast<uint32>(Path.size());
+	Add(Location, &PathSize, sizeof(PathSize));
+	Add(Location, Path.data(), Path.size());
+	Add(Full, &PathSize, sizeof(PathSize));
+	Add(Full, Path.data(), Path.size());
+
+	int64_t Size = File.GetSize();
+	uint32 CRC = calculate_crc_for_file(File);
+	Add(Full, &Size, sizeof(Size));
+	Add(Full, &CRC, sizeof(CRC));
+}
+
+void ModelCacheKey::AddOption(const std::string& Option)
+{
+	uint32 OptionSize = static_cast<uint32>(Option.size());
+	Add(Location, &OptionSize, sizeof(OptionSize));
+	Add(Location, Option.data(), Option.size());
+	Add(Full, &OptionSize, sizeof(OptionSize));
+	Add(Full, Option.data(), Option.size());
+}
+
+void ModelCacheKey::AddOption(float Option)
+{
+	Add(Location, &Option, sizeof(Option));
+	Add(Full, &Option, sizeof(Option));
+}
+
+void ModelCacheKey::AddOption(int Option)
+{
+	int32 Value = Option;
+	Add(Location, &Value, sizeof(Value));
+	Add(Full, &Value, sizeof(Value));
+}
+
+std::string ModelCacheKey::Name() const
+{
+	std::vector<uint8> Bytes(Location);
+	uint32 CRC = calculate_data_crc(Bytes.data(), static_cast<int32>(Bytes.size()));
+
+	char Name[32];
+	snprintf(Name, sizeof(Name), "%08x.model", static_cast<unsigned>(CRC));
+	return Name;
+}
+
+
+static void GetModelCacheDir(FileSpecifier& Dir)
+{
+	Dir.SetToLocalDataDir();
+	Dir += "Model Cache";
+}
+
+bool LoadModelCache(const ModelCacheKey& Key, Model3D& Model)
+{
+	FileSpecifier File;
+	GetModelCacheDir(File);
+	File += Key.Name();
+
+	OpenedFile OFile;
+	if (!File.Open(OFile)) return false;
+
+	int32 Length;
+	if (!OFile.GetLength(Length) || Length < static_cast<int32>(sizeof(ModelCacheHeader))) return false;
+
+	// one read, rather than one per array
+	std::vector<uint8> Data(Length);
+	if (!OFile.Read(Length, Data.data())) return false;
+	OFile.Close();
+
+	ModelCacheHeader Header;
+	memcpy(&Header, Data.data(), sizeof(Header));
+	if (memcmp(Header.Magic, kModelCacheMagic, sizeof(Header.Magic)) != 0 ||
+		Header.Version != kModelCacheVersion ||
+		Header.ByteOrder != kModelCacheByteOrder ||
+		Header.NumArrays != kModelCacheArrays ||
+		Header.FileSize != static_cast<uint32>(Length))
+		return false;
+
+	// an entry for some other version of the model, or a hash collision
+	const std::vector<uint8>& KeyBytes = Key.Bytes();
+	size_t Offset = sizeof(Header);
+	if (Header.KeySize != KeyBytes.size() || Offset + KeyBytes.size() > Data.size() ||
+		memcmp(Data.data() + Offset, KeyBytes.data(), KeyBytes.size()) != 0)
+		return false;
+	Offset += KeyBytes.size();
+
+	size_t FixedSize = sizeof(Model.TransformPos) + sizeof(Model.TransformNorm) + sizeof(Model.BoundingBox);
+	size_t TableSize = kModelCacheArrays*sizeof(ModelCacheArray);
+	if (Offset + FixedSize + TableSize > Data.size()) return false;
+
+	const uint8 *Fixed = Data.data() + Offset;
+	const uint8 *Table = Fixed + FixedSize;
+
+	// Check every array before touching the model
+	bool Valid = true;
+	uint32 Index = 0;
+	ForEachArray(Model, [&](auto& Array) {
+		ModelCacheArray Entry;
+		memcpy(&Entry, Table + Index*sizeof(Entry), sizeof(Entry));
+		Index++;
+		if (Entry.ElementSize != sizeof(Array[0]) ||
+			Entry.Offset % kModelCacheAlignment != 0 ||
+			Entry.Offset > Data.size() ||
+			static_cast<uint64_t>(Entry.Count)*Entry.ElementSize > Data.size() - Entry.Offset)
+			Valid = false;
+	});
+	if (!Valid) return false;
+
+	Model.Clear();
+	memcpy(&Model.TransformPos, Fixed, sizeof(Model.TransformPos));
+	Fixed += sizeof(Model.TransformPos);
+	memcpy(&Model.TransformNorm, Fixed, sizeof(Model.TransformNorm));
+	Fixed += sizeof(Model.TransformNorm);
+	memcpy(Model.BoundingBox, Fixed, sizeof(Model.BoundingBox));
+
+	Index = 0;
+	ForEachArray(Model, [&](auto& Array) {
+		ModelCacheArray Entry;
+		memcpy(&Entry, Table + Index*sizeof(Entry), sizeof(Entry));
+		Index++;
+		Array.resize(Entry.Count);
+		if (Entry.Count)
+			memcpy(&Array[0], Data.data() + Entry.Offset, size_t(Entry.Count)*Entry.ElementSize);
+	});
+
+	return true;
+}
+
+void SaveModelCache(const ModelCacheKey& Key, Model3D& Model)
+{
+	FileSpecifier File;
+	GetModelCacheDir(File);
+	File.CreateDirectory();
+	File += Key.Name();
+
+	const std::vector<uint8>& KeyBytes = Key.Bytes();
+	size_t FixedOffset = sizeof(ModelCacheHeader) + KeyBytes.size();
+	size_t FixedSize = sizeof(Model.TransformPos) + sizeof(Model.TransformNorm) + sizeof(Model.BoundingBox);
+	size_t TableOffset = FixedOffset + FixedSize;
+
+	// Lay the arrays out, then fill everything in
+	std::vector<ModelCacheArray> Entries;
+	size_t Size = TableOffset + kModelCacheArrays*sizeof(ModelCacheArray);
+	ForEachArray(Model, [&](auto& Array) {
+		ModelCacheArray Entry;
+		obj_clear(Entry);
+		Size = Align(Size);
+		Entry.ElementSize = sizeof(Array[0]);
+		Entry.Count = static_cast<uint32>(Array.size());
+		Entry.Offset = static_cast<uint32>(Size);
+		Entries.push_back(Entry);
+		Size += Array.size()*sizeof(Array[0]);
+	});
+
+	std::vector<uint8> Data(Size, 0);
+
+	ModelCacheHeader Header;
+	memcpy(Header.Magic, kModelCacheMagic, sizeof(Header.Magic));
+	Header.Version = kModelCacheVersion;
+	Header.ByteOrder = kModelCacheByteOrder;
+	Header.KeySize = static_cast<uint32>(KeyBytes.size());
+	Header.NumArrays = kModelCacheArrays;
+	Header.FileSize = static_cast<uint32>(Size);
+	memcpy(Data.data(), &Header, sizeof(Header));
+	if (!KeyBytes.empty())
+		memcpy(Data.data() + sizeof(Header), KeyBytes.data(), KeyBytes.size());
+
+	uint8 *Fixed = Data.data() + FixedOffset;
+	memcpy(Fixed, &Model.TransformPos, sizeof(Model.TransformPos));
+	Fixed += sizeof(Model.TransformPos);
+	memcpy(Fixed, &Model.TransformNorm, sizeof(Model.TransformNorm));
+	Fixed += sizeof(Model.TransformNorm);
+	memcpy(Fixed, Model.BoundingBox, sizeof(Model.BoundingBox));
+
+	memcpy(Data.data() + TableOffset, Entries.data(), Entries.size()*sizeof(ModelCacheArray));
+
+	uint32 Index = 0;
+	ForEachArray(Model, [&](auto& Array) {
+		const ModelCacheArray& Entry = Entries[Index++];
+		if (Entry.Count)
+			memcpy(Data.data() + Entry.Offset, &Array[0], size_t(Entry.Count)*Entry.ElementSize);
+	});
+
+	// Write it under another name first, so that a half-written entry is
+	// never picked up
+	FileSpecifier TempFile;
+	TempFile.SetTempName(File);
+	{
+		OpenedFile OFile;
+		if (!TempFile.Open(OFile, true)) return;
+		if (!OFile.Write(static_cast<int32>(Data.size()), Data.data()))
+		{
+			OFile.Close();
+			TempFile.Delete();
+			return;
+		}
+	}
+
+	if (!TempFile.Rename(File))
+	{
+		TempFile.Delete();
+		logWarning("couldn't write the model cache entry %s", File.GetPath());
+	}
+}
+
+#endif
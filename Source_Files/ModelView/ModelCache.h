@@ -0,0 +1,69 @@
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Keeps fully processed models (loaded, transformed, with their normals
+	and tangents worked out) on disk, so the model files don't have to be
+	parsed again on later loads
+*/
+
+#include "cseries.h"
+
+#ifdef HAVE_OPENGL
+
+#include <string>
+#include <vector>
+
+#include "Model3D.h"
+#include "FileHandler.h"
+
+// Everything a processed model depends on: the files it was read from and
+// the options it was processed with
+class ModelCacheKey
+{
+public:
+	// Where the cache entry lives depends on the file's path; what's in it
+	// depends on its contents
+	void AddFile(FileSpecifier& File);
+	void AddOption(const std::string& Option);
+	void AddOption(float Option);
+	void AddOption(int Option);
+
+	// names the cache file, so that a changed model replaces its old entry
+	std::string Name() const;
+
+	// goes into the cache file, and has to match for it to be used
+	const std::vector<uint8>& Bytes() const {return Full;}
+
+private:
+	void Add(std::vector<uint8>& To, const void *Data, size_t Size);
+
+	std::vector<uint8> Location;
+	std::vector<uint8> Full;
+};
+
+// Fills in Model from the cache, returning whether there was a usable entry
+bool LoadModelCache(const ModelCacheKey& Key, Model3D& Model);
+
+// Writes the processed model out for next time
+void SaveModelCache(const ModelCacheKey& Key, Model3D& Model);
+
+#endif
+
+#endif
@@ -31,6 +31,147 @@
 
 #include "ModelRenderer.h"
 #include <algorithm>
+#include <chrono>
+#include <math.h>
+
+#include "Console.h"
+#include "Logging.h"
+#include "screen.h"
+
+// A sorted order is used as it is while the view turns by less than about
+// a degree, and is touched up rather than redone within about 25 degrees
+const GLfloat SameViewCosine = 0.99985f;
+const GLfloat NearViewCosine = 0.9f;
+
+const size_t MaxSortedOrders = 64;
+
+// Touching up an order gives up and sorts from scratch after this many
+// moves per triangle
+const size_t MaxMovesPerTriangle = 8;
+
+// So the benchmark can compare against sorting everything every time
+static bool ReuseSortedOrders = true;
+
+static GLfloat ViewCosine(const GLfloat *A, const GLfloat *B)
+{
+	GLfloat Dot = A[0]*B[0] + A[1]*B[1] + A[2]*B[2];
+	GLfloat Norms = sqrt((A[0]*A[0] + A[1]*A[1] + A[2]*A[2])*(B[0]*B[0] + B[1]*B[1] + B[2]*B[2]));
+	return (Norms > 0) ? Dot/Norms : -1;
+}
+
+// Finds the depths of the triangles in Order, keeping the order they're in
+static void FindCentroidDepths(Model3D& Model, const GLfloat *ViewDirection,
+	vector<IndexedCentroidDepth>& Order)
+{
+	for (auto& Entry : Order)
+	{
+		GLushort *VIPtr = &Model.VertIndices[3*Entry.index];
+		GLfloat Sum[3] = {0, 0, 0};
+		for (int v=0; v<3; v++)
+		{
+			GLfloat *Pos = &Model.Positions[3*(*VIPtr)];
+			Sum[0] += Pos[0];
+			Sum[1] += Pos[1];
+			Sum[2] += Pos[2];
+			VIPtr++;
+		}
+		Entry.depth =
+			Sum[0]*ViewDirection[0] + Sum[1]*ViewDirection[1] + Sum[2]*ViewDirection[2];
+	}
+}
+
+// Insertion sort, which is quick when the order is nearly right already;
+// returns false, with the order still a permutation, if it took too long
+static bool TouchUpOrder(vector<IndexedCentroidDepth>& Order, size_t MaxMoves)
+{
+	size_t Moves = 0;
+	for (size_t i=1; i<Order.size(); i++)
+	{
+		IndexedCentroidDepth Entry = Order[i];
+		size_t j = i;
+		while (j > 0 && Entry < Order[j-1])
+		{
+			Order[j] = Order[j-1];
+			j--;
+		}
+		Order[j] = Entry;
+		
+		Moves += i - j;
+		if (Moves > MaxMoves) return false;
+	}
+	return true;
+}
+
+const vector<IndexedCentroidDepth>& ModelRenderer::SortTriangles(Model3D& Model)
+{
+	size_t NumTriangles = Model.NumVI()/3;
+	Model3D::PoseKey Pose;
+	bool PoseKnown = Model.FindPoseKey(Pose);
+	
+	// Look for this model, in this pose, seen from (nearly) this direction;
+	// failing that, the order from the nearest direction is a good start
+	int Nearest = NONE;
+	GLfloat NearestCosine = -2;
+	for (size_t k=0; k<SortedOrders.size(); k++)
+	{
+		SortedOrder& SO = SortedOrders[k];
+		if (SO.Model != &Model || SO.VertIndices != Model.VIBase() || SO.Order.size() != NumTriangles) continue;
+		
+		GLfloat Cosine = ViewCosine(SO.ViewDirection, ViewDirection);
+		if (ReuseSortedOrders && PoseKnown && SO.PoseKnown && SO.Pose == Pose && Cosine >= SameViewCosine)
+		{
+			SO.LastUsed = ++SortClock;
+			return SO.Order;
+		}
+		if (Cosine > NearestCosine)
+		{
+			Nearest = int(k);
+			NearestCosine = Cosine;
+		}
+	}
+	
+	// Close enough to be the same object seen a frame ago, so take over its
+	// order; otherwise keep that one for whatever it belongs to
+	int Dest = Nearest;
+	if (Dest == NONE || NearestCosine < NearViewCosine)
+	{
+		if (SortedOrders.size() < MaxSortedOrders)
+		{
+			SortedOrders.emplace_back();
+			Dest = int(SortedOrders.size()) - 1;
+		}
+		else
+		{
+			Dest = 0;
+			for (size_t k=1; k<SortedOrders.size(); k++)
+				if (SortedOrders[k].LastUsed < SortedOrders[Dest].LastUsed)
+					Dest = int(k);
+		}
+		if (Nearest != NONE && Nearest != Dest)
+			SortedOrders[Dest].Order = SortedOrders[Nearest].Order;
+	}
+	
+	SortedOrder& SO = SortedOrders[Dest];
+	bool Seeded = ReuseSortedOrders && Nearest != NONE;
+	if (!Seeded)
+	{
+		SO.Order.resize(NumTriangles);
+		for (size_t k=0; k<NumTriangles; k++)
+			SO.Order[k].index = (unsigned short)k;
+	}
+	
+	FindCentroidDepths(Model, ViewDirection, SO.Order);
+	if (!Seeded || !TouchUpOrder(SO.Order, MaxMovesPerTriangle*NumTriangles))
+		std::sort(SO.Order.begin(), SO.Order.end());
+	
+	SO.Model = &Model;
+	SO.VertIndices = Model.VIBase();
+	SO.Pose = Pose;
+	SO.PoseKnown = PoseKnown;
+	objlist_copy(SO.ViewDirection, ViewDirection, 3);
+	SO.LastUsed = ++SortClock;
+	return SO.Order;
+}
 
 void ModelRenderer::Render(Model3D& Model, ModelRenderShader *Shaders, int NumShaders,
 	int NumSeparableShaders, bool Use_Z_Buffer)
@@ -63,29 +204,8 @@ void ModelRenderer::Render(Model3D& Model, ModelRenderShader *Shaders, int NumSh
 	// OpenGL != PowerVR
 	// (which can store polygons and depth-sort them in its hardware)
 	
-	// Find the centroids:
 	size_t NumTriangles = Model.NumVI()/3;
-	IndexedCentroidDepths.resize(NumTriangles);
-	
-	GLushort *VIPtr = Model.VIBase();
-	for (unsigned short k=0; k<NumTriangles; k++)
-	{
-		GLfloat Sum[3] = {0, 0, 0};
-		for (int v=0; v<3; v++)
-		{
-			GLfloat *Pos = &Model.Positions[3*(*VIPtr)];
-			Sum[0] += Pos[0];
-			Sum[1] += Pos[1];
-			Sum[2] += Pos[2];
-			VIPtr++;
-		}
-		IndexedCentroidDepths[k].index = k;
-		IndexedCentroidDepths[k].depth = 
-			Sum[0]*ViewDirection[0] + Sum[1]*ViewDirection[1] + Sum[2]*ViewDirection[2];
-	}
-	
-	// Sort!
-	std::sort(IndexedCentroidDepths.begin(), IndexedCentroidDepths.end());
+	const vector<IndexedCentroidDepth>& IndexedCentroidDepths = SortTriangles(Model);
 	
 	// Optimization: a single nonseparable shader can be rendered as if it was separable,
 	// though it must still be depth-sorted.
@@ -210,9 +330,76 @@ void ModelRenderer::SetupRenderPass(Model3D& Model, ModelRenderShader& Shader)
 
 void ModelRenderer::Clear()
 {
-	IndexedCentroidDepths.clear();
+	SortedOrders.clear();
 	SortedVertIndices.clear();
 	ExtLightColors.clear();
 }
 
+// ".benchmark modelsort [count]" turns count copies of a made-up model,
+// each facing its own way, a little each frame, and times the sorting
+void ModelRenderer::RegisterBenchmark()
+{
+	Console::instance()->register_benchmark("modelsort", [](const std::string& arg) {
+		const int Rings = 40;
+		const int Segments = 40;
+		
+		Model3D Model;
+		for (int ir=0; ir<Rings; ir++)
+		{
+			double Lat = M_PI*(ir + 0.5)/Rings - M_PI/2;
+			for (int is=0; is<Segments; is++)
+			{
+				double Long = 2*M_PI*is/Segments;
+				Model.Positions.push_back(GLfloat(256*cos(Lat)*cos(Long)));
+				Model.Positions.push_back(GLfloat(128*cos(Lat)*sin(Long)));
+				Model.Positions.push_back(GLfloat(512*sin(Lat)));
+			}
+		}
+		for (int ir=0; ir<Rings-1; ir++)
+		{
+			for (int is=0; is<Segments; is++)
+			{
+				GLushort V00 = ir*Segments + is;
+				GLushort V01 = ir*Segments + (is + 1) % Segments;
+				GLushort V10 = V00 + Segments;
+				GLushort V11 = V01 + Segments;
+				GLushort Triangles[6] = {V00, V01, V11, V00, V11, V10};
+				Model.VertIndices.insert(Model.VertIndices.end(), Triangles, Triangles + 6);
+			}
+		}
+		
+		int Count = arg.empty() ? 24 : std::max(1, atoi(arg.c_str()));
+		const int Frames = 120;
+		const double Turn = M_PI/720;	// a quarter of a degree a frame
+		
+		double Millis[2];
+		for (int Reuse=0; Reuse<2; Reuse++)
+		{
+			ModelRenderer Renderer;
+			ReuseSortedOrders = Reuse;
+			
+			auto Start = std::chrono::steady_clock::now();
+			for (int f=0; f<Frames; f++)
+			{
+				for (int m=0; m<Count; m++)
+				{
+					double Angle = 2*M_PI*m/Count + Turn*f;
+					Renderer.ViewDirection[0] = GLfloat(cos(Angle));
+					Renderer.ViewDirection[1] = GLfloat(sin(Angle));
+					Renderer.ViewDirection[2] = 0;
+					Renderer.SortTriangles(Model);
+				}
+			}
+			Millis[Reuse] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count()/Frames;
+		}
+		ReuseSortedOrders = true;
+		
+		size_t NumTriangles = Model.NumVI()/3;
+		screen_printf("sorting %d models of %d triangles: %.3f ms a frame sorting each time, %.3f ms reusing orders",
+			Count, int(NumTriangles), Millis[0], Millis[1]);
+		logNote("model sort benchmark: %d models, %d triangles; sorting each time %.3f ms/frame, reusing orders %.3f ms/frame",
+			Count, int(NumTriangles), Millis[0], Millis[1]);
+	});
+}
+
 #endif // def HAVE_OPENGL
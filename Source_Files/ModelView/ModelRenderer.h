@@ -63,12 +63,29 @@ struct IndexedCentroidDepth
 class ModelRenderer
 {
 	// Kept here to avoid unnecessary re-allocation
-	vector<IndexedCentroidDepth> IndexedCentroidDepths;
 	vector<GLushort> SortedVertIndices;
 	vector<GLfloat> ExtLightColors;
 	
+	// Recent depth-sorted triangle orders; a model seen from nearly the
+	// same direction as before keeps its order, or has it touched up
+	struct SortedOrder
+	{
+		const Model3D *Model;
+		const GLushort *VertIndices;	// changes if the model gets reloaded
+		Model3D::PoseKey Pose;
+		bool PoseKnown;
+		GLfloat ViewDirection[3];
+		uint32 LastUsed;
+		vector<IndexedCentroidDepth> Order;
+	};
+	vector<SortedOrder> SortedOrders;
+	uint32 SortClock;
+	
 	void SetupRenderPass(Model3D& Model, ModelRenderShader& Shader);
 	
+	// Returns the model's triangles sorted from farthest to nearest
+	const vector<IndexedCentroidDepth>& SortTriangles(Model3D& Model);
+	
 public:
 	
 	// Needed for depth-sorting the model triangles by centroid;
@@ -98,6 +115,11 @@ public:
 	
 	// In case one wants to start over again with these persistent arrays
 	void Clear();
+	
+	// Sets up ".benchmark modelsort"
+	static void RegisterBenchmark();
+	
+	ModelRenderer(): SortClock(0) {}
 };
 
 
@@ -48,6 +48,11 @@ public:
 	virtual void    UpdateUnconfirmedActionFlags() = 0;
 
 	virtual bool CheckWorldUpdate() = 0;
+
+	// for noticing when the players' worlds go out of sync; protocols
+	// that can't compare them never report it
+	virtual void RecordWorldHash(int32 tick, uint32 hash) {}
+	virtual int32 GetWorldDivergedTick() { return NONE; }
 };
 
 #endif // NETWORKGAMEPROTOCOL_H
@@ -211,6 +211,18 @@ StarGameProtocol::CheckWorldUpdate()
 	return spoke_check_world_update();
 }
 
+void
+StarGameProtocol::RecordWorldHash(int32 tick, uint32 hash)
+{
+	spoke_record_world_hash(tick, hash);
+}
+
+int32
+StarGameProtocol::GetWorldDivergedTick()
+{
+	return spoke_get_world_diverged_tick();
+}
+
 /* ZZZ addition:
 ---------------------------
 	make_player_really_net_dead
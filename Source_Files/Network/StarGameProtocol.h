@@ -51,6 +51,9 @@ public:
 	void    UpdateUnconfirmedActionFlags();
 
 	bool CheckWorldUpdate() override;
+
+	void RecordWorldHash(int32 tick, uint32 hash) override;
+	int32 GetWorldDivergedTick() override;
 };
 
 extern void DefaultStarPreferences();
@@ -2199,6 +2199,27 @@ NetCheckWorldUpdate()
 	return sCurrentGameProtocol->CheckWorldUpdate();
 }
 
+void
+NetRecordWorldHash(int32 tick, uint32 hash)
+{
+	static int32 sReportedDivergedTick = NONE;
+
+	sCurrentGameProtocol->RecordWorldHash(tick, hash);
+
+	int32 diverged_tick = sCurrentGameProtocol->GetWorldDivergedTick();
+	if (diverged_tick == NONE)
+	{
+		// a new game
+		sReportedDivergedTick = NONE;
+	}
+	else if (diverged_tick != sReportedDivergedTick)
+	{
+		sReportedDivergedTick = diverged_tick;
+		logWarning("the game went out of sync at tick %d", diverged_tick);
+		screen_printf("Game out of sync since tick %d", diverged_tick);
+	}
+}
+
 extern const NetworkStats& hub_stats(int player_index);
 
 void NetProcessMessagesInGame() {
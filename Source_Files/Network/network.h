@@ -311,4 +311,8 @@ int32 NetGetLatency();
 const NetworkStats& NetGetStats(int player_index);
 bool NetCheckWorldUpdate();
 
+// after each real tick, with calculate_world_hash(); warns once if the
+// players' worlds have gone out of sync
+void NetRecordWorldHash(int32 tick, uint32 hash);
+
 #endif
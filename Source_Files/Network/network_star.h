@@ -46,6 +46,8 @@ enum {
         kPlayerNetDeadMessageType = 0x4e44,	// 'ND'
 	kSpokeToHubLossyByteStreamMessageType = 0x534c,	// 'SL'
 	kHubToSpokeLossyByteStreamMessageType = 0x484c, // 'HL'
+	kSpokeToHubWorldHashMessageType = 0x5748,	// 'WH'
+	kHubToSpokeWorldDivergedMessageType = 0x5744,	// 'WD'
 
 	kSpokeToHubIdentification = 0x4944,   // 'ID'
 	kSpokeToHubGameDataPacketV1Magic = 0x5331, // 'S1'
@@ -88,6 +90,10 @@ extern int32 hub_latency(int player_index); // in ms, kNetLatencyInvalid if not
 extern TickBasedActionQueue* spoke_get_unconfirmed_flags_queue();
 extern int32 spoke_get_smallest_unconfirmed_tick();
 extern bool spoke_check_world_update();
+// The world hash after each tick goes to the hub, which compares everyone's; when two differ it
+// tells all the spokes the first tick that did.  Both are lossy: it's a diagnostic, not a guarantee.
+extern void spoke_record_world_hash(int32 inTick, uint32 inHash);
+extern int32 spoke_get_world_diverged_tick(); // NONE until the hub has seen hashes differ
 extern void DefaultSpokePreferences();
 extern InfoTree SpokePreferencesTree();
 extern void SpokeParsePreferencesTree(InfoTree prefs, std::string version);
@@ -267,6 +267,27 @@ static uint32 sConnectedPlayersBitmask;
 static uint32 sLaggingPlayersBitmask;
 
 
+// The world hash the first player to report each tick had, and a bit-set of who has reported it
+// since.  A tick is forgotten once every connected player has; ticks some player never reports
+// (lost packets, or a version that doesn't send them) fall off the front of the window.
+// When two hashes differ, sWorldDivergedTick remembers the first tick they did, and every spoke
+// is told the same way as with netdead players: until it ACKs sWorldDivergedAnnounceTick.
+struct HubWorldHash {
+	uint32	mHash;
+	uint32	mReporters;
+	int	mFirstReporter;
+};
+
+enum {
+	kWorldHashWindow = 8 * TICKS_PER_SECOND,
+	kWorldHashSerializedLength = 8 // tick, hash
+};
+
+static std::map<int32, HubWorldHash> sWorldHashes;
+static int32 sWorldDivergedTick;
+static int32 sWorldDivergedAnnounceTick;
+
+
 // sPlayerReflectedFlags holds an element for every tick for which data has been
 // sent but at least one player has not yet acknowledged
 //
@@ -551,6 +572,10 @@ hub_initialize(int32 inStartingTick, size_t inNumPlayers, const NetAddrBlock* co
 	sLastRealUpdate = 0;
 	sLaggingPlayersBitmask = 0;
 
+	sWorldHashes.clear();
+	sWorldDivergedTick = NONE;
+	sWorldDivergedAnnounceTick = NONE;
+
         sHubActive = true;
 
         sHubTickTask = myXTMSetup(1000/TICKS_PER_SECOND, hub_tick);
@@ -1247,6 +1272,44 @@ process_lossy_byte_stream_message(AIStream& ps, int inSenderIndex, uint16 inLeng
 
 
 
+static void
+process_world_hash_message(AIStream& ps, int inSenderIndex, uint16 inLength)
+{
+	assert(inSenderIndex >= 0 && inSenderIndex < static_cast<int>(sNetworkPlayers.size()));
+
+	uint16 theCount = inLength / kWorldHashSerializedLength;
+	for(uint16 i = 0; i < theCount; i++)
+	{
+		int32 theTick;
+		uint32 theHash;
+		ps >> theTick >> theHash;
+
+		HubWorldHash& theWorldHash = sWorldHashes[theTick];
+		if(theWorldHash.mReporters == 0)
+		{
+			theWorldHash.mHash = theHash;
+			theWorldHash.mFirstReporter = inSenderIndex;
+		}
+		else if(theWorldHash.mHash != theHash && sWorldDivergedTick == NONE)
+		{
+			sWorldDivergedTick = theTick;
+			sWorldDivergedAnnounceTick = sSmallestIncompleteTick;
+			logWarningNMT("players' worlds diverged at tick %d: player %d has hash 0x%08x, player %d has 0x%08x", theTick, theWorldHash.mFirstReporter, theWorldHash.mHash, inSenderIndex, theHash);
+		}
+
+		theWorldHash.mReporters |= ((uint32)1) << inSenderIndex;
+		if((theWorldHash.mReporters & sConnectedPlayersBitmask) == sConnectedPlayersBitmask)
+			sWorldHashes.erase(theTick);
+	}
+
+	ps.ignore(inLength - theCount * kWorldHashSerializedLength);
+
+	while(sWorldHashes.size() > kWorldHashWindow)
+		sWorldHashes.erase(sWorldHashes.begin());
+}
+
+
+
 static void
 process_optional_message(AIStream& ps, int inSenderIndex, uint16 inMessageType)
 {
@@ -1258,6 +1321,8 @@ process_optional_message(AIStream& ps, int inSenderIndex, uint16 inMessageType)
 
 	if(inMessageType == kSpokeToHubLossyByteStreamMessageType)
 		process_lossy_byte_stream_message(ps, inSenderIndex, theMessageLength);
+	else if(inMessageType == kSpokeToHubWorldHashMessageType)
+		process_world_hash_message(ps, inSenderIndex, theMessageLength);
 	else
 	{
 		// Currently we ignore (skip) all optional messages
@@ -1498,6 +1563,14 @@ send_packets()
                                         }
                                 }
 
+				// Worlds out of sync?
+				if(sWorldDivergedTick != NONE && thePlayer.mSmallestUnacknowledgedTick <= sWorldDivergedAnnounceTick)
+				{
+					ps << (uint16)kHubToSpokeWorldDivergedMessageType
+						<< (uint16)sizeof(sWorldDivergedTick)
+						<< sWorldDivergedTick;
+				}
+
 				// Lossy streaming data?
 				if(haveLossyData && ((theDescriptor.mDestinations & (((uint32)1) << i)) != 0))
 				{
@@ -48,6 +48,7 @@
 #include "InfoTree.h"
 
 #include <map>
+#include <algorithm> // std::min()
 
 extern void make_player_really_net_dead(size_t inPlayerIndex);
 extern void call_distribution_response_function_if_available(byte* inBuffer, uint16 inBufferSize, int16 inDistributionType, uint8 inSendingPlayerIndex);
@@ -62,7 +63,9 @@ enum {
 	kDefaultTimingNthElement = kDefaultTimingWindowSize / 2,
 	kLossyByteStreamDataBufferSize = 1280,
 	kTypicalLossyByteStreamChunkSize = 56,
-	kLossyByteStreamDescriptorCount = kLossyByteStreamDataBufferSize / kTypicalLossyByteStreamChunkSize
+	kLossyByteStreamDescriptorCount = kLossyByteStreamDataBufferSize / kTypicalLossyByteStreamChunkSize,
+	kWorldHashQueueSize = 2 * TICKS_PER_SECOND,
+	kMaximumWorldHashesPerPacket = 8
 };
 
 struct SpokePreferences
@@ -147,6 +150,17 @@ static CircularQueue<SpokeLossyByteStreamChunkDescriptor> sOutgoingLossyByteStre
 // This is currently used only to hold incoming streaming data until it's passed to the upper-level code
 static byte sScratchBuffer[kLossyByteStreamDataBufferSize];
 
+struct SpokeWorldHash
+{
+	int32	mTick;
+	uint32	mHash;
+};
+
+// The world hash after each tick, from the main thread, waiting to go to the hub.  If it backs up,
+// new ones are dropped; the hub only compares the ticks it hears about from more than one player.
+static CircularQueue<SpokeWorldHash> sOutgoingWorldHashes(kWorldHashQueueSize);
+static int32 sWorldDivergedTick = NONE;
+
 
 static void spoke_became_disconnected();
 static void spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags);
@@ -157,6 +171,7 @@ static void handle_end_of_messages_message(AIStream& ps, IncomingGameDataPacketP
 static void handle_player_net_dead_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
 static void handle_timing_adjustment_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
 static void handle_lossy_byte_stream_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
+static void handle_world_diverged_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
 static void process_optional_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context, uint16 inMessageType);
 static bool spoke_tick();
 static void send_packet();
@@ -262,12 +277,15 @@ spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inN
 
 	sOutgoingLossyByteStreamDescriptors.reset();
 	sOutgoingLossyByteStreamData.reset();
+	sOutgoingWorldHashes.reset();
+	sWorldDivergedTick = NONE;
 
         sMessageTypeToMessageHandler.clear();
         sMessageTypeToMessageHandler[kEndOfMessagesMessageType] = handle_end_of_messages_message;
         sMessageTypeToMessageHandler[kTimingAdjustmentMessageType] = handle_timing_adjustment_message;
         sMessageTypeToMessageHandler[kPlayerNetDeadMessageType] = handle_player_net_dead_message;
 	sMessageTypeToMessageHandler[kHubToSpokeLossyByteStreamMessageType] = handle_lossy_byte_stream_message;
+	sMessageTypeToMessageHandler[kHubToSpokeWorldDivergedMessageType] = handle_world_diverged_message;
 
         sNeedToSendLocalOutgoingBuffer = false;
 
@@ -398,6 +416,26 @@ spoke_distribute_lossy_streaming_bytes(int16 inDistributionType, uint32 inDestin
 
 
 
+void
+spoke_record_world_hash(int32 inTick, uint32 inHash)
+{
+	if(!sSpokeActive || sOutgoingWorldHashes.getRemainingSpace() < 1)
+		return;
+
+	SpokeWorldHash theWorldHash = { inTick, inHash };
+	sOutgoingWorldHashes.enqueue(theWorldHash);
+}
+
+
+
+int32
+spoke_get_world_diverged_tick()
+{
+	return sWorldDivergedTick;
+}
+
+
+
 static void
 spoke_became_disconnected()
 {
@@ -885,6 +923,31 @@ handle_lossy_byte_stream_message(AIStream& ps, IncomingGameDataPacketProcessingC
 
 
 
+static void
+handle_world_diverged_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
+{
+	uint16 theMessageLength;
+	ps >> theMessageLength;
+
+	if(theMessageLength < sizeof(int32))
+	{
+		ps.ignore(theMessageLength);
+		return;
+	}
+
+	int32 theTick;
+	ps >> theTick;
+	ps.ignore(theMessageLength - sizeof(int32));
+
+	if(sWorldDivergedTick == NONE)
+	{
+		sWorldDivergedTick = theTick;
+		logWarningNMT("hub says the players' worlds diverged at tick %d", theTick);
+	}
+}
+
+
+
 static void
 process_optional_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context, uint16 inMessageType)
 {
@@ -1074,6 +1137,24 @@ send_packet()
 
 			ps.write(sScratchBuffer, theDescriptor.mLength);
 		}
+
+		// World hashes?  Dequeued first for the same reason as above.
+		if(sOutgoingWorldHashes.getCountOfElements() > 0)
+		{
+			uint16 theCount = std::min<unsigned int>(sOutgoingWorldHashes.getCountOfElements(), kMaximumWorldHashesPerPacket);
+			uint16 theMessageLength = theCount * (sizeof(int32) + sizeof(uint32));
+			SpokeWorldHash theWorldHashes[kMaximumWorldHashesPerPacket];
+			for(uint16 i = 0; i < theCount; i++)
+			{
+				theWorldHashes[i] = sOutgoingWorldHashes.peek();
+				sOutgoingWorldHashes.dequeue();
+			}
+
+			ps << (uint16)kSpokeToHubWorldHashMessageType
+				<< theMessageLength;
+			for(uint16 i = 0; i < theCount; i++)
+				ps << theWorldHashes[i].mTick << theWorldHashes[i].mHash;
+		}
 		
                 // No more messages
                 ps << (uint16)kEndOfMessagesMessageType;
@@ -37,6 +37,7 @@ Oct 13, 2000 (Loren Petrich)
 #include "AnimatedTextures.h"
 #include "interface.h"
 #include "InfoTree.h"
+#include "interpolated_world.h"
 
 
 class AnimTxtr
@@ -202,6 +203,10 @@ void AnimTxtr::Update()
 static vector<AnimTxtr> AnimTxtrList[NUMBER_OF_COLLECTIONS];
 
 
+// As of the last AnimTxtr_Capture()
+static vector<AnimTxtr> CapturedAnimTxtrList[NUMBER_OF_COLLECTIONS];
+
+
 // Deletes a collection's animated-texture sequences
 static void ATDelete(int c)
 {
@@ -228,6 +233,13 @@ void AnimTxtr_Update()
 }
 
 
+void AnimTxtr_Capture()
+{
+	for (int c=0; c<NUMBER_OF_COLLECTIONS; c++)
+		CapturedAnimTxtrList[c] = AnimTxtrList[c];
+}
+
+
 // Does animated-texture translation in place
 shape_descriptor AnimTxtr_Translate(shape_descriptor Texture)
 {
@@ -243,7 +255,7 @@ shape_descriptor AnimTxtr_Translate(shape_descriptor Texture)
 	// that could be handled as map preprocessing, by turning
 	// all shape descriptors that refer to unloaded shapes to NONE
 	
-	vector<AnimTxtr>& ATL = AnimTxtrList[Collection];
+	vector<AnimTxtr>& ATL = render_world ? CapturedAnimTxtrList[Collection] : AnimTxtrList[Collection];
 	for (vector<AnimTxtr>::iterator ATIter = ATL.begin(); ATIter < ATL.end(); ATIter++)
 		if (ATIter->Translate(Frame)) break;
 	
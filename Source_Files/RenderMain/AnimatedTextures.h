@@ -39,6 +39,11 @@ void AnimTxtr_Update();
 // Note: a shape_descriptor is really a short integer
 shape_descriptor AnimTxtr_Translate(shape_descriptor Texture);
 
+// Copies where every sequence is now, for a thread drawing from the render
+// world (see interpolated_world.h) to translate with while the next tick
+// updates them
+void AnimTxtr_Capture();
+
 class InfoTree;
 void parse_mml_animated_textures(const InfoTree& root);
 void reset_mml_animated_textures();
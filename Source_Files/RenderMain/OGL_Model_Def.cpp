@@ -35,7 +35,9 @@
 #include "Dim3_Loader.h"
 #include "StudioLoader.h"
 #include "WavefrontLoader.h"
+#include "ModelCache.h"
 #include "InfoTree.h"
+#include "MemoryBudget.h"
 
 
 // Model-data stuff;
@@ -212,6 +214,10 @@ void OGL_SkinManager::Unload()
 }
 
 
+// for the memory budget
+static size_t SkinBytes = 0;
+static int SkinBudgetID = NONE;
+
 void OGL_SkinManager::Reset(bool Clear_OGL_Txtrs)
 {
 	if (Clear_OGL_Txtrs)
@@ -226,6 +232,8 @@ void OGL_SkinManager::Reset(bool Clear_OGL_Txtrs)
 	
 	// Mass clearing
 	objlist_clear(IDsInUse[0],NUMBER_OF_OPENGL_BITMAP_SETS*NUMBER_OF_TEXTURES);
+	SkinBytes -= Bytes;
+	Bytes = 0;
 }
 
 
@@ -280,11 +288,57 @@ bool OGL_SkinManager::Use(short CLUT, short Which)
 		glGenTextures(1,&TxtrID);
 		InUse = true;
 		LoadSkin = true;
+		
+		// The caller loads the skin image into it
+		OGL_SkinData *Skin = GetSkin(CLUT);
+		if (Skin)
+		{
+			ImageDescriptor& Image = (Which == Normal) ? Skin->NormalImg : ((Which == Glowing) ? Skin->GlowImg : Skin->OffsetImg);
+			Bytes += Image.GetBufferSize();
+			SkinBytes += Image.GetBufferSize();
+		}
+		MemoryBudget::instance()->Miss(SkinBudgetID);
 	}
+	else
+		MemoryBudget::instance()->Hit(SkinBudgetID);
+	LastUsed = machine_tick_count();
 	glBindTexture(GL_TEXTURE_2D,TxtrID);
 	return LoadSkin;
 }
 
+// Releases the skins of the least recently drawn models that weren't drawn
+// in the last second, until bytes are freed; they get reloaded when next drawn
+static size_t TrimModelSkins(size_t bytes)
+{
+	vector<OGL_SkinManager*> Candidates;
+	uint32 Now = machine_tick_count();
+	for (int ic=0; ic<NUMBER_OF_COLLECTIONS; ic++)
+	{
+		for (auto& Entry : MdlList[ic])
+		{
+			OGL_SkinManager& Skins = Entry.ModelData;
+			if (Skins.Bytes && Now - Skins.LastUsed > MACHINE_TICKS_PER_SECOND)
+				Candidates.push_back(&Skins);
+		}
+	}
+	sort(Candidates.begin(), Candidates.end(), [](const OGL_SkinManager* a, const OGL_SkinManager* b) { return a->LastUsed < b->LastUsed; });
+	
+	size_t Freed = 0;
+	for (auto Skins : Candidates)
+	{
+		if (Freed >= bytes) break;
+		Freed += Skins->Bytes;
+		Skins->Reset(true);
+		MemoryBudget::instance()->Evicted(SkinBudgetID);
+	}
+	return Freed;
+}
+
+void OGL_RegisterModelSkinBudget()
+{
+	SkinBudgetID = MemoryBudget::instance()->Register("model skins", MemoryBudget::kPriorityNormal, []() { return SkinBytes; }, TrimModelSkins);
+}
+
 
 // Circle constants
 const double TWO_PI = 8*atan(1.0);
@@ -382,9 +436,36 @@ void OGL_ModelData::Load()
 	if (ModelFile == FileSpecifier()) return;
 	if (!ModelFile.Exists()) return;
 
+	char *Type = &ModelType[0];
+	
+	// The processed model depends on its files and on everything below
+	// that gets done to it
+	ModelCacheKey CacheKey;
+	CacheKey.AddOption(std::string(Type));
+	CacheKey.AddFile(ModelFile);
+	if (StringsEqual(Type,"dim3",4))
+	{
+		if (ModelFile1 != FileSpecifier() && ModelFile1.Exists()) CacheKey.AddFile(ModelFile1);
+		if (ModelFile2 != FileSpecifier() && ModelFile2.Exists()) CacheKey.AddFile(ModelFile2);
+	}
+	CacheKey.AddOption(Scale);
+	CacheKey.AddOption(XRot);
+	CacheKey.AddOption(YRot);
+	CacheKey.AddOption(ZRot);
+	CacheKey.AddOption(XShift);
+	CacheKey.AddOption(YShift);
+	CacheKey.AddOption(ZShift);
+	CacheKey.AddOption(int(NormalType));
+	CacheKey.AddOption(NormalSplit);
+	
+	if (LoadModelCache(CacheKey, Model))
+	{
+		OGL_SkinManager::Load();
+		return;
+	}
+	
 	bool Success = false;
 	
-	char *Type = &ModelType[0];
 	if (StringsEqual(Type,"wave",4))
 	{
 		// Alias|Wavefront, backward compatible version
@@ -575,6 +656,9 @@ void OGL_ModelData::Load()
 	
 	Model.AdjustNormals(NormalType,NormalSplit);
 	Model.CalculateTangents();
+	Model.BuildInverseVSIndices();
+	
+	SaveModelCache(CacheKey, Model);
 	
 	// Don't forget the skins
 	OGL_SkinManager::Load();
@@ -63,6 +63,8 @@ struct OGL_SkinManager
 	};
 	GLuint IDs[NUMBER_OF_OPENGL_BITMAP_SETS][NUMBER_OF_TEXTURES];		// Texture ID's
 	bool IDsInUse[NUMBER_OF_OPENGL_BITMAP_SETS][NUMBER_OF_TEXTURES];	// Which ID's are being used?
+	size_t Bytes = 0;				// Roughly how much video memory the skins take up
+	uint32 LastUsed = 0;			// Machine tick of the last Use()
 		
 	void Reset(bool Clear_OGL_Txtrs);		// Resets the skins so that they may be reloaded;
 											// indicate whether to clear OpenGL textures
@@ -136,6 +138,9 @@ OGL_ModelData *OGL_GetModelData(short Collection, short Sequence, short& ModelSe
 // Resets all model skins; arg is whether to clear OpenGL textures
 void OGL_ResetModelSkins(bool Clear_OGL_Txtrs);
 
+// Adds the skins to the asset memory budget
+void OGL_RegisterModelSkinBudget();
+
 // for managing the model loading and unloading;
 int OGL_CountModels(short Collection);
 void OGL_LoadModels(short Collection);
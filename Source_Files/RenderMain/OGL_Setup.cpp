@@ -78,6 +78,8 @@ Feb 5, 2002 (Br'fin (Jeremy Parsons)):
 
 #include "OGL_Headers.h"
 #include "OGL_Shader.h"
+#include "Model3D.h"
+#include "ModelRenderer.h"
 
 #endif
 
@@ -104,6 +106,8 @@ bool OGL_Initialize()
 //	glewInit();
 #endif	
 
+	Model3D::RegisterBenchmark();
+	ModelRenderer::RegisterBenchmark();
 	return _OGL_IsPresent = true;
 #else
 	return false;
@@ -100,6 +100,7 @@ May 3, 2003 (Br'fin (Jeremy Parsons))
 #include "OGL_Render.h"
 #include "OGL_Textures.h"
 #include "screen.h"
+#include "MemoryBudget.h"
 
 using std::min;
 using std::max;
@@ -171,6 +172,22 @@ static bool InfravisionActive = false;
 
 static std::list<TextureState*> sgActiveTextureStates;
 
+// for the memory budget
+static size_t sgTextureBytes = 0;
+static int sgTextureBudgetID = NONE;
+
+static uint32 sgTextureGeneration = 0;
+
+uint32 OGL_TextureGeneration()
+{
+	return sgTextureGeneration;
+}
+
+void OGL_TexturesChanged()
+{
+	sgTextureGeneration++;
+}
+
 
 // Allocate some textures and indicate whether an allocation had happened.
 bool TextureState::Allocate(short txType)
@@ -195,6 +212,11 @@ bool TextureState::Use(int Which)
 	bool result = !TexGened[Which];
 	TexGened[Which] = true;
 	IDUsage[Which]++;
+	LastUsed = machine_tick_count();
+	if (result)
+		MemoryBudget::instance()->Miss(sgTextureBudgetID);
+	else
+		MemoryBudget::instance()->Hit(sgTextureBudgetID);
 	return result;
 }
 
@@ -207,9 +229,36 @@ void TextureState::Reset()
 		sgActiveTextureStates.remove(this);
 		gGLTxStats.inUse--;
 		glDeleteTextures(NUMBER_OF_TEXTURES,IDs);
+		sgTextureBytes -= Bytes;
 	}
 	IsUsed = IsGlowing = IsBumped = TexGened[Normal] = TexGened[Glowing] = TexGened[Bump] = false;
 	IDUsage[Normal] = IDUsage[Glowing] = IDUsage[Bump] = unusedFrames = 0;
+	LastUsed = 0;
+	Bytes = 0;
+}
+
+// Releases the least recently used textures that weren't drawn in the last
+// second, until bytes are freed; they get reloaded when next drawn
+static size_t TrimTextures(size_t bytes)
+{
+	std::vector<TextureState*> candidates;
+	uint32 now = machine_tick_count();
+	for (auto state : sgActiveTextureStates)
+	{
+		if (state->TextureType != OGL_Txtr_Landscape && state->Bytes && now - state->LastUsed > MACHINE_TICKS_PER_SECOND)
+			candidates.push_back(state);
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const TextureState* a, const TextureState* b) { return a->LastUsed < b->LastUsed; });
+	
+	size_t freed = 0;
+	for (auto state : candidates)
+	{
+		if (freed >= bytes) break;
+		freed += state->Bytes;
+		state->Reset();
+		MemoryBudget::instance()->Evicted(sgTextureBudgetID);
+	}
+	return freed;
 }
 
 void TextureState::FrameTick() {
@@ -274,6 +323,13 @@ void FlatBumpTexture() {
 // Initialize the texture accounting
 void OGL_StartTextures()
 {
+	if (sgTextureBudgetID == NONE)
+	{
+		sgTextureBudgetID = MemoryBudget::instance()->Register("OpenGL textures", MemoryBudget::kPriorityNormal, []() { return sgTextureBytes; }, TrimTextures);
+		OGL_RegisterModelSkinBudget();
+	}
+	OGL_TexturesChanged();
+	
 	// Initialize the texture accounting proper
 	for (int it=0; it<OGL_NUMBER_OF_TEXTURE_TYPES; it++)
 		for (int ic=0; ic<MAXIMUM_COLLECTIONS; ic++)
@@ -378,6 +434,7 @@ void OGL_StopTextures()
 	for (int it=0; it<OGL_NUMBER_OF_TEXTURE_TYPES; it++)
 		for (int ic=0; ic<MAXIMUM_COLLECTIONS; ic++)
 			if (TextureStateSets[it][ic]) delete []TextureStateSets[it][ic];
+	OGL_TexturesChanged();
 
 	// clear blitters and fonts
 	OGL_Blitter::StopTextures();
@@ -1351,6 +1408,13 @@ void TextureManager::PlaceTexture(const ImageDescriptor *Image, bool normal_map)
 		assert(false);
 #endif
 	}
+
+	// The driver may store it differently, but this is close enough to budget with
+	size_t Bytes = Image->GetBufferSize();
+	if (mipmapsLoaded && Image->GetMipMapCount() <= 1)
+		Bytes += Bytes / 3;
+	TxtrStatePtr->Bytes += Bytes;
+	sgTextureBytes += Bytes;
 	
 	// Set texture-mapping features
 	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
@@ -1550,6 +1614,7 @@ void OGL_ResetTextures()
 {
 	// Fix for crashing bug when OpenGL is inactive
 	if (!OGL_IsActive()) return;
+	OGL_TexturesChanged();
 	
 	// Reset the textures:
 	for (int it=0; it<OGL_NUMBER_OF_TEXTURE_TYPES; it++)
@@ -47,6 +47,12 @@ void OGL_StopTextures();
 // Call this after every frame for housekeeping stuff
 void OGL_FrameTickTextures();
 
+// Changes whenever the texture states are started, stopped or reset,
+// or collections reloaded; anything holding on to a TextureManager
+// should let go of it then
+uint32 OGL_TextureGeneration();
+void OGL_TexturesChanged();
+
 // State of an individual texture set:
 struct TextureState
 {
@@ -65,6 +71,8 @@ struct TextureState
 	bool TexGened[NUMBER_OF_TEXTURES];	// Which ID's have had their textures generated?
 	int IDUsage[NUMBER_OF_TEXTURES];	// Which ID's are being used?  Reset every frame.
 	int unusedFrames;					// How many frames have passed since we were last used.
+	uint32 LastUsed;					// Machine tick of the last Use()
+	size_t Bytes;						// Roughly how much video memory the textures take up
 	short TextureType;
     
     GLdouble U_Scale;
@@ -253,6 +261,10 @@ public:
 
 	void SetupTextureMatrix();
 	void RestoreTextureMatrix();
+
+	// Whether the textures are in OpenGL already; right after Setup(),
+	// this says whether Setup() only had to look them up
+	bool IsLoaded() {return TxtrStatePtr && TxtrStatePtr->IsUsed;}
 	
 	TextureManager(const TextureManager&) = delete;
 	TextureManager& operator= (const TextureManager&) = delete;
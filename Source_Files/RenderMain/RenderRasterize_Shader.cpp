@@ -8,6 +8,7 @@
 
 #include "OGL_Headers.h"
 
+#include <chrono>
 #include <iostream>
 
 #include "RenderRasterize_Shader.h"
@@ -18,14 +19,31 @@
 #include "weapons.h"
 #include "AnimatedTextures.h"
 #include "OGL_Faders.h"
+#include "OGL_Render.h"
 #include "OGL_Textures.h"
 #include "OGL_Shader.h"
 #include "ChaseCam.h"
 #include "preferences.h"
 #include "screen.h"
+#include "interface.h"
+#include "Console.h"
+#include "Logging.h"
+#include "MemoryBudget.h"
 
 #define MAXIMUM_VERTICES_PER_WORLD_POLYGON (MAXIMUM_VERTICES_PER_POLYGON+4)
 
+// position, texture coordinate, color, normal, tangent
+enum { kSurfaceVertexFloats = 3 + 2 + 3 + 3 + 4 };
+const GLsizeiptr kBatchBufferSize = 1 << 20;
+
+// draw surfaces in batches, rather than one at a time
+static bool batch_surfaces = true;
+
+// glDraw* calls this frame so far
+static int draw_calls = 0;
+
+static void benchmark_surfaces(const std::string& arg);
+
 inline bool FogActive();
 
 class Blur {
@@ -101,6 +119,26 @@ void RenderRasterize_Shader::setupGL(Rasterizer_Shader_Class& Rasterizer) {
 
 	Shader::loadAll();
 
+	// any buffer we had went with the old context
+	batch_buffer = 0;
+	batch_buffer_used = 0;
+	batch_count = 0;
+	batch_window = nullptr;
+
+	static bool registered = false;
+	if (!registered) {
+		Console::instance()->register_benchmark("surfaces", benchmark_surfaces);
+		texture_budget_id = MemoryBudget::instance()->Register("texture managers", MemoryBudget::kPriorityLow,
+			[this]() { return texture_managers.size() * sizeof(TextureManager); },
+			[this](size_t) {
+				size_t freed = texture_managers.size() * sizeof(TextureManager);
+				MemoryBudget::instance()->Evicted(texture_budget_id, texture_managers.size());
+				texture_managers.clear();
+				return freed;
+			});
+		registered = true;
+	}
+
 	Shader* s_blur = Shader::get(Shader::S_Blur);
 	Shader* s_bloom = Shader::get(Shader::S_Bloom);
 
@@ -126,6 +164,10 @@ const float FixedAngleToDegrees = 360.0/(float(FIXED_ONE)*float(FULL_CIRCLE));
 
 void RenderRasterize_Shader::render_tree() {
 
+	draw_calls = 0;
+	texture_setups = 0;
+	texture_allocations = 0;
+
 	weaponFlare = PIN(view->maximum_depth_intensity - NATURAL_LIGHT_INTENSITY, 0, FIXED_ONE)/float(FIXED_ONE);
 	selfLuminosity = PIN(NATURAL_LIGHT_INTENSITY, 0, FIXED_ONE)/float(FIXED_ONE);
 
@@ -208,6 +250,11 @@ void RenderRasterize_Shader::render_tree() {
 	}
 
 	glAlphaFunc(GL_GREATER, 0.5);
+
+	last_render_frame_stats.draw_calls = draw_calls;
+	last_render_frame_stats.texture_setups = texture_setups;
+	last_render_frame_stats.texture_allocations = texture_allocations;
+	last_render_frame_stats.textures_cached = texture_managers.size();
 }
 
 void RenderRasterize_Shader::render_node(sorted_node_data *node, bool SeeThruLiquids, RenderStep renderStep)
@@ -217,6 +264,7 @@ void RenderRasterize_Shader::render_node(sorted_node_data *node, bool SeeThruLiq
     objectY = 0;
 
     RenderRasterizerClass::render_node(node, SeeThruLiquids, renderStep);
+	flush_batches();
 
 	// turn off clipping planes
 	glDisable(GL_CLIP_PLANE0);
@@ -263,14 +311,61 @@ void RenderRasterize_Shader::store_endpoint(
 	p.j = endpoint->vertex.y;
 }
 
-std::unique_ptr<TextureManager> RenderRasterize_Shader::setupSpriteTexture(const rectangle_definition& rect, short type, float offset, RenderStep renderStep) {
+size_t RenderRasterize_Shader::TextureKeyHash::operator()(const TextureKey& key) const
+{
+	size_t hash = key.shape;
+	hash = hash * 31 + key.low_level_shape;
+	hash = hash * 31 + key.transfer_mode;
+	hash = hash * 31 + key.texture_type;
+	return hash * 4 + (key.shadeless ? 2 : 0) + (key.infravision ? 1 : 0);
+}
+
+TextureManager* RenderRasterize_Shader::find_texture(const TextureKey& key, bool& found)
+{
+	++texture_setups;
+	if (texture_generation != OGL_TextureGeneration()) {
+		texture_managers.clear();
+		texture_generation = OGL_TextureGeneration();
+	}
+
+	auto it = texture_managers.find(key);
+	if (it != texture_managers.end()) {
+		if (it->second->IsLoaded()) {
+			MemoryBudget::instance()->Hit(texture_budget_id);
+			found = true;
+			return it->second.get();
+		}
+
+		// its textures were let go of; set up a new one to load them again
+		texture_managers.erase(it);
+	}
+
+	MemoryBudget::instance()->Miss(texture_budget_id);
+	++texture_allocations;
+	found = false;
+	loading_texture.reset(new TextureManager());
+	return loading_texture.get();
+}
+
+void RenderRasterize_Shader::keep_texture(const TextureKey& key)
+{
+	// one that had to load its textures holds copies of the images
+	// it loaded them from, which aren't worth keeping around
+	if (loading_texture->IsLoaded()) {
+		texture_managers[key] = std::move(loading_texture);
+	}
+}
+
+TextureManager* RenderRasterize_Shader::setupSpriteTexture(const rectangle_definition& rect, short type, float offset, RenderStep renderStep) {
 
 	Shader *s = NULL;
 	GLfloat color[3];
 	GLdouble shade = PIN(static_cast<GLfloat>(rect.ambient_shade)/static_cast<GLfloat>(FIXED_ONE),0,1);
 	color[0] = color[1] = color[2] = shade;
 
-	auto TMgr = std::unique_ptr<TextureManager>(new TextureManager());
+	const TextureKey key = { rect.ShapeDesc, rect.LowLevelShape, rect.transfer_mode, type, (rect.flags&_SHADELESS_BIT) != 0, IsInfravisionActive() };
+	bool found;
+	TextureManager* TMgr = find_texture(key, found);
 
 	TMgr->ShapeDesc = rect.ShapeDesc;
 	TMgr->LowLevelShape = rect.LowLevelShape;
@@ -281,7 +376,7 @@ std::unique_ptr<TextureManager> RenderRasterize_Shader::setupSpriteTexture(const
 	TMgr->IsShadeless = (rect.flags&_SHADELESS_BIT) != 0;
 	TMgr->TextureType = type;
 
-	if (current_player->infravision_duration) {
+	if (current_player->infravision_duration && !found) {
 		struct bitmap_definition* dummy;
 		// grab the normal shading tables, since the shader does the tinting
 		extended_get_shape_bitmap_and_shading_table(GET_DESCRIPTOR_COLLECTION(TMgr->ShapeDesc), TMgr->LowLevelShape, &dummy, &TMgr->ShadingTables, _shading_normal);
@@ -346,12 +441,14 @@ std::unique_ptr<TextureManager> RenderRasterize_Shader::setupSpriteTexture(const
 		s->enable();
 	}
 
-	if(TMgr->Setup()) {
-		TMgr->RenderNormal();
-	} else {
-		TMgr->ShapeDesc = UNONE;
-		return TMgr;
+	if (!found) {
+		if (!TMgr->Setup()) {
+			TMgr->ShapeDesc = UNONE;
+			return TMgr;
+		}
+		keep_texture(key);
 	}
+	TMgr->RenderNormal();
 
 	TMgr->SetupTextureMatrix();
 
@@ -370,19 +467,41 @@ std::unique_ptr<TextureManager> RenderRasterize_Shader::setupSpriteTexture(const
 	return TMgr;
 }
 
+// the color setupWallTexture() leaves a wall with: its light intensity,
+// unless infravision tints it
+static void wall_color(const shape_descriptor& Texture, short transferMode, float intensity, GLfloat color[3])
+{
+	if (current_player->infravision_duration && transferMode != _xfer_static) {
+		color[0] = color[1] = color[2] = 1;
+		FindInfravisionVersionRGBA(GET_COLLECTION(GET_DESCRIPTOR_COLLECTION(Texture)), color);
+	} else {
+		color[0] = color[1] = color[2] = intensity;
+	}
+}
+
 // Circle constants
 const double Radian2Circle = 1/TWO_PI;			// A circle is 2*pi radians
 const double FullCircleReciprocal = 1/double(FULL_CIRCLE);
 
-std::unique_ptr<TextureManager> RenderRasterize_Shader::setupWallTexture(const shape_descriptor& Texture, short transferMode, float pulsate, float wobble, float intensity, float offset, RenderStep renderStep) {
+TextureManager* RenderRasterize_Shader::setupWallTexture(const shape_descriptor& Texture, short transferMode, float pulsate, float wobble, float intensity, float offset, RenderStep renderStep) {
 
 	Shader *s = NULL;
 
-	auto TMgr = std::unique_ptr<TextureManager>(new TextureManager());
+	if (Texture == UNONE) {
+		no_texture.ShapeDesc = UNONE;
+		return &no_texture;
+	}
+
+	const bool landscape = (transferMode == _xfer_landscape || transferMode == _xfer_big_landscape);
+	const TextureKey key = { Texture, 0, transferMode, short(landscape ? OGL_Txtr_Landscape : OGL_Txtr_Wall), current_player->infravision_duration != 0, IsInfravisionActive() };
+	bool found;
+	TextureManager* TMgr = find_texture(key, found);
+
 	LandscapeOptions *opts = NULL;
 	TMgr->ShapeDesc = Texture;
-	if (TMgr->ShapeDesc == UNONE) { return TMgr; }
-	get_shape_bitmap_and_shading_table(Texture, &TMgr->Texture, &TMgr->ShadingTables, _shading_normal);
+	if (!found) {
+		get_shape_bitmap_and_shading_table(Texture, &TMgr->Texture, &TMgr->ShadingTables, _shading_normal);
+	}
 
 	TMgr->TransferMode = _textured_transfer;
 	TMgr->IsShadeless = current_player->infravision_duration ? 1 : 0;
@@ -391,7 +510,9 @@ std::unique_ptr<TextureManager> RenderRasterize_Shader::setupWallTexture(const s
 	float flare = weaponFlare;
 
 	glEnable(GL_TEXTURE_2D);
-	glColor4f(intensity, intensity, intensity, 1.0);
+	GLfloat color[3];
+	wall_color(Texture, transferMode, intensity, color);
+	glColor4f(color[0], color[1], color[2], 1.0);
 
 	switch(transferMode) {
 		case _xfer_static:
@@ -411,9 +532,6 @@ std::unique_ptr<TextureManager> RenderRasterize_Shader::setupWallTexture(const s
 			TMgr->LandscapeVertRepeat = opts->VertRepeat;
 			TMgr->Landscape_AspRatExp = opts->OGL_AspRatExp;
 			if (current_player->infravision_duration) {
-				GLfloat color[3] {1, 1, 1};
-				FindInfravisionVersionRGBA(GET_COLLECTION(GET_DESCRIPTOR_COLLECTION(Texture)), color);
-				glColor4f(color[0], color[1], color[2], 1);
 				s = Shader::get(Shader::S_LandscapeInfravision);
 			} else {
 				if (renderStep == kDiffuse) {
@@ -427,20 +545,13 @@ std::unique_ptr<TextureManager> RenderRasterize_Shader::setupWallTexture(const s
 		default:
 			TMgr->TextureType = OGL_Txtr_Wall;
 			if(TMgr->IsShadeless) {
-				if (renderStep == kDiffuse) {
-					glColor4f(1,1,1,1);
-				} else {
-					glColor4f(0,0,0,1);
-				}
+				// shadeless only under infravision, which tints instead
 				flare = -1;
 			}
 	}
 
 	if(s == NULL) {
 		if (current_player->infravision_duration) {
-			GLfloat color[3] {1, 1, 1};
-			FindInfravisionVersionRGBA(GET_COLLECTION(GET_DESCRIPTOR_COLLECTION(Texture)), color);
-			glColor4f(color[0], color[1], color[2], 1);
 			s = Shader::get(Shader::S_WallInfravision);
 		} else if(TEST_FLAG(Get_OGL_ConfigureData().Flags, OGL_Flag_BumpMap)) {
 			s = Shader::get(renderStep == kGlow ? Shader::S_BumpBloom : Shader::S_Bump);
@@ -450,16 +561,18 @@ std::unique_ptr<TextureManager> RenderRasterize_Shader::setupWallTexture(const s
 		s->enable();
 	}
 
-	if(TMgr->Setup()) {
-		TMgr->RenderNormal(); // must allocate first
-		if (TEST_FLAG(Get_OGL_ConfigureData().Flags, OGL_Flag_BumpMap)) {
-			glActiveTextureARB(GL_TEXTURE1_ARB);
-			TMgr->RenderBump();
-			glActiveTextureARB(GL_TEXTURE0_ARB);
+	if (!found) {
+		if (!TMgr->Setup()) {
+			TMgr->ShapeDesc = UNONE;
+			return TMgr;
 		}
-	} else {
-		TMgr->ShapeDesc = UNONE;
-		return TMgr;
+		keep_texture(key);
+	}
+	TMgr->RenderNormal(); // must allocate first
+	if (TEST_FLAG(Get_OGL_ConfigureData().Flags, OGL_Flag_BumpMap)) {
+		glActiveTextureARB(GL_TEXTURE1_ARB);
+		TMgr->RenderBump();
+		glActiveTextureARB(GL_TEXTURE0_ARB);
 	}
 
 	TMgr->SetupTextureMatrix();
@@ -566,7 +679,7 @@ void setupBlendFunc(short blendType) {
 	}
 }
 
-bool setupGlow(struct view_data *view, std::unique_ptr<TextureManager>& TMgr, float wobble, float intensity, float flare, float selfLuminosity, float offset, RenderStep renderStep) {
+bool setupGlow(struct view_data *view, TextureManager* TMgr, float wobble, float intensity, float flare, float selfLuminosity, float offset, RenderStep renderStep) {
 	if (TMgr->TransferMode == _textured_transfer && TMgr->IsGlowMapped()) {
 		Shader *s = NULL;
 		if (TMgr->TextureType == OGL_Txtr_Wall) {
@@ -601,19 +714,8 @@ bool setupGlow(struct view_data *view, std::unique_ptr<TextureManager>& TMgr, fl
 	return false;
 }
 
-void RenderRasterize_Shader::render_node_floor_or_ceiling(clipping_window_data *window,
-	polygon_data *polygon, horizontal_surface_data *surface, bool void_present, bool ceil, RenderStep renderStep) {
-
-	float offset = 0;
-
-	const shape_descriptor& texture = AnimTxtr_Translate(surface->texture);
-	float intensity = get_light_intensity(surface->lightsource_index) / float(FIXED_ONE - 1);
-	float wobble = calcWobble(surface->transfer_mode, view->tick_count);
-	// note: wobble and pulsate behave the same way on floors and ceilings
-	// note 2: stronger wobble looks more like classic with default shaders
-	auto TMgr = setupWallTexture(texture, surface->transfer_mode, wobble * 4.0, 0, intensity, offset, renderStep);
-	if(TMgr->ShapeDesc == UNONE) { return; }
-
+static void setupSurfaceBlend(TextureManager* TMgr, bool void_present)
+{
 	if (TMgr->IsBlended()) {
 		glEnable(GL_BLEND);
 		setupBlendFunc(TMgr->NormalBlend());
@@ -629,72 +731,238 @@ void RenderRasterize_Shader::render_node_floor_or_ceiling(clipping_window_data *
 		glDisable(GL_BLEND);
 		glDisable(GL_ALPHA_TEST);
 	}
+}
 
-	short vertex_count = polygon->vertex_count;
-
-	if (vertex_count) {
-        clip_to_window(window);
+static void add_surface_vertex(std::vector<GLfloat>& vertices, const GLfloat *position, const GLfloat *texcoord, const GLfloat *color, const vec3& N, const vec3& T, float sign)
+{
+	const GLfloat v[kSurfaceVertexFloats] = {
+		position[0], position[1], position[2],
+		texcoord[0], texcoord[1],
+		color[0], color[1], color[2],
+		N[0], N[1], N[2],
+		T[0], T[1], T[2], sign
+	};
+	vertices.insert(vertices.end(), v, v + kSurfaceVertexFloats);
+}
 
-		world_distance x = 0.0, y = 0.0;
-		instantiate_transfer_mode(view, surface->transfer_mode, x, y);
+RenderRasterize_Shader::SurfaceBatch& RenderRasterize_Shader::find_batch(clipping_window_data *window, const shape_descriptor& texture, short transfer_mode, bool void_present, float pulsate, float wobble, float offset, RenderStep renderStep)
+{
+	if (window != batch_window || renderStep != batch_step) {
+		flush_batches();
+		batch_window = window;
+		batch_step = renderStep;
+	}
 
-		vec3 N;
-		vec3 T;
-		float sign;
-		if(ceil) {
-			N = vec3(0,0,-1);
-			T = vec3(0,1,0);
-			sign = 1;
-		} else {
-			N = vec3(0,0,1);
-			T = vec3(0,1,0);
-			sign = -1;
+	for (size_t i = 0; i < batch_count; ++i) {
+		SurfaceBatch& batch = batches[i];
+		if (batch.texture == texture && batch.transfer_mode == transfer_mode && batch.void_present == void_present &&
+			batch.pulsate == pulsate && batch.wobble == wobble && batch.offset == offset) {
+			return batch;
 		}
-		glNormal3f(N[0], N[1], N[2]);
-		glMultiTexCoord4fARB(GL_TEXTURE1_ARB, T[0], T[1], T[2], sign);
+	}
 
-		GLfloat vertex_array[MAXIMUM_VERTICES_PER_POLYGON * 3];
-		GLfloat texcoord_array[MAXIMUM_VERTICES_PER_POLYGON * 2];
+	if (batch_count == batches.size()) {
+		batches.emplace_back();
+	}
+	SurfaceBatch& batch = batches[batch_count++];
+	batch.texture = texture;
+	batch.transfer_mode = transfer_mode;
+	batch.void_present = void_present;
+	batch.pulsate = pulsate;
+	batch.wobble = wobble;
+	batch.offset = offset;
+	batch.vertices.clear();
+	return batch;
+}
 
-		GLfloat* vp = vertex_array;
-		GLfloat* tp = texcoord_array;
-		if (ceil)
-		{
-			for(short i = 0; i < vertex_count; ++i) {
-				world_point2d vertex = get_endpoint_data(polygon->endpoint_indexes[vertex_count - 1 - i])->vertex;
-				*vp++ = vertex.x;
-				*vp++ = vertex.y;
-				*vp++ = surface->height;
-				*tp++ = (vertex.x + surface->origin.x + x) / float(WORLD_ONE);
-				*tp++ = (vertex.y + surface->origin.y + y) / float(WORLD_ONE);
-			}
+void RenderRasterize_Shader::flush_batches()
+{
+	if (!batch_count) {
+		batch_window = nullptr;
+		return;
+	}
+
+	clip_to_window(batch_window);
+
+	if (!batch_buffer) {
+		glGenBuffersARB(1, &batch_buffer);
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, batch_buffer);
+		glBufferDataARB(GL_ARRAY_BUFFER_ARB, kBatchBufferSize, NULL, GL_STREAM_DRAW_ARB);
+		batch_buffer_used = 0;
+	} else {
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, batch_buffer);
+	}
+
+	glEnableClientState(GL_COLOR_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glClientActiveTextureARB(GL_TEXTURE1_ARB);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glClientActiveTextureARB(GL_TEXTURE0_ARB);
+
+	for (size_t i = 0; i < batch_count; ++i) {
+		SurfaceBatch& batch = batches[i];
+
+		auto TMgr = setupWallTexture(batch.texture, batch.transfer_mode, batch.pulsate, batch.wobble, 1, batch.offset, batch_step);
+		if (TMgr->ShapeDesc == UNONE) {
+			Shader::disable();
+			continue;
 		}
-		else
-		{
-			for(short i=0; i<vertex_count; ++i) {
-				world_point2d vertex = get_endpoint_data(polygon->endpoint_indexes[i])->vertex;
-				*vp++ = vertex.x;
-				*vp++ = vertex.y;
-				*vp++ = surface->height;
-				*tp++ = (vertex.x + surface->origin.x + x) / float(WORLD_ONE);
-				*tp++ = (vertex.y + surface->origin.y + y) / float(WORLD_ONE);
+		setupSurfaceBlend(TMgr, batch.void_present);
+
+		GLsizeiptr bytes = batch.vertices.size() * sizeof(GLfloat);
+		const GLfloat *base;
+		if (bytes > kBatchBufferSize) {
+			// too big to stream; draw straight from memory
+			glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+			base = batch.vertices.data();
+		} else {
+			if (batch_buffer_used + bytes > kBatchBufferSize) {
+				// orphan it, so we don't wait on draws still using it
+				glBufferDataARB(GL_ARRAY_BUFFER_ARB, kBatchBufferSize, NULL, GL_STREAM_DRAW_ARB);
+				batch_buffer_used = 0;
 			}
+			glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, batch_buffer_used, bytes, batch.vertices.data());
+			base = reinterpret_cast<const GLfloat *>(batch_buffer_used);
+			batch_buffer_used += bytes;
 		}
-		glVertexPointer(3, GL_FLOAT, 0, vertex_array);
-		glTexCoordPointer(2, GL_FLOAT, 0, texcoord_array);
 
-		glDrawArrays(GL_POLYGON, 0, vertex_count);
-
-		// see note 2 above; pulsate uniform should stay set from setupWall call
-		if (setupGlow(view, TMgr, 0, intensity, weaponFlare, selfLuminosity, offset, renderStep)) {
-			glDrawArrays(GL_POLYGON, 0, vertex_count);
+		const GLsizei stride = kSurfaceVertexFloats * sizeof(GLfloat);
+		glVertexPointer(3, GL_FLOAT, stride, base);
+		glTexCoordPointer(2, GL_FLOAT, stride, base + 3);
+		glColorPointer(3, GL_FLOAT, stride, base + 5);
+		glNormalPointer(GL_FLOAT, stride, base + 8);
+		glClientActiveTextureARB(GL_TEXTURE1_ARB);
+		glTexCoordPointer(4, GL_FLOAT, stride, base + 11);
+		glClientActiveTextureARB(GL_TEXTURE0_ARB);
+
+		GLsizei count = batch.vertices.size() / kSurfaceVertexFloats;
+		glDrawArrays(GL_TRIANGLES, 0, count);
+		++draw_calls;
+
+		if (setupGlow(view, TMgr, batch.wobble, 1, weaponFlare, selfLuminosity, batch.offset, batch_step)) {
+			glDrawArrays(GL_TRIANGLES, 0, count);
+			++draw_calls;
 		}
 
 		Shader::disable();
 		glMatrixMode(GL_TEXTURE);
 		glLoadIdentity();
 		glMatrixMode(GL_MODELVIEW);
+
+		if (bytes > kBatchBufferSize) {
+			glBindBufferARB(GL_ARRAY_BUFFER_ARB, batch_buffer);
+		}
+	}
+
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glClientActiveTextureARB(GL_TEXTURE1_ARB);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glClientActiveTextureARB(GL_TEXTURE0_ARB);
+	glColor4f(1, 1, 1, 1);
+
+	batch_count = 0;
+	batch_window = nullptr;
+}
+
+void RenderRasterize_Shader::render_node_floor_or_ceiling(clipping_window_data *window,
+	polygon_data *polygon, horizontal_surface_data *surface, bool void_present, bool ceil, RenderStep renderStep) {
+
+	float offset = 0;
+
+	const shape_descriptor& texture = AnimTxtr_Translate(surface->texture);
+	float intensity = get_light_intensity(surface->lightsource_index) / float(FIXED_ONE - 1);
+	float wobble = calcWobble(surface->transfer_mode, view->tick_count);
+
+	short vertex_count = polygon->vertex_count;
+	if (!vertex_count || texture == UNONE) { return; }
+
+	world_distance x = 0.0, y = 0.0;
+	instantiate_transfer_mode(view, surface->transfer_mode, x, y);
+
+	vec3 N;
+	vec3 T;
+	float sign;
+	if(ceil) {
+		N = vec3(0,0,-1);
+		T = vec3(0,1,0);
+		sign = 1;
+	} else {
+		N = vec3(0,0,1);
+		T = vec3(0,1,0);
+		sign = -1;
+	}
+
+	GLfloat vertex_array[MAXIMUM_VERTICES_PER_POLYGON * 3];
+	GLfloat texcoord_array[MAXIMUM_VERTICES_PER_POLYGON * 2];
+
+	GLfloat* vp = vertex_array;
+	GLfloat* tp = texcoord_array;
+	if (ceil)
+	{
+		for(short i = 0; i < vertex_count; ++i) {
+			world_point2d vertex = get_endpoint_data(polygon->endpoint_indexes[vertex_count - 1 - i])->vertex;
+			*vp++ = vertex.x;
+			*vp++ = vertex.y;
+			*vp++ = surface->height;
+			*tp++ = (vertex.x + surface->origin.x + x) / float(WORLD_ONE);
+			*tp++ = (vertex.y + surface->origin.y + y) / float(WORLD_ONE);
+		}
 	}
+	else
+	{
+		for(short i=0; i<vertex_count; ++i) {
+			world_point2d vertex = get_endpoint_data(polygon->endpoint_indexes[i])->vertex;
+			*vp++ = vertex.x;
+			*vp++ = vertex.y;
+			*vp++ = surface->height;
+			*tp++ = (vertex.x + surface->origin.x + x) / float(WORLD_ONE);
+			*tp++ = (vertex.y + surface->origin.y + y) / float(WORLD_ONE);
+		}
+	}
+
+	// note: wobble and pulsate behave the same way on floors and ceilings
+	// note 2: stronger wobble looks more like classic with default shaders
+	if (batch_surfaces) {
+		GLfloat color[3];
+		wall_color(texture, surface->transfer_mode, intensity, color);
+		SurfaceBatch& batch = find_batch(window, texture, surface->transfer_mode, void_present, wobble * 4.0, 0, offset, renderStep);
+		// as a fan, to keep the winding
+		for (short i = 1; i + 1 < vertex_count; ++i) {
+			add_surface_vertex(batch.vertices, vertex_array, texcoord_array, color, N, T, sign);
+			add_surface_vertex(batch.vertices, vertex_array + i * 3, texcoord_array + i * 2, color, N, T, sign);
+			add_surface_vertex(batch.vertices, vertex_array + (i + 1) * 3, texcoord_array + (i + 1) * 2, color, N, T, sign);
+		}
+		return;
+	}
+
+	auto TMgr = setupWallTexture(texture, surface->transfer_mode, wobble * 4.0, 0, intensity, offset, renderStep);
+	if(TMgr->ShapeDesc == UNONE) { return; }
+
+	setupSurfaceBlend(TMgr, void_present);
+
+	clip_to_window(window);
+
+	glNormal3f(N[0], N[1], N[2]);
+	glMultiTexCoord4fARB(GL_TEXTURE1_ARB, T[0], T[1], T[2], sign);
+
+	glVertexPointer(3, GL_FLOAT, 0, vertex_array);
+	glTexCoordPointer(2, GL_FLOAT, 0, texcoord_array);
+
+	glDrawArrays(GL_POLYGON, 0, vertex_count);
+	++draw_calls;
+
+	// see note 2 above; pulsate uniform should stay set from setupWall call
+	if (setupGlow(view, TMgr, 0, intensity, weaponFlare, selfLuminosity, offset, renderStep)) {
+		glDrawArrays(GL_POLYGON, 0, vertex_count);
+		++draw_calls;
+	}
+
+	Shader::disable();
+	glMatrixMode(GL_TEXTURE);
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
 }
 
 void RenderRasterize_Shader::render_node_side(clipping_window_data *window, vertical_surface_data *surface, bool void_present, RenderStep renderStep) {
@@ -712,24 +980,7 @@ void RenderRasterize_Shader::render_node_side(clipping_window_data *window, vert
 		pulsate = wobble;
 		wobble = 0;
 	}
-	auto TMgr = setupWallTexture(texture, surface->transfer_mode, pulsate, wobble, intensity, offset, renderStep);
-	if(TMgr->ShapeDesc == UNONE) { return; }
-
-	if (TMgr->IsBlended()) {
-		glEnable(GL_BLEND);
-		setupBlendFunc(TMgr->NormalBlend());
-		glEnable(GL_ALPHA_TEST);
-		glAlphaFunc(GL_GREATER, 0.001);
-	} else {
-		glDisable(GL_BLEND);
-		glEnable(GL_ALPHA_TEST);
-		glAlphaFunc(GL_GREATER, 0.5);
-	}
-
-	if (void_present && TMgr->IsBlended()) {
-		glDisable(GL_BLEND);
-		glDisable(GL_ALPHA_TEST);
-	}
+	if (texture == UNONE) { return; }
 
 	world_distance h= MIN(surface->h1, surface->hmax);
 
@@ -746,8 +997,6 @@ void RenderRasterize_Shader::render_node_side(clipping_window_data *window, vert
 		long_to_overflow_short_2d(surface->p1, vertex[1], flags);
 
 		if (vertex_count) {
-            clip_to_window(window);
-
 			vertex_count= 4;
 			vertices[0].z= vertices[1].z= h + view->origin.z;
 			vertices[2].z= vertices[3].z= surface->h0 + view->origin.z;
@@ -768,8 +1017,6 @@ void RenderRasterize_Shader::render_node_side(clipping_window_data *window, vert
 			vec3 N(-dy, dx, 0);
 			vec3 T(dx, dy, 0);
 			float sign = 1;
-			glNormal3f(N[0], N[1], N[2]);
-			glMultiTexCoord4fARB(GL_TEXTURE1_ARB, T[0], T[1], T[2], sign);
 
 			world_distance x = 0.0, y = 0.0;
 			instantiate_transfer_mode(view, surface->transfer_mode, x, y);
@@ -793,13 +1040,37 @@ void RenderRasterize_Shader::render_node_side(clipping_window_data *window, vert
 				*tp++ = (tOffset - vertices[i].z) / div;
 				*tp++ = (x0+p2) / div;
 			}
+
+			if (batch_surfaces) {
+				GLfloat color[3];
+				wall_color(texture, surface->transfer_mode, intensity, color);
+				SurfaceBatch& batch = find_batch(window, texture, surface->transfer_mode, void_present, pulsate, wobble, offset, renderStep);
+				static const int quad_triangles[6] = { 0, 1, 2, 0, 2, 3 };
+				for (int i : quad_triangles) {
+					add_surface_vertex(batch.vertices, vertex_array + i * 3, texcoord_array + i * 2, color, N, T, sign);
+				}
+				return;
+			}
+
+			auto TMgr = setupWallTexture(texture, surface->transfer_mode, pulsate, wobble, intensity, offset, renderStep);
+			if(TMgr->ShapeDesc == UNONE) { return; }
+
+			setupSurfaceBlend(TMgr, void_present);
+
+			clip_to_window(window);
+
+			glNormal3f(N[0], N[1], N[2]);
+			glMultiTexCoord4fARB(GL_TEXTURE1_ARB, T[0], T[1], T[2], sign);
+
 			glVertexPointer(3, GL_FLOAT, 0, vertex_array);
 			glTexCoordPointer(2, GL_FLOAT, 0, texcoord_array);
 			
 			glDrawArrays(GL_QUADS, 0, vertex_count);
+			++draw_calls;
 
 			if (setupGlow(view, TMgr, wobble, intensity, weaponFlare, selfLuminosity, offset, renderStep)) {
 				glDrawArrays(GL_QUADS, 0, vertex_count);
+				++draw_calls;
 			}
 
 			Shader::disable();
@@ -959,6 +1230,7 @@ bool RenderModel(rectangle_definition& RenderRectangle, short Collection, short
 	}
 
 	glDrawElements(GL_TRIANGLES,(GLsizei)ModelPtr->Model.NumVI(),GL_UNSIGNED_SHORT,ModelPtr->Model.VIBase());
+	++draw_calls;
 
 	if (canGlow && SkinPtr->GlowImg.IsPresent()) {
 		glEnable(GL_BLEND);
@@ -977,6 +1249,7 @@ bool RenderModel(rectangle_definition& RenderRectangle, short Collection, short
 			LoadModelSkin(SkinPtr->GlowImg, Collection, CLUT);
 		}
 		glDrawElements(GL_TRIANGLES,(GLsizei)ModelPtr->Model.NumVI(),GL_UNSIGNED_SHORT,ModelPtr->Model.VIBase());
+		++draw_calls;
 	}
 
 	glDisableClientState(GL_NORMAL_ARRAY);
@@ -995,6 +1268,9 @@ bool RenderModel(rectangle_definition& RenderRectangle, short Collection, short
 
 void RenderRasterize_Shader::render_node_object(render_object_data *object, bool other_side_of_media, RenderStep renderStep) {
 
+	// objects go in front of the surfaces queued so far
+	flush_batches();
+
     if (!object->clipping_windows)
         return;
 
@@ -1132,9 +1408,11 @@ void RenderRasterize_Shader::_render_node_object_helper(render_object_data *obje
 	glTexCoordPointer(2, GL_FLOAT, 0, texcoord_array);
 
 	glDrawArrays(GL_QUADS, 0, 4);
+	++draw_calls;
 
 	if (setupGlow(view, TMgr, 0, 1, weaponFlare, selfLuminosity, offset, renderStep)) {
 		glDrawArrays(GL_QUADS, 0, 4);
+		++draw_calls;
 	}
         
 	glEnable(GL_DEPTH_TEST);
@@ -1334,9 +1612,11 @@ void RenderRasterize_Shader::render_viewer_sprite(rectangle_definition& RenderRe
 		
 	// Go!
         glDrawArrays(GL_POLYGON,0,4);
+        ++draw_calls;
 
         if (setupGlow(view, TMgr, 0, 1, weaponFlare, selfLuminosity, 0, renderStep)) {
             glDrawArrays(GL_QUADS, 0, 4);
+            ++draw_calls;
 	}
 	
 	glEnable(GL_DEPTH_TEST);
@@ -1344,3 +1624,47 @@ void RenderRasterize_Shader::render_viewer_sprite(rectangle_definition& RenderRe
 	TMgr->RestoreTextureMatrix();
 
 }
+
+// ".benchmark surfaces [frames]" renders the current view over and over,
+// one surface at a time and then batched
+static void benchmark_surfaces(const std::string& arg)
+{
+	if (get_game_state() != _game_in_progress || !OGL_IsActive()) {
+		screen_printf("The surface benchmark needs a game in progress, in OpenGL");
+		return;
+	}
+
+	int frames = std::max(1, atoi(arg.c_str()));
+	if (arg.empty()) {
+		frames = 200;
+	}
+
+	bool was_batching = batch_surfaces;
+	double ms[2];
+	double draws[2];
+	for (int pass = 0; pass < 2; ++pass) {
+		batch_surfaces = (pass == 1);
+
+		// warm up the textures and the driver
+		for (int i = 0; i < 10; ++i) {
+			render_screen(0);
+		}
+		glFinish();
+
+		int total_draws = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; ++i) {
+			render_screen(0);
+			total_draws += last_render_frame_stats.draw_calls;
+		}
+		glFinish();
+		auto end = std::chrono::steady_clock::now();
+
+		ms[pass] = std::chrono::duration<double, std::milli>(end - start).count() / frames;
+		draws[pass] = double(total_draws) / frames;
+	}
+	batch_surfaces = was_batching;
+
+	screen_printf("%d frames: %.2f ms and %.0f draws a frame unbatched, %.2f ms and %.0f draws batched", frames, ms[0], draws[0], ms[1], draws[1]);
+	logNote("surface benchmark: %d frames, unbatched %.2f ms/frame %.0f draws/frame, batched %.2f ms/frame %.0f draws/frame", frames, ms[0], draws[0], ms[1], draws[1]);
+}
@@ -18,6 +18,8 @@
 #include "Rasterizer_Shader.h"
 
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 class Blur;
 class RenderRasterize_Shader : public RenderRasterizerClass {
@@ -32,6 +34,64 @@ class RenderRasterize_Shader : public RenderRasterizerClass {
 	
 	long_vector2d leftmost_clip, rightmost_clip;
 
+	// Surfaces of one polygon seen through one clipping window don't
+	// overlap on screen, so they can go in any order: the ones sharing a
+	// texture and transfer mode are queued up and drawn together
+	struct SurfaceBatch {
+		shape_descriptor texture;
+		short transfer_mode;
+		bool void_present;
+		float pulsate;
+		float wobble;
+		float offset;
+		std::vector<GLfloat> vertices;	// triangles, kSurfaceVertexFloats apiece
+	};
+	std::vector<SurfaceBatch> batches;
+	size_t batch_count = 0;		// the rest keep their storage for later
+	clipping_window_data *batch_window = nullptr;
+	RenderStep batch_step = kDiffuse;
+
+	// streamed vertex buffer; orphaned and refilled when it runs out
+	GLuint batch_buffer = 0;
+	GLsizeiptr batch_buffer_used = 0;
+
+	// TextureManagers whose Setup() only had to look up textures already
+	// in OpenGL, kept so later surfaces and frames can skip it; ones that
+	// are loading textures live in loading_texture until the next one
+	struct TextureKey {
+		shape_descriptor shape;
+		uint16 low_level_shape;
+		short transfer_mode;
+		short texture_type;
+		bool shadeless;
+		bool infravision;
+
+		bool operator==(const TextureKey& other) const {
+			return shape == other.shape && low_level_shape == other.low_level_shape &&
+				transfer_mode == other.transfer_mode && texture_type == other.texture_type &&
+				shadeless == other.shadeless && infravision == other.infravision;
+		}
+	};
+	struct TextureKeyHash {
+		size_t operator()(const TextureKey& key) const;
+	};
+	std::unordered_map<TextureKey, std::unique_ptr<TextureManager>, TextureKeyHash> texture_managers;
+	std::unique_ptr<TextureManager> loading_texture;
+	TextureManager no_texture;
+	uint32 texture_generation = 0;
+	int texture_budget_id = NONE;
+
+	// this frame so far
+	int texture_setups = 0;
+	int texture_allocations = 0;
+
+	// returns a cached manager with found set, or a new one to set up
+	TextureManager* find_texture(const TextureKey& key, bool& found);
+	void keep_texture(const TextureKey& key);
+
+	SurfaceBatch& find_batch(clipping_window_data *window, const shape_descriptor& texture, short transfer_mode, bool void_present, float pulsate, float wobble, float offset, RenderStep renderStep);
+	void flush_batches();
+
 protected:
 	virtual void render_node(sorted_node_data *node, bool SeeThruLiquids, RenderStep renderStep);	
 	virtual void store_endpoint(endpoint_data *endpoint, long_vector2d& p);
@@ -61,8 +121,8 @@ public:
 	virtual void render_tree(void);
         bool renders_viewer_sprites_in_tree() { return true; }
 
-	std::unique_ptr<TextureManager> setupWallTexture(const shape_descriptor& Texture, short transferMode, float pulsate, float wobble, float intensity, float offset, RenderStep renderStep);
-	std::unique_ptr<TextureManager> setupSpriteTexture(const rectangle_definition& rect, short type, float offset, RenderStep renderStep);
+	TextureManager* setupWallTexture(const shape_descriptor& Texture, short transferMode, float pulsate, float wobble, float intensity, float offset, RenderStep renderStep);
+	TextureManager* setupSpriteTexture(const rectangle_definition& rect, short type, float offset, RenderStep renderStep);
 };
 
 #endif
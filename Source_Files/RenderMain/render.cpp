@@ -215,6 +215,9 @@ Jan 17, 2001 (Loren Petrich):
 // LP additions
 #include "dynamic_limits.h"
 #include "AnimatedTextures.h"
+#include "interpolated_world.h"
+#include "FrameTimer.h"
+#include "WorkerPool.h"
 #ifdef HAVE_OPENGL
 #include "OGL_Render.h"
 #endif
@@ -228,6 +231,11 @@ extern WindowPtr screen_window;
 #include <string.h>
 #include <stdlib.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
 // LP additions for decomposition of this code:
 #include "RenderVisTree.h"
 #include "RenderSortPoly.h"
@@ -280,6 +288,8 @@ whitespace results when two adjacent polygons are clipped to different vertical
 
 vector<uint16> RenderFlagList;
 
+render_frame_stats last_render_frame_stats;
+
 // uint16 *render_flags;
 
 // LP additions: decomposition of the rendering code into various objects
@@ -321,6 +331,15 @@ static void update_view_data(struct view_data *view);
 static void update_render_effect(struct view_data *view);
 static void shake_view_origin(struct view_data *view, world_distance delta);
 
+// a weapon in hand, ready to draw
+struct viewer_sprite
+{
+	rectangle_definition rectangle;
+	bool model_flip;	// which way a 3D model faces, before mirroring
+};
+
+static void collect_viewer_sprites(view_data *view, vector<viewer_sprite>& sprites);
+static void draw_viewer_sprites(const vector<viewer_sprite>& sprites, RasterizerClass *RasPtr);
 static void render_viewer_sprite_layer(view_data *view, RasterizerClass *RasPtr);
 void position_sprite_axis(short *x0, short *x1, short scale_width, short screen_width,
 	short positioning_mode, _fixed position, bool flip, world_distance world_left, world_distance world_right);
@@ -426,6 +445,8 @@ void render_view(
 	struct view_data *view,
 	struct bitmap_definition *software_render_dest)
 {
+	finish_render_view();
+
 	update_view_data(view);
 
 	/* clear the render flags */
@@ -452,7 +473,10 @@ void render_view(
 		// LP: now from the visibility-tree class
 		/* build the render tree, regardless of map mode, so the automap updates while active */
 		RenderVisTree.view = view;
-		RenderVisTree.build_render_tree();
+		{
+			FrameTimer::Scope timer(FrameTimer::kVisibility);
+			RenderVisTree.build_render_tree();
+		}
 		
 		/* do something complicated and difficult to explain */
 		if (!view->overhead_map_active || map_is_translucent())
@@ -461,12 +485,18 @@ void render_view(
 			/* sort the render tree (so we have a depth-ordering of polygons) and accumulate
 				clipping information for each polygon */
 			RenderSortPoly.view = view;
-			RenderSortPoly.sort_render_tree();
+			{
+				FrameTimer::Scope timer(FrameTimer::kSorting);
+				RenderSortPoly.sort_render_tree();
+			}
 			
 			// LP: now from the object-placement class
 			/* build the render object list by looking at the sorted render tree */
 			RenderPlaceObjs.view = view;
-			RenderPlaceObjs.build_render_object_list();
+			{
+				FrameTimer::Scope timer(FrameTimer::kObjects);
+				RenderPlaceObjs.build_render_object_list();
+			}
 			
 			// LP addition: set the current rasterizer to whichever is appropriate here
 			RasterizerClass *RasPtr;
@@ -486,6 +516,8 @@ void render_view(
 			// Set its view:
 			RasPtr->SetView(*view);
 			
+			FrameTimer::Scope timer(FrameTimer::kRasterizing);
+
 			// Start rendering main view
 			RasPtr->Begin();
 			
@@ -519,6 +551,110 @@ void render_view(
 	}
 }
 
+/* ---------- pipelined software rendering */
+
+// One frame's rasterizing, run by whichever of a worker and
+// finish_render_view() gets to it first
+struct pipelined_frame
+{
+	std::atomic<bool> claimed{false};
+	bool done = false;
+	std::mutex mutex;
+	std::condition_variable done_changed;
+
+	void Run();
+};
+
+static view_data pipelined_view;
+static vector<viewer_sprite> pipelined_sprites;
+static std::shared_ptr<pipelined_frame> running_frame;
+
+void pipelined_frame::Run()
+{
+	if (claimed.exchange(true)) return;
+
+	// everything below reads the world through the map accessors, which
+	// now give the copy start_render_view() made
+	use_render_world(true);
+	{
+		FrameTimer::Scope timer(FrameTimer::kRasterizing);
+		Rasterizer_SW.Begin();
+		Render_Classic.render_tree();
+		draw_viewer_sprites(pipelined_sprites, &Rasterizer_SW);
+		Rasterizer_SW.End();
+	}
+	use_render_world(false);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	done = true;
+	done_changed.notify_all();
+}
+
+void start_render_view(
+	struct view_data *view,
+	struct bitmap_definition *software_render_dest)
+{
+	finish_render_view();
+
+	assert(software_render_dest);
+	assert(!view->terminal_mode_active && !view->overhead_map_active);
+
+	update_view_data(view);
+
+	/* clear the render flags */
+	objlist_clear(render_flags, RENDER_FLAGS_BUFFER_SIZE);
+
+	ResetOverheadMap();
+
+	// what's visible, and in what order, is worked out here, since the
+	// automap, Lua and the interpolated world all look at the render flags
+	RenderVisTree.view = view;
+	{
+		FrameTimer::Scope timer(FrameTimer::kVisibility);
+		RenderVisTree.build_render_tree();
+	}
+	RenderSortPoly.view = view;
+	{
+		FrameTimer::Scope timer(FrameTimer::kSorting);
+		RenderSortPoly.sort_render_tree();
+	}
+	RenderPlaceObjs.view = view;
+	{
+		FrameTimer::Scope timer(FrameTimer::kObjects);
+		RenderPlaceObjs.build_render_object_list();
+	}
+	collect_viewer_sprites(view, pipelined_sprites);
+
+	// the rest only needs the polygons, sides, lights and so on, as they
+	// are now, and its own copy of the view
+	capture_render_world();
+	pipelined_view = *view;
+
+	Rasterizer_SW.screen = software_render_dest;
+	Rasterizer_SW.SetView(pipelined_view);
+	Render_Classic.view = &pipelined_view;
+	Render_Classic.RasPtr = &Rasterizer_SW;
+
+	running_frame = std::make_shared<pipelined_frame>();
+	auto frame = running_frame;
+	WorkerPool::instance()->Post([frame]() { frame->Run(); });
+}
+
+void finish_render_view(
+	void)
+{
+	if (!running_frame) return;
+
+	// if no worker has started on it yet, don't wait for one
+	running_frame->Run();
+
+	std::unique_lock<std::mutex> lock(running_frame->mutex);
+	running_frame->done_changed.wait(lock, [] { return running_frame->done; });
+	lock.unlock();
+
+	running_frame.reset();
+}
+
 void start_render_effect(
 	struct view_data *view,
 	short effect)
@@ -577,6 +713,9 @@ void check_m1_exploration(void)
 		explore_tree.Resize(MAXIMUM_ENDPOINTS_PER_MAP, MAXIMUM_LINES_PER_MAP);
 	}
 
+	// The rasterizer reads the render flags, which get swapped out below
+	finish_render_view();
+
 	// Check the relevant players' views for exploration polygons.
 	// We check every TICKS_PER_EXLORE ticks, staggered by index.
 	for (int i = (dynamic_world->tick_count % TICKS_PER_EXPLORE);
@@ -986,19 +1125,18 @@ void instantiate_polygon_transfer_mode(
 
 /* ---------- viewer sprite layer (i.e., weapons) */
 
-static void render_viewer_sprite_layer(view_data *view, RasterizerClass *RasPtr)
+static void collect_viewer_sprites(view_data *view, vector<viewer_sprite>& sprites)
 {
 	rectangle_definition textured_rectangle;
 	weapon_display_information display_data;
 	shape_information_data *shape_information;
 	short count;
 
+	sprites.clear();
+
 	// LP change: bug out if weapons-in-hand are not to be displayed
 	if (!view->show_weapons_in_hand) return;
 	
-	// Need to set this...
-	RasPtr->SetForeground();
-	
 	// No models here, and completely opaque
 	textured_rectangle.ModelPtr = NULL;
 	textured_rectangle.Opacity = 1;
@@ -1042,9 +1180,9 @@ static void render_viewer_sprite_layer(view_data *view, RasterizerClass *RasPtr)
 			textured_rectangle.LightDepth = 0;
 			const GLfloat LightDirection[3] = {0, 1, 0};	// y is forward
 			objlist_copy(textured_rectangle.LightDirection,LightDirection,3);
-			RasPtr->SetForegroundView(display_data.flip_horizontal);
 		}
 #endif
+		bool model_flip = display_data.flip_horizontal;
 		
 		if (shape_information->flags&_X_MIRRORED_BIT) display_data.flip_horizontal= !display_data.flip_horizontal;
 		if (shape_information->flags&_Y_MIRRORED_BIT) display_data.flip_vertical= !display_data.flip_vertical;
@@ -1084,12 +1222,36 @@ static void render_viewer_sprite_layer(view_data *view, RasterizerClass *RasPtr)
 		/* make the weapon reflect the owner’s transfer mode */
 		instantiate_rectangle_transfer_mode(view, &textured_rectangle, display_data.transfer_mode, display_data.transfer_phase);
 		
+		sprites.push_back({textured_rectangle, model_flip});
+	}
+}
+
+static void draw_viewer_sprites(const vector<viewer_sprite>& sprites, RasterizerClass *RasPtr)
+{
+	if (sprites.empty()) return;
+
+	// Need to set this...
+	RasPtr->SetForeground();
+
+	for (auto sprite : sprites)
+	{
+#ifdef HAVE_OPENGL
+		if (sprite.rectangle.ModelPtr)
+			RasPtr->SetForegroundView(sprite.model_flip);
+#endif
 		/* and draw it */
 		// LP: added OpenGL support
-		RasPtr->texture_rectangle(textured_rectangle);
+		RasPtr->texture_rectangle(sprite.rectangle);
 	}
 }
 
+static void render_viewer_sprite_layer(view_data *view, RasterizerClass *RasPtr)
+{
+	static vector<viewer_sprite> sprites;
+	collect_viewer_sprites(view, sprites);
+	draw_viewer_sprites(sprites, RasPtr);
+}
+
 void position_sprite_axis(
 	short *x0,
 	short *x1,
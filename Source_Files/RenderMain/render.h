@@ -178,6 +178,18 @@ extern vector<uint16> RenderFlagList;
 
 // extern uint16 *render_flags;
 
+// What drawing the last frame took, for the render stats overlay;
+// only the OpenGL renderer keeps these
+struct render_frame_stats
+{
+	int draw_calls;
+	int texture_setups;		// walls, floors, ceilings and sprites given textures
+	int texture_allocations;	// the setups that needed a new TextureManager
+	int textures_cached;		// TextureManagers kept for reuse
+};
+
+extern render_frame_stats last_render_frame_stats;
+
 /* ---------- prototypes/RENDER.C */
 
 void allocate_render_memory(void);
@@ -185,6 +197,15 @@ void allocate_render_memory(void);
 void initialize_view_data(struct view_data *view, bool ignore_preferences = false);
 void render_view(struct view_data *view, struct bitmap_definition *software_render_dest /*ignored under OpenGL*/);
 
+// Pipelined software rendering: render_view(), but only visibility and
+// sorting happen before it returns; the rasterizing, from a copy of the
+// world, is left to a worker so the caller can get on with the next tick.
+// Not for the terminal or the overhead map.
+void start_render_view(struct view_data *view, struct bitmap_definition *software_render_dest);
+// Waits for the frame start_render_view() started, if there is one; the
+// destination bitmap is not to be touched until this returns
+void finish_render_view(void);
+
 void start_render_effect(struct view_data *view, short effect);
 
 void check_m1_exploration(void);
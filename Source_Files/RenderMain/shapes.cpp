@@ -104,6 +104,7 @@ Jan 17, 2001 (Loren Petrich):
 // LP addition: OpenGL support
 #include "OGL_Render.h"
 #include "OGL_LoadScreen.h"
+#include "OGL_Textures.h"
 
 // LP addition: infravision XML setup needs colors
 #include "InfoTree.h"
@@ -112,9 +113,19 @@ Jan 17, 2001 (Loren Petrich):
 #include "SW_Texture_Extras.h"
 
 #include <SDL2/SDL_rwops.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
 
 #include "Plugins.h"
+#include "Logging.h"
+#include "Console.h"
+#include "MemoryBudget.h"
+#include "WorkerPool.h"
 
 /* ---------- constants */
 
@@ -169,6 +180,7 @@ short number_of_shading_tables, shading_table_fractional_bits, shading_table_siz
 
 // LP addition: opened-shapes-file object
 static OpenedFile ShapesFile;
+static FileSpecifier ShapesFileSpec;
 OpenedResourceFile M1ShapesFile;
 
 static enum {
@@ -178,6 +190,68 @@ static enum {
 
 bool shapes_file_is_m1() { return shapes_file_version == M1_SHAPES_VERSION; }
 
+// Collections read from an M2 shapes file only decode their bitmaps when
+// something first asks for them, and only build the shading tables for a
+// clut when it is first drawn; levels typically use a fraction of both
+struct deferred_clut {
+	std::vector<byte> table;
+	bool built = false;
+
+	// what update_color_environment() would have built the table from
+	std::vector<rgb_color_value> colors;
+	pixel8 remapping_table[PIXEL8_MAXIMUM_COLORS];
+};
+
+struct deferred_collection {
+	// bitmap offsets relative to bitmap_source_offset in the shapes file;
+	// NONE for bitmaps that can't be read (again) from there
+	int32 bitmap_source_offset = 0;
+	std::vector<int32> bitmap_offsets;
+
+	// update_color_environment() has remapped the decoded bitmaps; the ones
+	// decoded later get the same (cumulative) remapping
+	bool remapped = false;
+	pixel8 remapping_table[PIXEL8_MAXIMUM_COLORS];
+
+	std::vector<deferred_clut> cluts;
+	short shading_bit_depth = 0;
+	int32 shading_table_bytes = 0;
+	bool is_opengl = false;
+};
+
+static deferred_collection deferred_collections[MAXIMUM_COLLECTIONS];
+
+// what the current level actually needed, reported when it's unloaded
+static struct {
+	int32 bitmaps_deferred;
+	int32 bitmaps_decoded;
+	int64_t bitmap_bytes_decoded;
+	int32 shading_tables_built;
+	int32 shading_tables_cached;
+	double shading_build_ms;
+} deferred_stats;
+
+// memory budget ids for the loaded collections and the shading table cache
+static int shapes_budget_id = NONE;
+static int shading_cache_budget_id = NONE;
+
+// A pipelined software frame rasterizes on a worker while the main thread
+// draws the HUD, so decoding deferred bitmaps (and seeking ShapesFile to do
+// it), building deferred shading tables, the shading table cache and the
+// counts below all happen under this; recursive because an alternate clut's
+// tables are built from the primary one's
+static std::recursive_mutex deferred_shapes_mutex;
+
+// MemoryBudget is main thread only, so hits, misses and evictions wait here
+// until the main thread asks the budget for the caches' sizes
+static struct {
+	int shapes_hits;
+	int shapes_misses;
+	int shading_hits;
+	int shading_misses;
+	int shading_evictions;
+} pending_budget_counts;
+
 /* ---------- private prototypes */
 
 static void update_color_environment(bool is_opengl);
@@ -732,12 +806,16 @@ static void load_bitmap(std::vector<uint8>& bitmap, SDL_RWops *p, int version)
 static void allocate_shading_tables(short collection_index, bool strip)
 {
 	collection_header *header = get_collection_header(collection_index);
-	// Allocate enough space for this collection's shading tables
+	deferred_collection& deferred = deferred_collections[collection_index];
+	deferred.cluts.clear();
+	// Allocate enough space for this collection's tint tables; the shading
+	// tables are allocated per clut when they're built
 	if (strip)
 		header->shading_tables.clear();
 	else {
 		collection_definition *definition = get_collection_definition(collection_index);
-		header->shading_tables.resize(get_shading_table_size(collection_index) * definition->clut_count + shading_table_size * NUMBER_OF_TINT_TABLES);
+		header->shading_tables.resize(shading_table_size * NUMBER_OF_TINT_TABLES);
+		deferred.cluts.resize(definition->clut_count);
 	}
 }
 
@@ -745,51 +823,16 @@ static void allocate_shading_tables(short collection_index, bool strip)
  *  Load collection
  */
 
-static bool load_collection(short collection_index, bool strip)
+// reads a collection whose definition starts at src_offset in p; touches no
+// globals, so level prefetching can use it from a worker thread. If
+// bitmap_offsets is given, the bitmaps are left empty and their offsets
+// (relative to src_offset) are returned instead
+static std::unique_ptr<collection_definition> decode_collection(SDL_RWops *p, int32 src_offset, int version, std::vector<int32> *bitmap_offsets)
 {
-	SDL_RWops* p;
-	std::shared_ptr<SDL_RWops> m1_p; // automatic deallocation
-	LoadedResource r;
-	int32 src_offset;
-
-	collection_header *header = get_collection_header(collection_index);
-	
-	if (shapes_file_version == M1_SHAPES_VERSION)
-	{
-		// Collections are stored in .256 resources
-		if (!M1ShapesFile.Get('.', '2', '5', '6', 128 + collection_index, r))
-		{
-			return false;
-		}
-
-		m1_p.reset(SDL_RWFromConstMem(r.GetPointer(), r.GetLength()), SDL_FreeRW);
-		p = m1_p.get();
-		src_offset = 0;
-	}
-	else
-	{
-		// Get offset and length of data in source file from header
-		
-		if (bit_depth == 8 || header->offset16 == -1) {
-			if (header->offset == -1)
-			{
-				return false;
-			}
-			src_offset = header->offset;
-		} else {
-			src_offset = header->offset16;
-		}
-
-		p = ShapesFile.GetRWops();
-		ShapesFile.SetPosition(0);
-		src_offset += SDL_RWtell(p);
-	}
-
 	// Read collection definition
 	std::unique_ptr<collection_definition> cd(new collection_definition);
 	SDL_RWseek(p, src_offset, RW_SEEK_SET);
 	load_collection_definition(cd.get(), p);
-	header->status &= ~markPATCHED;
 
 	// Convert CLUTS
 	if (cd->clut_count && cd->color_count) {
@@ -830,13 +873,99 @@ static bool load_collection(short collection_index, bool strip)
 		SDL_RWread(p, &t[0], sizeof(uint32), cd->bitmap_count);
 		byte_swap_memory(&t[0], _4byte, cd->bitmap_count);
 
-		for (int i = 0; i < cd->bitmap_count; i++) {
-			SDL_RWseek(p, src_offset + t[i], RW_SEEK_SET);
-			load_bitmap(cd->bitmaps[i], p, shapes_file_version);
+		if (bitmap_offsets) {
+			bitmap_offsets->assign(t.begin(), t.end());
+		} else {
+			for (int i = 0; i < cd->bitmap_count; i++) {
+				SDL_RWseek(p, src_offset + t[i], RW_SEEK_SET);
+				load_bitmap(cd->bitmaps[i], p, version);
+			}
 		}
 	}
 
+	return cd;
+}
+
+// where a collection's data is in the shapes file, for the current bit depth
+static bool get_collection_extent(short collection_index, int32& offset, int32& length)
+{
+	collection_header *header = get_collection_header(collection_index);
+	if (bit_depth == 8 || header->offset16 == -1) {
+		offset = header->offset;
+		length = header->length;
+	} else {
+		offset = header->offset16;
+		length = header->length16;
+	}
+
+	return offset != -1;
+}
+
+static std::unique_ptr<collection_definition> take_prefetched_collection(short collection_index, std::vector<int32>& bitmap_offsets);
+
+static bool load_collection(short collection_index, bool strip)
+{
+	SDL_RWops* p;
+	std::shared_ptr<SDL_RWops> m1_p; // automatic deallocation
+	LoadedResource r;
+	int32 src_offset;
+	std::vector<int32> bitmap_offsets;
+
+	// ShapesFile's position, and the deferred state
+	std::lock_guard<std::recursive_mutex> lock(deferred_shapes_mutex);
+
+	collection_header *header = get_collection_header(collection_index);
+	
+	// level prefetching may have decoded it already
+	std::unique_ptr<collection_definition> cd = take_prefetched_collection(collection_index, bitmap_offsets);
+	if (!cd)
+	{
+		if (shapes_file_version == M1_SHAPES_VERSION)
+		{
+			// Collections are stored in .256 resources
+			if (!M1ShapesFile.Get('.', '2', '5', '6', 128 + collection_index, r))
+			{
+				return false;
+			}
+
+			m1_p.reset(SDL_RWFromConstMem(r.GetPointer(), r.GetLength()), SDL_FreeRW);
+			p = m1_p.get();
+			src_offset = 0;
+		}
+		else
+		{
+			// Get offset and length of data in source file from header
+			int32 length;
+			if (!get_collection_extent(collection_index, src_offset, length))
+			{
+				return false;
+			}
+
+			p = ShapesFile.GetRWops();
+			ShapesFile.SetPosition(0);
+			src_offset += SDL_RWtell(p);
+		}
+
+		// M1 bitmaps have to be converted from a different RLE format, so
+		// those are still decoded up front
+		cd = decode_collection(p, src_offset, shapes_file_version, shapes_file_version == M1_SHAPES_VERSION ? NULL : &bitmap_offsets);
+	}
+
+	header->status &= ~markPATCHED;
+
 	header->collection = cd.release();
+
+	deferred_collection& deferred = deferred_collections[collection_index];
+	deferred = deferred_collection();
+	if (!bitmap_offsets.empty())
+	{
+		int32 length;
+		get_collection_extent(collection_index, src_offset, length);
+		ShapesFile.SetPosition(0);
+		deferred.bitmap_source_offset = SDL_RWtell(ShapesFile.GetRWops()) + src_offset;
+		deferred.bitmap_offsets.swap(bitmap_offsets);
+		deferred_stats.bitmaps_deferred += deferred.bitmap_offsets.size();
+	}
 	
 	if (strip) {
 		//!! don't know what to do
@@ -849,6 +978,7 @@ static bool load_collection(short collection_index, bool strip)
 	if (header->shading_tables.empty()) {
 		delete header->collection;
 		header->collection = NULL;
+		deferred = deferred_collection();
 		return false;
 	}
 
@@ -867,6 +997,357 @@ static void unload_collection(struct collection_header *header)
 	delete header->collection;
 	header->shading_tables.clear();
 	header->collection = NULL;
+	deferred_collections[header - collection_headers] = deferred_collection();
+}
+
+// whether a bitmap is still waiting for get_bitmap_definition() to decode it
+static bool bitmap_is_deferred(short collection_index, short bitmap_index)
+{
+	const deferred_collection& deferred = deferred_collections[collection_index];
+	if (bitmap_index < 0 || bitmap_index >= static_cast<short>(deferred.bitmap_offsets.size()) || deferred.bitmap_offsets[bitmap_index] == NONE)
+		return false;
+
+	collection_definition *definition = get_collection_definition(collection_index);
+	return bitmap_index < static_cast<short>(definition->bitmaps.size()) && definition->bitmaps[bitmap_index].empty();
+}
+
+static void decode_deferred_bitmap(short collection_index, short bitmap_index)
+{
+	deferred_collection& deferred = deferred_collections[collection_index];
+	std::vector<uint8>& data = get_collection_definition(collection_index)->bitmaps[bitmap_index];
+
+	SDL_RWops *p = ShapesFile.GetRWops();
+	SDL_RWseek(p, deferred.bitmap_source_offset + deferred.bitmap_offsets[bitmap_index], RW_SEEK_SET);
+	load_bitmap(data, p, M2_SHAPES_VERSION);
+
+	// catch up with what update_color_environment() did to the others
+	if (deferred.remapped)
+	{
+		bitmap_definition *bitmap = (bitmap_definition *) &data[0];
+		bitmap->row_addresses[0] = calculate_bitmap_origin(bitmap);
+		precalculate_bitmap_row_addresses(bitmap);
+		remap_bitmap(bitmap, deferred.remapping_table);
+	}
+
+	deferred_stats.bitmaps_decoded++;
+	deferred_stats.bitmap_bytes_decoded += data.size();
+}
+
+// Built shading tables outlive the collections they came from, so when the
+// next level loads the same collections with the same colors and screen
+// format, the tables are copied instead of built again
+static constexpr size_t kShadingTableCacheBytes = 32*MEG;
+
+// (collection, clut, bit depth, shading levels, OpenGL, hash of the inputs)
+typedef std::tuple<short, short, short, short, bool, uint64_t> shading_table_key;
+
+struct cached_shading_tables {
+	std::vector<byte> inputs;
+	std::vector<byte> table;
+	uint32 last_used;
+};
+
+static std::map<shading_table_key, cached_shading_tables> shading_table_cache;
+static size_t shading_table_cache_bytes = 0;
+static uint32 shading_table_cache_clock = 0;
+
+// everything a clut's shading tables are built from, besides the key
+static std::vector<byte> get_shading_table_inputs(const deferred_collection& deferred, short clut_index)
+{
+	const deferred_clut& clut = deferred.cluts[clut_index];
+	std::vector<byte> inputs(reinterpret_cast<const byte *>(clut.colors.data()), reinterpret_cast<const byte *>(clut.colors.data() + clut.colors.size()));
+	if (clut_index)
+		inputs.insert(inputs.end(), clut.remapping_table, clut.remapping_table + PIXEL8_MAXIMUM_COLORS);
+
+	if (!deferred.is_opengl && deferred.shading_bit_depth != 8)
+	{
+		const SDL_PixelFormat& fmt = deferred.shading_bit_depth == 16 ? pixel_format_16 : pixel_format_32;
+		const uint32 format[] = { fmt.Rloss, fmt.Gloss, fmt.Bloss, fmt.Rshift, fmt.Gshift, fmt.Bshift, fmt.Amask };
+		inputs.insert(inputs.end(), reinterpret_cast<const byte *>(format), reinterpret_cast<const byte *>(format + sizeof(format) / sizeof(format[0])));
+	}
+
+	return inputs;
+}
+
+static shading_table_key get_shading_table_key(const deferred_collection& deferred, short collection_index, short clut_index, const std::vector<byte>& inputs)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (byte b : inputs)
+	{
+		hash = (hash ^ b) * 1099511628211ULL;
+	}
+
+	return shading_table_key(collection_index, clut_index, deferred.shading_bit_depth, number_of_shading_tables, deferred.is_opengl, hash);
+}
+
+// throws out the least recently used tables until bytes are freed
+static size_t evict_shading_tables(size_t bytes)
+{
+	std::lock_guard<std::recursive_mutex> lock(deferred_shapes_mutex);
+	size_t freed = 0;
+	while (freed < bytes && !shading_table_cache.empty())
+	{
+		auto oldest = shading_table_cache.begin();
+		for (auto it = shading_table_cache.begin(); it != shading_table_cache.end(); ++it)
+		{
+			if (it->second.last_used < oldest->second.last_used)
+				oldest = it;
+		}
+
+		freed += oldest->second.table.size();
+		shading_table_cache_bytes -= oldest->second.table.size();
+		shading_table_cache.erase(oldest);
+		pending_budget_counts.shading_evictions++;
+	}
+
+	return freed;
+}
+
+static bool find_cached_shading_tables(const deferred_collection& deferred, short collection_index, short clut_index, byte *table)
+{
+	std::vector<byte> inputs = get_shading_table_inputs(deferred, clut_index);
+	auto it = shading_table_cache.find(get_shading_table_key(deferred, collection_index, clut_index, inputs));
+	if (it == shading_table_cache.end() || it->second.inputs != inputs || it->second.table.size() != static_cast<size_t>(deferred.shading_table_bytes))
+		return false;
+
+	memcpy(table, it->second.table.data(), it->second.table.size());
+	it->second.last_used = ++shading_table_cache_clock;
+	return true;
+}
+
+static void cache_shading_tables(const deferred_collection& deferred, short collection_index, short clut_index, const byte *table)
+{
+	std::vector<byte> inputs = get_shading_table_inputs(deferred, clut_index);
+	cached_shading_tables& entry = shading_table_cache[get_shading_table_key(deferred, collection_index, clut_index, inputs)];
+	shading_table_cache_bytes -= entry.table.size();
+	entry.inputs.swap(inputs);
+	entry.table.assign(table, table + deferred.shading_table_bytes);
+	entry.last_used = ++shading_table_cache_clock;
+	shading_table_cache_bytes += entry.table.size();
+
+	if (shading_table_cache_bytes > kShadingTableCacheBytes)
+		evict_shading_tables(shading_table_cache_bytes - kShadingTableCacheBytes);
+}
+
+// builds a clut's shading tables from what update_color_environment() saved
+static void build_shading_tables_from(deferred_collection& deferred, short collection_index, short clut_index, byte *table)
+{
+	deferred_clut& clut = deferred.cluts[clut_index];
+	struct rgb_color_value *colors = &clut.colors[0];
+	short color_count = static_cast<short>(clut.colors.size());
+	switch (deferred.shading_bit_depth)
+	{
+		case 8:
+			if (clut_index)
+			{
+				/* duplicate the primary shading table and remap it */
+				memcpy(table, get_collection_shading_tables(collection_index, 0), deferred.shading_table_bytes);
+				map_bytes(table, clut.remapping_table, deferred.shading_table_bytes);
+			}
+			else
+			{
+				build_shading_tables8(colors, color_count, table);
+			}
+			break;
+
+		case 16:
+			build_shading_tables16(colors, color_count, (pixel16 *) table, clut_index ? clut.remapping_table : (byte *) NULL, deferred.is_opengl);
+			break;
+
+		case 32:
+			build_shading_tables32(colors, color_count, (pixel32 *) table, clut_index ? clut.remapping_table : (byte *) NULL, deferred.is_opengl);
+			break;
+
+		default:
+			assert(false);
+			break;
+	}
+}
+
+// builds the shading tables update_color_environment() left for later
+static void build_deferred_shading_tables(short collection_index, short clut_index)
+{
+	deferred_collection& deferred = deferred_collections[collection_index];
+	deferred_clut& clut = deferred.cluts[clut_index];
+
+	// nothing to build from until update_color_environment() has run
+	if (clut.colors.empty())
+	{
+		if (clut.table.empty())
+			clut.table.resize(get_shading_table_size(collection_index));
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	clut.table.resize(deferred.shading_table_bytes);
+
+	// 8-bit alternate tables are just a remapped copy of the primary one
+	bool cacheable = deferred.shading_bit_depth != 8 || clut_index == 0;
+	if (cacheable && find_cached_shading_tables(deferred, collection_index, clut_index, &clut.table[0]))
+	{
+		deferred_stats.shading_tables_cached++;
+		pending_budget_counts.shading_hits++;
+	}
+	else
+	{
+		build_shading_tables_from(deferred, collection_index, clut_index, &clut.table[0]);
+		if (cacheable)
+		{
+			cache_shading_tables(deferred, collection_index, clut_index, &clut.table[0]);
+			pending_budget_counts.shading_misses++;
+		}
+	}
+
+	clut.built = true;
+	deferred_stats.shading_tables_built++;
+	deferred_stats.shading_build_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// hands MemoryBudget the counts the frames since it last asked left behind
+static void flush_pending_budget_counts()
+{
+	std::lock_guard<std::recursive_mutex> lock(deferred_shapes_mutex);
+	MemoryBudget *budget = MemoryBudget::instance();
+	budget->Hit(shapes_budget_id, pending_budget_counts.shapes_hits);
+	budget->Miss(shapes_budget_id, pending_budget_counts.shapes_misses);
+	budget->Hit(shading_cache_budget_id, pending_budget_counts.shading_hits);
+	budget->Miss(shading_cache_budget_id, pending_budget_counts.shading_misses);
+	budget->Evicted(shading_cache_budget_id, pending_budget_counts.shading_evictions);
+	obj_clear(pending_budget_counts);
+}
+
+// what the loaded collections hold that can grow or shrink
+static size_t get_shapes_memory()
+{
+	flush_pending_budget_counts();
+	std::lock_guard<std::recursive_mutex> lock(deferred_shapes_mutex);
+
+	size_t bytes = 0;
+	for (short collection_index = 0; collection_index < MAXIMUM_COLLECTIONS; ++collection_index)
+	{
+		collection_header *header = get_collection_header(collection_index);
+		if (!header->collection)
+			continue;
+
+		for (auto& bitmap : header->collection->bitmaps)
+			bytes += bitmap.size();
+		for (auto& clut : deferred_collections[collection_index].cluts)
+			bytes += clut.table.size();
+		bytes += header->shading_tables.size();
+	}
+
+	return bytes;
+}
+
+// drops decoded bitmaps that can be read from the shapes file again
+static size_t trim_shapes_memory(size_t bytes)
+{
+	// a pipelined frame may still be drawing from them
+	finish_render_view();
+	std::lock_guard<std::recursive_mutex> lock(deferred_shapes_mutex);
+
+	size_t freed = 0;
+	for (short collection_index = MAXIMUM_COLLECTIONS - 1; collection_index >= 0 && freed < bytes; --collection_index)
+	{
+		// the HUD draws from this one every frame
+		if (collection_index == _collection_interface)
+			continue;
+
+		collection_definition *definition = get_collection_definition(collection_index);
+		deferred_collection& deferred = deferred_collections[collection_index];
+		if (!definition)
+			continue;
+
+		for (size_t bitmap_index = 0; bitmap_index < deferred.bitmap_offsets.size() && bitmap_index < definition->bitmaps.size() && freed < bytes; ++bitmap_index)
+		{
+			std::vector<uint8>& bitmap = definition->bitmaps[bitmap_index];
+			if (deferred.bitmap_offsets[bitmap_index] == NONE || bitmap.empty())
+				continue;
+
+			freed += bitmap.size();
+			std::vector<uint8>().swap(bitmap);
+			MemoryBudget::instance()->Evicted(shapes_budget_id);
+		}
+	}
+
+	return freed;
+}
+
+// logs how much of the level's shapes were actually used
+static void report_deferred_shapes()
+{
+	std::lock_guard<std::recursive_mutex> lock(deferred_shapes_mutex);
+	int32 shading_tables = 0;
+	int64_t shading_bytes_skipped = 0;
+	for (int i = 0; i < MAXIMUM_COLLECTIONS; ++i)
+	{
+		const deferred_collection& deferred = deferred_collections[i];
+		for (auto& clut : deferred.cluts)
+		{
+			if (clut.colors.empty())
+				continue;
+
+			++shading_tables;
+			if (!clut.built)
+				shading_bytes_skipped += deferred.shading_table_bytes;
+		}
+	}
+
+	if (deferred_stats.bitmaps_deferred || shading_tables)
+	{
+		logNote("shapes: decoded %d of %d bitmaps (%lld KB); built %d of %d shading tables (%d from cache, %.1f ms), %lld KB not built",
+				deferred_stats.bitmaps_decoded, deferred_stats.bitmaps_deferred, static_cast<long long>(deferred_stats.bitmap_bytes_decoded / KILO),
+				deferred_stats.shading_tables_built, shading_tables, deferred_stats.shading_tables_cached, deferred_stats.shading_build_ms,
+				static_cast<long long>(shading_bytes_skipped / KILO));
+	}
+
+	deferred_stats.bitmaps_deferred = 0;
+	deferred_stats.bitmaps_decoded = 0;
+	deferred_stats.bitmap_bytes_decoded = 0;
+	deferred_stats.shading_tables_built = 0;
+	deferred_stats.shading_tables_cached = 0;
+	deferred_stats.shading_build_ms = 0;
+}
+
+// ".benchmark shading" rebuilds every shading table the loaded collections
+// can use, once from scratch and once from the cache
+static void benchmark_shading_tables(const std::string&)
+{
+	std::lock_guard<std::recursive_mutex> lock(deferred_shapes_mutex);
+	std::vector<byte> scratch;
+	int tables = 0;
+	double build_ms = 0, cached_ms = 0;
+	for (short collection_index = 0; collection_index < MAXIMUM_COLLECTIONS; ++collection_index)
+	{
+		deferred_collection& deferred = deferred_collections[collection_index];
+		for (short clut_index = 0; clut_index < static_cast<short>(deferred.cluts.size()); ++clut_index)
+		{
+			if (deferred.cluts[clut_index].colors.empty())
+				continue;
+
+			scratch.resize(deferred.shading_table_bytes);
+			auto start = std::chrono::steady_clock::now();
+			build_shading_tables_from(deferred, collection_index, clut_index, &scratch[0]);
+			auto built = std::chrono::steady_clock::now();
+			if (!find_cached_shading_tables(deferred, collection_index, clut_index, &scratch[0]))
+				cache_shading_tables(deferred, collection_index, clut_index, &scratch[0]);
+			auto cached = std::chrono::steady_clock::now();
+
+			build_ms += std::chrono::duration<double, std::milli>(built - start).count();
+			cached_ms += std::chrono::duration<double, std::milli>(cached - built).count();
+			++tables;
+		}
+	}
+
+	if (!tables)
+	{
+		screen_printf("No shading tables to benchmark");
+		return;
+	}
+
+	screen_printf("%d shading tables: %.2f ms to build, %.2f ms from cache (%d threads)", tables, build_ms, cached_ms, WorkerPool::instance()->Concurrency());
+	logNote("shading table benchmark: %d tables (%d-bit), %.2f ms to build, %.2f ms from cache, %d threads", tables, bit_depth, build_ms, cached_ms, WorkerPool::instance()->Concurrency());
 }
 
 #define ENDC_TAG FOUR_CHARS_TO_INT('e', 'n', 'd', 'c')
@@ -978,6 +1459,11 @@ void load_shapes_patch(SDL_RWops *p, bool override_replacements)
 					int32 size = SDL_ReadBE32(p);
 					if (cd && patch_bit_depth == 8 && bitmap_index < cd->bitmaps.size())
 					{
+						// the shapes file doesn't have this one any more
+						std::vector<int32>& bitmap_offsets = deferred_collections[collection_index].bitmap_offsets;
+						if (bitmap_index >= 0 && static_cast<size_t>(bitmap_index) < bitmap_offsets.size())
+							bitmap_offsets[bitmap_index] = NONE;
+
 						load_bitmap(cd->bitmaps[bitmap_index], p, M2_SHAPES_VERSION);
 						if (override_replacements)
 						{
@@ -1034,6 +1520,15 @@ void initialize_shape_handler()
 		atexit(shutdown_shape_handler);
 	
 	initialize_pixmap_handler();
+
+	Console::instance()->register_benchmark("shading", benchmark_shading_tables);
+
+	shapes_budget_id = MemoryBudget::instance()->Register("shapes", MemoryBudget::kPriorityHigh, get_shapes_memory, trim_shapes_memory);
+	shading_cache_budget_id = MemoryBudget::instance()->Register("shading table cache", MemoryBudget::kPriorityLow, []() {
+		flush_pending_budget_counts();
+		std::lock_guard<std::recursive_mutex> lock(deferred_shapes_mutex);
+		return shading_table_cache_bytes;
+	}, evict_shading_tables);
 }
 
 void open_shapes_file(FileSpecifier& File)
@@ -1052,6 +1547,7 @@ void open_shapes_file(FileSpecifier& File)
 	if (!m1_loaded && File.Open(ShapesFile))
 	{
 		shapes_file_version = M2_SHAPES_VERSION;
+		ShapesFileSpec = File;
 		// Load the collection headers;
 		// need a buffer for the packed data
 		int Size = MAXIMUM_COLLECTIONS*SIZEOF_collection_header;
@@ -1082,6 +1578,7 @@ void open_shapes_file(FileSpecifier& File)
 			
 			ObjPtr->collection = NULL;	// so unloading can work properly
 			ObjPtr->shading_tables.clear();	// so unloading can work properly
+			deferred_collections[k] = deferred_collection();
 		}
 		
 		assert((S - CollHdrStream) == Count*SIZEOF_collection_header);
@@ -1154,6 +1651,9 @@ void unload_all_collections(
 	struct collection_header *header;
 	short collection_index;
 	
+	// a frame may still be drawing from them
+	finish_render_view();
+
 	for (collection_index= 0, header= collection_headers; collection_index<MAXIMUM_COLLECTIONS; ++collection_index, ++header)
 	{
 		if (collection_loaded(header))
@@ -1377,6 +1877,107 @@ void *get_global_shading_table(
 	return shading_table;
 }
 
+/* ---------- level prefetching */
+
+struct collection_prefetch
+{
+	FileSpecifier file;
+	int32 offsets[MAXIMUM_COLLECTIONS];
+	int32 lengths[MAXIMUM_COLLECTIONS];
+	std::unique_ptr<collection_definition> collections[MAXIMUM_COLLECTIONS];
+	std::vector<int32> bitmap_offsets[MAXIMUM_COLLECTIONS];
+};
+
+// what the next load_collections() can use instead of reading the shapes file
+static std::unique_ptr<collection_prefetch> committed_prefetch;
+
+// only M2-format shapes can be read on a handle of our own
+collection_prefetch *begin_collection_prefetch(void)
+{
+	if (shapes_file_version != M2_SHAPES_VERSION || !ShapesFile.IsOpen())
+		return NULL;
+
+	collection_prefetch *prefetch = new collection_prefetch;
+	prefetch->file = ShapesFileSpec;
+	for (short collection_index = 0; collection_index < MAXIMUM_COLLECTIONS; ++collection_index)
+	{
+		if (!get_collection_extent(collection_index, prefetch->offsets[collection_index], prefetch->lengths[collection_index]))
+			prefetch->lengths[collection_index] = 0;
+	}
+
+	return prefetch;
+}
+
+// runs on a worker thread; returns the number of bytes read
+size_t decode_prefetched_collections(
+	collection_prefetch *prefetch,
+	const short *collections,
+	int count,
+	size_t budget)
+{
+	OpenedFile file;
+	if (!prefetch->file.Open(file))
+		return 0;
+
+	SDL_RWops *p = file.GetRWops();
+	file.SetPosition(0);
+	int32 base = SDL_RWtell(p);
+
+	size_t used = 0;
+	std::vector<uint8> data;
+	for (int i = 0; i < count; ++i)
+	{
+		short collection_index = collections[i];
+		if (collection_index < 0 || collection_index >= MAXIMUM_COLLECTIONS || prefetch->collections[collection_index])
+			continue;
+
+		int32 length = prefetch->lengths[collection_index];
+		if (length <= 0 || used + length > budget)
+			continue;
+
+		// one big read, then decode from memory instead of seeking around the
+		// file; the bitmaps are still left for first use, but reading them
+		// here means they'll come out of the OS's cache
+		data.resize(length);
+		SDL_RWseek(p, base + prefetch->offsets[collection_index], RW_SEEK_SET);
+		if (SDL_RWread(p, &data[0], length, 1) != 1)
+			continue;
+
+		std::shared_ptr<SDL_RWops> m(SDL_RWFromConstMem(&data[0], length), SDL_FreeRW);
+		prefetch->collections[collection_index] = decode_collection(m.get(), 0, M2_SHAPES_VERSION, &prefetch->bitmap_offsets[collection_index]);
+		used += length;
+	}
+
+	return used;
+}
+
+void commit_collection_prefetch(collection_prefetch *prefetch)
+{
+	committed_prefetch.reset(prefetch);
+}
+
+void dispose_collection_prefetch(collection_prefetch *prefetch)
+{
+	delete prefetch;
+}
+
+static std::unique_ptr<collection_definition> take_prefetched_collection(short collection_index, std::vector<int32>& bitmap_offsets)
+{
+	std::unique_ptr<collection_definition> cd;
+	if (committed_prefetch && shapes_file_version == M2_SHAPES_VERSION && committed_prefetch->file == ShapesFileSpec)
+	{
+		// the bit depth may have changed since
+		int32 offset, length;
+		if (get_collection_extent(collection_index, offset, length) && offset == committed_prefetch->offsets[collection_index])
+		{
+			cd = std::move(committed_prefetch->collections[collection_index]);
+			bitmap_offsets.swap(committed_prefetch->bitmap_offsets[collection_index]);
+		}
+	}
+
+	return cd;
+}
+
 void load_collections(
 	bool with_progress_bar,
 	bool is_opengl)
@@ -1384,11 +1985,16 @@ void load_collections(
 	struct collection_header *header;
 	short collection_index;
 
+	// a frame may still be drawing from the collections about to go
+	finish_render_view();
+
 	if (with_progress_bar)
 	{
 //		open_progress_dialog(_loading_collections);
 //		draw_progress_bar(0, 2*MAXIMUM_COLLECTIONS);
 	}
+	auto start= std::chrono::steady_clock::now();
+	report_deferred_shapes();
 	precalculate_bit_depth_constants();
 		
 	/* first go through our list of shape collections and dispose of any collections which
@@ -1442,6 +2048,9 @@ void load_collections(
 		header->flags= 0;
 	}
 
+	// whatever the prefetch guessed wrong isn't needed any more
+	committed_prefetch.reset();
+
 	Plugins::instance()->load_shapes_patches(is_opengl);
 
 	if (shapes_patch.size())
@@ -1465,6 +2074,12 @@ void load_collections(
 			}
 		}
 	}
+
+#ifdef HAVE_OPENGL
+	OGL_TexturesChanged();
+#endif
+
+	logNote("loaded collections in %.1f ms", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
 //	if (with_progress_bar)
 //		close_progress_dialog();
 }
@@ -1633,9 +2248,13 @@ static void update_color_environment(
 					find_or_add_color(&primary_colors[color_index], colors, &color_count);
 			}
 			
-			/* then remap the collection and recalculate the base addresses of each bitmap */
+			/* then remap the collection and recalculate the base addresses of each bitmap;
+				bitmaps which haven't been decoded yet are remapped when they are */
+			deferred_collection& deferred= deferred_collections[collection_index];
 			for (bitmap_index= 0; bitmap_index<collection->bitmap_count; ++bitmap_index)
 			{
+				if (bitmap_is_deferred(collection_index, bitmap_index)) continue;
+				
 				struct bitmap_definition *bitmap= get_bitmap_definition(collection_index, bitmap_index);
 				assert(bitmap);
 				
@@ -1647,20 +2266,31 @@ static void update_color_environment(
 				remap_bitmap(bitmap, remapping_table);
 			}
 			
-			/* build a shading table for each clut in this collection */
+			if (deferred.remapped)
+			{
+				for (color_index= 0; color_index<PIXEL8_MAXIMUM_COLORS; ++color_index)
+					deferred.remapping_table[color_index]= remapping_table[deferred.remapping_table[color_index]];
+			}
+			else
+			{
+				memcpy(deferred.remapping_table, remapping_table, PIXEL8_MAXIMUM_COLORS*sizeof(pixel8));
+				deferred.remapped= true;
+			}
+			
+			/* remember what each clut's shading table is built from; they get built the
+				first time something is drawn with that clut */
+			deferred.shading_bit_depth= collection->type==_interface_collection ? 8 : bit_depth;
+			deferred.shading_table_bytes= get_shading_table_size(collection_index);
+			deferred.is_opengl= is_opengl;
 			for (clut_index= 0; clut_index<collection->clut_count; ++clut_index)
 			{
-				void *primary_shading_table= get_collection_shading_tables(collection_index, 0);
-				short collection_bit_depth= collection->type==_interface_collection ? 8 : bit_depth;
-
+				deferred_clut& clut= deferred.cluts[clut_index];
+				
 				if (clut_index)
 				{
 					struct rgb_color_value *alternate_colors= get_collection_colors(collection_index, clut_index)+NUMBER_OF_PRIVATE_COLORS;
 					assert(alternate_colors);
-					void *alternate_shading_table= get_collection_shading_tables(collection_index, clut_index);
-					pixel8 shading_remapping_table[PIXEL8_MAXIMUM_COLORS];
-					
-					memset(shading_remapping_table, 0, PIXEL8_MAXIMUM_COLORS*sizeof(pixel8));
+					pixel8 *shading_remapping_table= clut.remapping_table;
 					
 //					dprintf("alternate clut %d entries;dm #%d #%d", collection->color_count, alternate_colors, collection->color_count*sizeof(ColorSpec));
 					
@@ -1673,41 +2303,16 @@ static void update_color_environment(
 							find_or_add_color(&alternate_colors[color_index], colors, &color_count);
 					}
 //					shading_remapping_table[iBLACK]= iBLACK; /* make iBLACK==>iBLACK remapping explicit */
-
-					switch (collection_bit_depth)
-					{
-						case 8:
-							/* duplicate the primary shading table and remap it */
-							memcpy(alternate_shading_table, primary_shading_table, get_shading_table_size(collection_index));
-							map_bytes((unsigned char *)alternate_shading_table, shading_remapping_table, get_shading_table_size(collection_index));
-							break;
-						
-						case 16:
-							build_shading_tables16(colors, color_count, (pixel16 *)alternate_shading_table, shading_remapping_table, is_opengl); break;
-							break;
-						
-						case 32:
-							build_shading_tables32(colors, color_count, (pixel32 *)alternate_shading_table, shading_remapping_table, is_opengl); break;
-							break;
-						
-						default:
-							assert(false);
-							break;
-					}
-				}
-				else
-				{
-					/* build the primary shading table */
-					switch (collection_bit_depth)
-					{
-					case 8: build_shading_tables8(colors, color_count, (unsigned char *)primary_shading_table); break;
-					case 16: build_shading_tables16(colors, color_count, (pixel16 *)primary_shading_table, (byte *) NULL, is_opengl); break;
-					case 32: build_shading_tables32(colors, color_count,  (pixel32 *)primary_shading_table, (byte *) NULL, is_opengl); break;
-						default:
-							assert(false);
-							break;
-					}
 				}
+				
+				clut.colors.assign(colors, colors+color_count);
+				clut.built= false;
+			}
+			
+			/* tables already handed out have to be rebuilt in place */
+			for (clut_index= 0; clut_index<collection->clut_count; ++clut_index)
+			{
+				if (!deferred.cluts[clut_index].table.empty()) build_deferred_shading_tables(collection_index, clut_index);
 			}
 			
 			build_collection_tinting_table(colors, color_count, collection_index, is_opengl);
@@ -1835,46 +2440,94 @@ static void build_shading_tables8(
 }
 #endif
 
-static void build_shading_tables16(
+// What SDL_MapRGB() does for the true-color formats the renderer uses,
+// without a call per pixel
+struct sdl_pixel_packer {
+	uint32 rloss, gloss, bloss;
+	uint32 rshift, gshift, bshift;
+	uint32 amask;
+
+	explicit sdl_pixel_packer(const SDL_PixelFormat *fmt) :
+		rloss(fmt->Rloss), gloss(fmt->Gloss), bloss(fmt->Bloss),
+		rshift(fmt->Rshift), gshift(fmt->Gshift), bshift(fmt->Bshift),
+		amask(fmt->Amask) { }
+
+	// takes 16-bit components
+	uint32 operator()(uint32 red, uint32 green, uint32 blue) const {
+		return ((red >> 8) >> rloss) << rshift | ((green >> 8) >> gloss) << gshift | ((blue >> 8) >> bloss) << bshift | amask;
+	}
+};
+
+// Mac xRGB 1555 pixel format
+struct mac_pixel16_packer {
+	uint32 operator()(uint32 red, uint32 green, uint32 blue) const { return RGBCOLOR_TO_PIXEL16(red, green, blue); }
+};
+
+// Mac xRGB 8888 pixel format
+struct mac_pixel32_packer {
+	uint32 operator()(uint32 red, uint32 green, uint32 blue) const { return RGBCOLOR_TO_PIXEL32(red, green, blue); }
+};
+
+// Fills every shading level for colors [0, color_count) and clears the rest.
+// Each level is independent, so they're split across the worker pool; within
+// a level the division by (number_of_shading_tables-1) is done with an exact
+// reciprocal so the inner loop has no branches or divides and vectorizes
+template <typename T, typename Packer>
+static void build_shading_levels(
 	struct rgb_color_value *colors,
 	short color_count,
-	pixel16 *shading_tables,
+	T *shading_tables,
 	byte *remapping_table,
-	bool is_opengl)
+	const Packer& pack)
 {
-	short i;
-	short start, count, level;
-	
-	objlist_set(shading_tables, 0, PIXEL8_MAXIMUM_COLORS);
-
-	SDL_PixelFormat *fmt = &pixel_format_16;
+	assert(number_of_shading_tables > 1);
 	
-	start= 0, count= 0;
-	while (get_next_color_run(colors, color_count, &start, &count))
+	// gather the components in the order they're written
+	uint32 red[PIXEL8_MAXIMUM_COLORS], green[PIXEL8_MAXIMUM_COLORS], blue[PIXEL8_MAXIMUM_COLORS];
+	uint32 luminescent[PIXEL8_MAXIMUM_COLORS];
+	for (short i= 0; i<color_count; ++i)
 	{
-		for (i=0;i<count;++i)
+		struct rgb_color_value *color= colors + (remapping_table ? remapping_table[i] : i);
+		red[i]= color->red;
+		green[i]= color->green;
+		blue[i]= color->blue;
+		luminescent[i]= (color->flags&SELF_LUMINESCENT_COLOR_FLAG) ? ~0U : 0;
+	}
+
+	// component*multiplier < 2^24 and the divisor is < 2^8, so this is exact
+	const uint32 divisor= number_of_shading_tables-1;
+	const uint64_t reciprocal= ((uint64_t(1) << 32) / divisor) + 1;
+	auto scale= [reciprocal](uint32 value) { return static_cast<uint32>((value*reciprocal) >> 32); };
+
+	WorkerPool::instance()->ParallelFor(0, number_of_shading_tables, [&](int first, int last) {
+		for (int level= first; level<last; ++level)
 		{
-			assert(number_of_shading_tables > 1);
-			for (level= 0; level<number_of_shading_tables; ++level)
+			const uint32 normal= level;
+			const uint32 self_luminescent= (number_of_shading_tables>>1)+(level>>1);
+			T *row= shading_tables + PIXEL8_MAXIMUM_COLORS*level;
+
+			for (int i= 0; i<color_count; ++i)
 			{
-				struct rgb_color_value *color= colors + (remapping_table ? remapping_table[start+i] : (start+i));
-				short multiplier= (color->flags&SELF_LUMINESCENT_COLOR_FLAG) ? ((number_of_shading_tables>>1)+(level>>1)) : level;
-				if (!is_opengl)
-					// Find optimal pixel value for video display
-					shading_tables[PIXEL8_MAXIMUM_COLORS*level+start+i]= 
-						SDL_MapRGB(fmt,
-						           ((color->red * multiplier) / (number_of_shading_tables-1)) >> 8,
-						           ((color->green * multiplier) / (number_of_shading_tables-1)) >> 8,
-						           ((color->blue * multiplier) / (number_of_shading_tables-1)) >> 8);
-				else
-				// Mac xRGB 1555 pixel format
-				shading_tables[PIXEL8_MAXIMUM_COLORS*level+start+i]= 
-					RGBCOLOR_TO_PIXEL16((color->red*multiplier)/(number_of_shading_tables-1),
-						(color->green*multiplier)/(number_of_shading_tables-1),
-						(color->blue*multiplier)/(number_of_shading_tables-1));
+				uint32 multiplier= (self_luminescent & luminescent[i]) | (normal & ~luminescent[i]);
+				row[i]= static_cast<T>(pack(scale(red[i]*multiplier), scale(green[i]*multiplier), scale(blue[i]*multiplier)));
 			}
+			std::fill(row + color_count, row + PIXEL8_MAXIMUM_COLORS, T(0));
 		}
-	}
+	}, 8);
+}
+
+static void build_shading_tables16(
+	struct rgb_color_value *colors,
+	short color_count,
+	pixel16 *shading_tables,
+	byte *remapping_table,
+	bool is_opengl)
+{
+	if (!is_opengl)
+		// Find optimal pixel value for video display
+		build_shading_levels(colors, color_count, shading_tables, remapping_table, sdl_pixel_packer(&pixel_format_16));
+	else
+		build_shading_levels(colors, color_count, shading_tables, remapping_table, mac_pixel16_packer());
 }
 
 static void build_shading_tables32(
@@ -1884,40 +2537,11 @@ static void build_shading_tables32(
 	byte *remapping_table, 
 	bool is_opengl)
 {
-	short i;
-	short start, count, level;
-	
-	objlist_set(shading_tables, 0, PIXEL8_MAXIMUM_COLORS);
-	
-	SDL_PixelFormat *fmt = &pixel_format_32;
-
-	start= 0, count= 0;
-	while (get_next_color_run(colors, color_count, &start, &count))
-	{
-		for (i= 0; i<count; ++i)
-		{
-			assert(number_of_shading_tables > 1);
-			for (level= 0; level<number_of_shading_tables; ++level)
-			{
-				struct rgb_color_value *color= colors + (remapping_table ? remapping_table[start+i] : (start+i));
-				short multiplier= (color->flags&SELF_LUMINESCENT_COLOR_FLAG) ? ((number_of_shading_tables>>1)+(level>>1)) : level;
-				
-				if (!is_opengl)
-					// Find optimal pixel value for video display
-					shading_tables[PIXEL8_MAXIMUM_COLORS*level+start+i]= 
-						SDL_MapRGB(fmt,
-						           ((color->red * multiplier) / (number_of_shading_tables-1)) >> 8,
-						           ((color->green * multiplier) / (number_of_shading_tables-1)) >> 8,
-						           ((color->blue * multiplier) / (number_of_shading_tables-1)) >> 8);
-				else
-				// Mac xRGB 8888 pixel format
-				shading_tables[PIXEL8_MAXIMUM_COLORS*level+start+i]= 
-					RGBCOLOR_TO_PIXEL32((color->red*multiplier)/(number_of_shading_tables-1),
-						(color->green*multiplier)/(number_of_shading_tables-1),
-						(color->blue*multiplier)/(number_of_shading_tables-1));
-			}
-		}
-	}
+	if (!is_opengl)
+		// Find optimal pixel value for video display
+		build_shading_levels(colors, color_count, shading_tables, remapping_table, sdl_pixel_packer(&pixel_format_32));
+	else
+		build_shading_levels(colors, color_count, shading_tables, remapping_table, mac_pixel32_packer());
 }
 
 static void build_global_shading_table16(
@@ -2222,14 +2846,14 @@ static void build_tinting_table16(
 {
 	short i;
 
-	SDL_PixelFormat *fmt = &pixel_format_16;
+	sdl_pixel_packer pack(&pixel_format_16);
 
 	for (i= 0; i<color_count; ++i, ++colors)
 	{
 		const rgb_color tinted_color = m2_apply_tint(*colors, *tint_color);
 		
 		// Find optimal pixel value for video display
-		*tint_table++ = SDL_MapRGB(fmt, tinted_color.red >> 8, tinted_color.green >> 8, tinted_color.blue >> 8);
+		*tint_table++ = pack(tinted_color.red, tinted_color.green, tinted_color.blue);
 	}
 }
 
@@ -2242,7 +2866,7 @@ static void build_tinting_table32(
 {
 	short i;
 
-	SDL_PixelFormat *fmt = &pixel_format_32;
+	sdl_pixel_packer pack(&pixel_format_32);
 
 	for (i= 0; i<color_count; ++i, ++colors)
 	{
@@ -2250,7 +2874,7 @@ static void build_tinting_table32(
 		
 		// Find optimal pixel value for video display
 		if (!is_opengl)
-			*tint_table++ = SDL_MapRGB(fmt, tinted_color.red >> 8, tinted_color.green >> 8, tinted_color.blue >> 8);
+			*tint_table++ = pack(tinted_color.red, tinted_color.green, tinted_color.blue);
 		else
 		// Mac xRGB 8888 pixel format
 			*tint_table++ = RGBCOLOR_TO_PIXEL32(tinted_color.red, tinted_color.green, tinted_color.blue);
@@ -2347,6 +2971,17 @@ static struct bitmap_definition *get_bitmap_definition(
 	if (!definition) return NULL;
 	if (!(bitmap_index >= 0 && bitmap_index < definition->bitmaps.size()))
 		return NULL;
+
+	std::lock_guard<std::recursive_mutex> lock(deferred_shapes_mutex);
+	if (bitmap_is_deferred(collection_index, bitmap_index))
+	{
+		decode_deferred_bitmap(collection_index, bitmap_index);
+		pending_budget_counts.shapes_misses++;
+	}
+	else
+	{
+		pending_budget_counts.shapes_hits++;
+	}
 	
 	if (definition->bitmaps[bitmap_index].empty())
 		return NULL;
@@ -2358,11 +2993,13 @@ static void *get_collection_shading_tables(
 	short collection_index,
 	short clut_index)
 {
-	void *shading_tables= get_collection_header(collection_index)->shading_tables.data();
+	std::vector<deferred_clut>& cluts= deferred_collections[collection_index].cluts;
+	if (clut_index < 0 || clut_index >= static_cast<short>(cluts.size())) return NULL;
 
-	shading_tables = (uint8 *)shading_tables + clut_index*get_shading_table_size(collection_index);
+	std::lock_guard<std::recursive_mutex> lock(deferred_shapes_mutex);
+	if (!cluts[clut_index].built) build_deferred_shading_tables(collection_index, clut_index);
 	
-	return shading_tables;
+	return cluts[clut_index].table.data();
 }
 
 static void *get_collection_tint_tables(
@@ -2374,7 +3011,7 @@ static void *get_collection_tint_tables(
 	
 	void *tint_table= get_collection_header(collection_index)->shading_tables.data();
 
-	tint_table = (uint8 *)tint_table + get_shading_table_size(collection_index)*definition->clut_count + shading_table_size*tint_index;
+	tint_table = (uint8 *)tint_table + shading_table_size*tint_index;
 	
 	return tint_table;
 }
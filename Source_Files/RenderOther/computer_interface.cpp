@@ -2615,6 +2615,18 @@ static size_t packed_terminal_length(const terminal_text_t &t)
 	     + t.text.size();
 }
 
+void get_interlevel_teleport_destinations(std::vector<short>& levels)
+{
+	for (const auto& terminal : map_terminal_text)
+	{
+		for (const auto& group : terminal.groupings)
+		{
+			if (group.type == _interlevel_teleport_group)
+				levels.push_back(group.permutation);
+		}
+	}
+}
+
 size_t calculate_packed_terminal_data_length(void)
 {
 	size_t total = 0;
@@ -78,6 +78,8 @@
 
 #include "cstypes.h"
 
+#include <vector>
+
 /* ------------ structures */
 struct static_preprocessed_terminal_data {
 	int16 total_length;
@@ -124,4 +126,7 @@ extern size_t calculate_packed_terminal_data_length(void);
 
 void clear_compiled_terminal_cache();
 
+// levels the map's terminals can send the player to
+void get_interlevel_teleport_destinations(std::vector<short>& levels);
+
 #endif
@@ -65,6 +65,7 @@ Jan 31, 2001 (Loren Petrich):
 #include "screen.h"
 #include "interface.h"
 #include "map.h" // for TICKS_PER_SECOND
+#include "tick_events.h"
 #include "InfoTree.h"
 
 #include <string.h>
@@ -352,6 +353,14 @@ void set_fade_effect(
 void start_fade(
 	short type)
 {
+	// already shown when the tick was predicted
+	tick_event event;
+	event.type= _fade_tick_event;
+	event.index= type;
+	event.identifier= NONE;
+	objlist_clear(event.values, 5);
+	if (!claim_world_tick_event(event)) return;
+
 	explicit_start_fade(type, world_color_table, visible_color_table, true);
 }
 
@@ -77,6 +77,7 @@ Mar 08, 2002 (Woody Zenfell):
 #include "screen_definitions.h"
 #include "images.h"
 #include "InfoTree.h"
+#include "FrameTimer.h"
 
 extern void draw_panels(void);
 extern void validate_world_window(void);
@@ -305,6 +306,7 @@ void update_interface(short time_elapsed)
 		ensure_HUD_buffer();
 
 		// LP addition: added support for HUD buffer;
+		FrameTimer::Scope timer(FrameTimer::kHUD);
 		_set_port_to_HUD();
 		if (HUD_SW.update_everything(time_elapsed))
 			force_update = true;
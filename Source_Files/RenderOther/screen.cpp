@@ -69,6 +69,8 @@
 #include "HUDRenderer_Lua.h"
 #include "Movie.h"
 #include "shell_options.h"
+#include "screen_blit.h"
+#include "FrameTimer.h"
 
 #include <algorithm>
 
@@ -86,7 +88,6 @@ static SDL_Texture *main_texture;
 // The HUD has a separate buffer.
 // It is initialized to NULL so as to allow its initing to be lazy.
 SDL_Surface *world_pixels = NULL;
-SDL_Surface *world_pixels_corrected = NULL;
 SDL_Surface *HUD_Buffer = NULL;
 SDL_Surface *Term_Buffer = NULL;
 SDL_Surface *Intro_Buffer = NULL; // intro screens, main menu, chapters, credits, etc.
@@ -134,12 +135,15 @@ static void change_screen_mode(int width, int height, int depth, bool nogl, bool
 static bool get_auto_resolution_size(short *w, short *h, struct screen_mode_data *mode);
 static void build_sdl_color_table(const color_table *color_table, SDL_Color *colors);
 static void reallocate_world_pixels(int width, int height);
+static void drop_pending_frame();
 static void reallocate_map_pixels(int width, int height);
 static void apply_gamma(SDL_Surface *src, SDL_Surface *dst);
-static void update_screen(SDL_Rect &source, SDL_Rect &destination, bool hi_rez, bool every_other_line);
+static void update_screen(SDL_Rect &source, SDL_Rect &destination, int scale, bool every_other_line);
 static void update_fps_display(SDL_Surface *s);
 static void DisplayPosition(SDL_Surface *s);
 static void DisplayMessages(SDL_Surface *s);
+static void DisplayRenderStats(SDL_Surface *s);
+static void DisplayFrameTimes(SDL_Surface *s);
 static void DrawSurface(SDL_Surface *s, SDL_Rect &dest_rect, SDL_Rect &src_rect);
 static void clear_screen_margin();
 
@@ -192,6 +196,10 @@ void Screen::Initialize(screen_mode_data* mode)
 
 		SDL_SetHint(SDL_HINT_VIDEO_MINIMIZE_ON_FOCUS_LOSS, "0");
 
+		Console::instance()->register_command("renderstats", [](const std::string&) { ShowRenderStats = !ShowRenderStats; });
+		FrameTimer::instance();
+		register_blit_benchmark();
+
 		uncorrected_color_table = (struct color_table *)malloc(sizeof(struct color_table));
 		world_color_table = (struct color_table *)malloc(sizeof(struct color_table));
 		visible_color_table = (struct color_table *)malloc(sizeof(struct color_table));
@@ -281,14 +289,12 @@ void Screen::Initialize(screen_mode_data* mode)
 		}
 	} else {
 
+		drop_pending_frame();
 		unload_all_collections();
 		if (world_pixels)
 			SDL_FreeSurface(world_pixels);
-		if (world_pixels_corrected)
-			SDL_FreeSurface(world_pixels_corrected);
 	}
 	world_pixels = NULL;
-	world_pixels_corrected = NULL;
 
 	screen_mode = *mode;
 	change_screen_mode(&screen_mode, true);
@@ -590,14 +596,11 @@ void Screen::window_to_screen(int &x, int &y)
 
 static void reallocate_world_pixels(int width, int height)
 {
+	drop_pending_frame();
 	if (world_pixels) {
 		SDL_FreeSurface(world_pixels);
 		world_pixels = NULL;
 	}
-	if (world_pixels_corrected) {
-		SDL_FreeSurface(world_pixels_corrected);
-		world_pixels_corrected = NULL;
-	}
 	SDL_PixelFormat *f = main_surface->format;
 //	world_pixels = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, f->BitsPerPixel, f->Rmask, f->Gmask, f->Bmask, f->Amask);
 	switch (bit_depth)
@@ -620,8 +623,7 @@ static void reallocate_world_pixels(int width, int height)
 		SDL_Color colors[256];
 		build_sdl_color_table(world_color_table, colors);
 		SDL_SetPaletteColors(world_pixels->format->palette, colors, 0, 256);
-	} else
-		world_pixels_corrected = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, world_pixels->format->BitsPerPixel, world_pixels->format->Rmask, world_pixels->format->Gmask, world_pixels->format->Bmask, 0);
+	}
 }
 
 static void reallocate_map_pixels(int width, int height)
@@ -728,6 +730,7 @@ void enter_screen(void)
 
 void exit_screen(void)
 {
+	drop_pending_frame();
 	in_game = false;
 #ifdef HAVE_OPENGL
 	OGL_StopRun();
@@ -1267,7 +1270,57 @@ void update_world_view_camera()
 	}
 }
 
+// Where everything went, for showing a frame after the world view has
+// been drawn
+struct frame_layout
+{
+	short ticks_elapsed;
+	SDL_Rect hud_rect, view_rect, map_rect, term_rect, buffer_rect;
+	short low_resolution_scale;
+	bool draw_every_other_line;
+	bool map_is_translucent;
+	bool update_full_screen;
+#ifdef HAVE_OPENGL
+	Rect screen_rect;
+#endif
+};
+
+static void render_frame(short ticks_elapsed, bool may_pipeline);
+static void present_frame(const frame_layout& layout);
+
+// A frame whose world view is still rasterizing on a worker
+static bool frame_pending = false;
+static frame_layout pending_layout;
+
 void render_screen(short ticks_elapsed)
+{
+	finish_render_screen();
+	render_frame(ticks_elapsed, false);
+}
+
+void start_render_screen(short ticks_elapsed)
+{
+	finish_render_screen();
+	render_frame(ticks_elapsed, graphics_preferences->software_pipelined_rendering);
+}
+
+void finish_render_screen(void)
+{
+	if (!frame_pending) return;
+
+	finish_render_view();
+	frame_pending = false;
+	present_frame(pending_layout);
+}
+
+// For when the world view is going away: the frame isn't worth showing
+static void drop_pending_frame()
+{
+	finish_render_view();
+	frame_pending = false;
+}
+
+static void render_frame(short ticks_elapsed, bool may_pipeline)
 {
 	// Make whatever changes are necessary to the world_view structure based on whichever player is frontmost
 	world_view->ticks_elapsed = ticks_elapsed;
@@ -1372,11 +1425,18 @@ void render_screen(short ticks_elapsed)
 		PrevDrawEveryOtherLine = DrawEveryOtherLine;
 	}
 
+	static short PrevLowResolutionScale = 2;
+	short LowResolutionScale = HighResolution ? 1 : std::max<short>(mode->low_resolution_scale, 2);
+	if (!HighResolution && PrevLowResolutionScale != LowResolutionScale) {
+		ViewChangedSize = true;
+		PrevLowResolutionScale = LowResolutionScale;
+	}
+
 	SDL_Rect BufferRect = {0, 0, ViewRect.w, ViewRect.h};
 	// Now the buffer rectangle; be sure to shrink it as appropriate
 	if (!HighResolution && screen_mode.acceleration == _no_acceleration) {
-		BufferRect.w >>= 1;
-		BufferRect.h >>= 1;
+		BufferRect.w /= LowResolutionScale;
+		BufferRect.h /= LowResolutionScale;
 	}
 
 	// Set up view data appropriately
@@ -1440,8 +1500,44 @@ void render_screen(short ticks_elapsed)
 	else if (software_render_dest.empty() || ViewChangedSize)
 		software_render_dest = bitmap_definition_of_sdl_surface(world_pixels);
 	
+	frame_layout layout = { ticks_elapsed, HUD_DestRect, ViewRect, MapRect, TermRect, BufferRect,
+		LowResolutionScale, DrawEveryOtherLine, MapIsTranslucent, update_full_screen };
+#ifdef HAVE_OPENGL
+	layout.screen_rect = sr;
+#endif
+
+	// With only the software-rendered world view to draw, it can be rasterized
+	// while the next tick runs, and shown after
+	if (may_pipeline && screen_mode.acceleration == _no_acceleration &&
+		!world_view->overhead_map_active && !world_view->terminal_mode_active &&
+		!update_full_screen)
+	{
+		start_render_view(world_view, software_render_dest.get());
+		pending_layout = layout;
+		frame_pending = true;
+		return;
+	}
+
 	// Render world view
 	render_view(world_view, software_render_dest.get());
+	present_frame(layout);
+}
+
+static void present_frame(const frame_layout& layout)
+{
+	short ticks_elapsed = layout.ticks_elapsed;
+	SDL_Rect HUD_DestRect = layout.hud_rect;
+	SDL_Rect ViewRect = layout.view_rect;
+	SDL_Rect MapRect = layout.map_rect;
+	SDL_Rect TermRect = layout.term_rect;
+	SDL_Rect BufferRect = layout.buffer_rect;
+	short LowResolutionScale = layout.low_resolution_scale;
+	bool DrawEveryOtherLine = layout.draw_every_other_line;
+	bool MapIsTranslucent = layout.map_is_translucent;
+	bool update_full_screen = layout.update_full_screen;
+#ifdef HAVE_OPENGL
+	Rect sr = layout.screen_rect;
+#endif
 
     // clear Lua drawing from previous frame
     // (SDL is slower if we do this before render_view)
@@ -1469,6 +1565,8 @@ void render_screen(short ticks_elapsed)
 		update_fps_display(disp_pixels);
 	  }
 	  DisplayPosition(disp_pixels);
+	  DisplayRenderStats(disp_pixels);
+	  DisplayFrameTimes(disp_pixels);
 	  DisplayScores(disp_pixels);
 	}
 	DisplayMessages(disp_pixels);
@@ -1486,9 +1584,11 @@ void render_screen(short ticks_elapsed)
 	if (screen_mode.acceleration != _no_acceleration) {
 #ifdef HAVE_OPENGL
 		if (Screen::instance()->hud()) {
-			if (Screen::instance()->lua_hud())
+			if (Screen::instance()->lua_hud()) {
+				FrameTimer::Scope timer(FrameTimer::kLuaHUD);
 				Lua_DrawHUD(ticks_elapsed);
-			else {
+			} else {
+				FrameTimer::Scope timer(FrameTimer::kHUD);
 				Rect dr = MakeRect(HUD_DestRect);
 				OGL_DrawHUD(dr, ticks_elapsed);
 			}
@@ -1510,7 +1610,10 @@ void render_screen(short ticks_elapsed)
 		// Update world window
 		if (!world_view->terminal_mode_active &&
 			(!world_view->overhead_map_active || MapIsTranslucent))
-			update_screen(BufferRect, ViewRect, HighResolution, DrawEveryOtherLine);
+		{
+			FrameTimer::Scope timer(FrameTimer::kPresent);
+			update_screen(BufferRect, ViewRect, LowResolutionScale, DrawEveryOtherLine);
+		}
 		
 		// Update map
 		if (world_view->overhead_map_active) {
@@ -1521,9 +1624,11 @@ void render_screen(short ticks_elapsed)
 		// Update HUD
 		if (Screen::instance()->lua_hud())
 		{
+			FrameTimer::Scope timer(FrameTimer::kLuaHUD);
 			Lua_DrawHUD(ticks_elapsed);
 		}
 		else if (HUD_RenderRequest) {
+			FrameTimer::Scope timer(FrameTimer::kHUD);
 			SDL_Rect src_rect = { 0, 320, 640, 160 };
 			DrawSurface(HUD_Buffer, HUD_DestRect, src_rect);
 			HUD_RenderRequest = false;
@@ -1538,6 +1643,7 @@ void render_screen(short ticks_elapsed)
 			}
 		}
 
+		FrameTimer::Scope timer(FrameTimer::kPresent);
 		if (update_full_screen || Screen::instance()->lua_hud())
 		{
 			MainScreenUpdateRect(0, 0, 0, 0);
@@ -1552,174 +1658,64 @@ void render_screen(short ticks_elapsed)
 #ifdef HAVE_OPENGL
 	// Swap OpenGL double-buffers
 	if (screen_mode.acceleration != _no_acceleration)
+	{
+		FrameTimer::Scope timer(FrameTimer::kPresent);
 		OGL_SwapBuffers();
+	}
 #endif
 	
 	Movie::instance()->AddFrame(Movie::FRAME_NORMAL);
+	FrameTimer::instance()->FrameShown();
 }
 
 /*
  *  Blit world view to screen
  */
 
-template <class T>
-static inline void quadruple_surface(
-	const T *src,
-	int src_pitch,
-	T *dst, int dst_pitch,
-	const SDL_Rect &dst_rect,
-	bool every_other_line)
-{
-	int width = dst_rect.w / 2;
-	int height = dst_rect.h / 2;
-	dst += dst_rect.y * dst_pitch / sizeof(T) + dst_rect.x;
-	T *dst2 = dst + dst_pitch / sizeof(T);
-
-	uint32 black_pixel = SDL_MapRGB(main_surface->format, 0, 0, 0);
-	bool overlay_active = world_view->overhead_map_active
-		&& map_is_translucent();
-	
-	while (height-- > 0) {
-		if (every_other_line) {
-			if (overlay_active) {
-				// overlay map needs us to clear all the scanlines, so we have
-				// to put black in the "skipped" lines
-				for (int x=0; x<width; x++) {
-					dst[x * 2] = dst[x * 2 + 1] = src[x];
-					dst2[x * 2] = dst2[x * 2 + 1] = black_pixel;
-				}
-			} else {
-				for (int x=0; x<width; x++) {
-					dst[x * 2] = dst[x * 2 + 1] = src[x];
-				}
-			}
-		} else {
-			for (int x=0; x<width; x++) {
-				T p = src[x];
-				dst[x * 2] = dst[x * 2 + 1] = p;
-				dst2[x * 2] = dst2[x * 2 + 1] = p;
-			}
-		}
-
-		src += src_pitch / sizeof(T);
-		dst += dst_pitch * 2 / sizeof(T);
-		dst2 += dst_pitch * 2 / sizeof(T);
-	}
-}
-
 static void apply_gamma(SDL_Surface *src, SDL_Surface *dst)
 {
+	static PixelConverter converter;
+	if (!converter.Update(src->format, dst->format, current_gamma_r, current_gamma_g, current_gamma_b))
+		return;
+
 	if (SDL_MUSTLOCK(dst)) {
 	    if (SDL_LockSurface(dst) < 0) return;
 	}
-	uint32 px, dst_px;
-	uint8 src_r, src_g, src_b;
-	uint8 dst_r, dst_g, dst_b;
-	
-	uint32 srm = src->format->Rmask, sgm = src->format->Gmask, sbm = src->format->Bmask;
-	uint32 drm = dst->format->Rmask, dgm = dst->format->Gmask, dbm = dst->format->Bmask;
-	uint32 srs = src->format->Rshift, sgs = src->format->Gshift, sbs = src->format->Bshift;
-	uint32 drs = dst->format->Rshift, dgs = dst->format->Gshift, dbs = dst->format->Bshift;
-	uint32 srl = src->format->Rloss, sgl = src->format->Gloss, sbl = src->format->Bloss;
-	uint32 drl = dst->format->Rloss, dgl = dst->format->Gloss, dbl = dst->format->Bloss;
-	
-	int sbpp = src->format->BytesPerPixel;
-	int dbpp = dst->format->BytesPerPixel;
-	uint8 *sptr = static_cast<uint8*>(src->pixels);
-	uint8 *dptr = static_cast<uint8*>(dst->pixels);
-	size_t numpixels = src->w * src->h;
-	for (size_t i = 0; i < numpixels; ++i) {
-		switch (sbpp) {
-			case 2:
-				px = reinterpret_cast<uint16*>(sptr)[i];
-				break;
-			case 4:
-				px = reinterpret_cast<uint32*>(sptr)[i];
-				break;
-			default:
-				return;
-		}
-	
-		src_r = ((px & srm) >> srs) << srl;
-		src_g = ((px & sgm) >> sgs) << sgl;
-		src_b = ((px & sbm) >> sbs) << sbl;
-		dst_r = current_gamma_r[src_r] >> 8;
-		dst_g = current_gamma_g[src_g] >> 8;
-		dst_b = current_gamma_b[src_b] >> 8;
-		dst_px = (((dst_r >> drl) << drs) & drm) |
-				 (((dst_g >> dgl) << dgs) & dgm) |
-				 (((dst_b >> dbl) << dbs) & dbm);
-			
-		switch (dbpp) {
-			case 2:
-				reinterpret_cast<uint16*>(dptr)[i] = dst_px;
-				break;
-			case 4:
-				reinterpret_cast<uint32*>(dptr)[i] = dst_px;
-				break;
-			default:
-				return;
-		}
-	}
+	SDL_Rect rect = { 0, 0, dst->w, dst->h };
+	blit_world_view(src, dst, rect, 1, false, false, converter);
 	if (SDL_MUSTLOCK(dst))
 		SDL_UnlockSurface(dst);
 }
 
-static inline bool pixel_formats_equal(SDL_PixelFormat* a, SDL_PixelFormat* b)
-{
-	return (a->BytesPerPixel == b->BytesPerPixel &&
-		a->Rmask == b->Rmask &&
-		a->Gmask == b->Gmask &&
-		a->Bmask == b->Bmask);
-}
-
-static void update_screen(SDL_Rect &source, SDL_Rect &destination, bool hi_rez, bool every_other_line)
+static void update_screen(SDL_Rect &source, SDL_Rect &destination, int scale, bool every_other_line)
 {
-	SDL_Surface *s = world_pixels;
-	if (!using_default_gamma && bit_depth > 8) {
-		apply_gamma(world_pixels, world_pixels_corrected);
-		s = world_pixels_corrected;
-	}
-		
-	if (hi_rez) 
+	// Gamma correction, conversion to the screen's format and doubling
+	// happen in one pass, straight into main_surface
+	static PixelConverter converter;
+	bool gamma = !using_default_gamma && bit_depth > 8;
+	if (!converter.Update(world_pixels->format, main_surface->format,
+						  gamma ? current_gamma_r : NULL,
+						  gamma ? current_gamma_g : NULL,
+						  gamma ? current_gamma_b : NULL))
 	{
-		SDL_BlitSurface(s, NULL, main_surface, &destination);
-	} 
-	else 
+		// some format we don't have a fast path for; SDL will have to do
+		if (scale == 1)
+			SDL_BlitSurface(world_pixels, NULL, main_surface, &destination);
+		else
+			SDL_BlitScaled(world_pixels, NULL, main_surface, &destination);
+		return;
+	}
+
+	if (SDL_MUSTLOCK(main_surface)) 
 	{
-		SDL_Surface* intermediary = 0;
-		if (SDL_MUSTLOCK(main_surface)) 
-		{
-			if (SDL_LockSurface(main_surface) < 0) return;
-		}
+		if (SDL_LockSurface(main_surface) < 0) return;
+	}
 
-		if (!pixel_formats_equal(s->format, main_surface->format))
-		{
-			intermediary = SDL_ConvertSurface(s, main_surface->format, s->flags);
-			s = intermediary;
-		}
+	bool overlay_active = world_view->overhead_map_active && map_is_translucent();
+	blit_world_view(world_pixels, main_surface, destination, scale, every_other_line, overlay_active, converter);
 
-		switch (s->format->BytesPerPixel) 
-		{
-		case 1:
-			quadruple_surface((pixel8 *)s->pixels, s->pitch, (pixel8 *)main_surface->pixels, main_surface->pitch, destination, every_other_line);
-			break;
-		case 2:
-			quadruple_surface((pixel16 *)s->pixels, s->pitch, (pixel16 *)main_surface->pixels, main_surface->pitch, destination, every_other_line);
-			break;
-		case 4:
-			quadruple_surface((pixel32 *)s->pixels, s->pitch, (pixel32 *)main_surface->pixels, main_surface->pitch, destination, every_other_line);
-			break;
-		}
-		
-		if (SDL_MUSTLOCK(main_surface)) {
-			SDL_UnlockSurface(main_surface);
-		}
-
-		if (intermediary) 
-		{
-			SDL_FreeSurface(intermediary);
-		}
+	if (SDL_MUSTLOCK(main_surface)) {
+		SDL_UnlockSurface(main_surface);
 	}
 //	SDL_UpdateRects(main_surface, 1, &destination);
 }
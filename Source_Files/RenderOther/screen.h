@@ -185,6 +185,12 @@ void start_extravision_effect(bool out);
 
 void render_screen(short ticks_elapsed);
 
+// render_screen(), except that with the software renderer and pipelined
+// rendering on, the world view may still be rasterizing on a worker when
+// it returns; finish_render_screen() waits for it and shows the frame
+void start_render_screen(short ticks_elapsed);
+void finish_render_screen(void);
+
 void toggle_overhead_map_display_status(void);
 
 // Returns whether the size scale had been changed
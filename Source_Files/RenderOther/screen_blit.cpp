@@ -0,0 +1,423 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Copying the software renderer's world view to the screen: gamma
+	correction, pixel format conversion and scaling, all in one pass
+*/
+
+#include "screen_blit.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+
+#include "Console.h"
+#include "Logging.h"
+#include "WorkerPool.h"
+#include "shell.h"
+
+static bool same_format(const SDL_PixelFormat& a, const SDL_PixelFormat& b)
+{
+	return a.BytesPerPixel == b.BytesPerPixel &&
+		a.Rmask == b.Rmask && a.Gmask == b.Gmask &&
+		a.Bmask == b.Bmask && a.Amask == b.Amask;
+}
+
+// Widens a channel to 8 bits by repeating its bits, the way SDL does
+static uint8 expand_channel(uint32 value, uint32 loss)
+{
+	if (loss >= 8) return 0;
+
+	uint32 level = value << loss;
+	for (uint32 bits = 8 - loss; bits < 8; bits *= 2)
+		level |= level >> bits;
+	return static_cast<uint8>(level);
+}
+
+// A source channel value, as it ends up in the destination pixel
+static pixel32 map_channel(uint32 value, uint32 src_loss, const uint16 *gamma,
+	uint32 dst_loss, uint32 dst_shift, uint32 dst_mask)
+{
+	uint8 level;
+	if (gamma)
+		// the way the gamma tables have always been applied
+		level = gamma[static_cast<uint8>(value << src_loss)] >> 8;
+	else
+		level = expand_channel(value, src_loss);
+
+	return ((static_cast<uint32>(level) >> dst_loss) << dst_shift) & dst_mask;
+}
+
+PixelConverter::PixelConverter() :
+	gamma(false),
+	valid(false),
+	identity(false),
+	red_shift(0), green_shift(0), blue_shift(0),
+	red_max(0), green_max(0), blue_max(0),
+	alpha(0)
+{
+	obj_clear(src);
+	obj_clear(dst);
+	obj_clear(gamma_tables);
+}
+
+bool PixelConverter::Update(const SDL_PixelFormat *src_format, const SDL_PixelFormat *dst_format,
+	const uint16 *gamma_r, const uint16 *gamma_g, const uint16 *gamma_b)
+{
+	int src_bpp = src_format->BytesPerPixel;
+	int dst_bpp = dst_format->BytesPerPixel;
+	if (src_bpp != 1 && src_bpp != 2 && src_bpp != 4) return false;
+	if (dst_bpp != 2 && dst_bpp != 4) return false;
+	if (src_bpp == 1 && !src_format->palette) return false;
+
+	bool changed = !valid || !same_format(src, *src_format) || !same_format(dst, *dst_format) ||
+		gamma != (gamma_r != NULL);
+
+	if (gamma_r && !changed)
+	{
+		changed = memcmp(gamma_tables[0], gamma_r, sizeof(gamma_tables[0])) != 0 ||
+			memcmp(gamma_tables[1], gamma_g, sizeof(gamma_tables[1])) != 0 ||
+			memcmp(gamma_tables[2], gamma_b, sizeof(gamma_tables[2])) != 0;
+	}
+
+	// the 8-bit palette changes with fades and flashes
+	SDL_Palette *src_palette = src_bpp == 1 ? src_format->palette : NULL;
+	if (src_palette && !changed)
+	{
+		changed = palette.size() != static_cast<size_t>(src_palette->ncolors) ||
+			memcmp(palette.data(), src_palette->colors, palette.size()*sizeof(SDL_Color)) != 0;
+	}
+
+	if (!changed) return true;
+
+	src = *src_format;
+	dst = *dst_format;
+	src.palette = dst.palette = NULL;
+	src.next = dst.next = NULL;
+
+	gamma = gamma_r != NULL;
+	if (gamma)
+	{
+		memcpy(gamma_tables[0], gamma_r, sizeof(gamma_tables[0]));
+		memcpy(gamma_tables[1], gamma_g, sizeof(gamma_tables[1]));
+		memcpy(gamma_tables[2], gamma_b, sizeof(gamma_tables[2]));
+	}
+
+	if (src_palette)
+		palette.assign(src_palette->colors, src_palette->colors + src_palette->ncolors);
+	else
+		palette.clear();
+
+	Build();
+	valid = true;
+	return true;
+}
+
+void PixelConverter::Build()
+{
+	identity = !gamma && src.BytesPerPixel > 1 && same_format(src, dst);
+
+	// SDL fills in the alpha of pixels converted to formats that have it
+	alpha = dst.Amask;
+
+	const uint16 *gamma_r = gamma ? gamma_tables[0] : NULL;
+	const uint16 *gamma_g = gamma ? gamma_tables[1] : NULL;
+	const uint16 *gamma_b = gamma ? gamma_tables[2] : NULL;
+
+	switch (src.BytesPerPixel)
+	{
+	case 1:
+		// the palette is already gamma corrected
+		direct.assign(256, alpha);
+		for (size_t i = 0; i < palette.size() && i < direct.size(); ++i)
+		{
+			const SDL_Color& color = palette[i];
+			direct[i] = map_channel(color.r, 0, NULL, dst.Rloss, dst.Rshift, dst.Rmask) |
+				map_channel(color.g, 0, NULL, dst.Gloss, dst.Gshift, dst.Gmask) |
+				map_channel(color.b, 0, NULL, dst.Bloss, dst.Bshift, dst.Bmask) | alpha;
+		}
+		break;
+
+	case 2:
+		direct.resize(65536);
+		for (uint32 p = 0; p < direct.size(); ++p)
+		{
+			direct[p] = map_channel((p & src.Rmask) >> src.Rshift, src.Rloss, gamma_r, dst.Rloss, dst.Rshift, dst.Rmask) |
+				map_channel((p & src.Gmask) >> src.Gshift, src.Gloss, gamma_g, dst.Gloss, dst.Gshift, dst.Gmask) |
+				map_channel((p & src.Bmask) >> src.Bshift, src.Bloss, gamma_b, dst.Bloss, dst.Bshift, dst.Bmask) | alpha;
+		}
+		break;
+
+	case 4:
+		direct.clear();
+		red_shift = src.Rshift;
+		green_shift = src.Gshift;
+		blue_shift = src.Bshift;
+		red_max = src.Rmask >> src.Rshift;
+		green_max = src.Gmask >> src.Gshift;
+		blue_max = src.Bmask >> src.Bshift;
+		for (uint32 value = 0; value < 256; ++value)
+		{
+			red[value] = value <= red_max ? map_channel(value, src.Rloss, gamma_r, dst.Rloss, dst.Rshift, dst.Rmask) : 0;
+			green[value] = value <= green_max ? map_channel(value, src.Gloss, gamma_g, dst.Gloss, dst.Gshift, dst.Gmask) : 0;
+			blue[value] = value <= blue_max ? map_channel(value, src.Bloss, gamma_b, dst.Bloss, dst.Bshift, dst.Bmask) : 0;
+		}
+		break;
+	}
+}
+
+struct IdentityConverter
+{
+	template <class T> T Map(T p) const { return p; }
+};
+
+// Off only for the benchmark, to compare against
+static bool parallel_blits = true;
+
+// A source row has to make about this many screen pixels to be worth
+// handing to another thread
+static const int kMinimumPixelsPerChunk = 64 * 1024;
+
+// Each source row is converted once, straight into the screen, and then
+// copied down for the rest of its lines; rows are split between threads
+template <class S, class D, class C>
+static void blit_rows(SDL_Surface *src, SDL_Surface *dst, const SDL_Rect& dst_rect,
+	int scale, bool every_other_line, bool black_lines, const C& conv)
+{
+	int width = std::min(src->w, dst_rect.w / scale);
+	int height = std::min(src->h, dst_rect.h / scale);
+	int dst_width = width * scale;
+
+	const uint8 *src_pixels = static_cast<const uint8 *>(src->pixels);
+	uint8 *dst_pixels = static_cast<uint8 *>(dst->pixels) + dst_rect.y * dst->pitch + dst_rect.x * sizeof(D);
+	int src_pitch = src->pitch;
+	int dst_pitch = dst->pitch;
+	D black_pixel = static_cast<D>(SDL_MapRGB(dst->format, 0, 0, 0));
+
+	auto blit = [=, &conv](int first, int last) {
+		for (int y = first; y < last; ++y)
+		{
+			const S *s = reinterpret_cast<const S *>(src_pixels + y * src_pitch);
+			uint8 *dst_row = dst_pixels + y * scale * dst_pitch;
+			D *d = reinterpret_cast<D *>(dst_row);
+
+			if (scale == 1)
+			{
+				if constexpr (std::is_same<C, IdentityConverter>::value)
+					memcpy(d, s, width * sizeof(D));
+				else
+				{
+					for (int x = 0; x < width; ++x)
+						d[x] = static_cast<D>(conv.Map(s[x]));
+				}
+				continue;
+			}
+
+			if (scale == 2)
+			{
+				for (int x = 0; x < width; ++x)
+					d[x * 2] = d[x * 2 + 1] = static_cast<D>(conv.Map(s[x]));
+			}
+			else
+			{
+				for (int x = 0; x < width; ++x)
+				{
+					D p = static_cast<D>(conv.Map(s[x]));
+					std::fill_n(d + x * scale, scale, p);
+				}
+			}
+
+			// with every_other_line, the odd lines of the screen get skipped
+			int line = y * scale;
+			for (int k = 1; k < scale; ++k)
+			{
+				D *dk = reinterpret_cast<D *>(dst_row + k * dst_pitch);
+				if (!every_other_line || ((line + k) & 1) == 0)
+					memcpy(dk, d, dst_width * sizeof(D));
+				else if (black_lines)
+					std::fill_n(dk, dst_width, black_pixel);
+			}
+		}
+	};
+
+	int min_rows = std::max(1, kMinimumPixelsPerChunk / std::max(1, dst_width * scale));
+	if (parallel_blits)
+		WorkerPool::instance()->ParallelFor(0, height, blit, min_rows);
+	else
+		blit(0, height);
+
+	// 2x has always left the odd pixel at the edges alone; at bigger scales
+	// the leftover strips are wide enough to notice, so they're cleared
+	if (scale > 2)
+	{
+		int dst_height = height * scale;
+		for (int y = 0; y < dst_rect.h; ++y)
+		{
+			D *d = reinterpret_cast<D *>(dst_pixels + y * dst_pitch);
+			if (y < dst_height)
+				std::fill(d + dst_width, d + dst_rect.w, black_pixel);
+			else
+				std::fill_n(d, dst_rect.w, black_pixel);
+		}
+	}
+}
+
+template <class S, class C>
+static void blit_to(SDL_Surface *src, SDL_Surface *dst, const SDL_Rect& dst_rect,
+	int scale, bool every_other_line, bool black_lines, const C& conv)
+{
+	switch (dst->format->BytesPerPixel)
+	{
+	case 2:
+		blit_rows<S, pixel16>(src, dst, dst_rect, scale, every_other_line, black_lines, conv);
+		break;
+	case 4:
+		blit_rows<S, pixel32>(src, dst, dst_rect, scale, every_other_line, black_lines, conv);
+		break;
+	}
+}
+
+void blit_world_view(SDL_Surface *src, SDL_Surface *dst, const SDL_Rect& dst_rect,
+	int scale, bool every_other_line, bool black_lines, const PixelConverter& conv)
+{
+	scale = std::max(1, scale);
+
+	if (conv.Identity())
+	{
+		switch (src->format->BytesPerPixel)
+		{
+		case 2:
+			blit_rows<pixel16, pixel16>(src, dst, dst_rect, scale, every_other_line, black_lines, IdentityConverter());
+			break;
+		case 4:
+			blit_rows<pixel32, pixel32>(src, dst, dst_rect, scale, every_other_line, black_lines, IdentityConverter());
+			break;
+		}
+		return;
+	}
+
+	switch (src->format->BytesPerPixel)
+	{
+	case 1:
+		blit_to<pixel8>(src, dst, dst_rect, scale, every_other_line, black_lines, conv);
+		break;
+	case 2:
+		blit_to<pixel16>(src, dst, dst_rect, scale, every_other_line, black_lines, conv);
+		break;
+	case 4:
+		blit_to<pixel32>(src, dst, dst_rect, scale, every_other_line, black_lines, conv);
+		break;
+	}
+}
+
+static double elapsed_milliseconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void fill_with_noise(SDL_Surface *s)
+{
+	uint8 *pixels = static_cast<uint8 *>(s->pixels);
+	for (int i = 0; i < s->pitch * s->h; ++i)
+		pixels[i] = static_cast<uint8>(rand());
+}
+
+// Times copying a world view to a 32-bit screen the ways update_screen()
+// does, and a 16-bit one the way it used to, with a surface converted and
+// freed every frame; and the low-resolution scales, on one thread and on all
+static void benchmark_blit(const std::string& arg)
+{
+	int frames = arg.empty() ? 60 : std::max(1, atoi(arg.c_str()));
+
+	uint16 gamma_table[256];
+	for (int i = 0; i < 256; ++i)
+		gamma_table[i] = static_cast<uint16>(65535.0 * pow(i / 255.0, 1 / 1.3));
+
+	const struct { int width, height; } sizes[] = { { 1920, 1080 }, { 2560, 1440 } };
+	for (auto& size : sizes)
+	{
+		int w = size.width, h = size.height;
+		SDL_Surface *screen = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+		SDL_Surface *world32 = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+		SDL_Surface *world16 = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 16, 0xf800, 0x07e0, 0x001f, 0);
+		SDL_Surface *half32 = SDL_CreateRGBSurface(SDL_SWSURFACE, w / 2, h / 2, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+		SDL_Surface *quarter32 = SDL_CreateRGBSurface(SDL_SWSURFACE, w / 4, h / 4, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+		SDL_Surface *surfaces[] = { screen, world32, world16, half32, quarter32 };
+		if (!screen || !world32 || !world16 || !half32 || !quarter32)
+		{
+			screen_printf("Couldn't allocate surfaces to benchmark blitting");
+			for (auto surface : surfaces)
+				SDL_FreeSurface(surface);
+			return;
+		}
+
+		for (int i = 1; i < 5; ++i)
+			fill_with_noise(surfaces[i]);
+		SDL_SetSurfaceBlendMode(world16, SDL_BLENDMODE_NONE);
+
+		SDL_Rect rect = { 0, 0, w, h };
+		PixelConverter conv;
+		auto time_blits = [&](SDL_Surface *src, int scale) {
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < frames; ++i)
+				blit_world_view(src, screen, rect, scale, false, false, conv);
+			return elapsed_milliseconds(start) / frames;
+		};
+
+		conv.Update(world32->format, screen->format);
+		double copy_ms = time_blits(world32, 1);
+		parallel_blits = false;
+		double serial_doubled_ms = time_blits(half32, 2);
+		parallel_blits = true;
+		double doubled_ms = time_blits(half32, 2);
+		double quadrupled_ms = time_blits(quarter32, 4);
+
+		conv.Update(world32->format, screen->format, gamma_table, gamma_table, gamma_table);
+		double gamma_ms = time_blits(world32, 1);
+		double gamma_doubled_ms = time_blits(half32, 2);
+
+		conv.Update(world16->format, screen->format);
+		double convert_ms = time_blits(world16, 1);
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; ++i)
+		{
+			SDL_Surface *converted = SDL_ConvertSurface(world16, screen->format, world16->flags);
+			SDL_BlitSurface(converted, NULL, screen, &rect);
+			SDL_FreeSurface(converted);
+		}
+		double sdl_convert_ms = elapsed_milliseconds(start) / frames;
+
+		int threads = WorkerPool::instance()->Concurrency();
+		screen_printf("%dx%d: copy %.2f ms, gamma %.2f ms, gamma at 2x %.2f ms", w, h, copy_ms, gamma_ms, gamma_doubled_ms);
+		screen_printf("%dx%d: 2x %.2f ms (%.2f ms on one thread), 4x %.2f ms, %d threads", w, h, doubled_ms, serial_doubled_ms, quadrupled_ms, threads);
+		screen_printf("%dx%d: 16-bit to 32-bit %.2f ms (%.2f ms converting a surface each frame)", w, h, convert_ms, sdl_convert_ms);
+		logNote("blit benchmark %dx%d: copy %.3f ms, gamma %.3f ms, gamma 2x %.3f ms, 2x %.3f ms (serial %.3f ms), 4x %.3f ms, %d threads, 16->32 %.3f ms, SDL_ConvertSurface 16->32 %.3f ms",
+			w, h, copy_ms, gamma_ms, gamma_doubled_ms, doubled_ms, serial_doubled_ms, quadrupled_ms, threads, convert_ms, sdl_convert_ms);
+
+		for (auto surface : surfaces)
+			SDL_FreeSurface(surface);
+	}
+}
+
+void register_blit_benchmark()
+{
+	Console::instance()->register_benchmark("blit", benchmark_blit);
+}
@@ -0,0 +1,90 @@
+#ifndef SCREEN_BLIT_H
+#define SCREEN_BLIT_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Copying the software renderer's world view to the screen: gamma
+	correction, pixel format conversion and scaling, all in one pass
+*/
+
+#include "cseries.h"
+
+#include <vector>
+
+// Maps pixels of one format to another, through the gamma tables if there
+// are any. Every source pixel value (or, for 32-bit sources, channel value)
+// has its destination bits worked out ahead of time, so converting a pixel
+// is a lookup or three and some ORs.
+class PixelConverter
+{
+public:
+	PixelConverter();
+
+	// Gets ready to go from src_format to dst_format, which must be 8 (with
+	// a palette), 16 or 32 bits and 16 or 32 bits respectively; returns
+	// false for anything else. Only rebuilds its tables when the formats,
+	// palette or gamma tables have changed since the last call.
+	bool Update(const SDL_PixelFormat *src_format, const SDL_PixelFormat *dst_format,
+		const uint16 *gamma_r = NULL, const uint16 *gamma_g = NULL, const uint16 *gamma_b = NULL);
+
+	// pixels can be copied as they are
+	bool Identity() const { return identity; }
+
+	pixel32 Map(pixel8 p) const { return direct[p]; }
+	pixel32 Map(pixel16 p) const { return direct[p]; }
+	pixel32 Map(pixel32 p) const {
+		return red[(p >> red_shift) & red_max] |
+			green[(p >> green_shift) & green_max] |
+			blue[(p >> blue_shift) & blue_max] | alpha;
+	}
+
+private:
+	void Build();
+
+	// what the tables were built for
+	SDL_PixelFormat src;
+	SDL_PixelFormat dst;
+	std::vector<SDL_Color> palette;
+	bool gamma;
+	uint16 gamma_tables[3][256];
+
+	bool valid;
+	bool identity;
+
+	// 8- and 16-bit sources: the whole pixel at once
+	std::vector<pixel32> direct;
+
+	// 32-bit sources: a channel at a time
+	pixel32 red[256], green[256], blue[256];
+	uint32 red_shift, green_shift, blue_shift;
+	uint32 red_max, green_max, blue_max;
+	pixel32 alpha;
+};
+
+// Copies all of src into dst_rect of dst, converted by conv, with each pixel
+// made into a scale x scale block (the low-resolution modes), split up
+// between the worker threads. every_other_line leaves the odd lines of dst
+// alone, or makes them black if black_lines is set. dst must already be
+// locked, if it needs to be.
+void blit_world_view(SDL_Surface *src, SDL_Surface *dst, const SDL_Rect& dst_rect,
+	int scale, bool every_other_line, bool black_lines, const PixelConverter& conv);
+
+// ".benchmark blit [frames]", at 1080p and 1440p
+void register_blit_benchmark();
+
+#endif
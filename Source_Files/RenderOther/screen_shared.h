@@ -137,6 +137,9 @@ bool displaying_fps= false;
 bool ShowPosition = false;
 bool ShowScores = false;
 
+// whether to show what the last frame took to draw
+bool ShowRenderStats = false;
+
 // Whether rendering of the HUD has been requested
 static bool HUD_RenderRequest = false;
 static bool Term_RenderRequest = false;
@@ -622,6 +625,104 @@ static void DisplayPosition(SDL_Surface *s)
 	
 }
 
+static void DisplayRenderStats(SDL_Surface *s)
+{
+	if (!ShowRenderStats) return;
+
+	FontSpecifier& Font = GetOnScreenFont();
+
+	DisplayTextDest = s;
+	DisplayTextFont = Font.Info;
+	DisplayTextStyle = Font.Style;
+
+	const render_frame_stats& stats = last_render_frame_stats;
+	char lines[3][64];
+	sprintf(lines[0], "draw calls %d", stats.draw_calls);
+	sprintf(lines[1], "textures %d, %d allocated", stats.texture_setups, stats.texture_allocations);
+	sprintf(lines[2], "texture managers %d", stats.textures_cached);
+
+	auto text_margins = alephone::Screen::instance()->lua_text_margins;
+	short LineSpacing = Font.LineSpacing;
+	short X0 = s->w - text_margins.right - LineSpacing/3;
+	short Y = text_margins.top + LineSpacing;
+	for (auto& line : lines)
+	{
+		DisplayText(X0 - DisplayTextWidth(line), Y, line);
+		Y += LineSpacing;
+	}
+}
+
+static void DisplayRect(SDL_Surface *s, const SDL_Rect& rect, unsigned char r, unsigned char g, unsigned char b)
+{
+#ifdef HAVE_OPENGL
+	if((OGL_MapActive || !world_view->overhead_map_active) && !world_view->terminal_mode_active)
+		if (OGL_RenderTextCursor(rect, r, g, b)) return;
+#endif
+
+	SDL_Rect dst = rect;
+	SDL_FillRect(s, &dst, SDL_MapRGB(world_pixels->format, r, g, b));
+}
+
+// A bar per recent frame, with lines at 30 and 60 fps, then the frame time
+// percentiles and where the time went
+static void DisplayFrameTimes(SDL_Surface *s)
+{
+	FrameTimer* timer = FrameTimer::instance();
+	if (!timer->OverlayVisible()) return;
+
+	FontSpecifier& Font = GetOnScreenFont();
+
+	DisplayTextDest = s;
+	DisplayTextFont = Font.Info;
+	DisplayTextStyle = Font.Style;
+
+	auto text_margins = alephone::Screen::instance()->lua_text_margins;
+	short LineSpacing = Font.LineSpacing;
+	short X0 = text_margins.left + LineSpacing/3;
+	short Y = s->h / 2;
+
+	// 50 ms at the top
+	const float max_ms = 50.0f;
+	const short graph_height = 4*LineSpacing;
+	short graph_bottom = Y + graph_height;
+	for (int i = 0; i < timer->FrameCount(); ++i)
+	{
+		float ms = std::min(timer->FrameTime(i), max_ms);
+		SDL_Rect bar = { X0 + i, graph_bottom - static_cast<short>(graph_height*ms/max_ms), 1, 0 };
+		bar.h = graph_bottom - bar.y;
+		if (ms > 1000.0f/30)
+			DisplayRect(s, bar, 0xff, 0x40, 0x40);
+		else if (ms > 1000.0f/60)
+			DisplayRect(s, bar, 0xff, 0xd0, 0x40);
+		else
+			DisplayRect(s, bar, 0x40, 0xff, 0x40);
+	}
+	for (float fps : { 30.0f, 60.0f })
+	{
+		SDL_Rect line = { X0, graph_bottom - static_cast<short>(graph_height*(1000/fps)/max_ms), 240, 1 };
+		DisplayRect(s, line, 0x80, 0x80, 0x80);
+	}
+
+	Y = graph_bottom + LineSpacing;
+	sprintf(temporary, "frame p50 %.1f  p95 %.1f  p99 %.1f ms",
+		timer->Percentile(50), timer->Percentile(95), timer->Percentile(99));
+	DisplayText(X0, Y, temporary);
+	Y += LineSpacing;
+
+	for (int stage = 0; stage < FrameTimer::kNumberOfStages; ++stage)
+	{
+		sprintf(temporary, "%-12s %6.2f ms", FrameTimer::StageName(static_cast<FrameTimer::Stage>(stage)),
+			timer->StageAverage(static_cast<FrameTimer::Stage>(stage)));
+		DisplayText(X0, Y, temporary);
+		Y += LineSpacing;
+	}
+
+	if (timer->Tracing())
+	{
+		DisplayText(X0, Y, "tracing", 0xff, 0x40, 0x40);
+	}
+}
+
 static void DisplayInputLine(SDL_Surface *s)
 {
   if (Console::instance()->input_active() && 
@@ -31,6 +31,9 @@ SOUND.C
 #include "OpenALManager.h"
 #include "shell_options.h"
 #include "Movie.h"
+#include "MemoryBudget.h"
+#include "map.h"
+#include "tick_events.h"
 
 #undef SLOT_IS_USED
 #undef SLOT_IS_FREE
@@ -44,7 +47,9 @@ SOUND.C
 
 class SoundMemoryManager {
 public:
-	SoundMemoryManager(std::size_t max_size) : m_size(0), m_max_size(max_size) { }
+	SoundMemoryManager(std::size_t max_size) : m_size(0), m_max_size(max_size) {
+		m_budget_id = MemoryBudget::instance()->Register("sounds", MemoryBudget::kPriorityNormal, [this]() { return m_size; }, [this](std::size_t bytes) { return Trim(bytes); });
+	}
 
 	void SetMaxSize(std::size_t max_size) { m_max_size = max_size; }
 
@@ -57,9 +62,23 @@ public:
 		return m_entries.count(index);
 	}
 
+	std::vector<short> LoadedSounds() {
+		std::vector<short> indexes;
+		for (auto& entry : m_entries)
+		{
+			indexes.push_back(entry.first);
+		}
+		return indexes;
+	}
+
 	void Clear() { m_entries.clear(); m_size = 0; }
 	void Release(short index); // sound must be loaded
 
+	// releases the least recently played sounds until bytes are freed
+	std::size_t Trim(std::size_t bytes);
+
+	void CountLookup(bool hit) { if (hit) MemoryBudget::instance()->Hit(m_budget_id); else MemoryBudget::instance()->Miss(m_budget_id); }
+
 private:
 	struct Entry {
 		Entry() : data(5), last_played(0) { }
@@ -84,6 +103,7 @@ private:
 	std::map<short, Entry> m_entries;
 	std::size_t m_size;
 	std::size_t m_max_size;
+	int m_budget_id;
 };
 
 void SoundMemoryManager::Add(std::shared_ptr<SoundData> data, short index, short slot)
@@ -130,6 +150,18 @@ void SoundMemoryManager::ReleaseOldestSound()
 
 	std::cerr << "Dropping sound " << oldest_sound->first << std::endl;
 	Release(oldest_sound->first);
+	MemoryBudget::instance()->Evicted(m_budget_id);
+}
+
+std::size_t SoundMemoryManager::Trim(std::size_t bytes)
+{
+	std::size_t start = m_size;
+	while (m_entries.size() && start - m_size < bytes)
+	{
+		ReleaseOldestSound();
+	}
+
+	return start - m_size;
 }
 
 void SoundMemoryManager::Update(short index)
@@ -138,6 +170,18 @@ void SoundMemoryManager::Update(short index)
 }
 
 
+struct SoundManager::Prefetch
+{
+	FileSpecifier file;
+	short sound_source;
+
+	std::vector<short> indexes;
+	std::vector<SoundDefinition> definitions; // copies, since the worker can't share
+	std::vector<int> slot_counts;
+
+	std::map<short, std::vector<std::shared_ptr<SoundData> > > data;
+};
+
 static void Shutdown()
 {
 	SoundManager::instance()->Shutdown();
@@ -176,6 +220,7 @@ void SoundManager::SetParameters(const Parameters& parameters)
 
 		// We need to get rid of the sounds we have in memory
 		UnloadAllSounds();
+		prefetched_sounds.reset();
 
 		// Stuff in our new parameters
 		this->parameters = parameters;
@@ -197,6 +242,7 @@ void SoundManager::Shutdown()
 bool SoundManager::OpenSoundFile(FileSpecifier& File)
 {
 	UnloadAllSounds();
+	prefetched_sounds.reset();
 	sound_file.reset(new M2SoundFile);
 	if (!sound_file->Open(File))
 	{
@@ -213,6 +259,7 @@ bool SoundManager::OpenSoundFile(FileSpecifier& File)
 	if (sound_file->SourceCount() == 1)
 		sound_source = _8bit_22k_source;
 
+	sound_file_spec = File;
 	return true;
 }
 
@@ -287,15 +334,28 @@ bool SoundManager::LoadSound(short sound_index)
 			return false;
 		}
 			
+		sounds->CountLookup(sounds->IsLoaded(sound_index));
 		if (sounds->IsLoaded(sound_index))
 		{
 			sounds->Update(sound_index);
 		} 
 		else
 		{
+			// level prefetching may have read it already
+			std::vector<std::shared_ptr<SoundData> > prefetched;
+			if (prefetched_sounds)
+			{
+				auto it = prefetched_sounds->data.find(sound_index);
+				if (it != prefetched_sounds->data.end())
+				{
+					prefetched.swap(it->second);
+					prefetched_sounds->data.erase(it);
+				}
+			}
+
 			for (int i = 0; i < NumSlots; ++i)
 			{
-				auto p = sound_file->GetSoundData(definition, i);
+				auto p = (static_cast<size_t>(i) < prefetched.size() && prefetched[i]) ? prefetched[i] : sound_file->GetSoundData(definition, i);
 
 				SoundOptions *SndOpts = SoundReplacements::instance()->GetSoundOptions(sound_index, i);
 				if (SndOpts)
@@ -320,6 +380,81 @@ bool SoundManager::LoadSound(short sound_index)
 	return false;
 }
 
+std::shared_ptr<SoundManager::Prefetch> SoundManager::BeginPrefetch()
+{
+	// M1 sounds are resources, which we can't read on a handle of our own
+	if (!active || !dynamic_cast<M2SoundFile*>(sound_file.get()))
+	{
+		return std::shared_ptr<Prefetch>();
+	}
+
+	auto prefetch = std::make_shared<Prefetch>();
+	prefetch->file = sound_file_spec;
+	prefetch->sound_source = sound_source;
+
+	// most of what's loaded now belongs to the player, weapons and items,
+	// which the next level will want again after goto_level() unloads them
+	for (auto sound_index : sounds->LoadedSounds())
+	{
+		SoundDefinition* definition = GetSoundDefinition(sound_index);
+		if (definition)
+		{
+			prefetch->indexes.push_back(sound_index);
+			prefetch->definitions.push_back(*definition);
+			prefetch->slot_counts.push_back((parameters.flags & _more_sounds_flag) ? definition->permutations : 1);
+		}
+	}
+
+	return prefetch;
+}
+
+// runs on a worker thread; returns the number of bytes read
+size_t SoundManager::DecodePrefetch(Prefetch& prefetch, size_t budget)
+{
+	OpenedFile file;
+	if (!prefetch.file.Open(file))
+	{
+		return 0;
+	}
+
+	size_t used = 0;
+	for (size_t i = 0; i < prefetch.indexes.size(); ++i)
+	{
+		std::vector<std::shared_ptr<SoundData> > slots;
+		size_t size = 0;
+		for (int slot = 0; slot < prefetch.slot_counts[i]; ++slot)
+		{
+			auto p = prefetch.definitions[i].LoadData(file, slot);
+			if (p)
+			{
+				size += p->size();
+			}
+			slots.push_back(p);
+		}
+
+		if (used + size > budget)
+		{
+			break;
+		}
+
+		used += size;
+		prefetch.data[prefetch.indexes[i]].swap(slots);
+	}
+
+	return used;
+}
+
+void SoundManager::CommitPrefetch(std::shared_ptr<Prefetch> prefetch)
+{
+	// the sound file or quality may have changed in the meantime
+	if (prefetch && (!(prefetch->file == sound_file_spec) || prefetch->sound_source != sound_source))
+	{
+		prefetch.reset();
+	}
+
+	prefetched_sounds = prefetch;
+}
+
 void SoundManager::LoadSounds(short *sounds, short count)
 {
 	for (short i = 0; i < count; i++)
@@ -362,9 +497,20 @@ std::shared_ptr<AudioPlayer> SoundManager::PlaySound(short sound_index,
 				 bool loop) 
 {
 	/* don’t do anything if we’re not initialized or active, or our sound_code is NONE,
-		or our volume is zero */
+		or our volume is zero, or this sound was already heard when the tick was predicted */
 	if (sound_index!=NONE && active && OpenALManager::Get()->GetMasterVolume() > 0)
 	{
+		tick_event event;
+		event.type= _sound_tick_event;
+		event.index= sound_index;
+		event.identifier= identifier;
+		event.values[0]= source ? source->point.x : NONE;
+		event.values[1]= source ? source->point.y : NONE;
+		event.values[2]= source ? source->point.z : NONE;
+		event.values[3]= pitch;
+		event.values[4]= (local ? 1 : 0) | (loop ? 2 : 0);
+		if (!claim_world_tick_event(event)) return nullptr;
+
 		SoundVolumes variables;
 		
 		/* make sure the sound data is in memory */
@@ -394,20 +540,42 @@ std::shared_ptr<AudioPlayer> SoundManager::PlaySound(short sound_index,
 				}
 				
 			}
-			return BufferSound(parameters);
+			auto player = BufferSound(parameters);
+			StopIfMispredicted(player);
+			return player;
 		}
 	}
 
 	return nullptr;
 }
 				
+void SoundManager::StopIfMispredicted(const std::shared_ptr<SoundPlayer>& player)
+{
+	if (!player || !world_is_predicting()) return;
+
+	std::weak_ptr<SoundPlayer> weak_player = player;
+	set_world_tick_event_undo([weak_player]() {
+		if (auto sound_player = weak_player.lock()) sound_player->AskStop();
+	});
+}
+
 void SoundManager::DirectPlaySound(short sound_index, angle direction, short volume, _fixed pitch)
 {
 	/* don’t do anything if we’re not initialized or active, or our sound_code is NONE,
-	   or our volume is zero */
+	   or our volume is zero, or this sound was already heard when the tick was predicted */
 
 	if (sound_index != NONE && active && parameters.volume_db > MINIMUM_VOLUME_DB)
 	{
+		tick_event event;
+		event.type = _direct_sound_tick_event;
+		event.index = sound_index;
+		event.identifier = NONE;
+		event.values[0] = direction;
+		event.values[1] = volume;
+		event.values[2] = pitch;
+		event.values[3] = event.values[4] = 0;
+		if (!claim_world_tick_event(event)) return;
+
 		if (LoadSound(sound_index))
 		{
 			SoundVolumes variables;
@@ -430,7 +598,7 @@ void SoundManager::DirectPlaySound(short sound_index, angle direction, short vol
 			}
 
 			/* start the sound playing */
-			BufferSound(parameters);
+			StopIfMispredicted(BufferSound(parameters));
 		}
 	}
 }
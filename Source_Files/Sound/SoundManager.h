@@ -67,6 +67,14 @@ public:
 	void UnloadSound(short sound);
 	void UnloadAllSounds();
 
+	// level prefetching (see game_wad.cpp): BeginPrefetch() picks the sounds on
+	// the main thread, DecodePrefetch() reads them on a worker thread, and
+	// CommitPrefetch() hands them back for LoadSound() to use
+	struct Prefetch;
+	std::shared_ptr<Prefetch> BeginPrefetch();
+	static size_t DecodePrefetch(Prefetch& prefetch, size_t budget);
+	void CommitPrefetch(std::shared_ptr<Prefetch> prefetch);
+
 	std::shared_ptr<AudioPlayer> PlaySound(short sound_index, world_location3d *source, short identifier, bool local, _fixed pitch = _normal_frequency, bool loop = false);
 	void PlayLocalSound(short sound_index, _fixed pitch = _normal_frequency) { PlaySound(sound_index, NULL, NONE, true, pitch); }
 	void DirectPlaySound(short sound_index, angle direction, short volume, _fixed pitch);
@@ -127,6 +135,8 @@ private:
 	void SetStatus(bool active);
 	SoundDefinition* GetSoundDefinition(short sound_index);
 	std::shared_ptr<SoundPlayer> BufferSound(SoundParameters parameters);
+	// a predicted tick's sound stops if the real tick doesn't make it
+	void StopIfMispredicted(const std::shared_ptr<SoundPlayer>& player);
 	float CalculatePitchModifier(short sound_index, _fixed pitch_modifier);
 	void AngleAndVolumeToStereoVolume(angle delta, short volume, short *right_volume, short *left_volume);
 	short GetRandomSoundPermutation(short sound_index);
@@ -143,7 +153,9 @@ private:
 	short sound_source; // 8-bit, 16-bit
 	
 	std::unique_ptr<SoundFile> sound_file;
+	FileSpecifier sound_file_spec;
 	SoundMemoryManager* sounds;
+	std::shared_ptr<Prefetch> prefetched_sounds;
 
 	// buffer sizes
 	static const int MINIMUM_SOUND_BUFFER_SIZE = 300*KILO;
@@ -33,18 +33,74 @@
 #include "InfoTree.h"
 #include "XML_ParseTreeRoot.h"
 #include "Scenario.h"
+#include "WorkerPool.h"
+#include "ZipArchivePool.h"
 
 #include <boost/algorithm/string/predicate.hpp>
 
 namespace algo = boost::algorithm;
 
+// bump this whenever what the index holds for a plugin changes
+static const int kPluginIndexVersion = 2;
+
+// A file a Plugin.xml refers to, and whether ParsePlugin() found it; plugins
+// drop what isn't there, so a file coming or going changes the plugin
+struct CheckedFile {
+	std::string path;
+	bool exists;
+};
+
+// A Plugin.xml, or a zip that may hold several, along with what was parsed
+// out of it and enough to tell when it has changed since
+struct PluginSource {
+	FileSpecifier file;
+	bool zip = false;
+	TimeType date = 0;
+	int64_t size = -1;
+	TimeType directory_date = 0; // files the plugin refers to come and go here
+
+	bool parsed = false;
+	std::vector<Plugin> plugins;
+	std::vector<std::string> errors;
+	std::vector<CheckedFile> checked_files;
+
+	bool unchanged(const PluginSource& other) const {
+		return zip == other.zip && date == other.date && size == other.size && directory_date == other.directory_date &&
+			checked_files_unchanged();
+	}
+
+	// the files usually live in subdirectories, whose changes don't touch
+	// directory_date; a zip's date and size already cover what's in it
+	bool checked_files_unchanged() const {
+		if (zip)
+			return true;
+
+		for (const auto& checked : checked_files)
+		{
+			if (FileSpecifier(checked.path).Exists() != checked.exists)
+				return false;
+		}
+		return true;
+	}
+};
+
 class PluginLoader {
 public:
 	PluginLoader() { }
 	~PluginLoader() { }
 	
-	bool ParsePlugin(FileSpecifier& file);
+	bool ParsePlugin(FileSpecifier& file, std::vector<Plugin>& plugins, std::vector<std::string>& errors, std::vector<CheckedFile>& checked_files);
 	bool ParseDirectory(FileSpecifier& dir);
+	void ParseSource(PluginSource& source);
+
+	void LoadIndex();
+	void SaveIndex();
+
+	// in the order the directories were walked
+	std::vector<PluginSource> sources;
+
+	// what the index had last time, by path
+	std::map<std::string, PluginSource> index;
 };
 
 bool Plugin::compatible() const {
@@ -261,10 +317,12 @@ const Plugin* Plugins::find_theme()
 	return 0;
 }
 
-static bool plugin_file_exists(const Plugin& Data, std::string Path)
+static bool plugin_file_exists(const Plugin& Data, std::string Path, std::vector<CheckedFile>& checked_files)
 {
 	FileSpecifier f = Data.directory + Path;
-	return f.Exists();
+	bool exists = f.Exists();
+	checked_files.push_back({f.GetPath(), exists});
+	return exists;
 }
 
 static int utf8_to_int(const std::string& s)
@@ -283,7 +341,8 @@ static int utf8_to_int(const std::string& s)
 	}
 }
 
-bool PluginLoader::ParsePlugin(FileSpecifier& file_name)
+// Runs on worker threads, so problems go in errors instead of the log
+bool PluginLoader::ParsePlugin(FileSpecifier& file_name, std::vector<Plugin>& plugins, std::vector<std::string>& errors, std::vector<CheckedFile>& checked_files)
 {
 	OpenedFile file;
 	if (file_name.Open(file)) 
@@ -315,26 +374,26 @@ bool PluginLoader::ParsePlugin(FileSpecifier& file_name)
 				root.read_attr("minimum_version", Data.required_version);
 				
 				if (root.read_attr("hud_lua", Data.hud_lua) &&
-					!plugin_file_exists(Data, Data.hud_lua))
+					!plugin_file_exists(Data, Data.hud_lua, checked_files))
 					Data.hud_lua = "";
 				
 				if (root.read_attr("solo_lua", Data.solo_lua) &&
-					!plugin_file_exists(Data, Data.solo_lua))
+					!plugin_file_exists(Data, Data.solo_lua, checked_files))
 					Data.solo_lua = "";
 				
 				if (root.read_attr("stats_lua", Data.stats_lua) &&
-					!plugin_file_exists(Data, Data.stats_lua))
+					!plugin_file_exists(Data, Data.stats_lua, checked_files))
 					Data.stats_lua = "";
 				
 				if (root.read_attr("theme_dir", Data.theme) &&
-					!plugin_file_exists(Data, Data.theme + "/theme2.mml"))
+					!plugin_file_exists(Data, Data.theme + "/theme2.mml", checked_files))
 					Data.theme = "";
 				
 				for (const InfoTree &tree : root.children_named("mml"))
 				{
 					std::string mml_path;
 					if (tree.read_attr("file", mml_path) &&
-						plugin_file_exists(Data, mml_path))
+						plugin_file_exists(Data, mml_path, checked_files))
 						Data.mmls.push_back(mml_path);
 				}
 
@@ -343,7 +402,7 @@ bool PluginLoader::ParsePlugin(FileSpecifier& file_name)
 					ShapesPatch patch;
 					tree.read_attr("file", patch.path);
 					tree.read_attr("requires_opengl", patch.requires_opengl);
-					if (plugin_file_exists(Data, patch.path))
+					if (plugin_file_exists(Data, patch.path, checked_files))
 						Data.shapes_patches.push_back(patch);
 				}
 
@@ -407,17 +466,17 @@ bool PluginLoader::ParsePlugin(FileSpecifier& file_name)
 						Data.shapes_patches.clear();
 						Data.map_patches.clear();
 					}
-					Plugins::instance()->add(Data);
+					plugins.push_back(Data);
 				}
 				
 			} catch (const InfoTree::parse_error& e) {
-				logError("There were parsing errors in %s Plugin.xml: %s", name, e.what());
+				errors.push_back(std::string("There were parsing errors in ") + name + " Plugin.xml: " + e.what());
 			} catch (const InfoTree::path_error& e) {
-				logError("There were parsing errors in %s Plugin.xml: %s", name, e.what());
+				errors.push_back(std::string("There were parsing errors in ") + name + " Plugin.xml: " + e.what());
 			} catch (const InfoTree::data_error& e) {
-				logError("There were parsing errors in %s Plugin.xml: %s", name, e.what());
+				errors.push_back(std::string("There were parsing errors in ") + name + " Plugin.xml: " + e.what());
 			} catch (const InfoTree::unexpected_error& e) {
-				logError("There were parsing errors in %s Plugin.xml: %s", name, e.what());
+				errors.push_back(std::string("There were parsing errors in ") + name + " Plugin.xml: " + e.what());
 			}
 		}
 
@@ -436,7 +495,12 @@ bool PluginLoader::ParseDirectory(FileSpecifier& dir)
 		FileSpecifier file = dir + it->name;
 		if (it->name == "Plugin.xml")
 		{
-			ParsePlugin(file);
+			PluginSource source;
+			source.file = file;
+			source.date = file.GetDate();
+			source.size = file.GetSize();
+			source.directory_date = dir.GetDate();
+			sources.push_back(source);
 		}
 		else if (it->is_directory && it->name[0] != '.') 
 		{
@@ -444,20 +508,265 @@ bool PluginLoader::ParseDirectory(FileSpecifier& dir)
 		}
 		else if (algo::ends_with(it->name, ".zip") || algo::ends_with(it->name, ".ZIP"))
 		{
-			// search it for a Plugin.xml file
-			for (const auto& zip_entry : file.ReadZIP())
+			PluginSource source;
+			source.file = file;
+			source.zip = true;
+			source.date = file.GetDate();
+			source.size = file.GetSize();
+			sources.push_back(source);
+		}
+	}
+
+	return true;
+}
+
+void PluginLoader::ParseSource(PluginSource& source)
+{
+	source.parsed = true;
+	source.plugins.clear();
+	source.errors.clear();
+	source.checked_files.clear();
+
+	if (!source.zip)
+	{
+		ParsePlugin(source.file, source.plugins, source.errors, source.checked_files);
+		return;
+	}
+
+	// search it for a Plugin.xml file
+	for (const auto& zip_entry : source.file.ReadZIP())
+	{
+		if (zip_entry == "Plugin.xml" || algo::ends_with(zip_entry, "/Plugin.xml"))
+		{
+			std::string archive = source.file.GetPath();
+			FileSpecifier file_name = FileSpecifier(archive.substr(0, archive.find_last_of('.'))) + zip_entry;
+			ParsePlugin(file_name, source.plugins, source.errors, source.checked_files);
+		}
+	}
+}
+
+static void get_plugin_index_file(FileSpecifier& file)
+{
+	file.SetToLocalDataDir();
+	file += "Plugin Index.xml";
+}
+
+static InfoTree plugin_to_tree(const Plugin& plugin)
+{
+	InfoTree tree;
+	tree.put_attr("directory", plugin.directory.GetPath());
+	tree.put_attr("name", plugin.name);
+	tree.put_attr("description", plugin.description);
+	tree.put_attr("version", plugin.version);
+	tree.put_attr("minimum_version", plugin.required_version);
+	tree.put_attr("hud_lua", plugin.hud_lua);
+	tree.put_attr("solo_lua", plugin.solo_lua);
+	tree.put_attr("stats_lua", plugin.stats_lua);
+	tree.put_attr("theme_dir", plugin.theme);
+
+	for (const auto& mml : plugin.mmls)
+	{
+		InfoTree child;
+		child.put_attr("file", mml);
+		tree.add_child("mml", child);
+	}
+
+	for (const auto& patch : plugin.shapes_patches)
+	{
+		InfoTree child;
+		child.put_attr("file", patch.path);
+		child.put_attr("requires_opengl", patch.requires_opengl);
+		tree.add_child("shapes_patch", child);
+	}
+
+	for (const auto& info : plugin.required_scenarios)
+	{
+		InfoTree child;
+		child.put_attr("name", info.name);
+		child.put_attr("id", info.scenario_id);
+		child.put_attr("version", info.version);
+		tree.add_child("scenario", child);
+	}
+
+	for (const auto& patch : plugin.map_patches)
+	{
+		InfoTree child;
+		for (auto checksum : patch.parent_checksums)
+		{
+			child.add("checksum", checksum);
+		}
+		for (const auto& resource : patch.resource_map)
+		{
+			InfoTree rsrc;
+			rsrc.put_attr("type", resource.first.first);
+			rsrc.put_attr("id", resource.first.second);
+			rsrc.put_attr("data", resource.second);
+			child.add_child("resource", rsrc);
+		}
+		tree.add_child("map_patch", child);
+	}
+
+	return tree;
+}
+
+// the index holds plugins as they were after ParsePlugin() checked them over;
+// they're only used while the files it checked are still there (or not)
+static Plugin plugin_from_tree(const InfoTree& tree)
+{
+	Plugin plugin = Plugin();
+	plugin.enabled = true;
+
+	std::string directory;
+	tree.read_attr("directory", directory);
+	plugin.directory = DirectorySpecifier(directory);
+
+	tree.read_attr("name", plugin.name);
+	tree.read_attr("description", plugin.description);
+	tree.read_attr("version", plugin.version);
+	tree.read_attr("minimum_version", plugin.required_version);
+	tree.read_attr("hud_lua", plugin.hud_lua);
+	tree.read_attr("solo_lua", plugin.solo_lua);
+	tree.read_attr("stats_lua", plugin.stats_lua);
+	tree.read_attr("theme_dir", plugin.theme);
+
+	for (const InfoTree& child : tree.children_named("mml"))
+	{
+		std::string mml;
+		child.read_attr("file", mml);
+		plugin.mmls.push_back(mml);
+	}
+
+	for (const InfoTree& child : tree.children_named("shapes_patch"))
+	{
+		ShapesPatch patch;
+		child.read_attr("file", patch.path);
+		child.read_attr("requires_opengl", patch.requires_opengl);
+		plugin.shapes_patches.push_back(patch);
+	}
+
+	for (const InfoTree& child : tree.children_named("scenario"))
+	{
+		ScenarioInfo info;
+		child.read_attr("name", info.name);
+		child.read_attr("id", info.scenario_id);
+		child.read_attr("version", info.version);
+		plugin.required_scenarios.push_back(info);
+	}
+
+	for (const InfoTree& child : tree.children_named("map_patch"))
+	{
+		MapPatch patch;
+		for (const InfoTree& cs_tree : child.children_named("checksum"))
+		{
+			patch.parent_checksums.insert(cs_tree.get_value(static_cast<uint32_t>(0)));
+		}
+		for (const InfoTree& rsrc_tree : child.children_named("resource"))
+		{
+			uint32_t type = 0;
+			int id = 0;
+			std::string path;
+			rsrc_tree.read_attr("type", type);
+			rsrc_tree.read_attr("id", id);
+			rsrc_tree.read_attr("data", path);
+			patch.resource_map.insert(std::make_pair(std::make_pair(type, id), path));
+		}
+		plugin.map_patches.push_back(patch);
+	}
+
+	return plugin;
+}
+
+void PluginLoader::LoadIndex()
+{
+	FileSpecifier file;
+	get_plugin_index_file(file);
+	if (!file.Exists())
+		return;
+
+	try {
+		InfoTree root = InfoTree::load_xml(file).get_child("plugin_index");
+
+		int version = 0;
+		root.read_attr("version", version);
+		if (version != kPluginIndexVersion)
+			return;
+
+		for (const InfoTree& tree : root.children_named("source"))
+		{
+			std::string path;
+			PluginSource source;
+			tree.read_attr("path", path);
+			tree.read_attr("zip", source.zip);
+			tree.read_attr("date", source.date);
+			tree.read_attr("size", source.size);
+			tree.read_attr("directory_date", source.directory_date);
+
+			for (const InfoTree& child : tree.children_named("plugin"))
 			{
-				if (zip_entry == "Plugin.xml" || algo::ends_with(zip_entry, "/Plugin.xml"))
-				{
-					std::string archive = file.GetPath();
-					FileSpecifier file_name = FileSpecifier(archive.substr(0, archive.find_last_of('.'))) + zip_entry;
-					ParsePlugin(file_name);
-				}
+				source.plugins.push_back(plugin_from_tree(child));
 			}
+
+			for (const InfoTree& child : tree.children_named("checked"))
+			{
+				CheckedFile checked;
+				checked.exists = false;
+				child.read_attr("path", checked.path);
+				child.read_attr("exists", checked.exists);
+				source.checked_files.push_back(checked);
+			}
+
+			index[path] = source;
 		}
+	} catch (const InfoTree::unexpected_error& e) {
+		logWarning("Ignoring plugin index %s: %s", file.GetPath(), e.what());
+		index.clear();
 	}
+}
 
-	return true;
+void PluginLoader::SaveIndex()
+{
+	InfoTree root;
+	root.put_attr("version", kPluginIndexVersion);
+
+	for (const auto& source : sources)
+	{
+		// parse it again next time, so the errors get logged again
+		if (source.errors.size())
+			continue;
+
+		InfoTree tree;
+		tree.put_attr("path", source.file.GetPath());
+		tree.put_attr("zip", source.zip);
+		tree.put_attr("date", source.date);
+		tree.put_attr("size", source.size);
+		tree.put_attr("directory_date", source.directory_date);
+
+		for (const auto& plugin : source.plugins)
+		{
+			tree.add_child("plugin", plugin_to_tree(plugin));
+		}
+
+		for (const auto& checked : source.checked_files)
+		{
+			InfoTree child;
+			child.put_attr("path", checked.path);
+			child.put_attr("exists", checked.exists);
+			tree.add_child("checked", child);
+		}
+
+		root.add_child("source", tree);
+	}
+
+	FileSpecifier file;
+	get_plugin_index_file(file);
+
+	InfoTree fileroot;
+	fileroot.put_child("plugin_index", root);
+	try {
+		fileroot.save_xml(file);
+	} catch (const InfoTree::unexpected_error& e) {
+		logWarning("Could not save plugin index %s: %s", file.GetPath(), e.what());
+	}
 }
 
 extern std::vector<DirectorySpecifier> data_search_path;
@@ -466,11 +775,65 @@ void Plugins::enumerate() {
 
 	logContext("parsing plugins");
 	PluginLoader loader;
+
+	// zips may have come or gone since last time
+	ZipArchivePool::instance()->Clear();
 	
 	for (std::vector<DirectorySpecifier>::const_iterator it = data_search_path.begin(); it != data_search_path.end(); ++it) {
 		DirectorySpecifier path = *it + "Plugins";
 		loader.ParseDirectory(path);
 	}
+
+	// anything the index has, unchanged, doesn't need parsing again; whatever
+	// is new or changed gets parsed in parallel
+	loader.LoadIndex();
+
+	std::vector<PluginSource*> changed;
+	for (auto& source : loader.sources)
+	{
+		auto it = loader.index.find(source.file.GetPath());
+		if (source.date && source.size >= 0 && it != loader.index.end() && it->second.unchanged(source))
+		{
+			source.plugins = it->second.plugins;
+			source.checked_files = it->second.checked_files;
+		}
+		else
+		{
+			changed.push_back(&source);
+		}
+	}
+
+	// the Mac Roman table map patches use is built on first use; build it
+	// here, rather than racing to on the workers
+	utf8_to_mac_roman(" ");
+
+	WorkerPool::instance()->ParallelFor(0, static_cast<int>(changed.size()), [&](int first, int last) {
+		for (int i = first; i < last; ++i)
+		{
+			loader.ParseSource(*changed[i]);
+		}
+	});
+
+	for (const auto& source : loader.sources)
+	{
+		for (const auto& error : source.errors)
+		{
+			logError("%s", error.c_str());
+		}
+
+		for (const auto& plugin : source.plugins)
+		{
+			add(plugin);
+		}
+	}
+
+	if (changed.size() || loader.index.size() != loader.sources.size())
+	{
+		loader.SaveIndex();
+	}
+
+	logNote("%d plugin sources, %d reparsed", static_cast<int>(loader.sources.size()), static_cast<int>(changed.size()));
+
 	std::sort(m_plugins.begin(), m_plugins.end());
 	clear_game_error();
 	m_validated = false;
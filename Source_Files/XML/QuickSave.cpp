@@ -55,6 +55,7 @@
 #include "SDL_rwops_ostream.h"
 #include "WadImageCache.h"
 #include "InfoTree.h"
+#include "MemoryBudget.h"
 
 namespace algo = boost::algorithm;
 
@@ -91,26 +92,57 @@ private:
     QuickSaveImageCache() {};
     static const int k_max_items = 100;
     
+    void pop_lru();
+    size_t trim(size_t bytes);
+    
     std::list<cache_pair_t> m_used;
     std::map<std::string, cache_iter_t> m_images;
+    size_t m_bytes = 0;
+    int m_budget_id = NONE;
 };
 
 QuickSaveImageCache* QuickSaveImageCache::instance() {
     static QuickSaveImageCache* m_instance = nullptr;
     if (!m_instance) {
         m_instance = new QuickSaveImageCache;
+        m_instance->m_budget_id = MemoryBudget::instance()->Register("quick save previews", MemoryBudget::kPriorityLow, [] { return m_instance->m_bytes; }, [](size_t bytes) { return m_instance->trim(bytes); });
     }
     
     return m_instance;
 }
 
+static size_t surface_bytes(SDL_Surface* s) {
+    return static_cast<size_t>(s->h) * s->pitch;
+}
+
+void QuickSaveImageCache::pop_lru() {
+    cache_iter_t lru = m_used.end();
+    --lru;
+    m_images.erase(lru->first);
+    m_bytes -= surface_bytes(lru->second);
+    SDL_FreeSurface(lru->second);
+    m_used.pop_back();
+    MemoryBudget::instance()->Evicted(m_budget_id);
+}
+
+size_t QuickSaveImageCache::trim(size_t bytes) {
+    size_t freed = 0;
+    while (freed < bytes && !m_used.empty()) {
+        freed += surface_bytes(m_used.back().second);
+        pop_lru();
+    }
+    return freed;
+}
+
 SDL_Surface* QuickSaveImageCache::get(std::string image_name) {
     std::map<std::string, cache_iter_t>::iterator it = m_images.find(image_name);
     if (it != m_images.end()) {
         // found it: move to front of list
         m_used.splice(m_used.begin(), m_used, it->second);
+        MemoryBudget::instance()->Hit(m_budget_id);
         return it->second->second;
     }
+    MemoryBudget::instance()->Miss(m_budget_id);
     
     // didn't find: load image
     FileSpecifier f;
@@ -127,14 +159,11 @@ SDL_Surface* QuickSaveImageCache::get(std::string image_name) {
 	if (img) {
         m_used.push_front(cache_pair_t(image_name, img));
         m_images[image_name] = m_used.begin();
+        m_bytes += surface_bytes(img);
         
         // enforce maximum cache size
         if (m_used.size() > k_max_items) {
-            cache_iter_t lru = m_used.end();
-            --lru;
-            m_images.erase(lru->first);
-            SDL_FreeSurface(lru->second);
-            m_used.pop_back();
+            pop_lru();
         }
     }
     return img;
@@ -146,6 +175,7 @@ void QuickSaveImageCache::clear() {
         SDL_FreeSurface(it->second);
     }
     m_used.clear();
+    m_bytes = 0;
 }
 
 
@@ -115,6 +115,8 @@
 #include "Movie.h"
 #include "HTTP.h"
 #include "WadImageCache.h"
+#include "MemoryBudget.h"
+#include "ZipArchivePool.h"
 
 #ifdef __WIN32__
 #define WIN32_LEAN_AND_MEAN
@@ -480,6 +482,7 @@ static void initialize_application(void)
 				data_search_path.erase(data_search_path.begin() + dsp_delete_pos);
 			// add selected directory where command-line argument would go
 			data_search_path.insert(data_search_path.begin() + dsp_insert_pos, chosen_dir);
+			ZipArchivePool::instance()->SearchPathChanged();
 			
 			default_data_dir = chosen_dir;
 			
@@ -516,6 +519,8 @@ static void initialize_application(void)
 	screenshots_dir.CreateDirectory();
 	
 	WadImageCache::instance()->initialize_cache();
+	ZipArchivePool::instance()->Initialize();
+	MemoryBudget::instance()->SetBudget(static_cast<size_t>(environment_preferences->asset_memory_budget) * MEG);
 
 #ifndef HAVE_OPENGL
 	graphics_preferences->screen_mode.acceleration = _no_acceleration;
@@ -67,6 +67,7 @@ struct screen_mode_data
 	bool high_resolution;
 	bool fullscreen;
 	bool draw_every_other_line;
+	short low_resolution_scale; // screen pixels per world pixel, across and down, when not high_resolution
 	
 	short bit_depth;  // currently 8 or 16
 	short gamma_level;
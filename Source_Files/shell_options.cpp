@@ -115,7 +115,8 @@ static const std::vector<ShellOptionsFlag> shell_options_flags {
 	{"j", "nojoystick", "Do not initialize joysticks", shell_options.nojoystick},
 	{"i", "insecure_lua", "", shell_options.insecure_lua},
 	{"Q", "skip-intro", "Skip intro screens", shell_options.skip_intro},
-	{"e", "editor", "Use editor prefs; jump directly to map", shell_options.editor}
+	{"e", "editor", "Use editor prefs; jump directly to map", shell_options.editor},
+	{"r", "fast-replay", "Replay films as fast as possible; quit when one ends", shell_options.fast_replay}
 };
 
 static const std::vector<ShellOptionsString> shell_options_strings {
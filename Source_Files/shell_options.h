@@ -21,6 +21,7 @@ struct ShellOptions {
 
 	bool skip_intro;
 	bool editor;
+	bool fast_replay;
 
 	std::string directory;
 	std::vector<std::string> files;